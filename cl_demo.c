@@ -47,6 +47,9 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #ifndef CLIENTONLY
 #include "server.h"
 #endif
+#ifdef WITH_ZLIB
+#include <zlib.h>
+#endif
 
 // TODO: Create states for demo_recording, demo_playback, and so on and put all related vars into these. Right now with global vars for everything is a mess. Also renaming some of the time vars to be less confusing is probably good. demotime, olddemotime, nextdemotime, prevtime...
 typedef struct demo_state_s
@@ -1885,6 +1888,512 @@ static qbool CL_DemoShouldWeReadNextMessage(float demotime)
 	return true;
 }
 
+//=============================================================================
+//								DEMO KEYFRAMES
+//=============================================================================
+
+//
+// Every demo_keyframe_interval seconds of demo we keep a copy of what the parser
+// needs to carry on from that point in the file: cl, the player entities, the
+// lightstyles and the demo and netchan vars. Seeking back then starts from the
+// last keyframe before the destination instead of the start of the demo, and
+// seeking forward skips to it when that's further than the next keyframe.
+// Either way only what's between the keyframe and the destination is parsed.
+//
+// Keyframes are taken as the demo is read, seeking included, so the first pass
+// through a demo builds the index. "demo_keyframes scan" runs through the rest
+// of the demo to build all of it and comes back. With demo_keyframe_save 1 the
+// index goes to <demo>.kfi when playback stops and is used the next time the
+// same demo is played.
+//
+// Only the same map can be restored, and what lives outside cl, like the
+// mvd_utils stats and the teamplay state, isn't.
+//
+
+cvar_t demo_keyframe_interval = {"demo_keyframe_interval", "10"};
+cvar_t demo_keyframe_save = {"demo_keyframe_save", "0"};
+
+#define DEMO_KEYFRAME_ID		(('I'<<24)+('F'<<16)+('K'<<8)+'D')	// "DKFI"
+#define DEMO_KEYFRAME_VERSION	1
+#define DEMO_KEYFRAME_CRCSIZE	0x10000		// Of the demo, for telling it's the same one.
+
+typedef struct demo_keystate_s
+{
+	clientState_t	cl;
+	centity_t		entities[MAX_CLIENTS + 1];		// The world and the players.
+	lightstyle_t	lightstyles[MAX_LIGHTSTYLES];
+} demo_keystate_t;
+
+typedef struct demo_keyframe_header_s
+{
+	int				id;
+	int				version;
+	int				statesize;		// Both change with the client.
+	int				keyframesize;
+	int				compressed;
+	unsigned long	demosize;
+	unsigned short	democrc;
+	float			interval;
+	int				numkeyframes;
+} demo_keyframe_header_t;
+
+static demo_keyframe_t	**demo_keyframes;			// A slot for every interval, NULL where we have none.
+static int				demo_numkeyframeslots;
+static float			demo_keyframeinterval;		// Of the keyframes we have.
+static int				demo_numkeyframes;
+static int				demo_keyframebytes;
+static qbool			demo_keyframesadded;		// Since the index was loaded.
+
+static char				demo_keyframefile[MAX_OSPATH * 2];	// Empty if the demo can't have an index.
+static unsigned long	demo_keyframedemosize;
+static unsigned short	demo_keyframedemocrc;
+
+static qbool			demo_keyframescan;
+static double			demo_keyframescanreturn;
+
+static demo_keystate_t	*demo_keystate;				// Unpacked.
+static byte				*demo_keypacked;
+static int				demo_keypackedsize;
+
+//
+// Allocates the buffers for packing keyframes.
+//
+static void CL_Demo_KeyframeBuffers(void)
+{
+	if (demo_keystate)
+		return;
+
+	demo_keystate = (demo_keystate_t *) Q_malloc(sizeof(*demo_keystate));
+
+	#ifdef WITH_ZLIB
+	demo_keypackedsize = compressBound(sizeof(*demo_keystate));
+	demo_keypacked = (byte *) Q_malloc(demo_keypackedsize);
+	#else
+	demo_keypackedsize = sizeof(*demo_keystate);
+	#endif // WITH_ZLIB
+}
+
+static void CL_Demo_ClearKeyframes(void)
+{
+	int i;
+
+	for (i = 0; i < demo_numkeyframeslots; i++)
+	{
+		if (demo_keyframes[i])
+		{
+			Q_free(demo_keyframes[i]->state);
+			Q_free(demo_keyframes[i]);
+		}
+	}
+
+	Q_free(demo_keyframes);
+	demo_numkeyframeslots = 0;
+	demo_numkeyframes = 0;
+	demo_keyframebytes = 0;
+	demo_keyframesadded = false;
+	demo_keyframescan = false;
+}
+
+//
+// Where we are in the demo, for MVDs nextdemotime can be ahead of the last message read.
+//
+static double CL_Demo_KeyframeTime(void)
+{
+	return max(prevtime, nextdemotime);
+}
+
+static int CL_Demo_KeyframeSlot(double time)
+{
+	return (int) ((time - demostarttime) / demo_keyframeinterval);
+}
+
+static void CL_Demo_AddKeyframeSlots(int slot)
+{
+	int newslots;
+
+	if (slot < demo_numkeyframeslots)
+		return;
+
+	newslots = slot + 64;
+	demo_keyframes = (demo_keyframe_t **) Q_realloc(demo_keyframes, newslots * sizeof(*demo_keyframes));
+	memset(demo_keyframes + demo_numkeyframeslots, 0, (newslots - demo_numkeyframeslots) * sizeof(*demo_keyframes));
+	demo_numkeyframeslots = newslots;
+}
+
+static void CL_Demo_SetKeyframe(int slot, demo_keyframe_t *kf)
+{
+	CL_Demo_AddKeyframeSlots(slot);
+	demo_keyframes[slot] = kf;
+	demo_numkeyframes++;
+	demo_keyframebytes += kf->size;
+}
+
+//
+// Copies the current state into kf->state.
+//
+static qbool CL_Demo_PackKeyframe(demo_keyframe_t *kf)
+{
+	demo_keystate_t *s = demo_keystate;
+	byte *data = (byte *) s;
+	int size = sizeof(*s);
+	int i, num;
+
+	memcpy(&s->cl, &cl, sizeof(cl));
+	memcpy(s->entities, cl_entities, sizeof(s->entities));
+	memcpy(s->lightstyles, cl_lightstyle, sizeof(s->lightstyles));
+
+	// Whatever is left in the unused entity slots would only make it bigger.
+	for (i = 0; i < UPDATE_BACKUP; i++)
+	{
+		packet_entities_t *pack = &s->cl.frames[i].packet_entities;
+
+		num = bound(0, pack->num_entities, MAX_MVD_PACKET_ENTITIES);
+		memset(pack->entities + num, 0, (MAX_MVD_PACKET_ENTITIES - num) * sizeof(pack->entities[0]));
+	}
+
+	#ifdef WITH_ZLIB
+	{
+		uLongf packedsize = demo_keypackedsize;
+
+		if (compress2(demo_keypacked, &packedsize, data, size, Z_BEST_SPEED) != Z_OK)
+			return false;
+
+		data = demo_keypacked;
+		size = packedsize;
+	}
+	#endif // WITH_ZLIB
+
+	kf->state = (byte *) Q_malloc(size);
+	memcpy(kf->state, data, size);
+	kf->size = size;
+
+	return true;
+}
+
+static qbool CL_Demo_UnpackKeyframe(demo_keyframe_t *kf)
+{
+	#ifdef WITH_ZLIB
+	uLongf size = sizeof(*demo_keystate);
+
+	return (uncompress((Bytef *) demo_keystate, &size, kf->state, kf->size) == Z_OK && size == sizeof(*demo_keystate));
+	#else
+	if (kf->size != sizeof(*demo_keystate))
+		return false;
+
+	memcpy(demo_keystate, kf->state, kf->size);
+	return true;
+	#endif // WITH_ZLIB
+}
+
+//
+// Takes a keyframe if we have none for this part of the demo yet.
+// Called between two demo messages, when the last one has been parsed.
+//
+static void CL_Demo_CheckKeyframe(void)
+{
+	demo_keyframe_t *kf;
+	double time;
+	int slot;
+
+	if (demo_keyframe_interval.value <= 0 || cls.timedemo || cls.state != ca_active || !cl.validsequence
+		|| cls.mvdplayback == QTV_PLAYBACK || cls.nqdemoplayback || cls.demorewinding || demostarttime < 0)
+	{
+		return;
+	}
+
+	if (!demo_numkeyframes)
+		demo_keyframeinterval = max(1, demo_keyframe_interval.value);
+
+	time = CL_Demo_KeyframeTime();
+	slot = CL_Demo_KeyframeSlot(time);
+
+	if (slot < 0 || (slot < demo_numkeyframeslots && demo_keyframes[slot]))
+		return;
+
+	CL_Demo_KeyframeBuffers();
+
+	kf = (demo_keyframe_t *) Q_malloc(sizeof(*kf));
+	if (!CL_Demo_PackKeyframe(kf))
+	{
+		Q_free(kf);
+		return;
+	}
+
+	// Whatever is still in the playback buffer hasn't been read yet.
+	kf->filepos					= VFS_TELL(playbackfile) - pb_cnt;
+	kf->timestamp				= time;
+	kf->prevtime				= prevtime;
+	kf->olddemotime				= olddemotime;
+	kf->nextdemotime			= nextdemotime;
+	kf->servercount				= cl.servercount;
+	kf->incoming_sequence		= cls.netchan.incoming_sequence;
+	kf->incoming_acknowledged	= cls.netchan.incoming_acknowledged;
+	kf->outgoing_sequence		= cls.netchan.outgoing_sequence;
+	kf->lastto					= cls.lastto;
+	kf->lasttype				= cls.lasttype;
+
+	CL_Demo_SetKeyframe(slot, kf);
+	demo_keyframesadded = true;
+}
+
+//
+// Returns the last keyframe at or before the given time on this map.
+//
+static demo_keyframe_t *CL_Demo_FindKeyframe(double time)
+{
+	demo_keyframe_t *kf;
+	int slot;
+
+	if (!demo_numkeyframes || demostarttime < 0)
+		return NULL;
+
+	for (slot = min(CL_Demo_KeyframeSlot(time), demo_numkeyframeslots - 1); slot >= 0; slot--)
+	{
+		if (!(kf = demo_keyframes[slot]) || kf->timestamp > time)
+			continue;
+
+		// Anything before it is from an earlier map as well.
+		if (kf->servercount != cl.servercount)
+			return NULL;
+
+		return kf;
+	}
+
+	return NULL;
+}
+
+//
+// Puts the parser back to where it was when the keyframe was taken.
+//
+static qbool CL_Demo_RestoreKeyframe(demo_keyframe_t *kf)
+{
+	extern void CL_ProcessUserInfo (int slot, player_info_t *player, char *key);
+	extern int parsecountmod, oldparsecountmod;
+	demo_keystate_t *s;
+	qbool newuserinfo[MAX_CLIENTS];
+	size_t keep_start, keep_end;
+	int i;
+
+	CL_Demo_KeyframeBuffers();
+	s = demo_keystate;
+
+	if (!CL_Demo_UnpackKeyframe(kf) || VFS_SEEK(playbackfile, kf->filepos, SEEK_SET))
+		return false;
+
+	CL_Demo_PB_Init(NULL, 0);
+
+	// Precaches, static entities and who we're looking at don't change on the
+	// same map, from model_name to cdtrack cl is kept as it is.
+	keep_start = offsetof(clientState_t, model_name);
+	keep_end = offsetof(clientState_t, viewent);
+	memcpy((byte *) &s->cl + keep_start, (byte *) &cl + keep_start, keep_end - keep_start);
+	s->cl.paused = cl.paused;
+
+	// Skins only have to be looked up again for the players who changed.
+	for (i = 0; i < MAX_CLIENTS; i++)
+	{
+		newuserinfo[i] = (strcmp(s->cl.players[i].userinfo, cl.players[i].userinfo) != 0);
+
+		if (!newuserinfo[i])
+		{
+			s->cl.players[i].skin = cl.players[i].skin;
+			memcpy(s->cl.players[i].translations, cl.players[i].translations, sizeof(cl.players[i].translations));
+		}
+	}
+
+	memcpy(&cl, &s->cl, sizeof(cl));
+	memcpy(cl_entities, s->entities, sizeof(s->entities));
+	memcpy(cl_lightstyle, s->lightstyles, sizeof(cl_lightstyle));
+
+	// The other entities start lerping over.
+	for (i = MAX_CLIENTS + 1; i < CL_MAX_EDICTS; i++)
+		cl_entities[i].sequence = 0;
+
+	parsecountmod = cl.parsecount & UPDATE_MASK;
+	oldparsecountmod = cl.oldparsecount & UPDATE_MASK;
+
+	prevtime							= kf->prevtime;
+	olddemotime							= kf->olddemotime;
+	nextdemotime						= kf->nextdemotime;
+	cls.netchan.incoming_sequence		= kf->incoming_sequence;
+	cls.netchan.incoming_acknowledged	= kf->incoming_acknowledged;
+	cls.netchan.outgoing_sequence		= kf->outgoing_sequence;
+	cls.lastto							= kf->lastto;
+	cls.lasttype						= kf->lasttype;
+
+	for (i = 0; i < MAX_CLIENTS; i++)
+	{
+		if (newuserinfo[i])
+			CL_ProcessUserInfo(i, &cl.players[i], NULL);
+	}
+
+	CL_ClearTEnts();
+	CL_ClearPredict();
+	memset(cl_dlights, 0, sizeof(cl_dlights));
+	R_InitParticles();
+
+	return true;
+}
+
+//
+// Continues a seek to the given time from the closest keyframe before it,
+// unless that's behind us or we'd get there just as quickly by reading on.
+//
+static qbool CL_Demo_SeekKeyframe(double time)
+{
+	demo_keyframe_t *kf = CL_Demo_FindKeyframe(time);
+	double now = CL_Demo_KeyframeTime();
+
+	if (!kf)
+		return false;
+
+	if (time >= now && kf->timestamp < now + demo_keyframeinterval)
+		return false;
+
+	return CL_Demo_RestoreKeyframe(kf);
+}
+
+//
+// Writes the keyframes to <demo>.kfi.
+//
+static void CL_Demo_SaveKeyframes(void)
+{
+	demo_keyframe_header_t header;
+	FILE *f;
+	int i;
+
+	if (!demo_keyframefile[0])
+	{
+		Com_Printf("Can't save keyframes for this demo\n");
+		return;
+	}
+
+	FS_CreatePath(demo_keyframefile);
+	if (!(f = fopen(demo_keyframefile, "wb")))
+	{
+		Com_Printf("Couldn't write %s\n", demo_keyframefile);
+		return;
+	}
+
+	memset(&header, 0, sizeof(header));
+	header.id			= DEMO_KEYFRAME_ID;
+	header.version		= DEMO_KEYFRAME_VERSION;
+	header.statesize	= sizeof(demo_keystate_t);
+	header.keyframesize	= sizeof(demo_keyframe_t);
+	#ifdef WITH_ZLIB
+	header.compressed	= 1;
+	#endif // WITH_ZLIB
+	header.demosize		= demo_keyframedemosize;
+	header.democrc		= demo_keyframedemocrc;
+	header.interval		= demo_keyframeinterval;
+	header.numkeyframes	= demo_numkeyframes;
+	fwrite(&header, sizeof(header), 1, f);
+
+	for (i = 0; i < demo_numkeyframeslots; i++)
+	{
+		if (!demo_keyframes[i])
+			continue;
+
+		fwrite(&i, sizeof(i), 1, f);
+		fwrite(demo_keyframes[i], sizeof(demo_keyframe_t), 1, f);
+		fwrite(demo_keyframes[i]->state, demo_keyframes[i]->size, 1, f);
+	}
+
+	fclose(f);
+	demo_keyframesadded = false;
+
+	Com_DPrintf("Wrote %i keyframes to %s\n", demo_numkeyframes, demo_keyframefile);
+}
+
+//
+// Loads <demo>.kfi if it was saved for this very demo.
+//
+static void CL_Demo_LoadKeyframes(void)
+{
+	demo_keyframe_header_t header;
+	demo_keyframe_t *kf;
+	FILE *f;
+	int i, slot;
+
+	CL_Demo_ClearKeyframes();
+
+	if (!demo_keyframefile[0] || !(f = fopen(demo_keyframefile, "rb")))
+		return;
+
+	CL_Demo_KeyframeBuffers();
+
+	if (fread(&header, sizeof(header), 1, f) != 1
+		|| header.id != DEMO_KEYFRAME_ID
+		|| header.version != DEMO_KEYFRAME_VERSION
+		|| header.statesize != sizeof(demo_keystate_t)
+		|| header.keyframesize != sizeof(demo_keyframe_t)
+		#ifdef WITH_ZLIB
+		|| !header.compressed
+		#else
+		|| header.compressed
+		#endif // WITH_ZLIB
+		|| header.demosize != demo_keyframedemosize
+		|| header.democrc != demo_keyframedemocrc
+		|| header.interval < 1)
+	{
+		Com_DPrintf("%s doesn't belong to this demo\n", demo_keyframefile);
+		fclose(f);
+		return;
+	}
+
+	demo_keyframeinterval = header.interval;
+
+	for (i = 0; i < header.numkeyframes; i++)
+	{
+		kf = (demo_keyframe_t *) Q_malloc(sizeof(*kf));
+
+		if (fread(&slot, sizeof(slot), 1, f) != 1 || fread(kf, sizeof(*kf), 1, f) != 1
+			|| slot < 0 || slot >= 0x10000 || (slot < demo_numkeyframeslots && demo_keyframes[slot])
+			|| kf->size <= 0 || kf->size > demo_keypackedsize || kf->filepos > demo_keyframedemosize)
+		{
+			Q_free(kf);
+			break;
+		}
+
+		kf->state = (byte *) Q_malloc(kf->size);
+		if (fread(kf->state, kf->size, 1, f) != 1)
+		{
+			Q_free(kf->state);
+			Q_free(kf);
+			break;
+		}
+
+		CL_Demo_SetKeyframe(slot, kf);
+	}
+
+	fclose(f);
+
+	Com_DPrintf("Loaded %i keyframes from %s\n", demo_numkeyframes, demo_keyframefile);
+}
+
+//
+// Opens the demo for CL_Play_f and remembers where its keyframe index goes.
+//
+static vfsfile_t *CL_Demo_OpenPlaybackFile(char *path, relativeto_t relativeto)
+{
+	vfsfile_t *file = FS_OpenVFS(path, "rb", relativeto);
+	int len;
+
+	if (file)
+	{
+		// Demos in the quake file system, paks included, get it in the gamedir.
+		if (relativeto == FS_ANY)
+			len = snprintf(demo_keyframefile, sizeof(demo_keyframefile), "%s/%s.kfi", com_gamedir, path);
+		else
+			len = snprintf(demo_keyframefile, sizeof(demo_keyframefile), "%s.kfi", path);
+
+		if (len < 0 || len >= (int) sizeof(demo_keyframefile))
+			demo_keyframefile[0] = 0;
+	}
+
+	return file;
+}
+
 //
 // When a demo is playing back, all NET_SendMessages are skipped, and NET_GetMessages are read from the demo file.
 // Whenever cl.time gets past the last received message, another message is read from the demo file.
@@ -1952,6 +2461,10 @@ qbool CL_GetDemoMessage (void)
 	// DEMO REWIND.
 	if (!cls.mvdplayback || cls.mvdplayback != QTV_PLAYBACK) 
 	{
+		// Start from a keyframe if we have one on the way, back or forward.
+		if (cls.demoseeking == DST_SEEKING_NORMAL && !cls.demorewinding)
+			CL_Demo_SeekKeyframe(cls.demotime);
+
 		// If we're seeking and our seek destination is in the past we need to rewind.
 		if (cls.demoseeking && !cls.demorewinding && (cls.demotime < nextdemotime))
 		{
@@ -2009,6 +2522,8 @@ qbool CL_GetDemoMessage (void)
 		if (!pb_ensure())
 			return false;
 
+		CL_Demo_CheckKeyframe();
+
 		// Read the time of the next message in the demo.
 		demotime = CL_PeekDemoTime();
 
@@ -2048,6 +2563,14 @@ qbool CL_GetDemoMessage (void)
 
 				R_InitParticles();
 			}
+
+			// A keyframe scan is done, go back to where it started.
+			if (demo_keyframescan)
+			{
+				Com_Printf("Demo keyframes: %i (%.1f MB)\n", demo_numkeyframes, demo_keyframebytes / (1024.0 * 1024.0));
+				CL_Demo_Jump(demo_keyframescanreturn, 0, DST_SEEKING_NORMAL);
+				return false;
+			}
 		}
 
 		playback_recordtime = demotime;
@@ -3224,6 +3747,11 @@ void CL_StopPlayback (void)
 	if (Movie_IsCapturing())
 		Movie_Stop();
 
+	// Keep the keyframes for the next time the demo is played.
+	if (demo_keyframe_save.integer && demo_keyframesadded && demo_keyframefile[0])
+		CL_Demo_SaveKeyframes();
+	CL_Demo_ClearKeyframes();
+
 	// Close the playback file.
 	if (playbackfile)
 		VFS_CLOSE(playbackfile);
@@ -3594,6 +4122,8 @@ void CL_Play_f (void)
 	Host_EndGame();
 
 	TP_ExecTrigger("f_demostart");
+
+	demo_keyframefile[0] = 0;
 	
 	// VFS-FIXME: This will affect playing qwz inside a zip
 	#ifndef WITH_VFS_ARCHIVE_LOADING 
@@ -3643,24 +4173,24 @@ void CL_Play_f (void)
 		// Look for the file in the above directory if it has ../ prepended to the filename.
 		if (!strncmp(name, "../", 3) || !strncmp(name, "..\\", 3))
 		{
-			playbackfile = FS_OpenVFS(va("%s/%s", com_basedir, name + 3), "rb", FS_NONE_OS);
+			playbackfile = CL_Demo_OpenPlaybackFile(va("%s/%s", com_basedir, name + 3), FS_NONE_OS);
 		}
 		else
 		{
 			// Search demo on quake file system, even in paks.
-			playbackfile = FS_OpenVFS(name, "rb", FS_ANY);
+			playbackfile = CL_Demo_OpenPlaybackFile(name, FS_ANY);
 		}
 
 		// Look in the demo dir (user specified).
 		if (!playbackfile)
 		{
-			playbackfile = FS_OpenVFS(va("%s/%s", CL_DemoDirectory(), name), "rb", FS_NONE_OS);
+			playbackfile = CL_Demo_OpenPlaybackFile(va("%s/%s", CL_DemoDirectory(), name), FS_NONE_OS);
 		}
 
 		// Check the full system path (Run a demo anywhere on the file system).
 		if (!playbackfile)
 		{
-			playbackfile = FS_OpenVFS(name, "rb", FS_NONE_OS);
+			playbackfile = CL_Demo_OpenPlaybackFile(name, FS_NONE_OS);
 		}
 	}
 
@@ -3718,6 +4248,11 @@ void CL_Play_f (void)
 		buf = Q_malloc(len);
 
 		VFS_READ(playbackfile, buf, len, NULL);
+
+		// A saved keyframe index has to be for the same demo.
+		demo_keyframedemosize = len;
+		demo_keyframedemocrc = CRC_Block((byte *) buf, min(len, DEMO_KEYFRAME_CRCSIZE));
+
 		if (!(mmap_file = FSMMAP_OpenVFS(buf, len))) 
 		{
 			// Couldn't create the memory file, just remove the buffer
@@ -3752,6 +4287,7 @@ void CL_Play_f (void)
 	cls.demo_rewindtime = 0;
 
 	CL_DemoPlaybackInit();
+	CL_Demo_LoadKeyframes();
 
 	Com_Printf("Playing demo from %s\n", COM_SkipPath(name));
 }
@@ -4882,6 +5418,53 @@ static void CL_Demo_Jump_Status_f (void)
 }
 
 
+//
+// Shows, builds, saves or drops the keyframes of the demo being played.
+//
+static void CL_Demo_Keyframes_f (void)
+{
+	char *cmd = Cmd_Argv(1);
+
+	if (!cls.demoplayback || cls.mvdplayback == QTV_PLAYBACK || cls.nqdemoplayback)
+	{
+		Com_Printf("Error: not playing a QWD or MVD demo\n");
+		return;
+	}
+
+	if (!strcmp(cmd, "scan"))
+	{
+		if (cls.state < ca_active || demo_keyframe_interval.value <= 0)
+		{
+			Com_Printf("Error: demo must be active and demo_keyframe_interval set\n");
+			return;
+		}
+
+		// Seek to the end, taking keyframes on the way, and then back here.
+		demo_keyframescanreturn = cls.demotime - demostarttime;
+		CL_Demo_Jump(max(0, demo_time_length - 1), 0, DST_SEEKING_NORMAL);
+		demo_keyframescan = true;
+	}
+	else if (!strcmp(cmd, "save"))
+	{
+		CL_Demo_SaveKeyframes();
+	}
+	else if (!strcmp(cmd, "clear"))
+	{
+		CL_Demo_ClearKeyframes();
+	}
+	else if (Cmd_Argc() == 1)
+	{
+		Com_Printf("%i keyframes, one every %g seconds, %.1f MB\n", demo_numkeyframes,
+			demo_numkeyframes ? demo_keyframeinterval : demo_keyframe_interval.value, demo_keyframebytes / (1024.0 * 1024.0));
+		if (demo_keyframefile[0])
+			Com_Printf("index file: %s%s\n", demo_keyframefile, demo_keyframesadded ? " (not saved)" : "");
+	}
+	else
+	{
+		Com_Printf("Usage: %s [scan | save | clear]\n", Cmd_Argv(0));
+	}
+}
+
 //
 // Jumps to a specified time in a demo. Time specified in seconds.
 //
@@ -4900,6 +5483,7 @@ void CL_Demo_Jump(double seconds, int relative, demoseekingtype_t seeking)
 	cls.demotime = newdemotime;
 
 	cls.demoseeking = seeking;
+	demo_keyframescan = false;
 }
 
 double Demo_GetSpeed(void)
@@ -4979,6 +5563,7 @@ void CL_Demo_Init(void)
 	Cmd_AddCommand("demo_jump", CL_Demo_Jump_f);
 	Cmd_AddCommand("demo_jump_mark", CL_Demo_Jump_Mark_f);
 	Cmd_AddCommand("demo_jump_status", CL_Demo_Jump_Status_f);
+	Cmd_AddCommand("demo_keyframes", CL_Demo_Keyframes_f);
 	Cmd_AddCommand("demo_controls", DemoControls_f);
 
 	//
@@ -5002,6 +5587,8 @@ void CL_Demo_Init(void)
 	Cvar_Register(&demo_dir);
 	Cvar_Register(&demo_benchmarkdumps);
 	Cvar_Register(&cl_startupdemo);
+	Cvar_Register(&demo_keyframe_interval);
+	Cvar_Register(&demo_keyframe_save);
 
 	Cvar_ResetCurrentGroup();
 }
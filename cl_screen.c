@@ -2295,6 +2295,15 @@ void Parse_WeaponStats(char *s)
 	ws_clients[ client ].wpn[wp].hits    = atoi( Cmd_Argv( arg++ ) );
 }
 
+// the //wps numbers of a player for mvd_dumpstats, weapon counts from 0 for the axe
+void SCR_GetWeaponStats(int client, int weapon, int *attacks, int *hits)
+{
+	wpType_t *wpn = &ws_clients[client].wpn[wpAXE + weapon];
+
+	*attacks = wpn->attacks;
+	*hits = wpn->hits;
+}
+
 static int SCR_Draw_WeaponStatsPlayer(ws_player_t *ws_cl, int x, int y, qbool width_only)
 {
 	char *s, tmp[1024], tmp2[MAX_MACRO_STRING], *start, *end;
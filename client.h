@@ -171,8 +171,20 @@ typedef struct demo_keyframe_s
 {
 	unsigned long			filepos;	// The position in the demo file where the keyframe can be found.
 	double					timestamp;	// The time stamp in question.
-	struct demo_keyframe_s	*prev;
-	// TODO : Add any state information needed to reproduce this frame.
+
+	// Everything else needed to carry on parsing from filepos.
+	float					prevtime;
+	float					olddemotime;
+	float					nextdemotime;
+	int						servercount;	// Only usable on the same map.
+	int						incoming_sequence;
+	int						incoming_acknowledged;
+	int						outgoing_sequence;
+	int						lastto;
+	int						lasttype;
+
+	int						size;		// Of state, which is compressed if we have zlib.
+	byte					*state;		// cl, the player entities and the lightstyles.
 } demo_keyframe_t;
 
 typedef struct 
@@ -220,7 +232,6 @@ typedef struct
 // clientState_t should hold all pieces of the client state
 
 #define	MAX_DLIGHTS			64
-#define	MAX_STYLESTRING		64
 
 typedef enum {lt_default, lt_muzzleflash, lt_explosion, lt_rocket,
 	lt_red, lt_blue, lt_redblue, lt_green, lt_redgreen, lt_bluegreen,
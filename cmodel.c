@@ -90,6 +90,7 @@ HULL BOXES
 static hull_t		box_hull;
 static dclipnode_t	box_clipnodes[6];
 static mplane_t		box_planes[6];
+static cclipnode_t	box_packed[6];
 
 /*
 ** CM_InitBoxHull
@@ -114,7 +115,14 @@ static void CM_InitBoxHull (void)
 		box_clipnodes[i].children[side^1] = (i != 5) ? (i + 1) : CONTENTS_SOLID;
 		box_planes[i].type = i>>1;
 		box_planes[i].normal[i>>1] = 1;
+
+		box_packed[i].type = i>>1;
+		box_packed[i].normal[i>>1] = 1;
+		box_packed[i].children[0] = box_clipnodes[i].children[0];
+		box_packed[i].children[1] = box_clipnodes[i].children[1];
 	}
+	box_hull.packed = box_packed;
+	box_hull.packedhead = 0;
 }
 
 /*
@@ -132,15 +140,92 @@ hull_t *CM_HullForBox (vec3_t mins, vec3_t maxs)
 	box_planes[4].dist = maxs[2];
 	box_planes[5].dist = mins[2];
 
+	box_packed[0].dist = maxs[0];
+	box_packed[1].dist = mins[0];
+	box_packed[2].dist = maxs[1];
+	box_packed[3].dist = mins[1];
+	box_packed[4].dist = maxs[2];
+	box_packed[5].dist = mins[2];
+
 	return &box_hull;
 }
 
+/*
+** The packed hulls, see CM_PackHulls.  Whatever the layout, the same float
+** operations run in the same order, so the results are identical.
+*/
+static qbool cm_usepacked = true;
+
+void CM_UsePackedHulls (qbool use)
+{
+	cm_usepacked = use;
+}
+
+/*
+** Recently tested points of the map's hulls, pmove asks about the same
+** points over and over.  Box hulls change all the time and are not kept.
+** Nothing is kept either while other threads test points, see
+** CM_SetThreaded.
+*/
+#define	CONTENTS_CACHE	1024	// power of two
+
+typedef struct {
+	const hull_t	*hull;
+	vec3_t			p;
+	int				contents;
+} contentscache_t;
+
+static contentscache_t contents_cache[CONTENTS_CACHE];
+static qbool cm_threaded;
+
+void CM_SetThreaded (qbool threaded)
+{
+	cm_threaded = threaded;
+}
+
+static unsigned int FloatBits (float f)
+{
+	union { float f; unsigned int i; } u;
+
+	u.f = f;
+	return u.i;
+}
+
+static int PackedPointContents (const hull_t *hull, const vec3_t p)
+{
+	const cclipnode_t *nodes = hull->packed;
+	contentscache_t *c = NULL;
+	int num;
+
+	if (hull != &box_hull && !cm_threaded) {
+		c = &contents_cache[(FloatBits (p[0]) * 73856093u ^ FloatBits (p[1]) * 19349663u
+						^ FloatBits (p[2]) * 83492791u) >> 7 & (CONTENTS_CACHE - 1)];
+		if (c->hull == hull && c->p[0] == p[0] && c->p[1] == p[1] && c->p[2] == p[2])
+			return c->contents;
+	}
+
+	num = hull->packedhead;
+	while (num >= 0)
+		num = (PlaneDiff (p, nodes + num) < 0) ? nodes[num].children[1] : nodes[num].children[0];
+
+	if (c) {
+		c->hull = hull;
+		VectorCopy (p, c->p);
+		c->contents = num;
+	}
+
+	return num;
+}
+
 int CM_HullPointContents (hull_t *hull, int num, vec3_t p)
 {
 	dclipnode_t *node;
 	mplane_t *plane;
 	float d;
 
+	if (hull->packed && num == hull->firstclipnode && cm_usepacked)
+		return PackedPointContents (hull, p);
+
 	while (num >= 0) {
 		if (num < hull->firstclipnode || num > hull->lastclipnode)
 		{
@@ -171,7 +256,7 @@ LINE TESTING IN HULLS
 // 1/32 epsilon to keep floating point happy
 #define	DIST_EPSILON	0.03125
 
-enum { TR_EMPTY, TR_SOLID, TR_BLOCKED };
+enum { TR_EMPTY, TR_SOLID, TR_BLOCKED, TR_TOODEEP };
 
 typedef struct {
 	hull_t *hull;
@@ -299,22 +384,217 @@ start:
 	return TR_BLOCKED;
 }
 
+/*
+** RecursiveHullTrace without the recursion, over a packed hull
+*/
+#define	MAX_TRACE_STACK	128		// deeper hulls are not packed, deeper traces give TR_TOODEEP
+
+typedef struct {
+	const cclipnode_t	*node;
+	float		t1, t2;
+	float		p1f, p2f, midf;
+	vec3_t		p1, p2, mid;
+	int			nearside;
+	qbool		farside;		// near side done, oldcheck is its result
+	int			oldcheck;
+} tracestack_t;
+
+static int PackedHullTrace (hulltrace_local_t *htl, const vec3_t start, const vec3_t end)
+{
+	tracestack_t stack[MAX_TRACE_STACK], *f = NULL;
+	const cclipnode_t *nodes = htl->hull->packed, *node;
+	trace_t *trace = &htl->trace;
+	float t1, t2, frac, p1f = 0, p2f = 1;
+	vec3_t p1, p2;
+	int num = htl->hull->packedhead, depth = 0, check, i;
+
+	VectorCopy (start, p1);
+	VectorCopy (end, p2);
+
+	while (1)
+	{
+		// go down until the segment is split or reaches a leaf
+		while (num >= 0)
+		{
+			node = nodes + num;
+
+			if (node->type < 3) {
+				t1 = p1[node->type] - node->dist;
+				t2 = p2[node->type] - node->dist;
+			}
+			else {
+				t1 = DotProduct (node->normal, p1) - node->dist;
+				t2 = DotProduct (node->normal, p2) - node->dist;
+			}
+
+			if (t1 >= 0 && t2 >= 0) {
+				num = node->children[0];
+				continue;
+			}
+			if (t1 < 0 && t2 < 0) {
+				num = node->children[1];
+				continue;
+			}
+
+			// a subtree shared with another hull can be deeper than CM_PackHull saw
+			if (depth == MAX_TRACE_STACK)
+				return TR_TOODEEP;
+
+			// remember the node, go to the near side first
+			f = &stack[depth++];
+			f->node = node;
+			f->t1 = t1;
+			f->t2 = t2;
+			f->p1f = p1f;
+			f->p2f = p2f;
+			VectorCopy (p1, f->p1);
+			VectorCopy (p2, f->p2);
+
+			frac = t1 / (t1 - t2);
+			frac = bound (0, frac, 1);
+			f->midf = p1f + (p2f - p1f)*frac;
+			for (i = 0; i < 3; i++)
+				f->mid[i] = p1[i] + frac*(p2[i] - p1[i]);
+
+			f->nearside = (t1 < t2) ? 1 : 0;
+			f->farside = false;
+
+			num = node->children[f->nearside];
+			p2f = f->midf;
+			VectorCopy (f->mid, p2);
+		}
+
+		// this is a leaf node
+		htl->leafcount++;
+		if (num == CONTENTS_SOLID) {
+			if (htl->leafcount == 1)
+				trace->startsolid = true;
+			check = TR_SOLID;
+		}
+		else {
+			if (num == CONTENTS_EMPTY)
+				trace->inopen = true;
+			else
+				trace->inwater = true;
+			check = TR_EMPTY;
+		}
+
+		// hand the result up until a node still has its far side to do
+		for ( ; depth; depth--)
+		{
+			f = &stack[depth - 1];
+
+			if (!f->farside) {
+				if (check == TR_BLOCKED)
+					continue;
+				// if we started in solid, allow us to move out to an empty area
+				if (check == TR_SOLID && (trace->inopen || trace->inwater))
+					continue;
+				f->oldcheck = check;
+				f->farside = true;
+				break;
+			}
+
+			if (check == TR_EMPTY || check == TR_BLOCKED)
+				continue;
+			if (f->oldcheck != TR_EMPTY)
+				continue;	// still in solid
+
+			// near side is empty, far side is solid
+			// this is the impact point
+			if (!f->nearside) {
+				VectorCopy (f->node->normal, trace->plane.normal);
+				trace->plane.dist = f->node->dist;
+			}
+			else {
+				VectorNegate (f->node->normal, trace->plane.normal);
+				trace->plane.dist = -f->node->dist;
+			}
+
+			// put the final point DIST_EPSILON pixels on the near side
+			if (f->t1 < f->t2)
+				frac = (f->t1 + DIST_EPSILON) / (f->t1 - f->t2);
+			else
+				frac = (f->t1 - DIST_EPSILON) / (f->t1 - f->t2);
+			frac = bound (0, frac, 1);
+			trace->fraction = f->p1f + (f->p2f - f->p1f)*frac;
+			for (i = 0; i < 3; i++)
+				trace->endpos[i] = f->p1[i] + frac*(f->p2[i] - f->p1[i]);
+
+			check = TR_BLOCKED;
+		}
+
+		if (!depth)
+			return check;
+
+		// go past the node
+		num = f->node->children[1 - f->nearside];
+		p1f = f->midf;
+		p2f = f->p2f;
+		VectorCopy (f->mid, p1);
+		VectorCopy (f->p2, p2);
+	}
+}
+
+/*
+** CM_HullNumber
+**
+** Tells trace logs which hull a trace went through: returns the model
+** number and fills in hullnum for the hulls of the map, returns -1 and
+** fills in the bounds for the box hull, -2 for anything else
+*/
+int CM_HullNumber (hull_t *hull, int *hullnum, vec3_t mins, vec3_t maxs)
+{
+	int i;
+
+	if (hull == &box_hull)
+	{
+		for (i = 0; i < 3; i++)
+		{
+			mins[i] = box_planes[i*2+1].dist;
+			maxs[i] = box_planes[i*2].dist;
+		}
+		*hullnum = 0;
+		return -1;
+	}
+
+	if ((byte *)hull < (byte *)map_cmodels || (byte *)hull >= (byte *)&map_cmodels[numcmodels])
+		return -2;
+
+	i = ((byte *)hull - (byte *)map_cmodels) / sizeof(cmodel_t);
+	*hullnum = hull - map_cmodels[i].hulls;
+	return i;
+}
+
+void (*cm_tracelog) (hull_t *hull, vec3_t start, vec3_t end, trace_t *trace);
+
+static void CM_ClearTrace (hulltrace_local_t *htl, hull_t *hull, vec3_t end)
+{
+	htl->hull = hull;
+	htl->leafcount = 0;
+	// fill in a default trace
+	memset (&htl->trace, 0, sizeof(htl->trace));
+	htl->trace.fraction = 1;
+	htl->trace.startsolid = false;
+	VectorCopy (end, htl->trace.endpos);
+}
+
 trace_t CM_HullTrace (hull_t *hull, vec3_t start, vec3_t end)
 {
-	int check;
+	int check = TR_TOODEEP;
 
 	// this structure is passed as a pointer to RecursiveHullTrace
 	// so as not to use much stack but still be thread safe
 	hulltrace_local_t htl;
-	htl.hull = hull;
-	htl.leafcount = 0;
-	// fill in a default trace
-	memset (&htl.trace, 0, sizeof(htl.trace));
-	htl.trace.fraction = 1;
-	htl.trace.startsolid = false;
-	VectorCopy (end, htl.trace.endpos);
+	CM_ClearTrace (&htl, hull, end);
+
+	if (hull->packed && cm_usepacked)
+		check = PackedHullTrace (&htl, start, end);
 
-	check = RecursiveHullTrace (&htl, hull->firstclipnode, 0, 1, start, end);
+	if (check == TR_TOODEEP) {
+		CM_ClearTrace (&htl, hull, end);
+		check = RecursiveHullTrace (&htl, hull->firstclipnode, 0, 1, start, end);
+	}
 
 	if (check == TR_SOLID) {
 		htl.trace.startsolid = htl.trace.allsolid = true;
@@ -325,6 +605,10 @@ trace_t CM_HullTrace (hull_t *hull, vec3_t start, vec3_t end)
 		VectorCopy (start, htl.trace.endpos);
 	}
 
+	// the log is written by one thread at a time only
+	if (cm_tracelog && !cm_threaded)
+		cm_tracelog (hull, start, end, &htl.trace);
+
 	return htl.trace;
 }
 
@@ -415,11 +699,9 @@ crosses a waterline.
 =============================================================================
 */
 
-static int	fatbytes;
 static byte	fatpvs[MAX_MAP_LEAFS/8];
-static vec3_t	fatpvs_org;
 
-static void AddToFatPVS_r (cnode_t *node)
+static void AddToFatPVS_r (cnode_t *node, const vec3_t org, byte *fat, int fatbytes)
 {
 	int i;
 	float d;
@@ -434,25 +716,42 @@ static void AddToFatPVS_r (cnode_t *node)
 			{
 				pvs = CM_LeafPVS ( (cleaf_t *)node);
 				for (i=0 ; i<fatbytes ; i++)
-					fatpvs[i] |= pvs[i];
+					fat[i] |= pvs[i];
 			}
 			return;
 		}
 	
 		plane = node->plane;
-		d = DotProduct (fatpvs_org, plane->normal) - plane->dist;
+		d = DotProduct (org, plane->normal) - plane->dist;
 		if (d > 8)
 			node = node->children[0];
 		else if (d < -8)
 			node = node->children[1];
 		else
 		{ // go down both
-			AddToFatPVS_r (node->children[0]);
+			AddToFatPVS_r (node->children[0], org, fat, fatbytes);
 			node = node->children[1];
 		}
 	}
 }
 
+/*
+=============
+CM_FatPVSToBuffer
+
+Same as CM_FatPVS, but writes into a caller supplied buffer of at least
+MAX_MAP_LEAFS/8 bytes, so it can be used from several threads at once.
+=============
+*/
+byte *CM_FatPVSToBuffer (vec3_t org, byte *buffer)
+{
+	int fatbytes = (visleafs+31)>>3;
+
+	memset (buffer, 0, fatbytes);
+	AddToFatPVS_r (map_nodes, org, buffer, fatbytes);
+	return buffer;
+}
+
 /*
 =============
 CM_FatPVS
@@ -463,12 +762,7 @@ given point.
 */
 byte *CM_FatPVS (vec3_t org)
 {
-	VectorCopy (org, fatpvs_org);
-
-	fatbytes = (visleafs+31)>>3;
-	memset (fatpvs, 0, fatbytes);
-	AddToFatPVS_r (map_nodes);
-	return fatpvs;
+	return CM_FatPVSToBuffer (org, fatpvs);
 }
 
 
@@ -480,6 +774,45 @@ static int leafs_maxcount;
 static int *leafs_list;
 static int leafs_topnode;
 static vec3_t leafs_mins, leafs_maxs;
+static float leafs_margin;		// only tracked when > 0
+
+/*
+** How far the box can move without changing which sides of the plane it is on
+*/
+static float BoxPlaneMargin (const mplane_t *plane, int sides)
+{
+	float lo, hi;
+	int i;
+
+	if (plane->type < 3)
+	{
+		lo = leafs_mins[plane->type];
+		hi = leafs_maxs[plane->type];
+	}
+	else
+	{
+		lo = hi = 0;
+		for (i = 0; i < 3; i++)
+		{
+			if (plane->normal[i] < 0)
+			{
+				lo += plane->normal[i] * leafs_maxs[i];
+				hi += plane->normal[i] * leafs_mins[i];
+			}
+			else
+			{
+				lo += plane->normal[i] * leafs_mins[i];
+				hi += plane->normal[i] * leafs_maxs[i];
+			}
+		}
+	}
+
+	if (sides == 1)
+		return lo - plane->dist;
+	if (sides == 2)
+		return plane->dist - hi;
+	return min (hi - plane->dist, plane->dist - lo);
+}
 
 static void FindTouchedLeafs_r (const cnode_t *node)
 {
@@ -506,6 +839,8 @@ static void FindTouchedLeafs_r (const cnode_t *node)
 		// NODE_MIXED
 		splitplane = node->plane;
 		sides = BOX_ON_PLANE_SIDE (leafs_mins, leafs_maxs, splitplane);
+		if (leafs_margin > 0)
+			leafs_margin = min (leafs_margin, BoxPlaneMargin (splitplane, sides));
 		
 		// recurse down the contacted sides
 		if (sides == 1)
@@ -522,10 +857,7 @@ static void FindTouchedLeafs_r (const cnode_t *node)
 	}
 }
 
-/*
-** Returns an array filled with leaf nums
-*/
-int CM_FindTouchedLeafs (const vec3_t mins, const vec3_t maxs, int leafs[], int maxleafs, int headnode, int *topnode)
+static int FindTouchedLeafs (const vec3_t mins, const vec3_t maxs, int leafs[], int maxleafs, int headnode, int *topnode)
 {
 	leafs_count = 0;
 	leafs_maxcount = maxleafs;
@@ -542,6 +874,31 @@ int CM_FindTouchedLeafs (const vec3_t mins, const vec3_t maxs, int leafs[], int
 	return leafs_count;
 }
 
+/*
+** Returns an array filled with leaf nums
+*/
+int CM_FindTouchedLeafs (const vec3_t mins, const vec3_t maxs, int leafs[], int maxleafs, int headnode, int *topnode)
+{
+	leafs_margin = 0;
+	return FindTouchedLeafs (mins, maxs, leafs, maxleafs, headnode, topnode);
+}
+
+/*
+** Same as CM_FindTouchedLeafs, and sets margin to how far the box (or either
+** of its corners) can move and still touch exactly the same leafs, 0 if none
+*/
+int CM_FindTouchedLeafsMargin (const vec3_t mins, const vec3_t maxs, int leafs[], int maxleafs, int headnode, float *margin)
+{
+	int count;
+
+	leafs_margin = 999999;
+	count = FindTouchedLeafs (mins, maxs, leafs, maxleafs, headnode, NULL);
+
+	// keep clear of rounding in BOX_ON_PLANE_SIDE
+	*margin = max (leafs_margin - 0.125, 0);
+	return count;
+}
+
 
 /*
 ===============================================================================
@@ -774,6 +1131,129 @@ static void CM_MakeHull0 (void)
 	}
 }
 
+/*
+=================
+CM_PackHull
+
+Copies the nodes reachable from the hull's head into packed, depth first
+with the front side next to its parent, so a trace mostly walks forward
+through memory.  Nodes already placed by another hull on the same
+clipnodes are shared.  Hulls the tracing code would complain about, or
+too deep for PackedHullTrace, keep the original code.
+=================
+*/
+static void CM_PackHull (hull_t *hull, cclipnode_t *packed, int *packedindex, int *numpacked, int *stack, int *visited, int stamp)
+{
+	int sp, num, depth, i, j;
+	dclipnode_t *node;
+	mplane_t *plane;
+
+	hull->packed = NULL;
+
+	// check the whole tree first
+	sp = 0;
+	stack[sp++] = hull->firstclipnode;
+	stack[sp++] = 1;
+	while (sp)
+	{
+		depth = stack[--sp];
+		num = stack[--sp];
+		if (num < 0)
+			continue;
+		if (num < hull->firstclipnode || num > hull->lastclipnode || depth > MAX_TRACE_STACK)
+			return;
+		if (visited[num] == stamp || packedindex[num] >= 0)
+			continue;
+		visited[num] = stamp;
+		node = hull->clipnodes + num;
+		for (i = 0; i < 2; i++) {
+			stack[sp++] = node->children[i];
+			stack[sp++] = depth + 1;
+		}
+	}
+
+	// place the nodes
+	sp = 0;
+	stack[sp++] = hull->firstclipnode;
+	while (sp)
+	{
+		num = stack[--sp];
+		if (num < 0 || packedindex[num] >= 0)
+			continue;
+		packedindex[num] = (*numpacked)++;
+		node = hull->clipnodes + num;
+		stack[sp++] = node->children[1];
+		stack[sp++] = node->children[0];
+	}
+
+	// fill them in
+	for (num = hull->firstclipnode; num <= hull->lastclipnode; num++)
+	{
+		if (visited[num] != stamp)
+			continue;
+		node = hull->clipnodes + num;
+		plane = hull->planes + node->planenum;
+		i = packedindex[num];
+		VectorCopy (plane->normal, packed[i].normal);
+		packed[i].dist = plane->dist;
+		packed[i].type = plane->type;
+		for (j = 0; j < 2; j++)
+			packed[i].children[j] = (node->children[j] < 0) ? node->children[j] : packedindex[node->children[j]];
+	}
+
+	hull->packed = packed;
+	hull->packedhead = (hull->firstclipnode < 0) ? hull->firstclipnode : packedindex[hull->firstclipnode];
+}
+
+/*
+=================
+CM_PackHulls
+=================
+*/
+static void CM_PackHulls (void)
+{
+	cclipnode_t *packed[2];
+	int *packedindex[2], numpacked[2], *stack, *visited;
+	int i, j, k, count[2], stamp = 0;
+	hull_t *hull;
+
+	// hull 0 is on the nodes, the others on the clipnodes
+	count[0] = numnodes;
+	count[1] = numclipnodes;
+
+	for (k = 0; k < 2; k++)
+	{
+		packed[k] = Hunk_AllocName (max (count[k], 1) * sizeof(cclipnode_t), loadname);
+		packedindex[k] = Q_malloc (max (count[k], 1) * sizeof(int));
+		memset (packedindex[k], -1, max (count[k], 1) * sizeof(int));
+		numpacked[k] = 0;
+	}
+	stack = Q_malloc ((max (numnodes, numclipnodes) * 4 + 4) * sizeof(int));
+	visited = Q_malloc (max (max (numnodes, numclipnodes), 1) * sizeof(int));
+
+	for (i = 0; i < numcmodels; i++)
+	{
+		for (j = 0; j < MAX_MAP_HULLS; j++)
+		{
+			hull = &map_cmodels[i].hulls[j];
+			k = (j == 0) ? 0 : 1;
+			if (hull->lastclipnode != count[k] - 1)
+			{
+				hull->packed = NULL;
+				continue;
+			}
+			CM_PackHull (hull, packed[k], packedindex[k], &numpacked[k], stack, visited, ++stamp);
+		}
+	}
+
+	Q_free (packedindex[0]);
+	Q_free (packedindex[1]);
+	Q_free (stack);
+	Q_free (visited);
+
+	memset (contents_cache, 0, sizeof(contents_cache));
+}
+
 /*
 =================
 CM_LoadPlanes
@@ -951,6 +1431,8 @@ void CM_InvalidateMap (void)
 	map_pvs = NULL;
 	map_phs = NULL;
 	map_entitystring = NULL;
+
+	memset (contents_cache, 0, sizeof(contents_cache));
 }
 
 /*
@@ -1019,6 +1501,7 @@ cmodel_t *CM_LoadMap (char *name, qbool clientload, unsigned *checksum, unsigned
 	CM_LoadSubmodels (&header->lumps[LUMP_MODELS]);
 
 	CM_MakeHull0 ();
+	CM_PackHulls ();
 
 	CM_BuildPVS (&header->lumps[LUMP_VISIBILITY], &header->lumps[LUMP_LEAFS]);
 
@@ -40,6 +40,15 @@ typedef struct mplane_s {
 	byte	pad[2];
 } mplane_t;
 
+// clipnode with its plane, laid out depth first by CM_PackHulls
+typedef struct cclipnode_s {
+	vec3_t	normal;
+	float	dist;
+	int		type;			// plane type, < 3 is axial
+	int		children[2];	// packed node numbers, negative numbers are contents
+	int		pad;			// 32 bytes
+} cclipnode_t;
+
 // !!! if this is changed, it must be changed in asm_i386.h too !!!
 typedef struct {
 	dclipnode_t	*clipnodes;
@@ -48,6 +57,8 @@ typedef struct {
 	int			lastclipnode;
 	vec3_t		clip_mins;
 	vec3_t		clip_maxs;
+	cclipnode_t	*packed;		// packed copy of the hull, NULL if it couldn't be made
+	int			packedhead;		// firstclipnode in packed
 } hull_t;
 
 typedef struct {
@@ -77,13 +88,19 @@ typedef struct {
 hull_t *CM_HullForBox (vec3_t mins, vec3_t maxs);
 int CM_HullPointContents (hull_t *hull, int num, vec3_t p);
 trace_t CM_HullTrace (hull_t *hull, vec3_t start, vec3_t end);
+void CM_UsePackedHulls (qbool use);	// for comparing with the original hull code
+void CM_SetThreaded (qbool threaded);	// while other threads trace as well
+int CM_HullNumber (hull_t *hull, int *hullnum, vec3_t mins, vec3_t maxs);
+extern void (*cm_tracelog) (hull_t *hull, vec3_t start, vec3_t end, trace_t *trace);	// sees every CM_HullTrace while set, unless threaded
 struct cleaf_s *CM_PointInLeaf (const vec3_t p);
 int CM_Leafnum (const struct cleaf_s *leaf);
 int CM_LeafAmbientLevel (const struct cleaf_s *leaf, int ambient_channel);
 byte *CM_LeafPVS (const struct cleaf_s *leaf);
 byte *CM_LeafPHS (const struct cleaf_s *leaf); // only for the server
 byte *CM_FatPVS (vec3_t org);
+byte *CM_FatPVSToBuffer (vec3_t org, byte *buffer);
 int CM_FindTouchedLeafs (const vec3_t mins, const vec3_t maxs, int leafs[], int maxleafs, int headnode, int *topnode);
+int CM_FindTouchedLeafsMargin (const vec3_t mins, const vec3_t maxs, int leafs[], int maxleafs, int headnode, float *margin);
 char *CM_EntityString (void);
 int CM_NumInlineModels (void);
 cmodel_t *CM_InlineModel (char *name);
@@ -1114,6 +1114,8 @@ qbool Info_SetStar (ctxinfo_t *ctx, const char *name, const char *value)
 		return Info_Remove(ctx, name);
 	}
 
+	ctx->changes++;
+
 	return true;
 }
 
@@ -1188,6 +1190,7 @@ qbool Info_Remove (ctxinfo_t *ctx, const char *name)
 			_Info_Free(a);
 
 			ctx->cur--; // decrease counter
+			ctx->changes++;
 
 			return true;
 		}
@@ -1214,6 +1217,7 @@ void Info_RemoveAll (ctxinfo_t *ctx)
 	}
 	ctx->info_list = NULL;
 	ctx->cur = 0; // set counter to 0
+	ctx->changes++;
 
 	// clear hash
 	memset (ctx->info_hash, 0, sizeof(ctx->info_hash));
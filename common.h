@@ -46,6 +46,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 //#define SV_MAX_EDICTS         1024	// FIXME: ouch! ouch! ouch!
 #define MAX_EDICTS              512	// FIXME: ouch! ouch! ouch! - trying to fix...
 #define MAX_LIGHTSTYLES         64
+#define MAX_STYLESTRING         64	// lightstyle chars kept by clients
 #define MAX_MODELS              512	// these are sent over the net as bytes
 #define MAX_VWEP_MODELS         32	// could be increased to 256
 #define MAX_SOUNDS              256	// so they cannot be blindly increased
@@ -255,6 +256,8 @@ typedef struct ctxinfo_s {
 	int		cur; // current infos
 	int		max; // max    infos
 
+	int		changes; // bumped on every modification, lets callers cache derived data
+
 } ctxinfo_t;
 
 // return value for given key
@@ -37,34 +37,8 @@ $Id: mvd_utils.c,v 1.57 2007-10-11 17:56:47 johnnycz Exp $
 #include "Ctrl.h"
 
 
-mvd_gt_info_t mvd_gt_info[mvd_gt_types] = {
-	{gt_1on1,"duel"},
-	{gt_2on2,"2on2"},
-	{gt_3on3,"3on3"},
-	{gt_4on4,"4on4"},
-	{gt_unknown,"unknown"},
-};
-
 mvd_cg_info_s mvd_cg_info;
 
-mvd_wp_info_t mvd_wp_info[mvd_info_types] = {
-	{AXE_INFO,"axe",IT_AXE,"axe"},
-	{SG_INFO,"sg",IT_SHOTGUN,"sg"},
-	{SSG_INFO,"ssg",IT_SUPER_SHOTGUN,"&cf0fssg&r"},
-	{NG_INFO,"ng",IT_NAILGUN,"&cf0fng&r"},
-	{SNG_INFO,"sng",IT_SUPER_NAILGUN,"&cf0fsng&r"},
-	{GL_INFO,"gl",IT_GRENADE_LAUNCHER,"&cf0fgl&r"},
-	{RL_INFO,"rl",IT_ROCKET_LAUNCHER,"&cf0frl&r"},
-	{LG_INFO,"lg",IT_LIGHTNING,"&cf0flg&r"},
-	{RING_INFO,"ring",IT_INVISIBILITY,"&cff0ring&r"},
-	{QUAD_INFO,"quad",IT_QUAD,"&c00fquad&r"},
-	{PENT_INFO,"pent",IT_INVULNERABILITY,"&cf00pent&r"},
-	{GA_INFO,"ga",IT_ARMOR1,"&c0f0ga&r"},
-	{YA_INFO,"ya",IT_ARMOR2,"&cff0ya&r"},
-	{RA_INFO,"ra",IT_ARMOR3,"&cf00ra&r"},
-	{MH_INFO,"mh",IT_SUPERHEALTH,"&c00fmh&r"},
-};
-
 typedef struct mvd_clock_t {
 	int itemtype;             // RA, Quad, RL, ...
 	double clockval;          // time when the clock expires
@@ -530,20 +504,6 @@ char *MVD_BestWeapon_strings (int i) {
 	return TP_ItemName(MVD_BestWeapon(i));
 }
 
-int MVD_Weapon_LWF (int i) {
-	switch (i) {
-		case IT_AXE: return 0;
-		case IT_SHOTGUN: return 1;
-		case IT_SUPER_SHOTGUN: return 2;
-		case IT_NAILGUN: return 3;
-		case IT_SUPER_NAILGUN: return 4;
-		case IT_GRENADE_LAUNCHER: return 5;
-		case IT_ROCKET_LAUNCHER: return 6;
-		case IT_LIGHTNING: return 7;
-		default: return 666;
-	}
-}
-
 char *MVD_BestAmmo (int i) {
 
 	switch (MVD_BestWeapon(i)) {
@@ -707,20 +667,6 @@ void MVD_Status_Announcer(int i, int z){
 	}
 }
 
-void MVD_Status_WP(int i, int *taken){
-	int j,k;
-	for (k = j = SSG_INFO; j <= LG_INFO; j++, k = k*2){
-		if (!mvd_new_info[i].mvdinfo.itemstats[j].has && mvd_new_info[i].p_info->stats[STAT_ITEMS] & k){
-			if (j >= GL_INFO && cl.deathmatch == 1) {
-				*taken |= (1 << j);
-			}
-			mvd_new_info[i].mvdinfo.itemstats[j].has = 1;
-			mvd_new_info[i].mvdinfo.itemstats[j].count++;
-		}
-	}
-
-}
-
 void MVD_Stats_Cleanup (void){
 	quad_is_active=0;
 	pent_is_active=0;
@@ -735,24 +681,6 @@ void MVD_Stats_Cleanup (void){
 	memset(&mvd_cg_info, 0, sizeof(mvd_cg_info_s));
 }
 
-void MVD_Set_Armor_Stats(int z,int i){
-	switch(z){
-		case GA_INFO:
-			mvd_new_info[i].mvdinfo.itemstats[YA_INFO].has=0;
-			mvd_new_info[i].mvdinfo.itemstats[RA_INFO].has=0;
-			break;
-		case YA_INFO:
-			mvd_new_info[i].mvdinfo.itemstats[GA_INFO].has=0;
-			mvd_new_info[i].mvdinfo.itemstats[RA_INFO].has=0;
-			break;
-		case RA_INFO:
-			mvd_new_info[i].mvdinfo.itemstats[GA_INFO].has=0;
-			mvd_new_info[i].mvdinfo.itemstats[YA_INFO].has=0;
-			break;
-
-	}
-}
-
 // calculates the average values of run statistics
 void MVD_Stats_CalcAvgRuns(void)
 {
@@ -857,150 +785,42 @@ static qbool MVD_Weapon_From_Backpack(int weapon, int taken, int *ammotaken)
 	return false;
 }
 
-static void MVD_Stats_Gather_AlivePlayer(int player_index)
+// the clocks, cams and messages of what MVD_Stats_Gather_Player found
+static void MVD_Stats_Gather_Events(int i, mvd_gather_t *g, qbool quad, qbool pent, qbool mh)
 {
-	int x; // item index
-	int z; // item index
-	int i = player_index;
-	int killdiff;
-	int taken = 0;
-	int ammotaken[AMMO_TYPES] = {0, 0, 0, 0};
-
-	for (x=GA_INFO;x<=RA_INFO && mvd_cg_info.deathmatch!=4;x++){
-		if(mvd_new_info[i].p_info->stats[STAT_ITEMS] & mvd_wp_info[x].it) {
-			if (!mvd_new_info[i].mvdinfo.itemstats[x].has){
-				taken |= (1 << x);
-				MVD_Set_Armor_Stats(x,i);
-				mvd_new_info[i].mvdinfo.itemstats[x].count++;
-				mvd_new_info[i].mvdinfo.itemstats[x].lost=mvd_new_info[i].p_info->stats[STAT_ARMOR];
-				mvd_new_info[i].mvdinfo.itemstats[x].has=1;
-			}
-			if (mvd_new_info[i].mvdinfo.itemstats[x].lost < mvd_new_info[i].p_info->stats[STAT_ARMOR]) {
-				taken |= (1 << x);
-				mvd_new_info[i].mvdinfo.itemstats[x].count++;
-			}
-			mvd_new_info[i].mvdinfo.itemstats[x].lost=mvd_new_info[i].p_info->stats[STAT_ARMOR];
-		}
-	}
-
-	for (x=RING_INFO;x<=PENT_INFO && mvd_cg_info.deathmatch!=4;x++){
-		if(!mvd_new_info[i].mvdinfo.itemstats[x].has && mvd_new_info[i].p_info->stats[STAT_ITEMS] & mvd_wp_info[x].it){
-			taken |= (1 << x);
-			mvd_new_info[i].mvdinfo.itemstats[x].has = 1;
-			if (x==PENT_INFO && (powerup_cam_active == 3 || powerup_cam_active == 2)){
-				pent_mentioned=0;
-				pent_is_active=1;
-				powerup_cam_active-=2;
-			}
-			if (x==QUAD_INFO && (powerup_cam_active == 3 || powerup_cam_active == 1)){
-				quad_mentioned=0;
-				quad_is_active=1;
-				powerup_cam_active-=1;
-			}
-			mvd_new_info[i].mvdinfo.itemstats[x].starttime = cls.demotime;
-			mvd_new_info[i].mvdinfo.itemstats[x].count++;
-		}
-		if (mvd_new_info[i].mvdinfo.itemstats[x].has && !(mvd_new_info[i].p_info->stats[STAT_ITEMS] & mvd_wp_info[x].it)){
-			mvd_new_info[i].mvdinfo.itemstats[x].has = 0;
-			if (x==QUAD_INFO && quad_is_active){
-				quad_is_active=0;
-			}
-			if (x==PENT_INFO && pent_is_active){
-				pent_is_active=0;
-			}
-			mvd_new_info[i].mvdinfo.itemstats[x].runs[mvd_new_info[i].mvdinfo.itemstats[x].run].starttime = mvd_new_info[i].mvdinfo.itemstats[x].starttime;
-			mvd_new_info[i].mvdinfo.itemstats[x].runs[mvd_new_info[i].mvdinfo.itemstats[x].run].time = cls.demotime - mvd_new_info[i].mvdinfo.itemstats[x].starttime;
-			mvd_new_info[i].mvdinfo.itemstats[x].run++;
-		}
-	}
-
-	if (!mvd_new_info[i].mvdinfo.itemstats[MH_INFO].has && mvd_new_info[i].p_info->stats[STAT_ITEMS] & IT_SUPERHEALTH){
-		mvd_new_info[i].mvdinfo.itemstats[MH_INFO].mention = 1;
-		mvd_new_info[i].mvdinfo.itemstats[MH_INFO].has = 1;
-		mvd_new_info[i].mvdinfo.itemstats[MH_INFO].count++;
-	}
-	if (mvd_new_info[i].mvdinfo.itemstats[MH_INFO].has && !(mvd_new_info[i].p_info->stats[STAT_ITEMS] & IT_SUPERHEALTH)) {
-		mvd_new_info[i].mvdinfo.itemstats[MH_INFO].has = 0;
-		MVD_ClockStart(MH_INFO);
-	}
-
-	for (z=RING_INFO;z<=PENT_INFO;z++){
-		if (mvd_new_info[i].mvdinfo.itemstats[z].has == 1){
-			mvd_new_info[i].mvdinfo.itemstats[z].runs[mvd_new_info[i].mvdinfo.itemstats[z].run].starttime = mvd_new_info[i].mvdinfo.itemstats[z].starttime;
-			mvd_new_info[i].mvdinfo.itemstats[z].runs[mvd_new_info[i].mvdinfo.itemstats[z].run].time = cls.demotime - mvd_new_info[i].mvdinfo.itemstats[z].starttime;
-		}
-	}
-
-	if (mvd_new_info[i].mvdinfo.lastfrags != mvd_new_info[i].p_info->frags ){
-		if (mvd_new_info[i].mvdinfo.lastfrags < mvd_new_info[i].p_info->frags){
-			killdiff = mvd_new_info[i].p_info->frags - mvd_new_info[i].mvdinfo.lastfrags;
-			for (z=0;z<8;z++){
-				if (z == MVD_Weapon_LWF(mvd_new_info[i].mvdinfo.lfw))
-						mvd_new_info[i].mvdinfo.killstats.normal[z].kills+=killdiff;
-			}
-			if (mvd_new_info[i].mvdinfo.lfw == -1)
-				mvd_new_info[i].mvdinfo.spawntelefrags+=killdiff;
-			for(z=8;z<11;z++){
-				if(mvd_new_info[i].mvdinfo.itemstats[z].has)
-					mvd_new_info[i].mvdinfo.itemstats[z].runs[mvd_new_info[i].mvdinfo.itemstats[z].run].frags+=killdiff;
-			}
-			mvd_new_info[i].mvdinfo.runs[mvd_new_info[i].mvdinfo.run].frags++;
-			}else if (mvd_new_info[i].mvdinfo.lastfrags > mvd_new_info[i].p_info->frags){
-			killdiff = mvd_new_info[i].mvdinfo.lastfrags - mvd_new_info[i].p_info->frags ;
-			for (z=AXE_INFO;z<=LG_INFO;z++){
-				if (z == MVD_Weapon_LWF(mvd_new_info[i].mvdinfo.lfw))
-					mvd_new_info[i].mvdinfo.killstats.normal[z].teamkills+=killdiff;
-			}
-			if (mvd_new_info[i].mvdinfo.lfw == -1){
-				mvd_new_info[i].mvdinfo.teamspawntelefrags+=killdiff;
-
-			}
-			for(z=8;z<11;z++){
-				if(mvd_new_info[i].mvdinfo.itemstats[z].has)
-					mvd_new_info[i].mvdinfo.itemstats[z].runs[mvd_new_info[i].mvdinfo.itemstats[z].run].teamfrags+=killdiff;
-			}
-			mvd_new_info[i].mvdinfo.runs[mvd_new_info[i].mvdinfo.run].teamfrags++;
-			}
+	mvd_info_t *pi = &mvd_new_info[i].mvdinfo;
+	int x;
 
+	if (quad && !pi->itemstats[QUAD_INFO].has)
+		quad_is_active = 0;
+	if (pi->das.isdead)
+		return;
 
-		mvd_new_info[i].mvdinfo.lastfrags = mvd_new_info[i].p_info->frags ;
+	if (g->taken & (1 << QUAD_INFO) && (powerup_cam_active == 3 || powerup_cam_active == 1)){
+		quad_mentioned=0;
+		quad_is_active=1;
+		powerup_cam_active-=1;
 	}
-
-	mvd_new_info[i].mvdinfo.runs[mvd_new_info[i].mvdinfo.run].time=cls.demotime - mvd_new_info[i].mvdinfo.das.alivetimestart;
-
-	if (mvd_new_info[i].mvdinfo.lfw == -1){
-		if (mvd_new_info[i].mvdinfo.lastfrags > mvd_new_info[i].p_info->frags ){
-			mvd_new_info[i].mvdinfo.teamspawntelefrags += mvd_new_info[i].p_info->frags - mvd_new_info[i].mvdinfo.lastfrags ;
-		}else if (mvd_new_info[i].mvdinfo.lastfrags < mvd_new_info[i].p_info->frags ){
-			mvd_new_info[i].mvdinfo.spawntelefrags += mvd_new_info[i].p_info->frags -mvd_new_info[i].mvdinfo.lastfrags  ;
-		}
-		mvd_new_info[i].mvdinfo.lastfrags = mvd_new_info[i].p_info->frags;
+	if (g->taken & (1 << PENT_INFO) && (powerup_cam_active == 3 || powerup_cam_active == 2)){
+		pent_mentioned=0;
+		pent_is_active=1;
+		powerup_cam_active-=2;
 	}
+	if (pent && !pi->itemstats[PENT_INFO].has)
+		pent_is_active = 0;
+	if (mh && !pi->itemstats[MH_INFO].has)
+		MVD_ClockStart(MH_INFO);
 
-	if (mvd_new_info[i].p_state->weaponframe > 0)
-			mvd_new_info[i].mvdinfo.lfw=mvd_new_info[i].p_info->stats[STAT_ACTIVEWEAPON];
 	if (mvd_cg_info.deathmatch!=4){
-		MVD_Status_WP(i, &taken);
-		for (z=SSG_INFO;z<=RA_INFO;z++) {
-			MVD_Status_Announcer(i,z);
+		for (x=SSG_INFO;x<=RA_INFO;x++) {
+			MVD_Status_Announcer(i,x);
 		}
 	}
 
-	for (x = 0; x < AMMO_TYPES; x++) {
-		int ammo_new = mvd_new_info[i].p_info->stats[STAT_SHELLS + x];
-		int ammo_old = mvd_new_info[i].mvdinfo.ammostats[x];
-		if (mvd_new_info[i].mvdinfo.initialized && ammo_new > ammo_old) {
-			int diff = ammo_new - ammo_old;
-			ammotaken[x] = diff;
-		}
-		mvd_new_info[i].mvdinfo.ammostats[x] =
-			mvd_new_info[i].p_info->stats[STAT_SHELLS + x];
-	}
-
 	for (x = 0; x < mvd_info_types; x++) {
-		if (taken & (1 << x)) {
+		if (g->taken & (1 << x)) {
 			qbool weapon_from_backpack =
-				IS_WEAPON(x) && MVD_Weapon_From_Backpack(x, taken, ammotaken);
+				IS_WEAPON(x) && MVD_Weapon_From_Backpack(x, g->taken, g->ammotaken);
 			// don't start clock if item was from backpack
 			qbool add_clock = !weapon_from_backpack;
 			Com_DPrintf("player %i took %i, weapon from backpack: %s\n",
@@ -1012,8 +832,10 @@ static void MVD_Stats_Gather_AlivePlayer(int player_index)
 }
 
 int MVD_Stats_Gather(void){
-	int death_stats = 0;
-	int x,i;
+	mvd_gather_t g;
+	mvd_info_t *pi;
+	qbool quad, pent, mh;
+	int i;
 
 	if(cl.countdown == true){
 		return 0;
@@ -1022,57 +844,27 @@ int MVD_Stats_Gather(void){
 		return 0;
 
 	for ( i=0; i<mvd_cg_info.pcount ; i++ ){
-		if (quad_time == pent_time && quad_time == 0 && !mvd_new_info[i].mvdinfo.firstrun){
+		pi = &mvd_new_info[i].mvdinfo;
+
+		if (quad_time == pent_time && quad_time == 0 && !pi->firstrun){
 			powerup_cam_active = 3;
 			quad_time=pent_time=cls.demotime;
 		}
 
-		if (mvd_new_info[i].mvdinfo.firstrun == 0){
-			mvd_new_info[i].mvdinfo.das.alivetimestart = cls.demotime;
+		if (pi->firstrun == 0)
 			gamestart_time = cls.demotime;
-			mvd_new_info[i].mvdinfo.firstrun = 1;
-			mvd_new_info[i].mvdinfo.lfw = -1;
-		}
-		// death alive stats
-		if (mvd_new_info[i].p_info->stats[STAT_HEALTH]>0 && mvd_new_info[i].mvdinfo.das.isdead == 1){
-			mvd_new_info[i].mvdinfo.das.isdead = 0;
-			mvd_new_info[i].mvdinfo.das.alivetimestart = cls.demotime;
-			mvd_new_info[i].mvdinfo.lfw = -1;
-		}
-
-		mvd_new_info[i].mvdinfo.das.alivetime = cls.demotime - mvd_new_info[i].mvdinfo.das.alivetimestart;
-		if (mvd_new_info[i].p_info->stats[STAT_HEALTH]<=0 && mvd_new_info[i].mvdinfo.das.isdead != 1){
-			mvd_new_info[i].mvdinfo.das.isdead = 1;
-			mvd_new_info[i].mvdinfo.das.deathcount++;
-			death_stats=1;
-		}
 
-		if (death_stats){
-			death_stats=0;
-			mvd_new_info[i].mvdinfo.run++;
+		quad = pi->itemstats[QUAD_INFO].has;
+		pent = pi->itemstats[PENT_INFO].has;
+		mh = pi->itemstats[MH_INFO].has;
 
-
-			for(x=0;x<13;x++){ // XXX: x<13? for sure? maybe x<mvd_info_types?
-
-				if (x == MVD_Weapon_LWF(mvd_new_info[i].mvdinfo.lfw)){
-						mvd_new_info[i].mvdinfo.itemstats[x].mention=-1;
-						mvd_new_info[i].mvdinfo.itemstats[x].lost++;
-				}
-
-				if (x == QUAD_INFO && mvd_new_info[i].mvdinfo.itemstats[QUAD_INFO].has){
-					if (mvd_new_info[i].mvdinfo.itemstats[x].starttime - cls.demotime < 30 )
-						quad_is_active = 0;
-						mvd_new_info[i].mvdinfo.itemstats[x].run++;
-						mvd_new_info[i].mvdinfo.itemstats[x].lost++;
-				}
-				mvd_new_info[i].mvdinfo.itemstats[x].has=0;
-			}
-			mvd_new_info[i].mvdinfo.lfw = -1;
-		}
-
-		if(!mvd_new_info[i].mvdinfo.das.isdead) {
-			MVD_Stats_Gather_AlivePlayer(i);
-		}
+		g.stats = mvd_new_info[i].p_info->stats;
+		g.frags = mvd_new_info[i].p_info->frags;
+		g.weaponframe = mvd_new_info[i].p_state->weaponframe;
+		g.deathmatch = mvd_cg_info.deathmatch;
+		g.time = cls.demotime;
+		MVD_Stats_Gather_Player(&g, pi);
+		MVD_Stats_Gather_Events(i, &g, quad, pent, mh);
 
 		if ((((pent_time + 300) - cls.demotime) < 5) && !pent_is_active){
 			if(!pent_mentioned){
@@ -1096,7 +888,7 @@ int MVD_Stats_Gather(void){
 			else if (powerup_cam_active == 0)
 				powerup_cam_active = 1;
 		}
-		mvd_new_info[i].mvdinfo.initialized = true;
+		pi->initialized = true;
 	}
 
 	return 1;
@@ -0,0 +1,524 @@
+/*
+Copyright (C) 2001-2002 jogihoogi
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the included (GNU.txt) GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+// mvd_utils_common.c - the stats gathering and xml stats of the mvd tools,
+// on nothing but mvd_info_t so mvdanalyze can link it as well
+
+#include "quakedef.h"
+#include "mvd_utils_common.h"
+
+mvd_gt_info_t mvd_gt_info[mvd_gt_types] = {
+	{gt_1on1,"duel"},
+	{gt_2on2,"2on2"},
+	{gt_3on3,"3on3"},
+	{gt_4on4,"4on4"},
+	{gt_unknown,"unknown"},
+};
+
+mvd_wp_info_t mvd_wp_info[mvd_info_types] = {
+	{AXE_INFO,"axe",IT_AXE,"axe"},
+	{SG_INFO,"sg",IT_SHOTGUN,"sg"},
+	{SSG_INFO,"ssg",IT_SUPER_SHOTGUN,"&cf0fssg&r"},
+	{NG_INFO,"ng",IT_NAILGUN,"&cf0fng&r"},
+	{SNG_INFO,"sng",IT_SUPER_NAILGUN,"&cf0fsng&r"},
+	{GL_INFO,"gl",IT_GRENADE_LAUNCHER,"&cf0fgl&r"},
+	{RL_INFO,"rl",IT_ROCKET_LAUNCHER,"&cf0frl&r"},
+	{LG_INFO,"lg",IT_LIGHTNING,"&cf0flg&r"},
+	{RING_INFO,"ring",IT_INVISIBILITY,"&cff0ring&r"},
+	{QUAD_INFO,"quad",IT_QUAD,"&c00fquad&r"},
+	{PENT_INFO,"pent",IT_INVULNERABILITY,"&cf00pent&r"},
+	{GA_INFO,"ga",IT_ARMOR1,"&c0f0ga&r"},
+	{YA_INFO,"ya",IT_ARMOR2,"&cff0ya&r"},
+	{RA_INFO,"ra",IT_ARMOR3,"&cf00ra&r"},
+	{MH_INFO,"mh",IT_SUPERHEALTH,"&c00fmh&r"},
+};
+
+/*
+===============================================================================
+
+STATS GATHERING
+
+===============================================================================
+*/
+
+int MVD_Weapon_LWF (int i)
+{
+	switch (i)
+	{
+		case IT_AXE: return AXE_INFO;
+		case IT_SHOTGUN: return SG_INFO;
+		case IT_SUPER_SHOTGUN: return SSG_INFO;
+		case IT_NAILGUN: return NG_INFO;
+		case IT_SUPER_NAILGUN: return SNG_INFO;
+		case IT_GRENADE_LAUNCHER: return GL_INFO;
+		case IT_ROCKET_LAUNCHER: return RL_INFO;
+		case IT_LIGHTNING: return LG_INFO;
+		default: return 666;
+	}
+}
+
+// hits per attack in percent
+float MVD_Weapon_Accuracy (mvd_wpstats_t *ws)
+{
+	return ws->attacks ? 100.0f * ws->hits / ws->attacks : 0;
+}
+
+// the *_INFO of a weapon name of //wps, -1 for anything else
+int MVD_Weapon_Name (char *name)
+{
+	int x;
+
+	for (x = AXE_INFO; x <= LG_INFO; x++)
+	{
+		if (!strcmp (name, mvd_wp_info[x].name))
+			return x;
+	}
+	return -1;
+}
+
+// the runs arrays keep MVD_MAX_RUNS, the last one is reused once they are full
+static void MVD_NextRun (int *run)
+{
+	if (*run < MVD_MAX_RUNS - 1)
+		(*run)++;
+}
+
+static void MVD_Set_Armor_Stats (mvd_info_t *pi, int z)
+{
+	pi->itemstats[GA_INFO].has = pi->itemstats[YA_INFO].has = pi->itemstats[RA_INFO].has = 0;
+	pi->itemstats[z].has = 1;
+}
+
+static void MVD_Status_WP (mvd_gather_t *g, mvd_info_t *pi)
+{
+	int j, k;
+
+	for (k = j = SSG_INFO; j <= LG_INFO; j++, k = k * 2)
+	{
+		if (!pi->itemstats[j].has && g->stats[STAT_ITEMS] & k)
+		{
+			if (j >= GL_INFO && g->deathmatch == 1)
+				g->taken |= (1 << j);
+			pi->itemstats[j].has = 1;
+			pi->itemstats[j].count++;
+		}
+	}
+}
+
+static void MVD_Stats_Gather_AlivePlayer (mvd_gather_t *g, mvd_info_t *pi)
+{
+	mvd_pw_t *it;
+	int x, z, killdiff, ammo;
+
+	for (x = GA_INFO; x <= RA_INFO && g->deathmatch != 4; x++)
+	{
+		it = &pi->itemstats[x];
+		if (g->stats[STAT_ITEMS] & mvd_wp_info[x].it)
+		{
+			if (!it->has)
+			{
+				g->taken |= (1 << x);
+				MVD_Set_Armor_Stats (pi, x);
+				it->count++;
+				it->lost = g->stats[STAT_ARMOR];
+			}
+			if (it->lost < g->stats[STAT_ARMOR])
+			{
+				g->taken |= (1 << x);
+				it->count++;
+			}
+			it->lost = g->stats[STAT_ARMOR];
+		}
+	}
+
+	for (x = RING_INFO; x <= PENT_INFO && g->deathmatch != 4; x++)
+	{
+		it = &pi->itemstats[x];
+		if (!it->has && g->stats[STAT_ITEMS] & mvd_wp_info[x].it)
+		{
+			g->taken |= (1 << x);
+			it->has = 1;
+			it->starttime = g->time;
+			it->count++;
+		}
+		if (it->has && !(g->stats[STAT_ITEMS] & mvd_wp_info[x].it))
+		{
+			it->has = 0;
+			it->runs[it->run].starttime = it->starttime;
+			it->runs[it->run].time = g->time - it->starttime;
+			MVD_NextRun (&it->run);
+		}
+	}
+
+	it = &pi->itemstats[MH_INFO];
+	if (!it->has && g->stats[STAT_ITEMS] & IT_SUPERHEALTH)
+	{
+		it->mention = 1;
+		it->has = 1;
+		it->count++;
+	}
+	if (it->has && !(g->stats[STAT_ITEMS] & IT_SUPERHEALTH))
+		it->has = 0;
+
+	for (z = RING_INFO; z <= PENT_INFO; z++)
+	{
+		it = &pi->itemstats[z];
+		if (it->has == 1)
+		{
+			it->runs[it->run].starttime = it->starttime;
+			it->runs[it->run].time = g->time - it->starttime;
+		}
+	}
+
+	// kills go to the last weapon fired, or count as spawn frags
+	if (pi->lastfrags < g->frags)
+	{
+		killdiff = g->frags - pi->lastfrags;
+		if ((z = MVD_Weapon_LWF (pi->lfw)) <= LG_INFO)
+			pi->killstats.normal[z].kills += killdiff;
+		if (pi->lfw == -1)
+			pi->spawntelefrags += killdiff;
+		for (z = RING_INFO; z <= PENT_INFO; z++)
+		{
+			if (pi->itemstats[z].has)
+				pi->itemstats[z].runs[pi->itemstats[z].run].frags += killdiff;
+		}
+		pi->runs[pi->run].frags++;
+	}
+	else if (pi->lastfrags > g->frags)
+	{
+		killdiff = pi->lastfrags - g->frags;
+		if ((z = MVD_Weapon_LWF (pi->lfw)) <= LG_INFO)
+			pi->killstats.normal[z].teamkills += killdiff;
+		if (pi->lfw == -1)
+			pi->teamspawntelefrags += killdiff;
+		for (z = RING_INFO; z <= PENT_INFO; z++)
+		{
+			if (pi->itemstats[z].has)
+				pi->itemstats[z].runs[pi->itemstats[z].run].teamfrags += killdiff;
+		}
+		pi->runs[pi->run].teamfrags++;
+	}
+	pi->lastfrags = g->frags;
+
+	pi->runs[pi->run].time = g->time - pi->das.alivetimestart;
+
+	if (g->weaponframe > 0)
+		pi->lfw = g->stats[STAT_ACTIVEWEAPON];
+	if (g->deathmatch != 4)
+		MVD_Status_WP (g, pi);
+
+	for (x = 0; x < AMMO_TYPES; x++)
+	{
+		ammo = g->stats[STAT_SHELLS + x];
+		if (pi->initialized && ammo > pi->ammostats[x])
+			g->ammotaken[x] = ammo - pi->ammostats[x];
+		pi->ammostats[x] = ammo;
+	}
+}
+
+/*
+==================
+MVD_Stats_Gather_Player
+
+Moves the stats of one player on to g->time, from what g has of the
+player now.  Fills in g->taken and g->ammotaken with what was picked up.
+Callers set pi->initialized once they are done with those.
+==================
+*/
+void MVD_Stats_Gather_Player (mvd_gather_t *g, mvd_info_t *pi)
+{
+	int x;
+
+	g->taken = 0;
+	memset (g->ammotaken, 0, sizeof(g->ammotaken));
+
+	if (!pi->firstrun)
+	{
+		pi->das.alivetimestart = g->time;
+		pi->firstrun = 1;
+		pi->lfw = -1;
+	}
+
+	// death alive stats
+	if (g->stats[STAT_HEALTH] > 0 && pi->das.isdead == 1)
+	{
+		pi->das.isdead = 0;
+		pi->das.alivetimestart = g->time;
+		pi->lfw = -1;
+	}
+
+	pi->das.alivetime = g->time - pi->das.alivetimestart;
+	if (g->stats[STAT_HEALTH] <= 0 && pi->das.isdead != 1)
+	{
+		pi->das.isdead = 1;
+		pi->das.deathcount++;
+		MVD_NextRun (&pi->run);
+
+		for (x = 0; x < 13; x++)
+		{
+			if (x == MVD_Weapon_LWF (pi->lfw))
+			{
+				pi->itemstats[x].mention = -1;
+				pi->itemstats[x].lost++;
+			}
+
+			if (x == QUAD_INFO && pi->itemstats[QUAD_INFO].has)
+			{
+				MVD_NextRun (&pi->itemstats[x].run);
+				pi->itemstats[x].lost++;
+			}
+			pi->itemstats[x].has = 0;
+		}
+		pi->lfw = -1;
+	}
+
+	if (!pi->das.isdead)
+		MVD_Stats_Gather_AlivePlayer (g, pi);
+}
+
+/*
+===============================================================================
+
+XML STATS
+
+The layout of mvd_dumpstats, mvdanalyze writes the same.
+
+===============================================================================
+*/
+
+// the name as character codes, mvd_name_to_xml
+static void MVD_XML_Chars (FILE *f, char *s)
+{
+	fprintf (f, "\n");
+	for (; *s; s++)
+		fprintf (f, "\t\t\t<char>%i</char>\n", (byte) *s);
+}
+
+static void MVD_XML_String (FILE *f, char *s)
+{
+	for (; *s; s++)
+	{
+		switch (*s)
+		{
+			case '&': fputs ("&amp;", f); break;
+			case '<': fputs ("&lt;", f); break;
+			case '>': fputs ("&gt;", f); break;
+			default: fputc (*s, f);
+		}
+	}
+}
+
+static qbool MVD_XML_TeamGame (mvd_cg_info_s *cg)
+{
+	return cg->gametype != 0 && cg->gametype != 4;
+}
+
+static void MVD_XML_Runs (FILE *f, mvd_runs_t *runs, int count)
+{
+	int x;
+
+	for (x = 0; x < count; x++)
+	{
+		fprintf (f, "\t\t<run id=\"%i\">\n", x);
+		fprintf (f, "\t\t\t<time>%9.3f</time>\n", runs[x].time);
+		fprintf (f, "\t\t\t<frags>%i</frags>\n", runs[x].frags);
+		fprintf (f, "\t\t\t<teamfrags>%i</teamfrags>\n", runs[x].teamfrags);
+		fprintf (f, "\t\t</run>\n");
+	}
+}
+
+// the accuracy of the weapons fired, when the demo has //wps
+static void MVD_XML_Weapons (FILE *f, mvd_info_t *pi)
+{
+	mvd_wpstats_t *ws;
+	int x;
+
+	for (x = AXE_INFO; x <= LG_INFO && !pi->wpstats[x].attacks; x++)
+		;
+	if (x > LG_INFO)
+		return;
+
+	fprintf (f, "\t\t<weapons>\n");
+	for (x = AXE_INFO; x <= LG_INFO; x++)
+	{
+		ws = &pi->wpstats[x];
+		if (!ws->attacks)
+			continue;
+		fprintf (f, "\t\t\t<%s>\n", mvd_wp_info[x].name);
+		fprintf (f, "\t\t\t\t<attacks>%i</attacks>\n", ws->attacks);
+		fprintf (f, "\t\t\t\t<hits>%i</hits>\n", ws->hits);
+		fprintf (f, "\t\t\t\t<accuracy>%.1f</accuracy>\n", MVD_Weapon_Accuracy (ws));
+		fprintf (f, "\t\t\t</%s>\n", mvd_wp_info[x].name);
+	}
+	fprintf (f, "\t\t</weapons>\n");
+}
+
+static void MVD_XML_Player (FILE *f, mvd_cg_info_s *cg, mvd_xmlplayer_t *p, int k)
+{
+	mvd_info_t *pi = p->info;
+	int x, y, z;
+
+	fprintf (f, "\t<player id=\"%i\">\n", k);
+	fprintf (f, "\t\t<nick>");
+	MVD_XML_Chars (f, p->name);
+	fprintf (f, "\t\t</nick>\n");
+	if (MVD_XML_TeamGame (cg))
+	{
+		fprintf (f, "\t\t<team>");
+		MVD_XML_Chars (f, p->team);
+		fprintf (f, "</team>\n");
+	}
+
+	fprintf (f, "\t\t<kills>\n");
+	for (z = 0, x = AXE_INFO; x <= LG_INFO; x++)
+	{
+		fprintf (f, "\t\t\t<%s>%i</%s>\n", mvd_wp_info[x].name, pi->killstats.normal[x].kills, mvd_wp_info[x].name);
+		z += pi->killstats.normal[x].kills;
+	}
+	fprintf (f, "\t\t\t<spawn>%i</spawn>\n", pi->spawntelefrags);
+	fprintf (f, "\t\t\t<all>%i</all>\n", z + pi->spawntelefrags);
+	fprintf (f, "\t\t</kills>\n");
+
+	fprintf (f, "\t\t<teamkills>\n");
+	for (z = 0, x = AXE_INFO; x <= LG_INFO; x++)
+	{
+		fprintf (f, "\t\t\t<%s>%i</%s>\n", mvd_wp_info[x].name, pi->killstats.normal[x].teamkills, mvd_wp_info[x].name);
+		z += pi->killstats.normal[x].teamkills;
+	}
+	fprintf (f, "\t\t\t<spawn>%i</spawn>\n", pi->teamspawntelefrags);
+	fprintf (f, "\t\t\t<all>%i</all>\n", z + pi->teamspawntelefrags);
+	fprintf (f, "\t\t</teamkills>\n");
+
+	fprintf (f, "\t\t<deaths>%i</deaths>\n", pi->das.deathcount);
+
+	fprintf (f, "\t\t<took>\n");
+	for (x = SSG_INFO; x <= MH_INFO; x++)
+		fprintf (f, "\t\t\t<%s>%i</%s>\n", mvd_wp_info[x].name, pi->itemstats[x].count, mvd_wp_info[x].name);
+	fprintf (f, "\t\t</took>\n");
+	fprintf (f, "\t\t<lost>\n");
+	for (x = SSG_INFO; x <= MH_INFO; x++)
+		fprintf (f, "\t\t\t<%s>%i</%s>\n", mvd_wp_info[x].name, pi->itemstats[x].lost, mvd_wp_info[x].name);
+	fprintf (f, "\t\t</lost>\n");
+
+	MVD_XML_Weapons (f, pi);
+
+	fprintf (f, "\t<runs>\n");
+	MVD_XML_Runs (f, pi->runs, pi->run);
+	fprintf (f, "\t</runs>\n");
+
+	for (y = RING_INFO; y <= PENT_INFO; y++)
+	{
+		if (!pi->itemstats[y].run)
+			continue;
+		fprintf (f, "\t<%s_runs>\n", mvd_wp_info[y].name);
+		MVD_XML_Runs (f, pi->itemstats[y].runs, pi->itemstats[y].run);
+		fprintf (f, "\t</%s_runs>\n", mvd_wp_info[y].name);
+	}
+
+	fprintf (f, "\t</player>\n\n");
+}
+
+// the players of one team and what all of them took, lost and killed
+static void MVD_XML_Team (FILE *f, mvd_cg_info_s *cg, char *tag, char *team, mvd_xmlplayer_t *players, int count)
+{
+	int n, x, z, sum;
+
+	fprintf (f, "\t\t<%s>\n", tag);
+	fprintf (f, "\t\t\t<name>");
+	MVD_XML_Chars (f, team);
+	fprintf (f, "</name>\n");
+
+	fprintf (f, "\t\t\t<players>\n");
+	for (n = 0, z = 0; n < count; n++)
+	{
+		if (!strcmp (players[n].team, team))
+			MVD_XML_Player (f, cg, &players[n], z++);
+	}
+	fprintf (f, "\t\t\t</players>\n");
+
+	for (x = 0; x < 3; x++)
+	{
+		fprintf (f, "\t\t<%s>\n", x == 0 ? "took" : x == 1 ? "lost" : "kills");
+		for (z = (x == 2 ? AXE_INFO : SSG_INFO); z <= (x == 0 ? MH_INFO : x == 1 ? QUAD_INFO : LG_INFO); z++)
+		{
+			for (sum = 0, n = 0; n < count; n++)
+			{
+				if (strcmp (players[n].team, team))
+					continue;
+				sum += x == 0 ? players[n].info->itemstats[z].count : x == 1 ? players[n].info->itemstats[z].lost
+					: players[n].info->killstats.normal[z].kills;
+			}
+			fprintf (f, "\t\t\t<%s>%i</%s>\n", mvd_wp_info[z].name, sum, mvd_wp_info[z].name);
+		}
+		fprintf (f, "\t\t</%s>\n", x == 0 ? "took" : x == 1 ? "lost" : "kills");
+	}
+
+	fprintf (f, "\t\t</%s>\n", tag);
+}
+
+/*
+==================
+MVD_XMLStats_Write
+
+Writes the stats of the game in cg and of the players to f
+==================
+*/
+void MVD_XMLStats_Write (FILE *f, mvd_cg_info_s *cg, mvd_xmlplayer_t *players, int count)
+{
+	int n;
+
+	fprintf (f, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+	fprintf (f, "<?xml-stylesheet type=\"text/xsl\" href=\"mvdstats.xsl\"?>\n");
+	fprintf (f, "<mvdstats>\n\n\n");
+	fprintf (f, "<demoinfos>\n");
+	fprintf (f, "\t\t<map>");
+	MVD_XML_String (f, cg->mapname);
+	fprintf (f, "</map>\n");
+	fprintf (f, "\t\t<gametype>%s</gametype>\n", mvd_gt_info[cg->gametype].name);
+	fprintf (f, "\t\t<hostname>");
+	MVD_XML_String (f, cg->hostname);
+	fprintf (f, "</hostname>\n");
+	if (MVD_XML_TeamGame (cg))
+	{
+		fprintf (f, "\t\t<team1>");
+		MVD_XML_Chars (f, cg->team1);
+		fprintf (f, "</team1>\n");
+		fprintf (f, "\t\t<team2>");
+		MVD_XML_Chars (f, cg->team2);
+		fprintf (f, "</team2>\n");
+	}
+	fprintf (f, "\t\t<timelimit>%i</timelimit>\n", cg->timelimit);
+	fprintf (f, "</demoinfos>\n");
+
+	if (MVD_XML_TeamGame (cg))
+	{
+		fprintf (f, "<Teamstats>\n");
+		MVD_XML_Team (f, cg, "team1", cg->team1, players, count);
+		MVD_XML_Team (f, cg, "team2", cg->team2, players, count);
+		fprintf (f, "</Teamstats>\n");
+	}
+	else
+	{
+		for (n = 0; n < count; n++)
+			MVD_XML_Player (f, cg, &players[n], n);
+	}
+
+	fprintf (f, "</mvdstats>\n");
+}
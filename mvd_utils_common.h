@@ -43,6 +43,8 @@ $Id: mvd_utils_common.h,v 1.2 2007-09-24 21:34:51 johnnycz Exp $
 
 #define AMMO_TYPES 4
 
+#define MVD_MAX_RUNS 512
+
 // killstats structures
 typedef struct mvd_ks_w_s {
 	int kills;
@@ -102,17 +104,23 @@ typedef struct mvd_pw_s {
 	int count ;
 	int lost ;
 	int mention;
-	mvd_runs_t runs[512];
+	mvd_runs_t runs[MVD_MAX_RUNS];
 	int run;
 } mvd_pw_t;
 
+// weapon accuracy from the //wps of KTX, sg and ssg count bullets
+typedef struct mvd_wpstats_s {
+	int attacks;
+	int hits;
+} mvd_wpstats_t;
+
 typedef struct mvd_info_s {
     float value;
     int lfw;				//last fired weapon
 	mvd_ds_t das;			//dead alive stats
 	mvd_pw_t itemstats[mvd_info_types];		//item stats
 	unsigned short ammostats[AMMO_TYPES];
-	mvd_runs_t runs[512];	//
+	mvd_runs_t runs[MVD_MAX_RUNS];	//
 	mvd_avgruns_all_t run_stats;	// calculated from other items
 	mvd_ks_t killstats;		// killstats
 	int spawntelefrags;
@@ -121,6 +129,7 @@ typedef struct mvd_info_s {
 	int lastfrags;
 	int run;
 	int firstrun;
+	mvd_wpstats_t wpstats[LG_INFO + 1];	// axe - lg
 	qbool initialized;
 } mvd_info_t;
 
@@ -189,6 +198,31 @@ typedef struct mvd_wp_info_s {
 
 extern mvd_wp_info_t mvd_wp_info[mvd_info_types];
 
+// what the stats of one player are gathered from
+typedef struct mvd_gather_s {
+	int		*stats;					// STAT_*
+	int		frags;
+	int		weaponframe;
+	int		deathmatch;
+	double	time;
+	int		taken;					// set to the items picked up, 1 << *_INFO
+	int		ammotaken[AMMO_TYPES];	// and the ammo
+} mvd_gather_t;
+
+// a player of the xml stats
+typedef struct mvd_xmlplayer_s {
+	char		*name;
+	char		*team;
+	mvd_info_t	*info;
+} mvd_xmlplayer_t;
+
+// mvd_utils_common, also linked into mvdanalyze:
+int MVD_Weapon_LWF(int i);
+int MVD_Weapon_Name(char *name);
+float MVD_Weapon_Accuracy(mvd_wpstats_t *ws);
+void MVD_Stats_Gather_Player(mvd_gather_t *g, mvd_info_t *pi);
+void MVD_XMLStats_Write(FILE *f, mvd_cg_info_s *cg, mvd_xmlplayer_t *players, int count);
+
 // mvd_autotrack:
 void MVD_AutoTrack(void);
 void MVD_AutoTrack_Init(void);
@@ -0,0 +1,1513 @@
+/*
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the included (GNU.txt) GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+// mvdanalyze.c - match stats of many demos at once, without the client
+
+/*
+mvdanalyze [-j threads] [-json] [-n] [-o dir] <demo> ...
+
+A standalone program (make mvdanalyze) that reads .mvd and .qwd demos,
+gzipped ones as well, with nothing of the client: no renderer, no sound,
+no cl state.  Each demo is parsed from memory by one of the worker threads
+(one per CPU by default), which takes the next demo off the list when it
+is done, so a directory of thousands is as fast as the disk allows.
+
+The parser only knows how long every server message is, and keeps what
+the stats need: serverinfo, userinfo, frags, the stats from dem_stats and
+the weapon frames from svc_playerinfo.  Like the client with no player
+tracked it leaves out what was sent to single players, but the //wps
+weapon stats of KTX in there are read, for the accuracy of every player.
+
+Whenever the demo time moves on the stats are gathered into the same
+mvd_info_t as in the client, by MVD_Stats_Gather_Player, and at the end of
+the demo they are written to <dir>/<demo>.xml by MVD_XMLStats_Write, the
+writer of mvd_dumpstats, or to <demo>.json with -json.  Both are in
+mvd_utils_common.c, which the client links as well.  Unlike in the client
+the stats stay with the player slot when someone joins or leaves, and
+the accuracy is there for every player, not only the tracked one.
+
+A .qwd only has the stats of whoever recorded it, so only that player is
+gathered and written.  A new map in the demo starts the stats over, as it
+does in the client.
+
+-n parses without writing anything, to time the parser.  Prints a line for
+every demo and the demos per second at the end, exits with 1 if any demo
+couldn't be read.
+*/
+
+#include <pthread.h>
+#include <setjmp.h>
+#include <unistd.h>
+#ifdef WITH_ZLIB
+#include <zlib.h>
+#endif
+
+#include "quakedef.h"
+#include "mvd_utils_common.h"
+
+#define MA_DLBLOCKSIZE	1024	// chunked downloads, as in cl_parse.c
+
+typedef struct
+{
+	char			userinfo[MAX_INFO_STRING];
+	char			name[MAX_SCOREBOARDNAME];
+	char			team[MAX_INFO_STRING];
+	qbool			spectator;
+	int				frags;
+	int				stats[MAX_CL_STATS];
+	int				weaponframe;
+} ma_player_t;
+
+typedef struct
+{
+	char			*path;
+	byte			*buf;
+	int				buflen;
+	int				pos;
+	qbool			mvd;
+	qbool			finished;		// svc_disconnect in a qwd
+	double			demotime;
+	int				frames;
+
+	// the message being parsed
+	byte			*msg;
+	int				msgsize;
+	int				readcount;
+	qbool			badread;
+	char			string[2048];
+
+	jmp_buf			abort;
+	char			error[256];
+
+	int				protoversion;
+	int				fteext, fteext2;
+	int				coordsize, anglesize;
+	int				playernum;
+	int				lastto, lasttype;
+	qbool			single;			// the message went to single players
+	char			serverinfo[MAX_SERVERINFO_STRING];
+	char			mapname[MAX_QPATH];
+	int				nummodels;
+	qbool			standby, countdown, was_standby;
+	int				deathmatch, timelimit;
+
+	ma_player_t		players[MAX_CLIENTS];
+
+	// mvd_new_info and mvd_cg_info, but by player slot
+	mvd_info_t		info[MAX_CLIENTS];
+	int				ids[MAX_CLIENTS];
+	mvd_cg_info_s	cg;
+} ma_demo_t;
+
+typedef struct
+{
+	qbool			ok;
+	double			size;		// uncompressed
+	double			time;		// parsing
+} ma_result_t;
+
+static char				**ma_demos;
+static ma_result_t		*ma_results;
+static int				ma_numdemos;
+static int				ma_nextdemo;
+static pthread_mutex_t	ma_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static qbool			ma_json;
+static qbool			ma_nooutput;
+static char				*ma_outdir = ".";
+
+void Sys_Error (char *error, ...)
+{
+	va_list argptr;
+
+	va_start (argptr, error);
+	vfprintf (stderr, error, argptr);
+	va_end (argptr);
+	fputc ('\n', stderr);
+	exit (2);
+}
+
+void Sys_Printf (char *fmt, ...)
+{
+	va_list argptr;
+
+	va_start (argptr, fmt);
+	vprintf (fmt, argptr);
+	va_end (argptr);
+}
+
+static double MA_Time (void)
+{
+	struct timespec t;
+
+	clock_gettime (CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// gives up on the demo, nothing else
+static void MA_Error (ma_demo_t *d, char *error, ...)
+{
+	va_list argptr;
+
+	va_start (argptr, error);
+	vsnprintf (d->error, sizeof(d->error), error, argptr);
+	va_end (argptr);
+	longjmp (d->abort, 1);
+}
+
+// COM_SkipPath and COM_StripExtension, without the rest of common.c
+static char *MA_SkipPath (char *path)
+{
+	char *s = strrchr (path, '/');
+
+	return s ? s + 1 : path;
+}
+
+static void MA_StripExtension (char *name)
+{
+	char *s = strrchr (name, '.');
+
+	if (s)
+		*s = 0;
+}
+
+/*
+===============================================================================
+
+MESSAGE READING
+
+The MSG_Read functions of the engine work on net_message, these read the
+message of one demo so the workers don't get in each other's way.
+
+===============================================================================
+*/
+
+static int MA_ReadByte (ma_demo_t *d)
+{
+	if (d->readcount + 1 > d->msgsize)
+	{
+		d->badread = true;
+		return -1;
+	}
+	return d->msg[d->readcount++];
+}
+
+static int MA_ReadShort (ma_demo_t *d)
+{
+	byte *p = d->msg + d->readcount;
+
+	if (d->readcount + 2 > d->msgsize)
+	{
+		d->badread = true;
+		return -1;
+	}
+	d->readcount += 2;
+	return (short) (p[0] | (p[1] << 8));
+}
+
+static int MA_ReadLong (ma_demo_t *d)
+{
+	byte *p = d->msg + d->readcount;
+
+	if (d->readcount + 4 > d->msgsize)
+	{
+		d->badread = true;
+		return -1;
+	}
+	d->readcount += 4;
+	return (int) (p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int) p[3] << 24));
+}
+
+static float MA_ReadFloat (ma_demo_t *d)
+{
+	union
+	{
+		int		l;
+		float	f;
+	} dat;
+
+	dat.l = MA_ReadLong (d);
+	return d->badread ? -1 : dat.f;
+}
+
+static char *MA_ReadString (ma_demo_t *d)
+{
+	int c, l = 0;
+
+	while ((c = MA_ReadByte (d)) > 0 && l < sizeof(d->string) - 1)
+		d->string[l++] = c;
+	d->string[l] = 0;
+	return d->string;
+}
+
+static void MA_Skip (ma_demo_t *d, int len)
+{
+	if (d->readcount + len > d->msgsize)
+	{
+		d->badread = true;
+		d->readcount = d->msgsize;
+		return;
+	}
+	d->readcount += len;
+}
+
+/*
+===============================================================================
+
+INFO STRINGS
+
+Info_ValueForKey returns a static buffer, so these are our own.
+
+===============================================================================
+*/
+
+static void MA_InfoValue (char *s, char *key, char *value, int size)
+{
+	char *k;
+	int len;
+
+	value[0] = 0;
+
+	while (*s == '\\')
+	{
+		k = ++s;
+		while (*s && *s != '\\')
+			s++;
+		if (!*s)
+			return;
+		len = s++ - k;
+
+		for (k = strncmp (k, key, len) || key[len] ? NULL : value; *s && *s != '\\'; s++)
+		{
+			if (k && k - value < size - 1)
+				*k++ = *s;
+		}
+
+		if (k)
+		{
+			*k = 0;
+			return;
+		}
+	}
+}
+
+// sets key to value, or removes it with an empty value
+static void MA_InfoSet (char *s, int size, char *key, char *value)
+{
+	char out[MAX_INFO_STRING], *p, *k;
+	int len, outlen = 0;
+
+	for (p = s; *p == '\\'; )
+	{
+		k = p++;
+		while (*p && *p != '\\')
+			p++;
+		if (!*p)
+			break;
+		len = p - k - 1;
+		for (p++; *p && *p != '\\'; p++)
+			;
+
+		if ((strncmp (k + 1, key, len) || key[len]) && outlen + (p - k) < sizeof(out))
+		{
+			memcpy (out + outlen, k, p - k);
+			outlen += p - k;
+		}
+	}
+	out[outlen] = 0;
+
+	if (value[0] && outlen + strlen (key) + strlen (value) + 2 < sizeof(out))
+		snprintf (out + outlen, sizeof(out) - outlen, "\\%s\\%s", key, value);
+
+	strlcpy (s, out, size);
+}
+
+/*
+===============================================================================
+
+STATS
+
+What MVD_Init_Info and MVD_Stats_Gather in mvd_utils.c do, less the clocks,
+the autotrack and the powerup cams.  The gathering itself is shared.
+
+===============================================================================
+*/
+
+// a .qwd only has the stats of the player who recorded it
+static qbool MA_Counted (ma_demo_t *d, int slot)
+{
+	return d->mvd || slot == d->playernum;
+}
+
+static void MA_InitInfo (ma_demo_t *d, int player_slot)
+{
+	char hostname[sizeof(d->cg.hostname)], dm[16];
+	int i, z;
+
+	for (z = 0, i = 0; i < MAX_CLIENTS; i++)
+	{
+		if (!d->players[i].name[0] || d->players[i].spectator)
+			continue;
+		d->ids[z++] = i;
+		if (player_slot == i || player_slot == MAX_CLIENTS)
+			d->info[i].initialized = false;
+	}
+
+	strlcpy (d->cg.mapname, d->mapname, sizeof(d->cg.mapname));
+	d->cg.timelimit = d->timelimit;
+
+	strlcpy (d->cg.team1, z ? d->players[d->ids[0]].team : "", sizeof(d->cg.team1));
+	d->cg.team2[0] = 0;
+	for (i = 0; i < z; i++)
+	{
+		if (strcmp (d->players[d->ids[i]].team, d->cg.team1))
+		{
+			strlcpy (d->cg.team2, d->players[d->ids[i]].team, sizeof(d->cg.team2));
+			break;
+		}
+	}
+
+	if (z == 2)
+		d->cg.gametype = 0;
+	else if (z == 4)
+		d->cg.gametype = 1;
+	else if (z == 6)
+		d->cg.gametype = 2;
+	else if (z == 8)
+		d->cg.gametype = 3;
+	else
+		d->cg.gametype = 4;
+
+	MA_InfoValue (d->serverinfo, "hostname", hostname, sizeof(hostname));
+	strlcpy (d->cg.hostname, hostname, sizeof(d->cg.hostname));
+	MA_InfoValue (d->serverinfo, "deathmatch", dm, sizeof(dm));
+	d->cg.deathmatch = atoi (dm);
+
+	d->cg.pcount = z;
+}
+
+static void MA_Gather (ma_demo_t *d)
+{
+	mvd_gather_t g;
+	int i, n;
+
+	if (d->countdown || d->standby)
+		return;
+
+	g.deathmatch = d->cg.deathmatch;
+	g.time = d->demotime;
+	for (n = 0; n < d->cg.pcount; n++)
+	{
+		if (!MA_Counted (d, (i = d->ids[n])))
+			continue;
+		g.stats = d->players[i].stats;
+		g.frags = d->players[i].frags;
+		g.weaponframe = d->players[i].weaponframe;
+		MVD_Stats_Gather_Player (&g, &d->info[i]);
+		d->info[i].initialized = true;
+	}
+}
+
+// MVD_Mainhook, once every time the demo time moves on
+static void MA_Frame (ma_demo_t *d)
+{
+	if (d->was_standby && !d->standby)
+	{
+		d->was_standby = false;
+		MA_InitInfo (d, MAX_CLIENTS);
+	}
+	else
+		d->was_standby = d->standby;
+
+	MA_Gather (d);
+	d->frames++;
+}
+
+/*
+===============================================================================
+
+PARSING
+
+Follows CL_ParseServerMessage and what it calls, reading only what the
+stats need and skipping over the rest.
+
+===============================================================================
+*/
+
+static void MA_NewMap (ma_demo_t *d)
+{
+	memset (d->players, 0, sizeof(d->players));
+	memset (d->info, 0, sizeof(d->info));
+	memset (&d->cg, 0, sizeof(d->cg));
+	d->serverinfo[0] = 0;
+	d->mapname[0] = 0;
+	d->standby = d->countdown = false;
+	d->was_standby = true;
+	d->deathmatch = d->timelimit = 0;
+}
+
+static void MA_ServerInfoChanged (ma_demo_t *d)
+{
+	char value[64];
+
+	MA_InfoValue (d->serverinfo, "status", value, sizeof(value));
+	d->standby = !strcasecmp (value, "standby");
+	d->countdown = !strcasecmp (value, "countdown");
+
+	MA_InfoValue (d->serverinfo, "deathmatch", value, sizeof(value));
+	d->deathmatch = atoi (value);
+	MA_InfoValue (d->serverinfo, "timelimit", value, sizeof(value));
+	d->timelimit = atoi (value);
+}
+
+// CL_ProcessUserInfo
+static void MA_UserInfoChanged (ma_demo_t *d, ma_player_t *p)
+{
+	char spec[16];
+
+	MA_InfoValue (p->userinfo, "name", p->name, sizeof(p->name));
+	MA_InfoValue (p->userinfo, "team", p->team, sizeof(p->team));
+	MA_InfoValue (p->userinfo, "*spectator", spec, sizeof(spec));
+	p->spectator = spec[0] != 0;
+}
+
+static ma_player_t *MA_Player (ma_demo_t *d, int slot, char *what)
+{
+	if (slot < 0 || slot >= MAX_CLIENTS)
+		MA_Error (d, "%s for player %i", what, slot);
+	return &d->players[slot];
+}
+
+static void MA_ParseServerData (ma_demo_t *d)
+{
+	int protover;
+
+	MA_NewMap (d);
+	d->fteext = d->fteext2 = 0;
+
+	while (1)
+	{
+		protover = MA_ReadLong (d);
+		if (d->badread)
+			MA_Error (d, "svc_serverdata cut off");
+		if (protover == PROTOCOL_VERSION_FTE)
+			d->fteext = MA_ReadLong (d);
+		else if (protover == PROTOCOL_VERSION_FTE2)
+			d->fteext2 = MA_ReadLong (d);
+		else if (protover == 26 || protover == 27 || protover == PROTOCOL_VERSION)
+			break;
+		else
+			MA_Error (d, "protocol version %i", protover);
+	}
+
+	d->protoversion = protover;
+	d->coordsize = (d->fteext & FTE_PEXT_FLOATCOORDS) ? 4 : 2;
+	d->anglesize = (d->fteext & FTE_PEXT_FLOATCOORDS) ? 2 : 1;
+
+	MA_ReadLong (d);		// servercount
+	MA_ReadString (d);		// gamedir
+
+	if (d->mvd)
+	{
+		MA_ReadFloat (d);	// demotime
+		d->playernum = MAX_CLIENTS - 1;
+	}
+	else
+		d->playernum = MA_ReadByte (d) & ~128;
+
+	MA_ReadString (d);		// level name
+	MA_Skip (d, 10 * 4);	// movevars
+}
+
+// CL_ParseDelta
+static void MA_ParseDelta (ma_demo_t *d, int bits)
+{
+	int morebits = 0;
+
+	bits &= ~511;
+	if (bits & U_MOREBITS)
+		bits |= MA_ReadByte (d);
+
+	if (bits & U_FTE_EVENMORE && d->fteext)
+	{
+		morebits = MA_ReadByte (d);
+		if (morebits & U_FTE_YETMORE)
+			morebits |= MA_ReadByte (d) << 8;
+	}
+
+	MA_Skip (d, !!(bits & U_MODEL) + !!(bits & U_FRAME) + !!(bits & U_COLORMAP)
+		+ !!(bits & U_SKIN) + !!(bits & U_EFFECTS));
+
+	MA_Skip (d, d->coordsize * (!!(bits & U_ORIGIN1) + !!(bits & U_ORIGIN2) + !!(bits & U_ORIGIN3))
+		+ d->anglesize * (!!(bits & U_ANGLE1) + !!(bits & U_ANGLE2) + !!(bits & U_ANGLE3)));
+
+	if (morebits & U_FTE_TRANS && d->fteext & FTE_PEXT_TRANS)
+		MA_ReadByte (d);
+}
+
+// CL_ParsePacketEntities
+static void MA_ParsePacketEntities (ma_demo_t *d, qbool delta)
+{
+	int word;
+
+	if (delta)
+		MA_ReadByte (d);
+
+	while (1)
+	{
+		word = (unsigned short) MA_ReadShort (d);
+		if (d->badread)
+			MA_Error (d, "bad packetentities");
+		if (!word)
+			break;
+
+		if (word & U_REMOVE)
+		{
+			if (word & U_MOREBITS && d->fteext & FTE_PEXT_ENTITYDBL)
+			{
+				if (MA_ReadByte (d) & U_FTE_EVENMORE)
+					MA_ReadByte (d);
+			}
+			continue;
+		}
+
+		MA_ParseDelta (d, word);
+	}
+}
+
+// MSG_ReadDeltaUsercmd
+static void MA_ParseDeltaUsercmd (ma_demo_t *d)
+{
+	int bits = MA_ReadByte (d);
+
+	if (d->protoversion == 26)
+	{
+		MA_Skip (d, 2 * (!!(bits & CM_ANGLE1) + 1 + !!(bits & CM_ANGLE3))
+			+ !!(bits & CM_FORWARD) + !!(bits & CM_SIDE) + !!(bits & CM_UP));
+	}
+	else
+	{
+		MA_Skip (d, 2 * (!!(bits & CM_ANGLE1) + !!(bits & CM_ANGLE2) + !!(bits & CM_ANGLE3)
+			+ !!(bits & CM_FORWARD) + !!(bits & CM_SIDE) + !!(bits & CM_UP)));
+	}
+
+	MA_Skip (d, !!(bits & CM_BUTTONS) + !!(bits & CM_IMPULSE));
+
+	// msec, protocol 26 only sends it with CM_ANGLE2
+	if (d->protoversion != 26 || (bits & CM_ANGLE2))
+		MA_ReadByte (d);
+}
+
+// CL_ParsePlayerinfo
+static void MA_ParsePlayerinfo (ma_demo_t *d)
+{
+	ma_player_t *p = MA_Player (d, MA_ReadByte (d), "svc_playerinfo");
+	int i, flags;
+
+	flags = MA_ReadShort (d);
+
+	if (d->mvd)
+	{
+		MA_ReadByte (d);	// frame
+
+		for (i = 0; i < 3; i++)
+		{
+			if (flags & (DF_ORIGIN << i))
+				MA_Skip (d, d->coordsize);
+		}
+		for (i = 0; i < 3; i++)
+		{
+			if (flags & (DF_ANGLES << i))
+				MA_Skip (d, 2);
+		}
+
+		MA_Skip (d, !!(flags & DF_MODEL) + !!(flags & DF_SKINNUM) + !!(flags & DF_EFFECTS));
+
+		// kept from the last update, like the rest of the state
+		if (flags & DF_WEAPONFRAME)
+			p->weaponframe = MA_ReadByte (d);
+		return;
+	}
+
+	MA_Skip (d, 3 * d->coordsize + 1);
+
+	if (flags & PF_MSEC)
+		MA_ReadByte (d);
+	if (flags & PF_COMMAND)
+		MA_ParseDeltaUsercmd (d);
+
+	for (i = 0; i < 3; i++)
+	{
+		if (flags & (PF_VELOCITY1 << i))
+			MA_Skip (d, 2);
+	}
+
+	MA_Skip (d, !!(flags & PF_MODEL) + !!(flags & PF_SKINNUM) + !!(flags & PF_EFFECTS));
+
+	p->weaponframe = (flags & PF_WEAPONFRAME) ? MA_ReadByte (d) : 0;
+
+	if (flags & PF_TRANS_Z && d->fteext & FTE_PEXT_TRANS)
+		MA_ReadByte (d);
+}
+
+// CL_ParseTEnt
+static void MA_ParseTEnt (ma_demo_t *d)
+{
+	int type = MA_ReadByte (d);
+
+	switch (type)
+	{
+		case TE_LIGHTNING1:
+		case TE_LIGHTNING2:
+		case TE_LIGHTNING3:
+			MA_Skip (d, 2 + 6 * d->coordsize);
+			break;
+
+		case TE_GUNSHOT:
+		case TE_BLOOD:
+			MA_Skip (d, 1 + 3 * d->coordsize);
+			break;
+
+		case TE_SPIKE:
+		case TE_SUPERSPIKE:
+		case TE_EXPLOSION:
+		case TE_TAREXPLOSION:
+		case TE_WIZSPIKE:
+		case TE_KNIGHTSPIKE:
+		case TE_LAVASPLASH:
+		case TE_TELEPORT:
+		case TE_LIGHTNINGBLOOD:
+			MA_Skip (d, 3 * d->coordsize);
+			break;
+
+		default:
+			if (!d->badread)
+				MA_Error (d, "bad temp entity %i", type);
+	}
+}
+
+static void MA_ParseModellist (ma_demo_t *d, qbool extended)
+{
+	char *str;
+
+	d->nummodels = extended ? (unsigned short) MA_ReadShort (d) : MA_ReadByte (d);
+
+	while (*(str = MA_ReadString (d)))
+	{
+		// the map is the first model
+		if (++d->nummodels == 1)
+		{
+			strlcpy (d->mapname, MA_SkipPath (str), sizeof(d->mapname));
+			MA_StripExtension (d->mapname);
+		}
+	}
+
+	MA_ReadByte (d);
+}
+
+// //wps <client> <weapon> <attacks> <hits> of KTX, Parse_WeaponStats
+static void MA_ParseWeaponStats (ma_demo_t *d, char *s)
+{
+	char weapon[16];
+	int client, x, attacks, hits;
+
+	if (sscanf (s, "//wps %i %15s %i %i", &client, weapon, &attacks, &hits) != 4)
+		return;
+	if (client < 0 || client >= MAX_CLIENTS || (x = MVD_Weapon_Name (weapon)) < 0)
+		return;
+
+	d->info[client].wpstats[x].attacks = attacks;
+	d->info[client].wpstats[x].hits = hits;
+}
+
+static void MA_ParseStufftext (ma_demo_t *d)
+{
+	char *s = MA_ReadString (d), *end;
+
+	if (!strncmp (s, "//wps ", 6))
+	{
+		MA_ParseWeaponStats (d, s);
+		return;
+	}
+
+	// the whole serverinfo, from the server or CL_WriteDemo... of the client
+	if (d->single || strncmp (s, "fullserverinfo ", 15))
+		return;
+
+	s += 15;
+	if (*s == '"')
+		s++;
+	for (end = s; *end && *end != '"' && *end != '\n'; end++)
+		;
+	*end = 0;
+
+	strlcpy (d->serverinfo, s, sizeof(d->serverinfo));
+	MA_ServerInfoChanged (d);
+}
+
+static void MA_ParseDownload (ma_demo_t *d)
+{
+	int size;
+
+	if (d->fteext & FTE_PEXT_CHUNKEDDOWNLOADS)
+	{
+		if (MA_ReadLong (d) < 0)
+		{
+			MA_ReadLong (d);
+			MA_ReadString (d);
+		}
+		else
+			MA_Skip (d, MA_DLBLOCKSIZE);
+		return;
+	}
+
+	size = MA_ReadShort (d);
+	MA_ReadByte (d);
+	if (size > 0)
+		MA_Skip (d, size);
+}
+
+static qbool MA_SharedState (int cmd)
+{
+	switch (cmd)
+	{
+		case svc_serverdata:
+		case svc_updatefrags:
+		case svc_updatestat:
+		case svc_updatestatlong:
+		case svc_updateuserinfo:
+		case svc_setinfo:
+		case svc_serverinfo:
+		case svc_playerinfo:
+		case svc_modellist:
+		case svc_fte_modellistshort:
+			return true;
+		default:
+			return false;
+	}
+}
+
+static void MA_ParseMessage (ma_demo_t *d)
+{
+	ma_player_t *p;
+	char key[MAX_INFO_STRING], *s;
+	int cmd, i, j;
+
+	while (1)
+	{
+		if (d->badread && !d->single)
+			MA_Error (d, "bad server message");
+
+		if ((cmd = MA_ReadByte (d)) == -1)
+			break;
+
+		// the rest of a message to single players would change what everyone
+		// sees, and one the client never reads doesn't fail the demo
+		if (d->single && (d->badread || MA_SharedState (cmd)))
+			break;
+
+		switch (cmd)
+		{
+			default:
+				if (d->single)
+					return;
+				MA_Error (d, "illegible server message %i", cmd);
+				break;
+
+			case svc_nop:
+			case svc_killedmonster:
+			case svc_foundsecret:
+			case svc_sellscreen:
+			case svc_smallkick:
+			case svc_bigkick:
+				break;
+
+			case svc_disconnect:
+				// there can be another map after it in an mvd
+				if (d->mvd)
+					MA_ReadString (d);
+				else
+					d->finished = true;
+				break;
+
+			case nq_svc_time:
+			case svc_maxspeed:
+			case svc_entgravity:
+				MA_ReadFloat (d);
+				break;
+
+			case svc_print:
+				MA_ReadByte (d);
+				MA_ReadString (d);
+				break;
+
+			case svc_centerprint:
+			case svc_finale:
+				MA_ReadString (d);
+				break;
+
+			case svc_stufftext:
+				MA_ParseStufftext (d);
+				break;
+
+			case svc_damage:
+				MA_Skip (d, 2 + 3 * d->coordsize);
+				break;
+
+			case svc_serverdata:
+				MA_ParseServerData (d);
+				break;
+
+			case svc_setangle:
+				MA_Skip (d, (d->mvd ? 1 : 0) + 3 * d->anglesize);
+				break;
+
+			case svc_lightstyle:
+				MA_ReadByte (d);
+				MA_ReadString (d);
+				break;
+
+			case svc_sound:
+				i = MA_ReadShort (d);
+				MA_Skip (d, !!(i & SND_VOLUME) + !!(i & SND_ATTENUATION) + 1 + 3 * d->coordsize);
+				break;
+
+			case svc_stopsound:
+			case svc_muzzleflash:
+				MA_ReadShort (d);
+				break;
+
+			case svc_fte_voicechat:
+				MA_Skip (d, 3);
+				MA_Skip (d, MA_ReadShort (d));
+				break;
+
+			case svc_updatefrags:
+				p = MA_Player (d, MA_ReadByte (d), "svc_updatefrags");
+				p->frags = MA_ReadShort (d);
+				break;
+
+			case svc_updateping:
+				MA_Skip (d, 3);
+				break;
+
+			case svc_updatepl:
+				MA_Skip (d, 2);
+				break;
+
+			case svc_updatestat:
+			case svc_updatestatlong:
+				i = MA_ReadByte (d);
+				j = cmd == svc_updatestat ? MA_ReadByte (d) : MA_ReadLong (d);
+				if (i < 0 || i >= MAX_CL_STATS)
+					MA_Error (d, "stat %i is invalid", i);
+
+				// CL_SetStat, the player of the dem_stats block in an mvd
+				p = MA_Player (d, d->mvd ? d->lastto : d->playernum, "stat");
+				p->stats[i] = j;
+				break;
+
+			case svc_updateentertime:
+				MA_Skip (d, 5);
+				break;
+
+			case svc_spawnbaseline:
+				MA_Skip (d, 2 + 4 + 3 * (d->coordsize + d->anglesize));
+				break;
+
+			case svc_spawnstatic:
+				MA_Skip (d, 4 + 3 * (d->coordsize + d->anglesize));
+				break;
+
+			case svc_fte_spawnstatic2:
+				if (!(d->fteext & FTE_PEXT_SPAWNSTATIC2))
+					MA_Error (d, "svc_fte_spawnstatic2 without FTE_PEXT_SPAWNSTATIC2");
+				// fall through
+			case svc_fte_spawnbaseline2:
+				MA_ParseDelta (d, MA_ReadShort (d));
+				break;
+
+			case svc_temp_entity:
+				MA_ParseTEnt (d);
+				break;
+
+			case svc_spawnstaticsound:
+				MA_Skip (d, 3 * d->coordsize + 3);
+				break;
+
+			case svc_cdtrack:
+			case svc_setpause:
+			case svc_chokecount:
+				MA_ReadByte (d);
+				break;
+
+			case svc_intermission:
+				MA_Skip (d, 3 * d->coordsize + 3 * d->anglesize);
+				break;
+
+			case svc_updateuserinfo:
+				p = MA_Player (d, i = MA_ReadByte (d), "svc_updateuserinfo");
+				j = !p->name[0];
+				MA_ReadLong (d);
+				strlcpy (p->userinfo, MA_ReadString (d), sizeof(p->userinfo));
+				MA_UserInfoChanged (d, p);
+
+				if (p->name[0] && j)
+				{
+					// someone new in the slot, doesn't get the stats of the last one
+					memset (&d->info[i], 0, sizeof(d->info[i]));
+					MA_InitInfo (d, i);
+				}
+				else if (!p->name[0] && !j)
+					MA_InitInfo (d, i);
+				break;
+
+			case svc_setinfo:
+				p = MA_Player (d, MA_ReadByte (d), "svc_setinfo");
+				strlcpy (key, MA_ReadString (d), sizeof(key));
+				MA_InfoSet (p->userinfo, sizeof(p->userinfo), key, MA_ReadString (d));
+				MA_UserInfoChanged (d, p);
+				break;
+
+			case svc_serverinfo:
+				strlcpy (key, MA_ReadString (d), sizeof(key));
+				MA_InfoSet (d->serverinfo, sizeof(d->serverinfo), key, MA_ReadString (d));
+				MA_ServerInfoChanged (d);
+				break;
+
+			case svc_download:
+				MA_ParseDownload (d);
+				break;
+
+			case svc_playerinfo:
+				MA_ParsePlayerinfo (d);
+				break;
+
+			case svc_nails:
+			case svc_nails2:
+				i = MA_ReadByte (d);
+				MA_Skip (d, i * (cmd == svc_nails2 ? 7 : 6));
+				break;
+
+			case svc_modellist:
+				MA_ParseModellist (d, false);
+				break;
+
+			case svc_fte_modellistshort:
+				if (!(d->fteext & FTE_PEXT_MODELDBL))
+					MA_Error (d, "svc_fte_modellistshort without FTE_PEXT_MODELDBL");
+				MA_ParseModellist (d, true);
+				break;
+
+			case svc_soundlist:
+				MA_ReadByte (d);
+				while (*(s = MA_ReadString (d)))
+					;
+				MA_ReadByte (d);
+				break;
+
+			case svc_packetentities:
+			case svc_deltapacketentities:
+				MA_ParsePacketEntities (d, cmd == svc_deltapacketentities);
+				break;
+
+			case svc_qizmovoice:
+				MA_Skip (d, 2 + 32);
+				break;
+		}
+	}
+}
+
+/*
+===============================================================================
+
+DEMO READING
+
+The framing of CL_GetDemoMessage, on the whole demo in memory.
+
+===============================================================================
+*/
+
+// false when the demo ends in the middle of it, the recording got cut off
+static qbool MA_DemoRead (ma_demo_t *d, void *data, int len)
+{
+	if (d->buflen - d->pos < len)
+		return false;
+	memcpy (data, d->buf + d->pos, len);
+	d->pos += len;
+	return true;
+}
+
+static void MA_ReadDemo (ma_demo_t *d)
+{
+	double demotime;
+	float qwdtime;
+	byte c, msec;
+	int type, size, mask;
+
+	while (!d->finished)
+	{
+		if (d->mvd)
+		{
+			if (!MA_DemoRead (d, &msec, 1))
+				break;
+			demotime = d->demotime + msec * 0.001;
+		}
+		else
+		{
+			if (!MA_DemoRead (d, &qwdtime, 4))
+				break;
+			demotime = LittleFloat (qwdtime);
+		}
+
+		// everything of the last frame is in
+		if (demotime > d->demotime)
+		{
+			MA_Frame (d);
+			d->demotime = demotime;
+		}
+
+		if (!MA_DemoRead (d, &c, 1))
+			break;
+
+		switch ((type = c & 7))
+		{
+			case dem_cmd:
+				if (d->mvd)
+					MA_Error (d, "dem_cmd in an mvd");
+				d->pos += sizeof(usercmd_t) + 3 * 4;	// and the view angles
+				continue;
+
+			case dem_set:
+				d->pos += 2 * 4;
+				continue;
+
+			case dem_multiple:
+				if (!MA_DemoRead (d, &mask, 4))
+					return;
+				d->lastto = LittleLong (mask);
+				break;
+
+			case dem_single:
+			case dem_stats:
+				d->lastto = c >> 3;
+				break;
+
+			case dem_all:
+				d->lastto = 0;
+				break;
+
+			case dem_read:
+				break;
+
+			default:
+				MA_Error (d, "bad demo message type %i", type);
+		}
+		d->lasttype = type;
+
+		if (!MA_DemoRead (d, &size, 4))
+			break;
+		size = LittleLong (size);
+		if (size < 0 || size > d->buflen - d->pos)
+			break;
+
+		d->msg = d->buf + d->pos;
+		d->msgsize = size;
+		d->readcount = 0;
+		d->badread = false;
+		d->pos += size;
+
+		// what went to single players, the client skips it when it doesn't track them,
+		// only the //wps in there are kept
+		d->single = type == dem_single || type == dem_multiple;
+
+		if (!d->mvd)
+		{
+			// connectionless packets and the netchan header
+			if (MA_ReadLong (d) == -1)
+				continue;
+			MA_ReadLong (d);
+			if (d->badread)
+				continue;
+		}
+
+		MA_ParseMessage (d);
+	}
+
+	if (d->pos > d->buflen)
+		d->pos = d->buflen;
+}
+
+/*
+===============================================================================
+
+OUTPUT
+
+===============================================================================
+*/
+
+static qbool MA_TeamGame (ma_demo_t *d)
+{
+	return d->cg.gametype != 0 && d->cg.gametype != 4;
+}
+
+// MVD_Status_Xml
+static void MA_WriteXml (FILE *f, ma_demo_t *d)
+{
+	mvd_xmlplayer_t players[MAX_CLIENTS];
+	int i, n, count;
+
+	for (count = 0, n = 0; n < d->cg.pcount; n++)
+	{
+		if (!MA_Counted (d, (i = d->ids[n])))
+			continue;
+		players[count].name = d->players[i].name;
+		players[count].team = d->players[i].team;
+		players[count++].info = &d->info[i];
+	}
+	MVD_XMLStats_Write (f, &d->cg, players, count);
+}
+
+// quake text as a json string, the high characters as latin-1
+static void MA_JsonString (FILE *f, char *s)
+{
+	fputc ('"', f);
+	for (; *s; s++)
+	{
+		if (*s == '"' || *s == '\\')
+			fprintf (f, "\\%c", *s);
+		else if ((byte) *s < 32 || (byte) *s >= 127)
+			fprintf (f, "\\u%04x", (byte) *s);
+		else
+			fputc (*s, f);
+	}
+	fputc ('"', f);
+}
+
+static void MA_JsonRuns (FILE *f, char *name, mvd_runs_t *runs, int count)
+{
+	int x;
+
+	fprintf (f, ",\n\t\t\t\"%s\": [", name);
+	for (x = 0; x < count; x++)
+	{
+		fprintf (f, "%s{\"time\": %.3f, \"frags\": %i, \"teamfrags\": %i}",
+			x ? ", " : "", runs[x].time, runs[x].frags, runs[x].teamfrags);
+	}
+	fprintf (f, "]");
+}
+
+static void MA_JsonItems (FILE *f, char *name, mvd_info_t *pi, int first, int last, qbool lost)
+{
+	int x;
+
+	fprintf (f, ",\n\t\t\t\"%s\": {", name);
+	for (x = first; x <= last; x++)
+	{
+		fprintf (f, "%s\"%s\": %i", x > first ? ", " : "", mvd_wp_info[x].name,
+			lost ? pi->itemstats[x].lost : pi->itemstats[x].count);
+	}
+	fprintf (f, "}");
+}
+
+static void MA_JsonKills (FILE *f, char *name, mvd_info_t *pi, qbool team)
+{
+	int x, n, all = 0;
+
+	fprintf (f, ",\n\t\t\t\"%s\": {", name);
+	for (x = AXE_INFO; x <= LG_INFO; x++)
+	{
+		n = team ? pi->killstats.normal[x].teamkills : pi->killstats.normal[x].kills;
+		fprintf (f, "\"%s\": %i, ", mvd_wp_info[x].name, n);
+		all += n;
+	}
+	n = team ? pi->teamspawntelefrags : pi->spawntelefrags;
+	fprintf (f, "\"spawn\": %i, \"all\": %i}", n, all + n);
+}
+
+// the weapons with //wps, as in <weapons> of the xml
+static void MA_JsonWeapons (FILE *f, mvd_info_t *pi)
+{
+	mvd_wpstats_t *ws;
+	int x, first = 1;
+
+	fprintf (f, ",\n\t\t\t\"weapons\": {");
+	for (x = AXE_INFO; x <= LG_INFO; x++)
+	{
+		ws = &pi->wpstats[x];
+		if (!ws->attacks)
+			continue;
+		fprintf (f, "%s\"%s\": {\"attacks\": %i, \"hits\": %i, \"accuracy\": %.1f}", first ? "" : ", ",
+			mvd_wp_info[x].name, ws->attacks, ws->hits, MVD_Weapon_Accuracy (ws));
+		first = 0;
+	}
+	fprintf (f, "}");
+}
+
+static void MA_WriteJson (FILE *f, ma_demo_t *d)
+{
+	ma_player_t *p;
+	mvd_info_t *pi;
+	char runs[16];
+	int i, n, y, first = 1;
+
+	fprintf (f, "{\n\t\"demo\": ");
+	MA_JsonString (f, MA_SkipPath (d->path));
+	fprintf (f, ",\n\t\"map\": ");
+	MA_JsonString (f, d->cg.mapname);
+	fprintf (f, ",\n\t\"gametype\": \"%s\",\n\t\"hostname\": ", mvd_gt_info[d->cg.gametype].name);
+	MA_JsonString (f, d->cg.hostname);
+	fprintf (f, ",\n\t\"timelimit\": %i,\n\t\"duration\": %.3f", d->cg.timelimit, d->demotime);
+	if (MA_TeamGame (d))
+	{
+		fprintf (f, ",\n\t\"teams\": [");
+		MA_JsonString (f, d->cg.team1);
+		fprintf (f, ", ");
+		MA_JsonString (f, d->cg.team2);
+		fprintf (f, "]");
+	}
+	fprintf (f, ",\n\t\"players\": [");
+
+	for (n = 0; n < d->cg.pcount; n++)
+	{
+		if (!MA_Counted (d, (i = d->ids[n])))
+			continue;
+		p = &d->players[i];
+		pi = &d->info[i];
+
+		fprintf (f, "%s\n\t\t{\n\t\t\t\"name\": ", first ? "" : ",");
+		MA_JsonString (f, p->name);
+		fprintf (f, ",\n\t\t\t\"team\": ");
+		MA_JsonString (f, p->team);
+		fprintf (f, ",\n\t\t\t\"frags\": %i,\n\t\t\t\"deaths\": %i", p->frags, pi->das.deathcount);
+		MA_JsonKills (f, "kills", pi, false);
+		MA_JsonKills (f, "teamkills", pi, true);
+		MA_JsonItems (f, "took", pi, SSG_INFO, MH_INFO, false);
+		MA_JsonItems (f, "lost", pi, SSG_INFO, MH_INFO, true);
+		MA_JsonWeapons (f, pi);
+		MA_JsonRuns (f, "runs", pi->runs, pi->run);
+		for (y = RING_INFO; y <= PENT_INFO; y++)
+		{
+			snprintf (runs, sizeof(runs), "%s_runs", mvd_wp_info[y].name);
+			MA_JsonRuns (f, runs, pi->itemstats[y].runs, pi->itemstats[y].run);
+		}
+		fprintf (f, "\n\t\t}");
+		first = 0;
+	}
+
+	fprintf (f, "\n\t]\n}\n");
+}
+
+static qbool MA_WriteStats (ma_demo_t *d)
+{
+	char name[MAX_OSPATH], path[MAX_OSPATH * 2], *s;
+	FILE *f;
+
+	// demo.mvd.gz becomes demo.xml
+	strlcpy (name, MA_SkipPath (d->path), sizeof(name));
+	if ((s = strstr (name, ".gz")) && !s[3])
+		*s = 0;
+	MA_StripExtension (name);
+
+	if (snprintf (path, sizeof(path), "%s/%s.%s", ma_outdir, name, ma_json ? "json" : "xml") >= sizeof(path))
+		return false;
+
+	if (!(f = fopen (path, "wb")))
+		return false;
+	if (ma_json)
+		MA_WriteJson (f, d);
+	else
+		MA_WriteXml (f, d);
+	return !fclose (f);
+}
+
+/*
+===============================================================================
+
+WORKERS
+
+===============================================================================
+*/
+
+static byte *MA_LoadFile (char *path, int *len)
+{
+	byte *buf = NULL;
+	int size = 0, n;
+#ifdef WITH_ZLIB
+	gzFile f;
+
+	// reads plain files as they are
+	if (!(f = gzopen (path, "rb")))
+		return NULL;
+
+	do
+	{
+		buf = Q_realloc (buf, size + 0x100000);
+		n = gzread (f, buf + size, 0x100000);
+		size += max (n, 0);
+	} while (n == 0x100000);
+
+	gzclose (f);
+#else
+	FILE *f;
+
+	if (!(f = fopen (path, "rb")))
+		return NULL;
+
+	do
+	{
+		buf = Q_realloc (buf, size + 0x100000);
+		n = fread (buf + size, 1, 0x100000, f);
+		size += n;
+	} while (n == 0x100000);
+
+	fclose (f);
+#endif
+
+	*len = size;
+	return buf;
+}
+
+static qbool MA_IsMvd (char *path)
+{
+	char name[MAX_OSPATH], *s;
+
+	strlcpy (name, path, sizeof(name));
+	if ((s = strstr (name, ".gz")) && !s[3])
+		*s = 0;
+	return (s = strrchr (name, '.')) && !strcasecmp (s, ".mvd");
+}
+
+static void MA_AnalyzeDemo (ma_demo_t *d, int num)
+{
+	ma_result_t *r = &ma_results[num];
+	double start = MA_Time ();
+
+	memset (d, 0, sizeof(*d));
+	d->path = ma_demos[num];
+	d->mvd = MA_IsMvd (d->path);
+	d->coordsize = 2;
+	d->anglesize = 1;
+	MA_NewMap (d);
+
+	if (!(d->buf = MA_LoadFile (d->path, &d->buflen)))
+		snprintf (d->error, sizeof(d->error), "couldn't open");
+	else if (!setjmp (d->abort))
+	{
+		MA_ReadDemo (d);
+		MA_Frame (d);
+
+		if (!ma_nooutput && !MA_WriteStats (d))
+			snprintf (d->error, sizeof(d->error), "couldn't write the stats to %s", ma_outdir);
+		else
+			r->ok = true;
+	}
+
+	r->size = d->pos;
+	r->time = MA_Time () - start;
+	Q_free (d->buf);
+
+	if (r->ok)
+	{
+		printf ("%s: %s %s, %i players, %.0f s of %s in %.3f s\n", d->path, d->cg.mapname[0] ? d->cg.mapname : d->mapname,
+			mvd_gt_info[d->cg.gametype].name, d->cg.pcount, d->demotime, d->mvd ? "mvd" : "qwd", r->time);
+	}
+	else
+		printf ("%s: %s at %i\n", d->path, d->error, d->pos);
+}
+
+static void *MA_Worker (void *arg)
+{
+	ma_demo_t *d = Q_malloc (sizeof(*d));
+	int num;
+
+	while (1)
+	{
+		pthread_mutex_lock (&ma_lock);
+		num = ma_nextdemo < ma_numdemos ? ma_nextdemo++ : -1;
+		pthread_mutex_unlock (&ma_lock);
+
+		if (num < 0)
+			break;
+		MA_AnalyzeDemo (d, num);
+	}
+
+	Q_free (d);
+	return NULL;
+}
+
+int main (int argc, char **argv)
+{
+	pthread_t threads[64];
+	double start, time, bytes = 0, cpu = 0;
+	int i, numthreads, failed = 0;
+
+	numthreads = sysconf (_SC_NPROCESSORS_ONLN);
+
+	for (i = 1; i < argc && argv[i][0] == '-'; i++)
+	{
+		if (!strcmp (argv[i], "-j") && i + 1 < argc)
+			numthreads = atoi (argv[++i]);
+		else if (!strcmp (argv[i], "-o") && i + 1 < argc)
+			ma_outdir = argv[++i];
+		else if (!strcmp (argv[i], "-json"))
+			ma_json = true;
+		else if (!strcmp (argv[i], "-n"))
+			ma_nooutput = true;
+		else
+			break;
+	}
+
+	if (i >= argc)
+	{
+		printf ("usage: %s [-j threads] [-json] [-n] [-o dir] <demo> ...\n", argv[0]);
+		return 2;
+	}
+
+	ma_demos = argv + i;
+	ma_numdemos = argc - i;
+	ma_results = Q_calloc (ma_numdemos, sizeof(*ma_results));
+	numthreads = bound (1, numthreads, min (ma_numdemos, sizeof(threads) / sizeof(threads[0])));
+
+	// stdout is shared by the workers, a line at a time
+	setvbuf (stdout, NULL, _IOLBF, 0);
+
+	start = MA_Time ();
+	for (i = 0; i < numthreads; i++)
+	{
+		if (pthread_create (&threads[i], NULL, MA_Worker, NULL))
+			Sys_Error ("Couldn't start worker %i", i);
+	}
+	for (i = 0; i < numthreads; i++)
+		pthread_join (threads[i], NULL);
+	time = MA_Time () - start;
+
+	for (i = 0; i < ma_numdemos; i++)
+	{
+		bytes += ma_results[i].size;
+		cpu += ma_results[i].time;
+		if (!ma_results[i].ok)
+			failed++;
+	}
+
+	printf ("%i demos, %i failed, %.1f MB in %.2f s with %i threads (%.2f s per thread)\n",
+		ma_numdemos, failed, bytes / (1024 * 1024), time, numthreads, cpu / numthreads);
+	printf ("%.1f demos/s, %.1f MB/s\n", time > 0 ? ma_numdemos / time : 0, time > 0 ? bytes / (1024 * 1024) / time : 0);
+
+	Q_free (ma_results);
+	return failed ? 1 : 0;
+}
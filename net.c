@@ -19,6 +19,10 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
     $Id: net.c,v 1.19 2007-10-04 13:48:11 dkure Exp $
 */
 
+#ifdef __linux__
+#define _GNU_SOURCE // recvmmsg, sendmmsg
+#endif
+
 #include "quakedef.h"
 #include "server.h"
 
@@ -33,10 +37,12 @@ sizebuf_t	net_message;
 byte		net_message_buffer[MSG_BUF_SIZE];
 
 #define MAX_LOOPBACK 4 // must be a power of two
+#define MAX_LOADTEST_LOOPBACK 64 // the same, for all sv_loadtest clients together
 
 typedef struct {
 	byte	data[MAX_UDP_PACKET];
 	int		datalen;
+	unsigned short	port;	// tells sv_loadtest clients apart, 0 for the local client
 } loopmsg_t;
 
 typedef struct {
@@ -50,6 +56,255 @@ WSADATA winsockdata;
 
 loopback_t	loopbacks[2];
 
+#ifndef CLIENTONLY
+// sv_loadtest clients to the server, they don't squeeze the local player out of loopbacks[NS_SERVER]
+typedef struct {
+	loopmsg_t	msgs[MAX_LOADTEST_LOOPBACK];
+	unsigned int	get, send;
+} loadtest_loopback_t;
+
+static loadtest_loopback_t	loadtest_loopback;
+#endif
+
+#ifndef CLIENTONLY
+/*
+=============================================================================
+
+BATCHED SERVER UDP
+
+The server socket is drained with one recvmmsg into a ring of packets which
+NET_GetPacket then hands out one at a time, and datagrams sent between
+NET_BeginSendBatch and NET_FlushSendBatch go out with a single sendmmsg.
+Platforms without these syscalls fall back to recvfrom/sendto.
+
+=============================================================================
+*/
+
+#if defined(__linux__) && defined(MSG_WAITFORONE)
+#define NET_HAVE_MMSG
+#endif
+
+#define NET_BATCH	32
+
+cvar_t	sv_udpbatch = {"sv_udpbatch", "1"};
+
+static qbool	net_mmsg_broken;	// kernel said ENOSYS, don't try again
+
+static byte		net_recv_bufs[NET_BATCH][MSG_BUF_SIZE];
+static struct sockaddr_storage	net_recv_addrs[NET_BATCH];
+static socklen_t	net_recv_addrlens[NET_BATCH];
+static int		net_recv_lens[NET_BATCH];
+static int		net_recv_count, net_recv_next;
+
+static byte		net_send_bufs[NET_BATCH][MAX_UDP_PACKET];
+static struct sockaddr_storage	net_send_addrs[NET_BATCH];
+static int		net_send_lens[NET_BATCH];
+static int		net_send_count;
+static qbool	net_send_batching;
+
+static struct
+{
+	double	recv_calls, recv_packets;
+	double	send_calls, send_packets;
+} net_udpstats;
+
+/*
+==================
+NET_RecvServerUDP
+
+recvfrom() for the server socket, served from the recvmmsg ring when possible.
+==================
+*/
+static int NET_RecvServerUDP (socket_t socket, struct sockaddr_storage *from, socklen_t *fromlen)
+{
+	int ret;
+#ifdef NET_HAVE_MMSG
+	struct mmsghdr msgs[NET_BATCH];
+	struct iovec iov[NET_BATCH];
+	int i;
+
+	if (net_recv_next < net_recv_count)
+	{
+		i = net_recv_next++;
+		memcpy (net_message_buffer, net_recv_bufs[i], net_recv_lens[i]);
+		memcpy (from, &net_recv_addrs[i], sizeof(*from));
+		*fromlen = net_recv_addrlens[i];
+		return net_recv_lens[i];
+	}
+
+	if ((int)sv_udpbatch.value && !net_mmsg_broken)
+	{
+		memset (msgs, 0, sizeof(msgs));
+		for (i = 0; i < NET_BATCH; i++)
+		{
+			iov[i].iov_base = net_recv_bufs[i];
+			iov[i].iov_len = sizeof(net_recv_bufs[i]);
+			msgs[i].msg_hdr.msg_iov = &iov[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+			msgs[i].msg_hdr.msg_name = &net_recv_addrs[i];
+			msgs[i].msg_hdr.msg_namelen = sizeof(net_recv_addrs[i]);
+		}
+
+		net_udpstats.recv_calls++;
+		ret = recvmmsg (socket, msgs, NET_BATCH, 0, NULL);
+
+		if (ret == -1 && qerrno == ENOSYS)
+		{
+			net_mmsg_broken = true;
+		}
+		else
+		{
+			if (ret <= 0)
+				return ret;
+
+			for (i = 0; i < ret; i++)
+			{
+				net_recv_lens[i] = msgs[i].msg_len;
+				net_recv_addrlens[i] = msgs[i].msg_hdr.msg_namelen;
+			}
+			net_recv_count = ret;
+			net_recv_next = 0;
+			net_udpstats.recv_packets += ret;
+
+			return NET_RecvServerUDP (socket, from, fromlen);
+		}
+	}
+#endif
+
+	net_udpstats.recv_calls++;
+	ret = recvfrom (socket, (char *)net_message_buffer, sizeof(net_message_buffer), 0, (struct sockaddr *)from, fromlen);
+	if (ret >= 0)
+		net_udpstats.recv_packets++;
+	return ret;
+}
+
+/*
+==================
+NET_ResetServerBatch
+
+Drops what was received from or queued for a server socket that is going away.
+==================
+*/
+static void NET_ResetServerBatch (void)
+{
+	net_recv_count = net_recv_next = 0;
+	net_send_count = 0;
+}
+
+static void NET_SendToError (socket_t socket)
+{
+	if (qerrno == EWOULDBLOCK)
+		return;
+	if (qerrno == ECONNREFUSED)
+		return;
+	if (qerrno == EADDRNOTAVAIL)
+		return;
+	Sys_Printf ("NET_SendPacket: sendto: (%i): %s %i\n", qerrno, strerror(qerrno), socket);
+}
+
+/*
+==================
+NET_BeginSendBatch
+
+Queue server UDP datagrams until NET_FlushSendBatch.
+==================
+*/
+void NET_BeginSendBatch (void)
+{
+	net_send_batching = (int)sv_udpbatch.value != 0;
+}
+
+/*
+==================
+NET_FlushSendBatch
+==================
+*/
+void NET_FlushSendBatch (void)
+{
+	socket_t socket = svs.socketip;
+	int i = 0, ret;
+#ifdef NET_HAVE_MMSG
+	struct mmsghdr msgs[NET_BATCH];
+	struct iovec iov[NET_BATCH];
+#endif
+
+	net_send_batching = false;
+
+	if (!net_send_count)
+		return;
+
+	if (socket == INVALID_SOCKET)
+	{
+		net_send_count = 0;
+		return;
+	}
+
+#ifdef NET_HAVE_MMSG
+	if (!net_mmsg_broken)
+	{
+		memset (msgs, 0, sizeof(msgs));
+		for (i = 0; i < net_send_count; i++)
+		{
+			iov[i].iov_base = net_send_bufs[i];
+			iov[i].iov_len = net_send_lens[i];
+			msgs[i].msg_hdr.msg_iov = &iov[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+			msgs[i].msg_hdr.msg_name = &net_send_addrs[i];
+			msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+		}
+
+		for (i = 0; i < net_send_count; )
+		{
+			net_udpstats.send_calls++;
+			ret = sendmmsg (socket, msgs + i, net_send_count - i, 0);
+
+			if (ret == -1 && qerrno == ENOSYS)
+			{
+				net_mmsg_broken = true;
+				break; // send the rest one by one
+			}
+
+			if (ret <= 0)
+			{
+				// the first datagram failed, report it and go on with the next one
+				NET_SendToError (socket);
+				i++;
+				continue;
+			}
+
+			net_udpstats.send_packets += ret;
+			i += ret;
+		}
+	}
+#endif
+
+	for ( ; i < net_send_count; i++)
+	{
+		net_udpstats.send_calls++;
+		ret = sendto (socket, (char *)net_send_bufs[i], net_send_lens[i], 0, (struct sockaddr *)&net_send_addrs[i], sizeof(struct sockaddr_in));
+		if (ret == -1)
+			NET_SendToError (socket);
+		else
+			net_udpstats.send_packets++;
+	}
+
+	net_send_count = 0;
+}
+
+/*
+==================
+NET_UDPStats
+
+Average datagrams moved per syscall on the server socket.
+==================
+*/
+void NET_UDPStats (double *in, double *out)
+{
+	*in = net_udpstats.recv_calls ? net_udpstats.recv_packets / net_udpstats.recv_calls : 0;
+	*out = net_udpstats.send_calls ? net_udpstats.send_packets / net_udpstats.send_calls : 0;
+}
+#endif // !CLIENTONLY
+
 //=============================================================================
 
 void NetadrToSockadr (netadr_t *a, struct sockaddr_storage *s)
@@ -81,7 +336,7 @@ qbool NET_CompareBaseAdr (netadr_t a, netadr_t b)
 qbool NET_CompareAdr (netadr_t a, netadr_t b)
 {
 	if (a.type == NA_LOOPBACK && b.type == NA_LOOPBACK)
-		return true;
+		return a.port == b.port;
 	if (a.ip[0] == b.ip[0] && a.ip[1] == b.ip[1] && a.ip[2] == b.ip[2] && a.ip[3] == b.ip[3] && a.port == b.port)
 		return true;
 	return false;
@@ -185,47 +440,79 @@ LOOPBACK BUFFERS FOR LOCAL PLAYER
 =============================================================================
 */
 
-qbool NET_GetLoopPacket (netsrc_t sock, netadr_t *from, sizebuf_t *message)
+static qbool NET_GetLoopMsg (loopmsg_t *msgs, unsigned int size, unsigned int *get, unsigned int send, netadr_t *from, sizebuf_t *message)
 {
 	int i;
-	loopback_t *loop;
-
-	loop = &loopbacks[sock];
 
-	if (loop->send - loop->get > MAX_LOOPBACK)
-		loop->get = loop->send - MAX_LOOPBACK;
+	if (send - *get > size)
+		*get = send - size;
 
-	if (loop->get >= loop->send)
+	if (*get >= send)
 		return false;
 
-	i = loop->get & (MAX_LOOPBACK-1);
-	loop->get++;
+	i = *get & (size - 1);
+	(*get)++;
 
-	if (message->maxsize < loop->msgs[i].datalen)
+	if (message->maxsize < msgs[i].datalen)
 		Sys_Error("NET_SendLoopPacket: Loopback buffer was too big");
 
-	memcpy (message->data, loop->msgs[i].data, loop->msgs[i].datalen);
-	message->cursize = loop->msgs[i].datalen;
+	memcpy (message->data, msgs[i].data, msgs[i].datalen);
+	message->cursize = msgs[i].datalen;
 	memset (from, 0, sizeof(*from));
 	from->type = NA_LOOPBACK;
+	from->port = msgs[i].port;
 	return true;
 }
 
-void NET_SendLoopPacket (netsrc_t sock, int length, void *data, netadr_t to)
+static void NET_SendLoopMsg (loopmsg_t *msgs, unsigned int size, unsigned int *send, int length, void *data, netadr_t to)
 {
 	int i;
+
+	i = *send & (size - 1);
+	(*send)++;
+
+	if (length > (int) sizeof(msgs[i].data))
+		Sys_Error ("NET_SendLoopPacket: length > MAX_UDP_PACKET");
+
+	memcpy (msgs[i].data, data, length);
+	msgs[i].datalen = length;
+	msgs[i].port = to.port;
+}
+
+qbool NET_GetLoopPacket (netsrc_t sock, netadr_t *from, sizebuf_t *message)
+{
 	loopback_t *loop;
 
-	loop = &loopbacks[sock ^ 1];
+	loop = &loopbacks[sock];
 
-	i = loop->send & (MAX_LOOPBACK - 1);
-	loop->send++;
+	if (NET_GetLoopMsg (loop->msgs, MAX_LOOPBACK, &loop->get, loop->send, from, message))
+		return true;
 
-	if (length > (int) sizeof(loop->msgs[i].data))
-		Sys_Error ("NET_SendLoopPacket: length > MAX_UDP_PACKET");
+#ifndef CLIENTONLY
+	if (sock == NS_SERVER)
+		return NET_GetLoopMsg (loadtest_loopback.msgs, MAX_LOADTEST_LOOPBACK, &loadtest_loopback.get,
+			loadtest_loopback.send, from, message);
+#endif
+
+	return false;
+}
+
+void NET_SendLoopPacket (netsrc_t sock, int length, void *data, netadr_t to)
+{
+	loopback_t *loop;
 
-	memcpy (loop->msgs[i].data, data, length);
-	loop->msgs[i].datalen = length;
+#ifndef CLIENTONLY
+	// a nonzero port is one of the sv_loadtest clients
+	if (sock == NS_CLIENT && to.port)
+	{
+		NET_SendLoopMsg (loadtest_loopback.msgs, MAX_LOADTEST_LOOPBACK, &loadtest_loopback.send, length, data, to);
+		return;
+	}
+#endif
+
+	loop = &loopbacks[sock ^ 1];
+
+	NET_SendLoopMsg (loop->msgs, MAX_LOOPBACK, &loop->send, length, data, to);
 }
 
 //=============================================================================
@@ -234,6 +521,9 @@ void NET_ClearLoopback (void)
 {
 	loopbacks[0].send = loopbacks[0].get = 0;
 	loopbacks[1].send = loopbacks[1].get = 0;
+#ifndef CLIENTONLY
+	loadtest_loopback.send = loadtest_loopback.get = 0;
+#endif
 }
 
 static cl_delayed_packet_t cl_delayed_packets_get[CL_MAX_DELAYED_PACKETS];
@@ -295,6 +585,11 @@ qbool NET_GetPacketEx (netsrc_t netsrc, qbool delay)
 			continue;
 
 		fromlen = sizeof(from);
+#ifndef CLIENTONLY
+		if (netsrc == NS_SERVER)
+			ret = NET_RecvServerUDP (socket, &from, &fromlen);
+		else
+#endif
 		ret = recvfrom (socket, (char *)net_message_buffer, sizeof(net_message_buffer), 0, (struct sockaddr *)&from, &fromlen);
 
 		if (ret == -1) {
@@ -580,6 +875,12 @@ void NET_SendPacketEx (netsrc_t netsrc, int length, void *data, netadr_t to, qbo
 	}
 
 	if (to.type == NA_LOOPBACK) {
+#ifndef CLIENTONLY
+		if (netsrc == NS_SERVER && to.port) {
+			SV_LoadTestPacket (length, data, to);
+			return;
+		}
+#endif
 		NET_SendLoopPacket (netsrc, length, data, to);
 		return;
 	}
@@ -639,6 +940,29 @@ void NET_SendPacketEx (netsrc_t netsrc, int length, void *data, netadr_t to, qbo
 	NetadrToSockadr (&to, &addr);
 	size = sizeof(struct sockaddr_in);
 
+#ifndef CLIENTONLY
+	if (netsrc == NS_SERVER && net_send_batching && length <= MAX_UDP_PACKET)
+	{
+		if (net_send_count == NET_BATCH)
+		{
+			NET_FlushSendBatch ();
+			net_send_batching = true;
+		}
+
+		memcpy (net_send_bufs[net_send_count], data, length);
+		net_send_addrs[net_send_count] = addr;
+		net_send_lens[net_send_count] = length;
+		net_send_count++;
+		return;
+	}
+
+	if (netsrc == NS_SERVER)
+	{
+		net_udpstats.send_calls++;
+		net_udpstats.send_packets++;
+	}
+#endif
+
 	ret = sendto (socket, data, length, 0, (struct sockaddr *)&addr, size);
 	if (ret == -1) {
 		if (qerrno == EWOULDBLOCK)
@@ -901,6 +1225,11 @@ qbool NET_Sleep (int msec)
 		i = svs.socketip;
 	}
 
+#ifndef CLIENTONLY
+	if (net_recv_next < net_recv_count)
+		msec = 0; // datagrams already read by recvmmsg are waiting
+#endif
+
 	timeout.tv_sec = msec/1000;
 	timeout.tv_usec = (msec%1000)*1000;
 	select(i+1, &fdset, NULL, NULL, &timeout);
@@ -1005,6 +1334,7 @@ void NET_CloseServer (void)
 		closesocket(svs.socketip);
 		svs.socketip = INVALID_SOCKET;
 	}
+	NET_ResetServerBatch ();
 
 // TCPCONNECT -->
 	if (svs.sockettcp != INVALID_SOCKET) {
@@ -1028,6 +1358,7 @@ void NET_InitServer (void)
 	}
 
 	if (svs.socketip == INVALID_SOCKET) {
+		NET_ResetServerBatch ();
 		svs.socketip = UDP_OpenSocket (port);
 		if (svs.socketip != INVALID_SOCKET)
 			NET_GetLocalAddress (svs.socketip, &net_local_sv_ipadr);
@@ -128,6 +128,9 @@ void	NET_CloseServer (void);
 void	NET_Shutdown (void);
 qbool	NET_GetPacket (netsrc_t sock);
 void	NET_SendPacket (netsrc_t sock, int length, void *data, netadr_t to);
+void	NET_BeginSendBatch (void);
+void	NET_FlushSendBatch (void);
+void	NET_UDPStats (double *in, double *out);
 
 void	NET_ClearLoopback (void);
 qbool	NET_Sleep (int msec);
@@ -160,8 +160,10 @@ void Netchan_Setup (netsrc_t sock, netchan_t *chan, netadr_t adr, int qport)
 //Returns true if the bandwidth choke isn't active
 qbool Netchan_CanPacket (netchan_t *chan)
 {
-	if (chan->remote_address.type == NA_LOOPBACK)
-		return true; // unlimited bandwidth for local client
+	// unlimited bandwidth for the local client, sv_loadtest clients
+	// (the other loopback ports) get the rate of a real connection
+	if (chan->remote_address.type == NA_LOOPBACK && !chan->remote_address.port)
+		return true;
 
 	if (chan->cleartime < curtime + MAX_BACKUP * chan->rate)
 		return true;
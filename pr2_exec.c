@@ -37,6 +37,9 @@ void PR2_Profile_f (void);
 void ED2_PrintEdict_f (void);
 void ED_Count (void);
 void PR_CleanLogText_Init();
+#ifdef QVM_JIT
+void PR2_VMBench_f (void);
+#endif
 void PR2_Init(void)
 {
 	int p;
@@ -47,6 +50,9 @@ void PR2_Init(void)
 #ifdef QVM_PROFILE
 	Cvar_Register(&sv_enableprofile);
 #endif
+#ifdef QVM_JIT
+	Cvar_Register(&sv_vmjit);
+#endif
 
 	p = COM_CheckParm ("-progtype");
 
@@ -64,7 +70,12 @@ void PR2_Init(void)
 	Cmd_AddCommand ("edicts", ED2_PrintEdicts);
 	Cmd_AddCommand ("edictcount", ED_Count);
 	Cmd_AddCommand ("profile", PR2_Profile_f);
+	Cmd_AddCommand ("sv_progprof", PR_Prof_f);
+	Cmd_AddCommand ("sv_stringstats", PR_Strings_f);
 	Cmd_AddCommand ("mod", PR2_GameConsoleCommand);
+#ifdef QVM_JIT
+	Cmd_AddCommand ("sv_vmbench", PR2_VMBench_f);
+#endif
 
 	PR_CleanLogText_Init();
 }
@@ -161,6 +172,62 @@ void PR2_GameStartFrame()
 	        0, 0, 0);
 }
 
+#ifdef QVM_JIT
+//===========================================================================
+// PR2_VMBench_f
+// runs the mod's StartFrame in the interpreter and as compiled code,
+// which moves the game on, so only on an empty server
+//===========================================================================
+void PR2_VMBench_f (void)
+{
+	double start, t[2];
+	float oldjit = sv_vmjit.value;
+	int frames, i, j;
+
+	if (sv.state != ss_active || !sv_vm || sv_vm->type != VM_BYTECODE)
+	{
+		Con_Printf ("sv_vmbench: needs a running map with a QVM mod\n");
+		return;
+	}
+	for (i = 0; i < MAX_CLIENTS; i++)
+	{
+		if (svs.clients[i].state != cs_free)
+		{
+			Con_Printf ("sv_vmbench: only runs with no clients on the server\n");
+			return;
+		}
+	}
+	if (!((qvm_t *) sv_vm->hInst)->jit)
+	{
+		Con_Printf ("sv_vmbench: the QVM couldn't be compiled\n");
+		return;
+	}
+
+	frames = Cmd_Argc () > 1 ? bound (1, Q_atoi (Cmd_Argv (1)), 100000) : 1000;
+
+	for (i = 0; i < 2; i++)
+	{
+		Cvar_SetValue (&sv_vmjit, i);
+		start = Sys_DoubleTime ();
+		for (j = 0; j < frames; j++)
+		{
+			pr_global_struct->self = EDICT_TO_PROG(sv.edicts);
+			pr_global_struct->other = EDICT_TO_PROG(sv.edicts);
+			pr_global_struct->time = sv.time;
+			PR2_GameStartFrame ();
+		}
+		t[i] = Sys_DoubleTime () - start;
+	}
+	Cvar_SetValue (&sv_vmjit, oldjit);
+
+	Con_Printf ("StartFrame x %i\n", frames);
+	Con_Printf ("interpreter: %8.2f us/frame\n", 1000000 * t[0] / frames);
+	Con_Printf ("compiled:    %8.2f us/frame\n", 1000000 * t[1] / frames);
+	if (t[1] > 0)
+		Con_Printf ("speedup:     %8.2fx\n", t[0] / t[1]);
+}
+#endif
+
 //===========================================================================
 // GameClientConnect
 //===========================================================================
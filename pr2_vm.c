@@ -32,6 +32,9 @@
 #include "qwsvdef.h"
 //#include "crc.c"
 
+#ifdef QVM_JIT
+cvar_t	sv_vmjit = {"sv_vmjit","1"};	// 0 runs compiled modules in the interpreter
+#endif
 #ifdef QVM_PROFILE
 cvar_t	sv_enableprofile = {"sv_enableprofile","0"};
 typedef struct
@@ -136,8 +139,12 @@ void PR2_Profile_f()
 
 void VM_UnloadQVM( qvm_t * qvm )
 {
-	if(qvm)
-		Q_free( qvm );
+	if(!qvm)
+		return;
+#ifdef QVM_JIT
+	QVM_JitFree( qvm );
+#endif
+	Q_free( qvm );
 }
 
 void VM_Unload( vm_t * vm )
@@ -218,8 +225,14 @@ void VM_PrintInfo( vm_t * vm)
 		Con_DPrintf("native\n");
 		break;
 	case VM_BYTECODE:
+		qvm = (qvm_t *)vm->hInst;
+#ifdef QVM_JIT
+		if(qvm && qvm->jit)
+			Con_DPrintf("bytecode compiled\n");
+		else
+#endif
 		Con_DPrintf("bytecode interpreted\n");
-		if((qvm=(qvm_t *)vm->hInst))
+		if(qvm)
 		{
 			Con_DPrintf("     code  length: %8xh\n", qvm->len_cs*sizeof(qvm->cs[0]));
 			Con_DPrintf("instruction count: %8d\n", qvm->len_cs);
@@ -443,6 +456,10 @@ qbool VM_LoadBytecode( vm_t * vm, sys_callex_t syscall1 )
 	}
 
 	LoadMapFile( qvm, vm->name );
+#ifdef QVM_JIT
+	QVM_JitCompile( qvm );
+#endif
+	PR_ProfReload();
 	vm->type = VM_BYTECODE;
 	vm->hInst = qvm;
 	return true;
@@ -504,6 +521,12 @@ int VM_Call( vm_t * vm, int command, int arg0, int arg1, int arg2, int arg3, int
 	case VM_NATIVE:
 		return vm->vmMain( command, arg0, arg1, arg2, arg3, arg4, arg5, arg6, arg7, arg8, arg9, arg10, arg11 );
 	case VM_BYTECODE:
+#ifdef QVM_JIT
+		// the profilers count instructions and calls, only the interpreter does that
+		if ( ((qvm_t*) vm->hInst)->jit && (int)sv_vmjit.value && !(int)sv_enableprofile.value && !pr_profiling )
+			return QVM_JitExec( (qvm_t*) vm->hInst, command, arg0, arg1, arg2, arg3, arg4, arg5, arg6, arg7, arg8, arg9,
+			                    arg10, arg11 );
+#endif
 		return QVM_Exec( (qvm_t*) vm->hInst, command, arg0, arg1, arg2, arg3, arg4, arg5, arg6, arg7, arg8, arg9, arg10,
 		                 arg11 );
 	case VM_NONE:
@@ -710,6 +733,8 @@ int QVM_Exec( register qvm_t * qvm, int command, int arg0, int arg1, int arg2, i
 			}
 #endif
 			STACK_INT( 1 ) = op.parm._int;
+			if ( pr_profiling )
+				PR_ProfEnter( qvm->PC - 1 );
 #ifdef QVM_RUNAWAY_PROTECTION
 			if(++cycles_p >= MAX_PROC_CALL)
 				QVM_RunError( qvm, "MAX_PROC_CALL reached\n" );
@@ -724,6 +749,8 @@ int QVM_Exec( register qvm_t * qvm, int command, int arg0, int arg1, int arg2, i
 				QVM_RunError( qvm, "QVM Stack underflow on leave at %8x", qvm->PC );
 #endif
 			qvm->PC = STACK_INT( 0 );
+			if ( pr_profiling )
+				PR_ProfLeave();
 #ifdef QVM_PROFILE
 			if((int)sv_enableprofile.value)
 			{
@@ -742,7 +769,14 @@ int QVM_Exec( register qvm_t * qvm, int command, int arg0, int arg1, int arg2, i
 			ivar = opStack[qvm->SP--]._int;
 			if ( ivar < 0 )
 			{
-				ivar = trap_Call( qvm, -ivar - 1 );
+				if ( pr_profiling )
+				{
+					PR_ProfEnter( ivar );
+					ivar = trap_Call( qvm, -ivar - 1 );
+					PR_ProfLeave();
+				}
+				else
+					ivar = trap_Call( qvm, -ivar - 1 );
 				opStack[qvm->SP]._int = ivar;
 			}
 			else
@@ -28,6 +28,10 @@
 #define QVM_DATA_PROTECTION
 #define QVM_PROFILE
 
+#if defined(__linux__) && defined(__x86_64__)
+#define QVM_JIT				// compile bytecode to native code, see pr2_vm_jit.c
+#endif
+
 #ifdef _WIN32
 #define EXPORT_FN __cdecl
 #else
@@ -228,6 +232,9 @@ typedef struct {
 	int	reenter;
 	symbols_t* sym_info;
 	sys_callex_t syscall;
+#ifdef QVM_JIT
+	struct qvmjit_s *jit;	// compiled code, NULL if interpreted
+#endif
 } qvm_t;
 
 
@@ -268,9 +275,20 @@ typedef enum
 extern char* opcode_names[];
 extern void VM_Unload(vm_t *vm);
 vm_t* VM_Load(vm_t *vm, vm_type_t type, char *name,sys_call_t syscall,sys_callex_t syscallex);
+qbool VM_LoadBytecode(vm_t *vm, sys_callex_t syscall1);
 extern int VM_Call(vm_t *vm, int /*command*/, int /*arg0*/, int , int , int , int , int , 
 				int , int , int , int , int , int /*arg11*/);
 void  QVM_StackTrace( qvm_t * qvm );
+symbols_t* QVM_FindName( qvm_t * qvm, int off );
+void QVM_RunError( qvm_t * qvm, char *error, ... );
 void VM_PrintInfo( vm_t * vm);
 
+#ifdef QVM_JIT
+extern cvar_t sv_vmjit;
+qbool QVM_JitCompile( qvm_t * qvm );
+void QVM_JitFree( qvm_t * qvm );
+int QVM_JitExec( qvm_t * qvm, int command, int arg0, int arg1, int arg2, int arg3,
+                 int arg4, int arg5, int arg6, int arg7, int arg8, int arg9, int arg10, int arg11 );
+#endif
+
 #endif /* !__PR2_VM_H__ */
@@ -0,0 +1,864 @@
+/*
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  $Id$
+ */
+/*
+  x86-64 code generator for QVM bytecode
+
+  Every QVM instruction is translated to native code when the module is
+  loaded.  QVM procedures become native procedures: OP_CALL is a call
+  through a table of procedure entry points, OP_LEAVE is a ret.
+
+  registers while running compiled code:
+    r12     ds, base of the data segment
+    r13     base of the opStack
+    rbx     opStack index, only bl is ever changed so it wraps at 256
+            and can't address anything outside the opStack
+    r14     procedure entry table, indexed by instruction number
+    r15d    LP, same meaning as qvm->LP
+    ebp     backward jumps left in the current procedure
+
+  All data segment accesses are checked against ds_mask like the
+  interpreter does with QVM_DATA_PROTECTION, errors end up in QVM_RunError
+  with qvm->PC and qvm->LP set so the stack trace works.
+*/
+
+#if defined(USE_PR2)
+
+#include "qwsvdef.h"
+
+#ifdef QVM_JIT
+
+#include <sys/mman.h>
+
+typedef enum
+{
+	JIT_ERR_BREAK,
+	JIT_ERR_DATA,
+	JIT_ERR_STACK,
+	JIT_ERR_CALL,
+	JIT_ERR_JUMP,
+	JIT_ERR_RUNAWAY,
+	JIT_ERR_DIVIDE
+} jiterror_t;
+
+static char *jit_errors[] =
+{
+	"OP_BREAK",
+	"data access out of range",
+	"QVM Stack overflow",
+	"bad call target",
+	"bad jump target",
+	"QVM runaway loop error",
+	"integer division by zero"
+};
+
+struct qvmjit_s
+{
+	byte	*code;
+	int		codesize;
+	void	**calls;	// native entry for each instruction that starts a procedure
+	void	**jumps;	// native address of each instruction allowed as OP_JUMP target
+	int		(*entry) (int *opstack);
+};
+
+// code generation state
+static byte		*jit_buf;
+static int		jit_size, jit_maxsize;
+static int		*jit_instr;		// code offset of each instruction
+static byte		*jit_target;	// instructions that are targets of conditional jumps
+
+typedef struct
+{
+	int		at;		// offset of a rel32
+	int		pc;		// instruction it refers to
+} jitfixup_t;
+
+static jitfixup_t	*jit_fixups;
+static int		jit_numfixups, jit_maxfixups;
+
+static int		jit_error_ofs, jit_badcall_ofs, jit_badjump_ofs;
+static int		jit_pc;
+static qvm_t	*jit_qvm;
+
+/*
+=============================================================================
+
+RUNTIME HELPERS
+
+called from the generated code with LP already stored in the qvm
+
+=============================================================================
+*/
+
+static void QVM_JitError (qvm_t *qvm, int error, int pc)
+{
+	if (pc >= 0)
+		qvm->PC = pc;
+	QVM_RunError (qvm, "%s at %8x\n", jit_errors[error], pc);
+}
+
+static int QVM_JitSyscall (qvm_t *qvm, int apinum, int pc)
+{
+	qvm->PC = pc;
+	return qvm->syscall (qvm->ds, qvm->ds_mask, apinum, (pr2val_t *) (qvm->ds + qvm->LP + 2 * sizeof(int)));
+}
+
+static void QVM_JitBlockCopy (qvm_t *qvm, int off1, int off2, int len, int pc)
+{
+	if ((off1 & ~qvm->ds_mask) || (off2 & ~qvm->ds_mask)
+		|| ((off1 + len) & ~qvm->ds_mask) || ((off2 + len) & ~qvm->ds_mask))
+	{
+		qvm->PC = pc;
+		QVM_RunError (qvm, "block copy out of range %8x\n", off1);
+	}
+	memmove (qvm->ds + off1, qvm->ds + off2, len);
+}
+
+/*
+=============================================================================
+
+EMITTER
+
+=============================================================================
+*/
+
+// opStack operands, [r13 + rbx*4 + disp]
+#define TOP		0
+#define NEXT	-4
+
+// condition codes, added to 0x70 for short and to 0x0f 0x80 for near jumps
+#define CC_B	0x2
+#define CC_AE	0x3
+#define CC_E	0x4
+#define CC_NE	0x5
+#define CC_BE	0x6
+#define CC_A	0x7
+#define CC_NS	0x9
+#define CC_P	0xa
+#define CC_L	0xc
+#define CC_GE	0xd
+#define CC_LE	0xe
+#define CC_G	0xf
+
+static void Emit1 (int b)
+{
+	if (jit_size >= jit_maxsize)
+	{
+		jit_maxsize = max (jit_maxsize * 2, 0x10000);
+		jit_buf = (byte *) Q_realloc (jit_buf, jit_maxsize);
+	}
+	jit_buf[jit_size++] = b;
+}
+
+static void Emit4 (int i)
+{
+	Emit1 (i & 0xff);
+	Emit1 ((i >> 8) & 0xff);
+	Emit1 ((i >> 16) & 0xff);
+	Emit1 ((i >> 24) & 0xff);
+}
+
+static void Emit8 (void *p)
+{
+	unsigned long long u = (unsigned long long) (quintptr_t) p;
+
+	Emit4 ((int) u);
+	Emit4 ((int) (u >> 32));
+}
+
+static void EmitBytes (int count, ...)
+{
+	va_list argptr;
+
+	va_start (argptr, count);
+	while (count--)
+		Emit1 (va_arg (argptr, int));
+	va_end (argptr);
+}
+
+// rel32 to a code offset that is already known
+static void EmitRel (int ofs)
+{
+	Emit4 (ofs - (jit_size + 4));
+}
+
+// rel32 to an instruction, patched once everything is emitted
+static void EmitRelInstr (int pc)
+{
+	if (jit_numfixups == jit_maxfixups)
+	{
+		jit_maxfixups = max (jit_maxfixups * 2, 1024);
+		jit_fixups = (jitfixup_t *) Q_realloc (jit_fixups, jit_maxfixups * sizeof(jitfixup_t));
+	}
+	jit_fixups[jit_numfixups].at = jit_size;
+	jit_fixups[jit_numfixups].pc = pc;
+	jit_numfixups++;
+	Emit4 (0);
+}
+
+// <prefix> rex.b <op> reg, [r13 + rbx*4 + disp]
+static void EmitOpStack (int prefix, int op, int reg, int disp)
+{
+	if (prefix)
+		Emit1 (prefix);
+	Emit1 (0x41);
+	if (op > 0xff)
+		Emit1 (op >> 8);
+	Emit1 (op & 0xff);
+	Emit1 (0x44 | (reg << 3));
+	Emit1 (0x9d);
+	Emit1 (disp & 0xff);
+}
+
+#define EmitIncSP()		EmitBytes (2, 0xfe, 0xc3)	// inc bl
+#define EmitDecSP()		EmitBytes (2, 0xfe, 0xcb)	// dec bl
+#define EmitPopSP2()	EmitBytes (3, 0x80, 0xeb, 0x02)	// sub bl, 2
+
+// mov esi, error; mov edx, pc; jmp error stub
+static void EmitErrorJump (jiterror_t error, int pc)
+{
+	Emit1 (0xbe);
+	Emit4 (error);
+	Emit1 (0xba);
+	Emit4 (pc);
+	Emit1 (0xe9);
+	EmitRel (jit_error_ofs);
+}
+
+// skips over the error when the condition holds
+static void EmitCheck (int cc, jiterror_t error)
+{
+	EmitBytes (2, 0x70 + cc, 15);
+	EmitErrorJump (error, jit_pc);
+}
+
+// mov rdi, qvm; mov [rdi + LP], r15d
+static void EmitStoreLP (void)
+{
+	EmitBytes (2, 0x48, 0xbf);
+	Emit8 (jit_qvm);
+	EmitBytes (3, 0x44, 0x89, 0xbf);
+	Emit4 ((int) (quintptr_t) &((qvm_t *) 0)->LP);
+}
+
+// mov rax, func; call rax
+static void EmitCallC (void *func)
+{
+	EmitBytes (2, 0x48, 0xb8);
+	Emit8 (func);
+	EmitBytes (2, 0xff, 0xd0);
+}
+
+// mov [r12 + r15 + disp], imm32
+static void EmitStoreStackInt (int disp, int value)
+{
+	EmitBytes (5, 0x43, 0xc7, 0x44, 0x3c, disp);
+	Emit4 (value);
+}
+
+// esi holds the syscall number, result is pushed
+static void EmitSyscall (void)
+{
+	Emit1 (0xba);
+	Emit4 (jit_pc);		// mov edx, pc
+	EmitStoreLP ();
+	EmitCallC ((void *) QVM_JitSyscall);
+	EmitIncSP ();
+	EmitOpStack (0, 0x89, 0, TOP);	// mov TOP, eax
+}
+
+// one backward jump less left, a procedure is allowed MAX_CYCLES of them
+static void EmitCountJump (void)
+{
+	EmitBytes (3, 0x83, 0xed, 0x01);	// sub ebp, 1
+	EmitCheck (CC_NS, JIT_ERR_RUNAWAY);
+}
+
+// checks the data segment offset in eax (reg 0) or ecx (reg 1)
+static void EmitCheckData (int reg)
+{
+	if (reg)
+		EmitBytes (2, 0xf7, 0xc1);		// test ecx, imm32
+	else
+		Emit1 (0xa9);					// test eax, imm32
+	Emit4 (~jit_qvm->ds_mask);
+	EmitCheck (CC_E, JIT_ERR_DATA);
+}
+
+static void EmitBranch (qvm_instruction_t *op)
+{
+	static const int intcc[] = { CC_E, CC_NE, CC_L, CC_LE, CC_G, CC_GE, CC_B, CC_BE, CC_A, CC_AE };
+	int target = op->parm._int;
+
+	if (target <= jit_pc)
+		EmitCountJump ();
+
+	if (op->opcode <= OP_GEU)
+	{
+		EmitOpStack (0, 0x8b, 0, NEXT);		// mov eax, NEXT
+		EmitOpStack (0, 0x8b, 1, TOP);		// mov ecx, TOP
+		EmitPopSP2 ();
+		EmitBytes (2, 0x39, 0xc8);			// cmp eax, ecx
+		EmitBytes (2, 0x0f, 0x80 + intcc[op->opcode - OP_EQ]);
+		EmitRelInstr (target);
+		return;
+	}
+
+	EmitOpStack (0xf3, 0x0f10, 0, NEXT);	// movss xmm0, NEXT
+	EmitOpStack (0xf3, 0x0f10, 1, TOP);		// movss xmm1, TOP
+	EmitPopSP2 ();
+
+	// unordered compares set ZF, PF and CF, so only the ones that test
+	// "above" get NaN right without looking at PF
+	switch (op->opcode)
+	{
+	case OP_EQF:
+		EmitBytes (3, 0x0f, 0x2e, 0xc1);	// ucomiss xmm0, xmm1
+		EmitBytes (2, 0x70 + CC_P, 6);
+		EmitBytes (2, 0x0f, 0x80 + CC_E);
+		break;
+	case OP_NEF:
+		EmitBytes (3, 0x0f, 0x2e, 0xc1);
+		EmitBytes (2, 0x0f, 0x80 + CC_P);
+		EmitRelInstr (target);
+		EmitBytes (2, 0x0f, 0x80 + CC_NE);
+		break;
+	case OP_LTF:
+		EmitBytes (3, 0x0f, 0x2e, 0xc8);	// ucomiss xmm1, xmm0
+		EmitBytes (2, 0x0f, 0x80 + CC_A);
+		break;
+	case OP_LEF:
+		EmitBytes (3, 0x0f, 0x2e, 0xc8);
+		EmitBytes (2, 0x0f, 0x80 + CC_AE);
+		break;
+	case OP_GTF:
+		EmitBytes (3, 0x0f, 0x2e, 0xc1);
+		EmitBytes (2, 0x0f, 0x80 + CC_A);
+		break;
+	default:	// OP_GEF
+		EmitBytes (3, 0x0f, 0x2e, 0xc1);
+		EmitBytes (2, 0x0f, 0x80 + CC_AE);
+		break;
+	}
+	EmitRelInstr (target);
+}
+
+static void EmitBinaryInt (int op)
+{
+	EmitOpStack (0, 0x8b, 0, TOP);		// mov eax, TOP
+	EmitDecSP ();
+	EmitOpStack (0, op, 0, TOP);		// <op> TOP, eax
+}
+
+static void EmitBinaryFloat (int op)
+{
+	EmitOpStack (0xf3, 0x0f10, 0, NEXT);	// movss xmm0, NEXT
+	EmitOpStack (0xf3, op, 0, TOP);			// <op>ss xmm0, TOP
+	EmitOpStack (0xf3, 0x0f11, 0, NEXT);	// movss NEXT, xmm0
+	EmitDecSP ();
+}
+
+static void EmitDivide (qbool sign, qbool mod)
+{
+	EmitOpStack (0, 0x8b, 1, TOP);		// mov ecx, TOP
+	EmitDecSP ();
+	EmitBytes (2, 0x85, 0xc9);			// test ecx, ecx
+	EmitCheck (CC_NE, JIT_ERR_DIVIDE);
+	EmitOpStack (0, 0x8b, 0, TOP);		// mov eax, TOP
+	if (sign)
+		EmitBytes (3, 0x99, 0xf7, 0xf9);	// cdq; idiv ecx
+	else
+		EmitBytes (4, 0x31, 0xd2, 0xf7, 0xf1);	// xor edx, edx; div ecx
+	EmitOpStack (0, 0x89, mod ? 2 : 0, TOP);	// mov TOP, eax/edx
+}
+
+static void EmitShift (int ext)
+{
+	EmitOpStack (0, 0x8b, 1, TOP);		// mov ecx, TOP
+	EmitDecSP ();
+	EmitOpStack (0, 0xd3, ext, TOP);	// shl/sar/shr TOP, cl
+}
+
+// returns the number of instructions translated
+static int EmitInstruction (qvm_instruction_t *op)
+{
+	qvm_t *qvm = jit_qvm;
+	int i;
+
+	switch (op->opcode)
+	{
+	case OP_IGNORE:
+		break;
+
+	case OP_ENTER:
+		Emit1 (0x55);						// push rbp
+		Emit1 (0xbd);
+		Emit4 (MAX_CYCLES);					// mov ebp, MAX_CYCLES
+		EmitBytes (3, 0x41, 0x81, 0xef);
+		Emit4 (op->parm._int);				// sub r15d, imm32
+		EmitBytes (3, 0x41, 0x81, 0xff);
+		Emit4 (qvm->len_ds - qvm->len_ss);	// cmp r15d, imm32
+		EmitCheck (CC_GE, JIT_ERR_STACK);
+		EmitStoreStackInt (4, op->parm._int);
+		break;
+
+	case OP_LEAVE:
+		EmitBytes (3, 0x41, 0x81, 0xc7);
+		Emit4 (op->parm._int);				// add r15d, imm32
+		EmitBytes (3, 0x41, 0x81, 0xff);
+		Emit4 (qvm->len_ds - 2 * sizeof(int));	// cmp r15d, imm32
+		EmitCheck (CC_LE, JIT_ERR_STACK);
+		EmitBytes (2, 0x5d, 0xc3);			// pop rbp; ret
+		break;
+
+	case OP_CONST:
+		// constant call targets are the common case, call them directly
+		if (op[1].opcode == OP_CALL && !jit_target[jit_pc + 1] && (i = op->parm._int) < qvm->len_cs
+			&& (i < 0 || qvm->cs[i].opcode == OP_ENTER))
+		{
+			EmitStoreStackInt (0, jit_pc + 2);
+			if (i < 0)
+			{
+				Emit1 (0xbe);
+				Emit4 (-i - 1);				// mov esi, apinum
+				EmitSyscall ();
+			}
+			else
+			{
+				Emit1 (0xe8);
+				EmitRelInstr (i);			// call procedure
+			}
+			return 2;
+		}
+		EmitIncSP ();
+		EmitOpStack (0, 0xc7, 0, TOP);
+		Emit4 (op->parm._int);				// mov TOP, imm32
+		break;
+
+	case OP_LOCAL:
+		EmitIncSP ();
+		EmitBytes (3, 0x41, 0x8d, 0x87);
+		Emit4 (op->parm._int);				// lea eax, [r15 + imm32]
+		EmitOpStack (0, 0x89, 0, TOP);
+		break;
+
+	case OP_CALL:
+		EmitStoreStackInt (0, jit_pc + 1);
+		EmitOpStack (0, 0x8b, 0, TOP);
+		EmitDecSP ();
+		EmitBytes (4, 0x85, 0xc0, 0x78, 0);	// test eax, eax; js syscall
+		i = jit_size;
+		Emit1 (0x3d);
+		Emit4 (qvm->len_cs);				// cmp eax, len_cs
+		EmitCheck (CC_B, JIT_ERR_CALL);
+		EmitBytes (4, 0x41, 0xff, 0x14, 0xc6);	// call [r14 + rax*8]
+		EmitBytes (2, 0xeb, 0);				// jmp done
+		jit_buf[i - 1] = jit_size - i;
+		i = jit_size;
+		EmitBytes (4, 0xf7, 0xd0, 0x89, 0xc6);	// not eax; mov esi, eax
+		EmitSyscall ();
+		jit_buf[i - 1] = jit_size - i;
+		break;
+
+	case OP_PUSH:
+		EmitIncSP ();
+		break;
+
+	case OP_POP:
+		EmitDecSP ();
+		break;
+
+	case OP_JUMP:
+		EmitOpStack (0, 0x8b, 0, TOP);
+		EmitDecSP ();
+		Emit1 (0x3d);
+		Emit4 (qvm->len_cs);				// cmp eax, len_cs
+		EmitCheck (CC_B, JIT_ERR_JUMP);
+		EmitCountJump ();
+		EmitBytes (2, 0x48, 0xb9);
+		Emit8 (qvm->jit->jumps);			// mov rcx, jumps
+		EmitBytes (3, 0xff, 0x24, 0xc1);	// jmp [rcx + rax*8]
+		break;
+
+	case OP_EQ: case OP_NE:
+	case OP_LTI: case OP_LEI: case OP_GTI: case OP_GEI:
+	case OP_LTU: case OP_LEU: case OP_GTU: case OP_GEU:
+	case OP_EQF: case OP_NEF:
+	case OP_LTF: case OP_LEF: case OP_GTF: case OP_GEF:
+		EmitBranch (op);
+		break;
+
+	case OP_LOAD1:
+	case OP_LOAD2:
+	case OP_LOAD4:
+		EmitOpStack (0, 0x8b, 0, TOP);
+		EmitCheckData (0);
+		// same as the interpreter, which is built with -funsigned-char
+		if (op->opcode == OP_LOAD1)
+			EmitBytes (5, 0x41, 0x0f, 0xb6, 0x04, 0x04);	// movzx eax, byte [r12 + rax]
+		else if (op->opcode == OP_LOAD2)
+			EmitBytes (5, 0x41, 0x0f, 0xbf, 0x04, 0x04);	// movsx eax, word [r12 + rax]
+		else
+			EmitBytes (4, 0x41, 0x8b, 0x04, 0x04);			// mov eax, [r12 + rax]
+		EmitOpStack (0, 0x89, 0, TOP);
+		break;
+
+	case OP_STORE1:
+	case OP_STORE2:
+	case OP_STORE4:
+		EmitOpStack (0, 0x8b, 0, NEXT);
+		EmitOpStack (0, 0x8b, 1, TOP);
+		EmitCheckData (0);
+		if (op->opcode == OP_STORE1)
+			EmitBytes (4, 0x41, 0x88, 0x0c, 0x04);			// mov [r12 + rax], cl
+		else if (op->opcode == OP_STORE2)
+			EmitBytes (5, 0x66, 0x41, 0x89, 0x0c, 0x04);	// mov [r12 + rax], cx
+		else
+			EmitBytes (4, 0x41, 0x89, 0x0c, 0x04);			// mov [r12 + rax], ecx
+		EmitPopSP2 ();
+		break;
+
+	case OP_ARG:
+		EmitBytes (3, 0x41, 0x8d, 0x8f);
+		Emit4 (op->parm._int);				// lea ecx, [r15 + imm32]
+		EmitCheckData (1);
+		EmitOpStack (0, 0x8b, 0, TOP);
+		EmitDecSP ();
+		EmitBytes (4, 0x41, 0x89, 0x04, 0x0c);	// mov [r12 + rcx], eax
+		break;
+
+	case OP_BLOCK_COPY:
+		EmitOpStack (0, 0x8b, 6, NEXT);		// mov esi, NEXT
+		EmitOpStack (0, 0x8b, 2, TOP);		// mov edx, TOP
+		EmitPopSP2 ();
+		Emit1 (0xb9);
+		Emit4 (op->parm._int);				// mov ecx, len
+		EmitBytes (2, 0x41, 0xb8);
+		Emit4 (jit_pc);						// mov r8d, pc
+		EmitStoreLP ();
+		EmitCallC ((void *) QVM_JitBlockCopy);
+		break;
+
+	case OP_SEX8:
+	case OP_SEX16:
+		EmitOpStack (0, op->opcode == OP_SEX8 ? 0x0fbe : 0x0fbf, 0, TOP);	// movsx eax, TOP
+		EmitOpStack (0, 0x89, 0, TOP);
+		break;
+
+	case OP_NEGI:
+		EmitOpStack (0, 0xf7, 3, TOP);		// neg TOP
+		break;
+
+	case OP_BCOM:
+		EmitOpStack (0, 0xf7, 2, TOP);		// not TOP
+		break;
+
+	case OP_ADD:	EmitBinaryInt (0x01); break;
+	case OP_SUB:	EmitBinaryInt (0x29); break;
+	case OP_BAND:	EmitBinaryInt (0x21); break;
+	case OP_BOR:	EmitBinaryInt (0x09); break;
+	case OP_BXOR:	EmitBinaryInt (0x31); break;
+
+	case OP_MULI:
+	case OP_MULU:
+		EmitOpStack (0, 0x8b, 0, TOP);
+		EmitDecSP ();
+		EmitOpStack (0, 0x0faf, 0, TOP);	// imul eax, TOP
+		EmitOpStack (0, 0x89, 0, TOP);
+		break;
+
+	case OP_DIVI:	EmitDivide (true, false); break;
+	case OP_DIVU:	EmitDivide (false, false); break;
+	case OP_MODI:	EmitDivide (true, true); break;
+	case OP_MODU:	EmitDivide (false, true); break;
+
+	case OP_LSH:	EmitShift (4); break;
+	case OP_RSHI:	EmitShift (7); break;
+	case OP_RSHU:	EmitShift (5); break;
+
+	case OP_NEGF:
+		EmitOpStack (0, 0x81, 6, TOP);
+		Emit4 (0x80000000);					// xor TOP, sign bit
+		break;
+
+	case OP_ADDF:	EmitBinaryFloat (0x0f58); break;
+	case OP_SUBF:	EmitBinaryFloat (0x0f5c); break;
+	case OP_MULF:	EmitBinaryFloat (0x0f59); break;
+	case OP_DIVF:	EmitBinaryFloat (0x0f5e); break;
+
+	case OP_CVIF:
+		EmitOpStack (0xf3, 0x0f2a, 0, TOP);		// cvtsi2ss xmm0, TOP
+		EmitOpStack (0xf3, 0x0f11, 0, TOP);		// movss TOP, xmm0
+		break;
+
+	case OP_CVFI:
+		EmitOpStack (0xf3, 0x0f2c, 0, TOP);		// cvttss2si eax, TOP
+		EmitOpStack (0, 0x89, 0, TOP);
+		break;
+
+	default:	// OP_UNDEF, OP_BREAK and garbage
+		EmitErrorJump (JIT_ERR_BREAK, jit_pc);
+		break;
+	}
+
+	return 1;
+}
+
+/*
+=============================================================================
+
+COMPILER
+
+=============================================================================
+*/
+
+static void EmitEntry (void)
+{
+	// int entry (int *opstack)
+	EmitBytes (10, 0x53, 0x55, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57);	// push rbx ... r15
+	EmitBytes (4, 0x48, 0x83, 0xec, 0x08);	// sub rsp, 8, compiled code runs with an aligned stack
+	EmitBytes (3, 0x49, 0x89, 0xfd);		// mov r13, rdi
+	EmitBytes (2, 0x31, 0xdb);				// xor ebx, ebx
+	EmitBytes (2, 0x49, 0xbc);
+	Emit8 (jit_qvm->ds);					// mov r12, ds
+	EmitBytes (2, 0x49, 0xbe);
+	Emit8 (jit_qvm->jit->calls);			// mov r14, calls
+	EmitBytes (2, 0x48, 0xb8);
+	Emit8 (jit_qvm);						// mov rax, qvm
+	EmitBytes (3, 0x44, 0x8b, 0xb8);
+	Emit4 ((int) (quintptr_t) &((qvm_t *) 0)->LP);	// mov r15d, [rax + LP]
+	Emit1 (0xe8);
+	EmitRelInstr (0);						// call vmMain
+	EmitOpStack (0, 0x8b, 0, TOP);			// mov eax, TOP
+	EmitBytes (4, 0x48, 0x83, 0xc4, 0x08);	// add rsp, 8
+	EmitBytes (11, 0x41, 0x5f, 0x41, 0x5e, 0x41, 0x5d, 0x41, 0x5c, 0x5d, 0x5b, 0xc3);
+
+	// error stub, esi = error, edx = pc
+	jit_error_ofs = jit_size;
+	EmitBytes (4, 0x48, 0x83, 0xe4, 0xf0);	// and rsp, -16
+	EmitStoreLP ();
+	EmitCallC ((void *) QVM_JitError);
+	Emit1 (0xcc);
+
+	jit_badcall_ofs = jit_size;
+	EmitErrorJump (JIT_ERR_CALL, -1);
+	jit_badjump_ofs = jit_size;
+	EmitErrorJump (JIT_ERR_JUMP, -1);
+}
+
+// checks what the generated code relies on, so that no bytecode can break
+// the native stack: procedures are only entered by calls and always start
+// with OP_ENTER, and there is no way to fall into the next procedure,
+// or off the end of the code.  VM_LoadBytecode puts an OP_BREAK after the
+// last instruction, the last procedure has to end before it.
+// Returns what is wrong with the code, NULL if it can be compiled.
+static char *QVM_JitVerify (qvm_t *qvm)
+{
+	qvm_instruction_t *op;
+	int i;
+
+	if (qvm->len_cs < 2 || qvm->cs[0].opcode != OP_ENTER)
+		return "the code doesn't start with OP_ENTER";
+	if (qvm->cs[qvm->len_cs - 1].opcode != OP_BREAK)
+		return "the code isn't padded with OP_BREAK";
+
+	op = &qvm->cs[qvm->len_cs - 2];
+	if (op->opcode != OP_LEAVE && op->opcode != OP_JUMP)
+		return "the last procedure doesn't end in OP_LEAVE or OP_JUMP";
+
+	for (i = 0, op = qvm->cs; i < qvm->len_cs; i++, op++)
+	{
+		switch (op->opcode)
+		{
+		case OP_ENTER:
+			if (op->parm._int < 2 * (int) sizeof(int) || op->parm._int >= qvm->len_ss)
+				return va ("bad OP_ENTER frame at %i", i);
+			if (i && qvm->cs[i - 1].opcode != OP_LEAVE)
+				return va ("no OP_LEAVE before the procedure at %i", i);
+			break;
+		case OP_LEAVE:
+			if (op->parm._int < 2 * (int) sizeof(int) || op->parm._int >= qvm->len_ss)
+				return va ("bad OP_LEAVE frame at %i", i);
+			break;
+		case OP_EQ: case OP_NE:
+		case OP_LTI: case OP_LEI: case OP_GTI: case OP_GEI:
+		case OP_LTU: case OP_LEU: case OP_GTU: case OP_GEU:
+		case OP_EQF: case OP_NEF:
+		case OP_LTF: case OP_LEF: case OP_GTF: case OP_GEF:
+			if (op->parm._uint >= (unsigned int) qvm->len_cs || qvm->cs[op->parm._int].opcode == OP_ENTER)
+				return va ("bad branch at %i", i);
+			jit_target[op->parm._int] = true;
+			break;
+		default:
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+void QVM_JitFree (qvm_t *qvm)
+{
+	if (!qvm->jit)
+		return;
+
+	if (qvm->jit->code)
+		munmap (qvm->jit->code, qvm->jit->codesize);
+	Q_free (qvm->jit->calls);
+	Q_free (qvm->jit->jumps);
+	Q_free (qvm->jit);
+}
+
+/*
+=================
+QVM_JitCompile
+
+Translates the loaded bytecode, returns false if the interpreter has to be used
+=================
+*/
+qbool QVM_JitCompile (qvm_t *qvm)
+{
+	struct qvmjit_s *jit;
+	double start = Sys_DoubleTime ();
+	int i, n, len;
+	char *error;
+	byte *code;
+
+	QVM_JitFree (qvm);
+
+	jit_target = (byte *) Q_malloc (qvm->len_cs);
+	if ((error = QVM_JitVerify (qvm)))
+	{
+		Con_Printf ("QVM_JitCompile: %s, using the interpreter\n", error);
+		Q_free (jit_target);
+		return false;
+	}
+
+	jit = qvm->jit = (struct qvmjit_s *) Q_malloc (sizeof(*jit));
+	jit->calls = (void **) Q_malloc (qvm->len_cs * sizeof(void *));
+	jit->jumps = (void **) Q_malloc (qvm->len_cs * sizeof(void *));
+	jit_instr = (int *) Q_malloc (qvm->len_cs * sizeof(int));
+	jit_qvm = qvm;
+	jit_size = jit_numfixups = 0;
+
+	EmitEntry ();
+
+	for (i = 0; i < qvm->len_cs; i += n)
+	{
+		jit_pc = i;
+		jit_instr[i] = jit_size;
+		n = EmitInstruction (&qvm->cs[i]);
+		if (n == 2)
+			jit_instr[i + 1] = -1;	// part of a direct call, not a jump target
+	}
+
+	for (i = 0; i < jit_numfixups; i++)
+		*(int *) (jit_buf + jit_fixups[i].at) = jit_instr[jit_fixups[i].pc] - (jit_fixups[i].at + 4);
+
+	len = (jit_size + 4095) & ~4095;
+	code = (byte *) mmap (NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (code == MAP_FAILED)
+	{
+		Con_Printf ("QVM_JitCompile: mmap failed, using the interpreter\n");
+		Q_free (jit_instr);
+		Q_free (jit_target);
+		QVM_JitFree (qvm);
+		return false;
+	}
+
+	memcpy (code, jit_buf, jit_size);
+	jit->code = code;
+	jit->codesize = len;
+	jit->entry = (int (*)(int *)) code;
+
+	for (i = 0; i < qvm->len_cs; i++)
+	{
+		jit->calls[i] = code + (qvm->cs[i].opcode == OP_ENTER ? jit_instr[i] : jit_badcall_ofs);
+		jit->jumps[i] = code + (qvm->cs[i].opcode == OP_ENTER || jit_instr[i] < 0 ? jit_badjump_ofs : jit_instr[i]);
+	}
+
+	if (mprotect (code, len, PROT_READ | PROT_EXEC))
+	{
+		Con_Printf ("QVM_JitCompile: mprotect failed, using the interpreter\n");
+		Q_free (jit_instr);
+		Q_free (jit_target);
+		QVM_JitFree (qvm);
+		return false;
+	}
+
+	Con_DPrintf ("QVM_JitCompile: %i instructions, %i bytes of code in %.1f ms\n",
+		qvm->len_cs, jit_size, 1000 * (Sys_DoubleTime () - start));
+
+	Q_free (jit_instr);
+	Q_free (jit_target);
+	Q_free (jit_buf);
+	Q_free (jit_fixups);
+	jit_maxsize = jit_maxfixups = 0;
+	return true;
+}
+
+/*
+=================
+QVM_JitExec
+
+Same as QVM_Exec, but runs the compiled code
+=================
+*/
+int QVM_JitExec (qvm_t *qvm, int command, int arg0, int arg1, int arg2, int arg3,
+                 int arg4, int arg5, int arg6, int arg7, int arg8, int arg9, int arg10, int arg11)
+{
+	int opStack[OPSTACKSIZE + 2];	// room for NEXT below the first slot
+	int savePC, saveLP, *stack, ret;
+
+	savePC = qvm->PC;
+	saveLP = qvm->LP;
+
+	if (!qvm->reenter)
+		qvm->LP = qvm->len_ds - sizeof(int);
+	if (qvm->reenter++ > MAX_vmMain_Call)
+		QVM_RunError (qvm, "QVM_Exec MAX_vmMain_Call reached");
+
+	qvm->LP -= 14 * sizeof(int);
+
+	stack = (int *) (qvm->ds + qvm->LP);
+	stack[0] = 0;	// return address
+	stack[1] = 14 * sizeof(int);
+	stack[2] = command;
+	stack[3] = arg0;
+	stack[4] = arg1;
+	stack[5] = arg2;
+	stack[6] = arg3;
+	stack[7] = arg4;
+	stack[8] = arg5;
+	stack[9] = arg6;
+	stack[10] = arg7;
+	stack[11] = arg8;
+	stack[12] = arg9;
+	stack[13] = arg10;
+	stack[14] = arg11;
+
+	ret = qvm->jit->entry (opStack + 1);
+
+	qvm->PC = savePC;
+	qvm->LP = saveLP;
+	qvm->reenter--;
+	return ret;
+}
+
+#endif /* QVM_JIT */
+
+#endif /* USE_PR2 */
@@ -22,7 +22,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "qwsvdef.h"
 
 #define	RETURN_EDICT(e) (((int *)pr_globals)[OFS_RETURN] = EDICT_TO_PROG(e))
-#define	RETURN_STRING(s) (((int *)pr_globals)[OFS_RETURN] = PR_SetString(s))
+#define	RETURN_STRING(s) (((int *)pr_globals)[OFS_RETURN] = PR_SetTmpString(s))
 
 /*
 ===============================================================================
@@ -878,16 +878,9 @@ void PF_executecmd (void)
 }
 
 #define MAX_PR_STRING_SIZE	2048
-#define MAX_PR_STRINGS		64
 
-int		pr_string_index = 0;
-char	pr_string_buf[MAX_PR_STRINGS][MAX_PR_STRING_SIZE];
-char	*pr_string_temp = pr_string_buf[0];
-
-void PF_SetTempString(void)
-{
-	pr_string_temp = pr_string_buf[(++pr_string_index) & (MAX_PR_STRINGS - 1)];
-}
+// builtins build their result here, PR_SetTmpString copies it
+char	pr_string_temp[MAX_PR_STRING_SIZE];
 
 
 /*
@@ -947,7 +940,6 @@ void PF_argv (void)
 		snprintf (pr_string_temp, MAX_PR_STRING_SIZE, "%s", Cmd_Argv(num));
 		RETURN_STRING(pr_string_temp);
 //		G_INT(OFS_RETURN) = PR_SetString(pr_string_temp);
-		PF_SetTempString();
 	}
 }
 
@@ -996,9 +988,7 @@ void PF_substr (void)
 
 	strlcpy(pr_string_temp, s, len + 1);
 
-	G_INT(OFS_RETURN) = PR_SetString(pr_string_temp);
-
-	PF_SetTempString();
+	G_INT(OFS_RETURN) = PR_SetTmpString(pr_string_temp);
 }
 
 /*
@@ -1013,9 +1003,7 @@ void PF_strcat (void)
 {
 	/* FIXME */
 	strcpy(pr_string_temp, PF_VarString(0)/*, MAX_PR_STRING_SIZE*/);
-	G_INT(OFS_RETURN) = PR_SetString(pr_string_temp);
-
-	PF_SetTempString();
+	G_INT(OFS_RETURN) = PR_SetTmpString(pr_string_temp);
 }
 
 /*
@@ -1171,7 +1159,7 @@ void PF_readcmd (void)
 		SV_BeginRedirect(old);
 
 
-	G_INT(OFS_RETURN) = PR_SetString(output);
+	G_INT(OFS_RETURN) = PR_SetTmpString(output);
 }
 
 /*
@@ -1522,8 +1510,7 @@ void PF_ftos (void)
 		snprintf (pr_string_temp, MAX_PR_STRING_SIZE, "%d",(int)v);
 	else
 		snprintf (pr_string_temp, MAX_PR_STRING_SIZE, "%5.1f",v);
-	G_INT(OFS_RETURN) = PR_SetString(pr_string_temp);
-	PF_SetTempString();
+	G_INT(OFS_RETURN) = PR_SetTmpString(pr_string_temp);
 }
 
 void PF_fabs (void)
@@ -1536,9 +1523,7 @@ void PF_fabs (void)
 void PF_vtos (void)
 {
 	snprintf (pr_string_temp, MAX_PR_STRING_SIZE, "'%5.1f %5.1f %5.1f'", G_VECTOR(OFS_PARM0)[0], G_VECTOR(OFS_PARM0)[1], G_VECTOR(OFS_PARM0)[2]);
-	G_INT(OFS_RETURN) = PR_SetString(pr_string_temp);
-
-	PF_SetTempString();
+	G_INT(OFS_RETURN) = PR_SetTmpString(pr_string_temp);
 }
 
 void PF_Spawn (void)
@@ -1616,7 +1601,7 @@ void PF_precache_sound (void)
 	{
 		if (!sv.sound_precache[i])
 		{
-			sv.sound_precache[i] = s;
+			sv.sound_precache[i] = PR_KeepString (G_INT(OFS_PARM0));
 			return;
 		}
 		if (!strcmp(sv.sound_precache[i], s))
@@ -1641,7 +1626,7 @@ void PF_precache_model (void)
 	{
 		if (!sv.model_precache[i])
 		{
-			sv.model_precache[i] = s;
+			sv.model_precache[i] = PR_KeepString (G_INT(OFS_PARM0));
 			return;
 		}
 		if (!strcmp(sv.model_precache[i], s))
@@ -1668,7 +1653,7 @@ static void PF_precache_vwep_model (void)
 	for (i = 0; i < MAX_VWEP_MODELS; i++)
 	{
 		if (!sv.vw_model_name[i]) {
-			sv.vw_model_name[i] = s;
+			sv.vw_model_name[i] = PR_KeepString (G_INT(OFS_PARM0));
 			G_INT(OFS_RETURN) = i;
 			return;
 		}
@@ -1682,8 +1667,11 @@ void PF_coredump (void)
 	ED_PrintEdicts ();
 }
 
+// only PR_ExecuteProgram traces, the threaded code ignores pr_trace
 void PF_traceon (void)
 {
+	if (sv_threadedprogs.value)
+		Con_DPrintf ("traceon: set sv_threadedprogs 0 to trace\n");
 	pr_trace = true;
 }
 
@@ -1789,7 +1777,14 @@ void PF_lightstyle (void)
 	style = G_FLOAT(OFS_PARM0);
 	val = G_STRING(OFS_PARM1);
 
-	// change the string in sv
+	// change the string in sv, temp strings don't stay where they are
+	if (PR_IsTmpString (G_INT(OFS_PARM1)))
+	{
+		if (strlen (val) >= sizeof(sv.tmplightstyles[style]))
+			Con_DPrintf ("PF_lightstyle: style %i cut to %i chars\n", style, (int) sizeof(sv.tmplightstyles[style]) - 1);
+		strlcpy (sv.tmplightstyles[style], val, sizeof(sv.tmplightstyles[style]));
+		val = sv.tmplightstyles[style];
+	}
 	sv.lightstyles[style] = val;
 
 	// send message to all clients on this server
@@ -2867,7 +2862,6 @@ void PF_infokey (void)
 
 	strlcpy(pr_string_temp, value, MAX_PR_STRING_SIZE);
 	RETURN_STRING(pr_string_temp);
-	PF_SetTempString();
 }
 
 /*
@@ -84,6 +84,7 @@ void ED_ClearEdict (edict_t *e)
 	memset (&e->v, 0, progs->entityfields * 4);
 	e->e->lastruntime = 0;
 	e->e->free = false;
+	SV_ThinkWake (e);
 }
 
 /*
@@ -1210,6 +1211,7 @@ void PR_LoadProgs (void)
 	pr_statements = (dstatement_t *)((byte *)progs + progs->ofs_statements);
 
 	num_prstr = 0;
+	PR_ClearStrings ();
 
 	pr_global_struct = (globalvars_t *)((byte *)progs + progs->ofs_globals);
 	pr_globals = (float *)pr_global_struct;
@@ -1258,6 +1260,9 @@ void PR_LoadProgs (void)
 	PR_InitPatchTables();
 #endif
 
+	PR_TranslateProgs ();
+	PR_ProfReload ();
+
 	// find optional QC-exported functions
 	SpectatorConnect = ED_FindFunctionOffset ("SpectatorConnect");
 	SpectatorThink = ED_FindFunctionOffset ("SpectatorThink");
@@ -1285,11 +1290,14 @@ void PR_Init (void)
 {
 	Cvar_Register(&sv_progsname);
 	Cvar_Register(&sv_forcenqprogs);
+	Cvar_Register(&sv_threadedprogs);
 
 	Cmd_AddCommand ("edict", ED_PrintEdict_f);
 	Cmd_AddCommand ("edicts", ED_PrintEdicts);
 	Cmd_AddCommand ("edictcount", ED_Count);
 	Cmd_AddCommand ("profile", PR_Profile_f);
+	Cmd_AddCommand ("sv_progprof", PR_Prof_f);
+	Cmd_AddCommand ("sv_stringstats", PR_Strings_f);
 
 	memset(pr_newstrtbl, 0, sizeof(pr_newstrtbl));
 	//	PR_CleanLogText_Init();
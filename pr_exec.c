@@ -20,6 +20,8 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 */
 
 #include "qwsvdef.h"
+#include <setjmp.h>
+#include <stddef.h>
 
 
 typedef struct prstack_s
@@ -318,6 +320,10 @@ int PR_EnterFunction (dfunction_t *f)
 	}
 
 	pr_xfunction = f;
+
+	if (pr_profiling)
+		PR_ProfEnter (f - pr_functions);
+
 	return f->first_statement - 1; // offset the s++
 }
 
@@ -342,12 +348,700 @@ int PR_LeaveFunction (void)
 	for (i=0 ; i < c ; i++)
 		((int *)pr_globals)[pr_xfunction->parm_start + i] = localstack[localstack_used+i];
 
+	if (pr_profiling)
+		PR_ProfLeave ();
+
 	// up stack
 	pr_depth--;
 	pr_xfunction = pr_stack[pr_depth].f;
 	return pr_stack[pr_depth].s;
 }
 
+/*
+============================================================================
+
+THREADED CODE
+
+PR_TranslateProgs turns every statement into a prcode_t with the operand
+pointers already resolved, PR_ExecuteThreaded then jumps from handler to
+handler without decoding anything.  Common pairs are fused:
+ADDRESS + STOREP_* and comparison + IF/IFNOT.  A fused statement still has
+its own translated second half, so jumping to it works as before.
+
+The runaway counter and the function profile are charged once per run of
+statements up to the next jump, call or return, so their totals match
+PR_ExecuteProgram.  pr_trace is ignored, set sv_threadedprogs 0 to trace.
+============================================================================
+*/
+
+// 0 - interpreter only, 2 - check the threaded code against the interpreter
+cvar_t	sv_threadedprogs = {"sv_threadedprogs", "1"};
+
+typedef enum
+{
+	PRV_OFF,
+	PRV_THREADED,		// threaded run, stops at the first builtin
+	PRV_INTERPRETER		// real run, compared at the same point
+} prverify_t;
+
+static prverify_t	pr_verify_stage;
+
+static void PR_VerifyStop (int builtin);
+
+enum
+{
+	PRT_CALL = OP_BITOR + 1,
+	PRT_ADDRESS_STOREP,		// ADDRESS + STOREP_F/S/ENT/FLD/FNC
+	PRT_ADDRESS_STOREP_V,
+	PRT_EQ_F_IF,			// comparison + IF/IFNOT
+	PRT_NE_F_IF,
+	PRT_LE_IF,
+	PRT_GE_IF,
+	PRT_LT_IF,
+	PRT_GT_IF,
+	PRT_EQ_E_IF,
+	PRT_NE_E_IF,
+	PRT_NOT_F_IF,
+	PRT_NOT_ENT_IF,
+	PRT_BADJUMP,
+	PRT_BADOP,
+	PRT_NUMOPS
+};
+
+typedef struct
+{
+	int		op;
+	int		count;		// statements up to and including the next jump, call or return
+	eval_t	*a, *b, *c;
+	eval_t	*d;			// value stored by a fused STOREP
+	int		jt, jf;		// branch targets if true / false, argc for calls
+} prcode_t;
+
+static prcode_t	*pr_code;
+
+// statements that end a run of straight code
+static qbool PR_IsTransfer (int op)
+{
+	return op == OP_IF || op == OP_IFNOT || op == OP_GOTO || op == OP_RETURN || op == OP_DONE
+		|| (op >= OP_CALL0 && op <= OP_CALL8);
+}
+
+// returns the fused opcode for a comparison followed by a branch on its result
+static int PR_FuseCompare (dstatement_t *st)
+{
+	if ((st[1].op != OP_IF && st[1].op != OP_IFNOT) || st[1].a != st->c)
+		return 0;
+
+	switch (st->op)
+	{
+	case OP_EQ_F:	return PRT_EQ_F_IF;
+	case OP_NE_F:	return PRT_NE_F_IF;
+	case OP_LE:		return PRT_LE_IF;
+	case OP_GE:		return PRT_GE_IF;
+	case OP_LT:		return PRT_LT_IF;
+	case OP_GT:		return PRT_GT_IF;
+	case OP_EQ_E:	return PRT_EQ_E_IF;
+	case OP_NE_E:	return PRT_NE_E_IF;
+	case OP_NOT_F:	return PRT_NOT_F_IF;
+	case OP_NOT_ENT:	return PRT_NOT_ENT_IF;
+	}
+	return 0;
+}
+
+/*
+====================
+PR_TranslateProgs
+
+Called by PR_LoadProgs
+====================
+*/
+void PR_TranslateProgs (void)
+{
+	int i, n = progs->numstatements, fused = 0;
+	dstatement_t *st;
+	prcode_t *code;
+
+	pr_code = (prcode_t *) Hunk_AllocName (n * sizeof(prcode_t), "prcode");
+
+	for (i = n - 1; i >= 0; i--)
+	{
+		st = &pr_statements[i];
+		code = &pr_code[i];
+
+		code->count = (PR_IsTransfer (st->op) || i == n - 1) ? 1 : pr_code[i + 1].count + 1;
+		code->a = (eval_t *) &pr_globals[st->a];
+		code->b = (eval_t *) &pr_globals[st->b];
+		code->c = (eval_t *) &pr_globals[st->c];
+		code->op = st->op;
+
+		switch (st->op)
+		{
+		case OP_STORE_ENT:
+		case OP_STORE_FLD:
+		case OP_STORE_S:
+		case OP_STORE_FNC:
+			code->op = OP_STORE_F;
+			break;
+
+		case OP_STOREP_ENT:
+		case OP_STOREP_FLD:
+		case OP_STOREP_S:
+		case OP_STOREP_FNC:
+			code->op = OP_STOREP_F;
+			break;
+
+		case OP_LOAD_FLD:
+		case OP_LOAD_ENT:
+		case OP_LOAD_S:
+		case OP_LOAD_FNC:
+			code->op = OP_LOAD_F;
+			break;
+
+		case OP_EQ_FNC:
+			code->op = OP_EQ_E;
+			break;
+
+		case OP_NE_FNC:
+			code->op = OP_NE_E;
+			break;
+
+		case OP_DONE:
+			code->op = OP_RETURN;
+			break;
+
+		case OP_CALL0: case OP_CALL1: case OP_CALL2:
+		case OP_CALL3: case OP_CALL4: case OP_CALL5:
+		case OP_CALL6: case OP_CALL7: case OP_CALL8:
+			code->op = PRT_CALL;
+			code->jt = st->op - OP_CALL0;
+			break;
+
+		case OP_GOTO:
+			code->jt = i + st->a;
+			if (code->jt < 0 || code->jt >= n)
+				code->op = PRT_BADJUMP;
+			break;
+
+		case OP_IF:
+		case OP_IFNOT:
+			code->op = OP_IF;
+			code->jt = i + st->b;
+			code->jf = i + 1;
+			if (code->jt < 0 || code->jt >= n || code->jf >= n)
+				code->op = PRT_BADJUMP;
+			else if (st->op == OP_IFNOT)
+			{
+				code->jf = code->jt;
+				code->jt = i + 1;
+			}
+			break;
+
+		case OP_ADDRESS:
+			if (i + 1 < n && st[1].b == st->c && st[1].op >= OP_STOREP_F && st[1].op <= OP_STOREP_FNC)
+			{
+				code->op = st[1].op == OP_STOREP_V ? PRT_ADDRESS_STOREP_V : PRT_ADDRESS_STOREP;
+				code->d = (eval_t *) &pr_globals[st[1].a];
+				fused++;
+			}
+			break;
+
+		case OP_EQ_F: case OP_NE_F: case OP_LE: case OP_GE: case OP_LT: case OP_GT:
+		case OP_EQ_E: case OP_NE_E: case OP_NOT_F: case OP_NOT_ENT:
+			// the branch was translated already, take its targets
+			if (i + 1 < n && PR_FuseCompare (st) && pr_code[i + 1].op == OP_IF)
+			{
+				code->op = PR_FuseCompare (st);
+				code->jt = pr_code[i + 1].jt;
+				code->jf = pr_code[i + 1].jf;
+				fused++;
+			}
+			break;
+
+		default:
+			if (st->op > OP_BITOR)
+				code->op = PRT_BADOP;
+			break;
+		}
+	}
+
+	Con_DPrintf ("PR_TranslateProgs: %i statements, %i fused\n", n, fused);
+}
+
+/*
+====================
+PR_ExecuteThreaded
+
+Same as PR_ExecuteProgram, running the translated statements
+====================
+*/
+static void PR_ExecuteThreaded (dfunction_t *f)
+{
+	prcode_t *st;
+	dfunction_t *newf;
+	edict_t *ed;
+	eval_t *ptr;
+	int runaway = 100000, exitdepth = pr_depth, i, s;
+	float cond, scale;
+
+#ifdef __GNUC__
+	// GCC labels as values, every handler jumps straight to the next one
+	static void *handlers[PRT_NUMOPS] =
+	{
+		[0 ... PRT_NUMOPS - 1] = &&L_PRT_BADOP,
+		[OP_ADD_F] = &&L_OP_ADD_F, [OP_ADD_V] = &&L_OP_ADD_V,
+		[OP_SUB_F] = &&L_OP_SUB_F, [OP_SUB_V] = &&L_OP_SUB_V,
+		[OP_MUL_F] = &&L_OP_MUL_F, [OP_MUL_V] = &&L_OP_MUL_V,
+		[OP_MUL_FV] = &&L_OP_MUL_FV, [OP_MUL_VF] = &&L_OP_MUL_VF,
+		[OP_DIV_F] = &&L_OP_DIV_F,
+		[OP_BITAND] = &&L_OP_BITAND, [OP_BITOR] = &&L_OP_BITOR,
+		[OP_GE] = &&L_OP_GE, [OP_LE] = &&L_OP_LE, [OP_GT] = &&L_OP_GT, [OP_LT] = &&L_OP_LT,
+		[OP_AND] = &&L_OP_AND, [OP_OR] = &&L_OP_OR,
+		[OP_NOT_F] = &&L_OP_NOT_F, [OP_NOT_V] = &&L_OP_NOT_V, [OP_NOT_S] = &&L_OP_NOT_S,
+		[OP_NOT_FNC] = &&L_OP_NOT_FNC, [OP_NOT_ENT] = &&L_OP_NOT_ENT,
+		[OP_EQ_F] = &&L_OP_EQ_F, [OP_EQ_V] = &&L_OP_EQ_V, [OP_EQ_S] = &&L_OP_EQ_S, [OP_EQ_E] = &&L_OP_EQ_E,
+		[OP_NE_F] = &&L_OP_NE_F, [OP_NE_V] = &&L_OP_NE_V, [OP_NE_S] = &&L_OP_NE_S, [OP_NE_E] = &&L_OP_NE_E,
+		[OP_STORE_F] = &&L_OP_STORE_F, [OP_STORE_V] = &&L_OP_STORE_V,
+		[OP_STOREP_F] = &&L_OP_STOREP_F, [OP_STOREP_V] = &&L_OP_STOREP_V,
+		[OP_ADDRESS] = &&L_OP_ADDRESS,
+		[OP_LOAD_F] = &&L_OP_LOAD_F, [OP_LOAD_V] = &&L_OP_LOAD_V,
+		[OP_IF] = &&L_OP_IF, [OP_GOTO] = &&L_OP_GOTO,
+		[PRT_CALL] = &&L_PRT_CALL, [OP_RETURN] = &&L_OP_RETURN, [OP_STATE] = &&L_OP_STATE,
+		[PRT_ADDRESS_STOREP] = &&L_PRT_ADDRESS_STOREP, [PRT_ADDRESS_STOREP_V] = &&L_PRT_ADDRESS_STOREP_V,
+		[PRT_EQ_F_IF] = &&L_PRT_EQ_F_IF, [PRT_NE_F_IF] = &&L_PRT_NE_F_IF,
+		[PRT_LE_IF] = &&L_PRT_LE_IF, [PRT_GE_IF] = &&L_PRT_GE_IF,
+		[PRT_LT_IF] = &&L_PRT_LT_IF, [PRT_GT_IF] = &&L_PRT_GT_IF,
+		[PRT_EQ_E_IF] = &&L_PRT_EQ_E_IF, [PRT_NE_E_IF] = &&L_PRT_NE_E_IF,
+		[PRT_NOT_F_IF] = &&L_PRT_NOT_F_IF, [PRT_NOT_ENT_IF] = &&L_PRT_NOT_ENT_IF,
+		[PRT_BADJUMP] = &&L_PRT_BADJUMP
+	};
+#define HANDLER(op)		L_##op:
+#define NEXT()			goto *handlers[st->op]
+#define DISPATCH_BEGIN	NEXT();
+#define DISPATCH_END
+#define DEFAULT
+#else
+#define HANDLER(op)		case op:
+#define NEXT()			goto dispatch
+#define DISPATCH_BEGIN	dispatch: switch (st->op) {
+#define DISPATCH_END	}
+#define DEFAULT			default:
+#endif
+
+// continue at statement s, paying for the straight code that starts there
+#define JUMP(s) { \
+	i = (s); \
+	st = &pr_code[i]; \
+	pr_xfunction->profile += st->count; \
+	if ((runaway -= st->count) <= 0) \
+	{ \
+		pr_xstatement = i; \
+		PR_RunError ("runaway loop error"); \
+	} \
+	NEXT(); \
+}
+
+#define BRANCH(c)	JUMP((c) ? st->jt : st->jf)
+
+	JUMP(PR_EnterFunction (f) + 1);
+
+	DISPATCH_BEGIN
+
+	HANDLER(OP_ADD_F)
+		st->c->_float = st->a->_float + st->b->_float;
+		st++; NEXT();
+	HANDLER(OP_ADD_V)
+		st->c->vector[0] = st->a->vector[0] + st->b->vector[0];
+		st->c->vector[1] = st->a->vector[1] + st->b->vector[1];
+		st->c->vector[2] = st->a->vector[2] + st->b->vector[2];
+		st++; NEXT();
+	HANDLER(OP_SUB_F)
+		st->c->_float = st->a->_float - st->b->_float;
+		st++; NEXT();
+	HANDLER(OP_SUB_V)
+		st->c->vector[0] = st->a->vector[0] - st->b->vector[0];
+		st->c->vector[1] = st->a->vector[1] - st->b->vector[1];
+		st->c->vector[2] = st->a->vector[2] - st->b->vector[2];
+		st++; NEXT();
+	HANDLER(OP_MUL_F)
+		st->c->_float = st->a->_float * st->b->_float;
+		st++; NEXT();
+	HANDLER(OP_MUL_V)
+		st->c->_float = st->a->vector[0] * st->b->vector[0]
+			+ st->a->vector[1] * st->b->vector[1]
+			+ st->a->vector[2] * st->b->vector[2];
+		st++; NEXT();
+	HANDLER(OP_MUL_FV)
+		scale = st->a->_float;
+		st->c->vector[0] = scale * st->b->vector[0];
+		st->c->vector[1] = scale * st->b->vector[1];
+		st->c->vector[2] = scale * st->b->vector[2];
+		st++; NEXT();
+	HANDLER(OP_MUL_VF)
+		scale = st->b->_float;
+		st->c->vector[0] = scale * st->a->vector[0];
+		st->c->vector[1] = scale * st->a->vector[1];
+		st->c->vector[2] = scale * st->a->vector[2];
+		st++; NEXT();
+	HANDLER(OP_DIV_F)
+		st->c->_float = st->a->_float / st->b->_float;
+		st++; NEXT();
+	HANDLER(OP_BITAND)
+		st->c->_float = (int) st->a->_float & (int) st->b->_float;
+		st++; NEXT();
+	HANDLER(OP_BITOR)
+		st->c->_float = (int) st->a->_float | (int) st->b->_float;
+		st++; NEXT();
+
+	HANDLER(OP_GE)
+		st->c->_float = st->a->_float >= st->b->_float;
+		st++; NEXT();
+	HANDLER(OP_LE)
+		st->c->_float = st->a->_float <= st->b->_float;
+		st++; NEXT();
+	HANDLER(OP_GT)
+		st->c->_float = st->a->_float > st->b->_float;
+		st++; NEXT();
+	HANDLER(OP_LT)
+		st->c->_float = st->a->_float < st->b->_float;
+		st++; NEXT();
+	HANDLER(OP_AND)
+		st->c->_float = st->a->_float && st->b->_float;
+		st++; NEXT();
+	HANDLER(OP_OR)
+		st->c->_float = st->a->_float || st->b->_float;
+		st++; NEXT();
+
+	HANDLER(OP_NOT_F)
+		st->c->_float = !st->a->_float;
+		st++; NEXT();
+	HANDLER(OP_NOT_V)
+		st->c->_float = !st->a->vector[0] && !st->a->vector[1] && !st->a->vector[2];
+		st++; NEXT();
+	HANDLER(OP_NOT_S)
+		st->c->_float = !st->a->string || !*PR_GetString (st->a->string);
+		st++; NEXT();
+	HANDLER(OP_NOT_FNC)
+		st->c->_float = !st->a->function;
+		st++; NEXT();
+	HANDLER(OP_NOT_ENT)
+		st->c->_float = (PROG_TO_EDICT(st->a->edict) == sv.edicts);
+		st++; NEXT();
+
+	HANDLER(OP_EQ_F)
+		st->c->_float = st->a->_float == st->b->_float;
+		st++; NEXT();
+	HANDLER(OP_EQ_V)
+		st->c->_float = (st->a->vector[0] == st->b->vector[0]) &&
+			(st->a->vector[1] == st->b->vector[1]) &&
+			(st->a->vector[2] == st->b->vector[2]);
+		st++; NEXT();
+	HANDLER(OP_EQ_S)
+		st->c->_float = !strcmp (PR_GetString (st->a->string), PR_GetString (st->b->string));
+		st++; NEXT();
+	HANDLER(OP_EQ_E)
+		st->c->_float = st->a->_int == st->b->_int;
+		st++; NEXT();
+	HANDLER(OP_NE_F)
+		st->c->_float = st->a->_float != st->b->_float;
+		st++; NEXT();
+	HANDLER(OP_NE_V)
+		st->c->_float = (st->a->vector[0] != st->b->vector[0]) ||
+			(st->a->vector[1] != st->b->vector[1]) ||
+			(st->a->vector[2] != st->b->vector[2]);
+		st++; NEXT();
+	HANDLER(OP_NE_S)
+		st->c->_float = strcmp (PR_GetString (st->a->string), PR_GetString (st->b->string));
+		st++; NEXT();
+	HANDLER(OP_NE_E)
+		st->c->_float = st->a->_int != st->b->_int;
+		st++; NEXT();
+
+	HANDLER(OP_STORE_F)
+		st->b->_int = st->a->_int;
+		st++; NEXT();
+	HANDLER(OP_STORE_V)
+		st->b->vector[0] = st->a->vector[0];
+		st->b->vector[1] = st->a->vector[1];
+		st->b->vector[2] = st->a->vector[2];
+		st++; NEXT();
+	HANDLER(OP_STOREP_F)
+		ptr = (eval_t *)((byte *)sv.edicts + st->b->_int);
+		ptr->_int = st->a->_int;
+		st++; NEXT();
+	HANDLER(OP_STOREP_V)
+		ptr = (eval_t *)((byte *)sv.edicts + st->b->_int);
+		ptr->vector[0] = st->a->vector[0];
+		ptr->vector[1] = st->a->vector[1];
+		ptr->vector[2] = st->a->vector[2];
+		st++; NEXT();
+
+	HANDLER(OP_ADDRESS)
+		ed = PROG_TO_EDICT(st->a->edict);
+		if (ed == (edict_t *)sv.edicts && sv.state == ss_active)
+		{
+			pr_xstatement = st - pr_code;
+			PR_RunError ("assignment to world entity");
+		}
+		st->c->_int = (byte *)((int *)&ed->v + PR_FIELDOFS(st->b->_int)) - (byte *)sv.edicts;
+		if (SV_THINKFIELD(PR_FIELDOFS(st->b->_int)))
+			SV_ThinkWake (ed);
+		st++; NEXT();
+	HANDLER(PRT_ADDRESS_STOREP)
+		ed = PROG_TO_EDICT(st->a->edict);
+		if (ed == (edict_t *)sv.edicts && sv.state == ss_active)
+		{
+			pr_xstatement = st - pr_code;
+			PR_RunError ("assignment to world entity");
+		}
+		st->c->_int = (byte *)((int *)&ed->v + PR_FIELDOFS(st->b->_int)) - (byte *)sv.edicts;
+		if (SV_THINKFIELD(PR_FIELDOFS(st->b->_int)))
+			SV_ThinkWake (ed);
+		ptr = (eval_t *)((byte *)sv.edicts + st->c->_int);
+		ptr->_int = st->d->_int;
+		st += 2; NEXT();
+	HANDLER(PRT_ADDRESS_STOREP_V)
+		ed = PROG_TO_EDICT(st->a->edict);
+		if (ed == (edict_t *)sv.edicts && sv.state == ss_active)
+		{
+			pr_xstatement = st - pr_code;
+			PR_RunError ("assignment to world entity");
+		}
+		st->c->_int = (byte *)((int *)&ed->v + PR_FIELDOFS(st->b->_int)) - (byte *)sv.edicts;
+		if (SV_THINKFIELD(PR_FIELDOFS(st->b->_int)))
+			SV_ThinkWake (ed);
+		ptr = (eval_t *)((byte *)sv.edicts + st->c->_int);
+		ptr->vector[0] = st->d->vector[0];
+		ptr->vector[1] = st->d->vector[1];
+		ptr->vector[2] = st->d->vector[2];
+		st += 2; NEXT();
+
+	HANDLER(OP_LOAD_F)
+		ed = PROG_TO_EDICT(st->a->edict);
+		//need for checking 'cmd mmode player N', if N >= 0x10000000 =(signed)=> negative
+		if (st->b->_int >= 0)
+			st->c->_int = ((eval_t *)((int *)&ed->v + PR_FIELDOFS(st->b->_int)))->_int;
+		else
+			st->c->_int = 0;
+		st++; NEXT();
+	HANDLER(OP_LOAD_V)
+		ed = PROG_TO_EDICT(st->a->edict);
+		ptr = (eval_t *)((int *)&ed->v + PR_FIELDOFS(st->b->_int));
+		st->c->vector[0] = ptr->vector[0];
+		st->c->vector[1] = ptr->vector[1];
+		st->c->vector[2] = ptr->vector[2];
+		st++; NEXT();
+
+	HANDLER(OP_IF)
+		BRANCH(st->a->_int);
+	HANDLER(OP_GOTO)
+		JUMP(st->jt);
+
+	HANDLER(PRT_EQ_F_IF)
+		st->c->_float = cond = st->a->_float == st->b->_float;
+		BRANCH(cond);
+	HANDLER(PRT_NE_F_IF)
+		st->c->_float = cond = st->a->_float != st->b->_float;
+		BRANCH(cond);
+	HANDLER(PRT_LE_IF)
+		st->c->_float = cond = st->a->_float <= st->b->_float;
+		BRANCH(cond);
+	HANDLER(PRT_GE_IF)
+		st->c->_float = cond = st->a->_float >= st->b->_float;
+		BRANCH(cond);
+	HANDLER(PRT_LT_IF)
+		st->c->_float = cond = st->a->_float < st->b->_float;
+		BRANCH(cond);
+	HANDLER(PRT_GT_IF)
+		st->c->_float = cond = st->a->_float > st->b->_float;
+		BRANCH(cond);
+	HANDLER(PRT_EQ_E_IF)
+		st->c->_float = cond = st->a->_int == st->b->_int;
+		BRANCH(cond);
+	HANDLER(PRT_NE_E_IF)
+		st->c->_float = cond = st->a->_int != st->b->_int;
+		BRANCH(cond);
+	HANDLER(PRT_NOT_F_IF)
+		st->c->_float = cond = !st->a->_float;
+		BRANCH(cond);
+	HANDLER(PRT_NOT_ENT_IF)
+		st->c->_float = cond = (PROG_TO_EDICT(st->a->edict) == sv.edicts);
+		BRANCH(cond);
+
+	HANDLER(PRT_CALL)
+		s = pr_xstatement = st - pr_code;	// return address for PR_EnterFunction
+		pr_argc = st->jt;
+		if (!st->a->function)
+			PR_RunError ("NULL function");
+
+		newf = &pr_functions[st->a->function];
+
+		if (newf->first_statement < 0)
+		{	// negative statements are built in functions
+			i = -newf->first_statement;
+			if (i >= pr_numbuiltins)
+				PR_RunError ("Bad builtin call number");
+			if (pr_verify_stage == PRV_THREADED)
+				PR_VerifyStop (st->a->function);
+			if (pr_profiling)
+			{
+				PR_ProfEnter (st->a->function);
+				pr_builtins[i] ();
+				PR_ProfLeave ();
+			}
+			else
+				pr_builtins[i] ();
+			JUMP(s + 1);
+		}
+
+		JUMP(PR_EnterFunction (newf) + 1);
+
+	HANDLER(OP_RETURN)
+		pr_globals[OFS_RETURN] = st->a->vector[0];
+		pr_globals[OFS_RETURN+1] = st->a->vector[1];
+		pr_globals[OFS_RETURN+2] = st->a->vector[2];
+
+		s = PR_LeaveFunction ();
+		if (pr_depth == exitdepth)
+			return;		// all done
+		JUMP(s + 1);
+
+	HANDLER(OP_STATE)
+		ed = PROG_TO_EDICT(pr_global_struct->self);
+		ed->v.nextthink = pr_global_struct->time + 0.1;
+		SV_ThinkWake (ed);
+		if (st->a->_float != ed->v.frame)
+			ed->v.frame = st->a->_float;
+		ed->v.think = st->b->function;
+		st++; NEXT();
+
+	HANDLER(PRT_BADJUMP)
+		pr_xstatement = st - pr_code;
+		PR_RunError ("Bad jump target");
+
+	HANDLER(PRT_BADOP)
+	DEFAULT
+		pr_xstatement = st - pr_code;
+		PR_RunError ("Bad opcode %i", pr_statements[pr_xstatement].op);
+
+	DISPATCH_END
+
+#undef HANDLER
+#undef NEXT
+#undef DISPATCH_BEGIN
+#undef DISPATCH_END
+#undef DEFAULT
+#undef JUMP
+#undef BRANCH
+}
+
+/*
+============================================================================
+
+THREADED CODE CHECK
+
+With sv_threadedprogs 2 every top level call is run by PR_ExecuteThreaded
+up to the first builtin it calls, or its return, and the globals and edicts
+are put aside there.  They are rolled back and PR_ExecuteProgram does the
+real run, which has to reach the same builtin with the same state.
+Builtins change more than the edicts, so nothing after the first one is
+checked, and function profiles count both runs.
+============================================================================
+*/
+
+static jmp_buf		pr_verify_jmp;
+static byte			*pr_verify_before, *pr_verify_after;	// globals, then the edicts
+static int			pr_verify_size, pr_verify_maxsize;
+static int			pr_verify_builtin;	// reached by the threaded run, 0 if it returned
+static dfunction_t	*pr_verify_function;
+
+static void PR_VerifySave (byte *buf)
+{
+	int globals = progs->numglobals * 4;
+
+	memcpy (buf, pr_globals, globals);
+	memcpy (buf + globals, sv.edicts, pr_verify_size - globals);
+}
+
+// returns the offset of the first differing int, -1 if there is none
+static int PR_VerifyDiff (byte *a, byte *b, int size)
+{
+	int i;
+
+	if (!memcmp (a, b, size))
+		return -1;
+	for (i = 0; a[i] == b[i]; i++)
+		;
+	return i & ~3;
+}
+
+static void PR_VerifyStop (int builtin)
+{
+	pr_verify_builtin = builtin;
+	PR_VerifySave (pr_verify_after);
+	longjmp (pr_verify_jmp, 1);
+}
+
+static void PR_VerifyCompare (int builtin)
+{
+	int globals = progs->numglobals * 4, i;
+	char *name = PR_GetString (pr_verify_function->s_name);
+
+	pr_verify_stage = PRV_OFF;
+
+	if (builtin != pr_verify_builtin)
+	{
+		Con_Printf ("sv_threadedprogs: %s: the threaded code stopped at %s", name,
+			pr_verify_builtin ? PR_GetString (pr_functions[pr_verify_builtin].s_name) : "return");
+		Con_Printf (", the interpreter at %s\n", builtin ? PR_GetString (pr_functions[builtin].s_name) : "return");
+	}
+	else if ((i = PR_VerifyDiff ((byte *) pr_globals, pr_verify_after, globals)) >= 0)
+		Con_Printf ("sv_threadedprogs: %s: global %i differs\n", name, i / 4);
+	else if ((i = PR_VerifyDiff ((byte *) sv.edicts, pr_verify_after + globals, pr_verify_size - globals)) >= 0)
+		Con_Printf ("sv_threadedprogs: %s: edict %i field %i differs\n", name,
+			i / pr_edict_size, (int)(i % pr_edict_size - offsetof(edict_t, v)) / 4);
+}
+
+/*
+====================
+PR_VerifyThreaded
+
+Dry run of f by the threaded code, PR_ExecuteProgram carries on with the real one
+====================
+*/
+static void PR_VerifyThreaded (dfunction_t *f)
+{
+	int globals = progs->numglobals * 4;
+	int depth = pr_depth, used = localstack_used, xstatement = pr_xstatement;
+	dfunction_t *xfunction = pr_xfunction;
+
+	pr_verify_size = globals + sv.num_edicts * pr_edict_size;
+	if (pr_verify_size > pr_verify_maxsize)
+	{
+		pr_verify_maxsize = pr_verify_size;
+		pr_verify_before = (byte *) Q_realloc (pr_verify_before, pr_verify_maxsize);
+		pr_verify_after = (byte *) Q_realloc (pr_verify_after, pr_verify_maxsize);
+	}
+	PR_VerifySave (pr_verify_before);
+
+	pr_verify_function = f;
+	pr_verify_builtin = 0;
+	pr_verify_stage = PRV_THREADED;
+	if (!setjmp (pr_verify_jmp))
+	{
+		PR_ExecuteThreaded (f);
+		PR_VerifySave (pr_verify_after);
+	}
+
+	memcpy (pr_globals, pr_verify_before, globals);
+	memcpy (sv.edicts, pr_verify_before + globals, pr_verify_size - globals);
+	pr_depth = depth;
+	localstack_used = used;
+	pr_xfunction = xfunction;
+	pr_xstatement = xstatement;
+
+	pr_verify_stage = PRV_INTERPRETER;
+}
+
 /*
 ============================================================================
 PR_ExecuteProgram
@@ -379,6 +1073,21 @@ void PR_ExecuteProgram (func_t fnum)
 	runaway = 100000;
 	pr_trace = false;
 
+	// an earlier check that ended in an error
+	if (!pr_depth)
+		pr_verify_stage = PRV_OFF;
+
+	// the threaded code ignores pr_trace, only the loop below traces
+	if (pr_code && sv_threadedprogs.value)
+	{
+		if (sv_threadedprogs.value != 2 || pr_depth)
+		{
+			PR_ExecuteThreaded (f);
+			return;
+		}
+		PR_VerifyThreaded (f);
+	}
+
 	// make a stack frame
 	exitdepth = pr_depth;
 
@@ -563,6 +1272,8 @@ void PR_ExecuteProgram (func_t fnum)
 			if (ed == (edict_t *)sv.edicts && sv.state == ss_active)
 				PR_RunError ("assignment to world entity");
 			c->_int = (byte *)((int *)&ed->v + PR_FIELDOFS(b->_int)) - (byte *)sv.edicts;
+			if (SV_THINKFIELD(PR_FIELDOFS(b->_int)))
+				SV_ThinkWake (ed);
 			break;
 
 		case OP_LOAD_F:
@@ -631,7 +1342,16 @@ void PR_ExecuteProgram (func_t fnum)
 				i = -newf->first_statement;
 				if (i >= pr_numbuiltins)
 					PR_RunError ("Bad builtin call number");
-				pr_builtins[i] ();
+				if (pr_verify_stage == PRV_INTERPRETER)
+					PR_VerifyCompare (a->function);
+				if (pr_profiling)
+				{
+					PR_ProfEnter (a->function);
+					pr_builtins[i] ();
+					PR_ProfLeave ();
+				}
+				else
+					pr_builtins[i] ();
 				break;
 			}
 
@@ -647,12 +1367,17 @@ void PR_ExecuteProgram (func_t fnum)
 
 			s = PR_LeaveFunction ();
 			if (pr_depth == exitdepth)
+			{
+				if (pr_verify_stage == PRV_INTERPRETER)
+					PR_VerifyCompare (0);
 				return;		// all done
+			}
 			break;
 
 		case OP_STATE:
 			ed = PROG_TO_EDICT(pr_global_struct->self);
 			ed->v.nextthink = pr_global_struct->time + 0.1;
+			SV_ThinkWake (ed);
 			if (a->_float != ed->v.frame)
 			{
 				ed->v.frame = a->_float;
@@ -673,6 +1398,289 @@ char *pr_newstrtbl[MAX_PRSTR];
 char *pr_strtbl[MAX_PRSTR];
 int num_prstr;
 
+/*
+============================================================================
+
+TEMP STRINGS
+
+Strings built at run time (builtin results, parameters of QC callbacks) are
+interned: identical strings share one copy and one string number, below the
+pr_strtbl and pr_newstrtbl ranges.  The copies live in a few big blocks.
+
+QC copies string numbers around freely, so instead of counting references
+PR_CollectStrings keeps every string that was handed out during the last
+PRSTR_FRAMES frames or that a string field or global still points at, and
+compacts those into one block.  It only runs once the blocks have grown
+past twice what survived the last collection.
+============================================================================
+*/
+
+#define PRSTR_BLOCK		0x10000
+#define PRSTR_HASH		4096	// power of two
+#define PRSTR_FRAMES	2
+
+typedef struct prstrblock_s
+{
+	struct prstrblock_s	*next;
+	int		size, used;
+} prstrblock_t;
+
+typedef struct
+{
+	char	*s;				// NULL if free
+	int		len;
+	unsigned int hash;
+	int		next;			// hash chain, or free list
+	int		frame;			// last handed out or referenced
+} prtmpstr_t;
+
+static prtmpstr_t	*pr_tmpstrs;
+static int			pr_numtmpstrs, pr_maxtmpstrs, pr_livetmpstrs;
+static int			pr_tmpstrhash[PRSTR_HASH];
+static int			pr_tmpstrfree = -1, pr_tmpstrfreelast = -1;
+static prstrblock_t	*pr_strblocks;
+static int			pr_strbytes, pr_strbytes_kept;
+static int			pr_strframe;
+
+static struct
+{
+	unsigned int	lookups, shared;
+	unsigned int	collections, freed;
+} pr_strstats;
+
+static unsigned int PR_StringHash (char *s, int *len)
+{
+	unsigned int h = 2166136261u;
+	unsigned char *p;
+
+	for (p = (unsigned char *) s; *p; p++)
+		h = (h ^ *p) * 16777619u;
+
+	*len = (char *) p - s;
+	return h;
+}
+
+static char *PR_StringAlloc (int size)
+{
+	prstrblock_t *b = pr_strblocks;
+
+	if (!b || b->used + size > b->size)
+	{
+		b = (prstrblock_t *) Q_malloc (sizeof(prstrblock_t) + max(size, PRSTR_BLOCK));
+		b->size = max(size, PRSTR_BLOCK);
+		b->next = pr_strblocks;
+		pr_strblocks = b;
+	}
+
+	b->used += size;
+	pr_strbytes += size;
+	return (char *)(b + 1) + b->used - size;
+}
+
+static void PR_FreeStringBlocks (prstrblock_t *b)
+{
+	prstrblock_t *next;
+
+	for ( ; b; b = next)
+	{
+		next = b->next;
+		Q_free (b);
+	}
+}
+
+/*
+==============
+PR_SetTmpString
+
+Returns the number of a string with the contents of s, good for at least
+PRSTR_FRAMES frames or as long as QC keeps it in a field or global
+==============
+*/
+int PR_SetTmpString (char *s)
+{
+	unsigned int h;
+	prtmpstr_t *t;
+	int i, len;
+
+	h = PR_StringHash (s, &len);
+	pr_strstats.lookups++;
+
+	for (i = pr_tmpstrhash[h & (PRSTR_HASH - 1)] - 1; i >= 0; i = t->next)
+	{
+		t = &pr_tmpstrs[i];
+		if (t->hash == h && t->len == len && !memcmp (t->s, s, len))
+		{
+			pr_strstats.shared++;
+			t->frame = pr_strframe;
+			return -(2 * MAX_PRSTR + i);
+		}
+	}
+
+	if (pr_tmpstrfree >= 0)
+	{
+		i = pr_tmpstrfree;
+		if ((pr_tmpstrfree = pr_tmpstrs[i].next) < 0)
+			pr_tmpstrfreelast = -1;
+	}
+	else
+	{
+		if (pr_numtmpstrs == pr_maxtmpstrs)
+		{
+			pr_maxtmpstrs = max(2 * pr_maxtmpstrs, 1024);
+			pr_tmpstrs = (prtmpstr_t *) Q_realloc (pr_tmpstrs, pr_maxtmpstrs * sizeof(prtmpstr_t));
+		}
+		i = pr_numtmpstrs++;
+	}
+
+	// s may point into a string of the last block, copy before it can move
+	t = &pr_tmpstrs[i];
+	t->s = PR_StringAlloc (len + 1);
+	memcpy (t->s, s, len + 1);
+	t->len = len;
+	t->hash = h;
+	t->frame = pr_strframe;
+	t->next = pr_tmpstrhash[h & (PRSTR_HASH - 1)] - 1;
+	pr_tmpstrhash[h & (PRSTR_HASH - 1)] = i + 1;
+	pr_livetmpstrs++;
+
+	return -(2 * MAX_PRSTR + i);
+}
+
+// flags the temp strings QC still holds in entity fields and globals
+static void PR_MarkStrings (void)
+{
+	ddef_t *def;
+	edict_t *ed;
+	int i, j, num;
+
+#ifdef USE_PR2
+	if (sv_vm)
+		return;
+#endif
+	if (!progs)
+		return;
+
+	for (i = 0, def = pr_globaldefs; i < progs->numglobaldefs; i++, def++)
+	{
+		if ((def->type & ~DEF_SAVEGLOBAL) != ev_string)
+			continue;
+		num = -((int *)pr_globals)[def->ofs] - 2 * MAX_PRSTR;
+		if (num >= 0 && num < pr_numtmpstrs)
+			pr_tmpstrs[num].frame = pr_strframe;
+	}
+
+	for (i = 0, def = pr_fielddefs; i < progs->numfielddefs; i++, def++)
+	{
+		if ((def->type & ~DEF_SAVEGLOBAL) != ev_string)
+			continue;
+		for (j = 0; j < sv.num_edicts; j++)
+		{
+			ed = EDICT_NUM(j);
+			num = -((int *)&ed->v)[PR_FIELDOFS(def->ofs)] - 2 * MAX_PRSTR;
+			if (num >= 0 && num < pr_numtmpstrs)
+				pr_tmpstrs[num].frame = pr_strframe;
+		}
+	}
+}
+
+/*
+==============
+PR_CollectStrings
+
+Called every server frame, while no QC is running
+==============
+*/
+void PR_CollectStrings (void)
+{
+	prstrblock_t *old;
+	prtmpstr_t *t;
+	char *s;
+	int i;
+
+	pr_strframe++;
+
+	if (pr_strbytes < 2 * max(pr_strbytes_kept, PRSTR_BLOCK))
+		return;
+
+	PR_MarkStrings ();
+
+	old = pr_strblocks;
+	pr_strblocks = NULL;
+	pr_strbytes = 0;
+	memset (pr_tmpstrhash, 0, sizeof(pr_tmpstrhash));
+
+	for (i = 0, t = pr_tmpstrs; i < pr_numtmpstrs; i++, t++)
+	{
+		if (!t->s)
+			continue;
+
+		if (pr_strframe - t->frame > PRSTR_FRAMES)
+		{
+			t->s = NULL;
+			t->next = -1;
+			if (pr_tmpstrfreelast >= 0)
+				pr_tmpstrs[pr_tmpstrfreelast].next = i;
+			else
+				pr_tmpstrfree = i;
+			pr_tmpstrfreelast = i;		// reused last, a stale number shows the old text longer
+			pr_livetmpstrs--;
+			pr_strstats.freed++;
+			continue;
+		}
+
+		s = PR_StringAlloc (t->len + 1);
+		memcpy (s, t->s, t->len + 1);
+		t->s = s;
+		t->next = pr_tmpstrhash[t->hash & (PRSTR_HASH - 1)] - 1;
+		pr_tmpstrhash[t->hash & (PRSTR_HASH - 1)] = i + 1;
+	}
+
+	PR_FreeStringBlocks (old);
+	pr_strbytes_kept = pr_strbytes;
+	pr_strstats.collections++;
+}
+
+/*
+==============
+PR_ClearStrings
+
+Called by PR_LoadProgs, string numbers of the previous progs are meaningless
+==============
+*/
+void PR_ClearStrings (void)
+{
+	PR_FreeStringBlocks (pr_strblocks);
+	pr_strblocks = NULL;
+	Q_free (pr_tmpstrs);
+	pr_numtmpstrs = pr_maxtmpstrs = pr_livetmpstrs = 0;
+	pr_tmpstrfree = pr_tmpstrfreelast = -1;
+	pr_strbytes = pr_strbytes_kept = 0;
+	memset (pr_tmpstrhash, 0, sizeof(pr_tmpstrhash));
+}
+
+void PR_Strings_f (void)
+{
+	prstrblock_t *b;
+	int i, blocks = 0, reserved = 0, zoned = 0;
+
+	for (b = pr_strblocks; b; b = b->next, blocks++)
+		reserved += b->size;
+
+	for (i = 0; i < MAX_PRSTR; i++)
+	{
+		if (pr_newstrtbl[i] && pr_newstrtbl[i] != pr_strings)
+			zoned++;
+	}
+
+	Con_Printf ("temp strings   : %i live, %i bytes used, %i bytes in %i blocks\n",
+		pr_livetmpstrs, pr_strbytes, reserved, blocks);
+	Con_Printf ("lookups        : %u, %u shared (%i%%)\n", pr_strstats.lookups, pr_strstats.shared,
+		pr_strstats.lookups ? (int)(100.0 * pr_strstats.shared / pr_strstats.lookups) : 0);
+	Con_Printf ("collections    : %u, %u strings freed\n", pr_strstats.collections, pr_strstats.freed);
+	Con_Printf ("engine strings : %i\n", num_prstr);
+	Con_Printf ("strzone strings: %i\n", zoned);
+}
+
 char *PR_GetString(int num)
 {
 	if (num < 0)
@@ -681,7 +1689,10 @@ char *PR_GetString(int num)
 		num = -num;
 		if (num >= 2 * MAX_PRSTR)
 		{
-			Con_Printf("PR_GetString: num = %d\n", num);// May be will be better to generate PR_RunError?
+			num -= 2 * MAX_PRSTR;
+			if (num < pr_numtmpstrs)
+				return pr_tmpstrs[num].s ? pr_tmpstrs[num].s : "";
+			Con_Printf("PR_GetString: num = %d\n", -(num + 2 * MAX_PRSTR));// May be will be better to generate PR_RunError?
 			return NULL;
 		}
 		if (num >= MAX_PRSTR)
@@ -692,6 +1703,31 @@ char *PR_GetString(int num)
 	return pr_strings + num;
 }
 
+qbool PR_IsTmpString (int num)
+{
+	return num <= -2 * MAX_PRSTR;
+}
+
+/*
+==============
+PR_KeepString
+
+For strings the engine holds on to until the next map.  Temp strings move
+or go away when they are collected, those are copied to the hunk.
+==============
+*/
+char *PR_KeepString (int num)
+{
+	char *s = PR_GetString (num), *copy;
+
+	if (!PR_IsTmpString (num) || !s)
+		return s;
+
+	copy = (char *) Hunk_Alloc (strlen (s) + 1);
+	strcpy (copy, s);
+	return copy;
+}
+
 int PR_SetString(char *s)
 {
 	int i;
@@ -713,22 +1749,3 @@ int PR_SetString(char *s)
 	return (int)(s - pr_strings);
 }
 
-/*
-==============
-PR_SetTmpString
-
-temp strings are used for qc function parameters
-many calls to function could cause strtbl overflow
-==============
-*/
-
-int PR_SetTmpString(char *s)
-{
-	static int index1;
-	static char tmp[8][2048];
-
-	index1 = (index1 + 1) & 7;
-
-	strlcpy(tmp[index1], s, sizeof(tmp[index1]));
-	return PR_SetString(tmp[index1]);
-}
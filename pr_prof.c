@@ -0,0 +1,385 @@
+/*
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the included (GNU.txt) GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+// pr_prof.c - call stack profiler for QC and QVM game code
+
+/*
+sv_progprof start [seconds] times every call the game code makes: QC
+functions through PR_EnterFunction / PR_LeaveFunction, QVM functions
+through OP_ENTER / OP_LEAVE, and builtins and syscalls around their call.
+Each distinct call stack is a node of a tree that keeps its wall clock
+time, so the cost of a function can be told apart by caller.
+
+sv_progprof stop (or the end of the given time) prints the functions
+with the most exclusive time and writes progprof.txt into the gamedir,
+one "caller;callee;... microseconds" line per stack, the collapsed format
+read by flamegraph.pl and speedscope.
+
+Compiled QVMs run in the interpreter while the profiler is on.
+*/
+
+#include "qwsvdef.h"
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#define PROF_FUNCS		4096
+#define PROF_NODES		32768	// distinct call stacks
+#define PROF_DEPTH		256
+#define PROF_NAMELEN	48
+#define PROF_FUNCHASH	(PROF_FUNCS * 2)	// power of two
+#define PROF_NODEHASH	(PROF_NODES * 2)
+
+typedef struct
+{
+	char	name[PROF_NAMELEN];
+	double	inclusive, exclusive;
+	int		calls;
+	int		active;			// recursion depth, inclusive time is added at the outermost call
+} proffunc_t;
+
+typedef struct
+{
+	int		parent, func;	// parent is -1 for calls made by the engine
+	double	time;			// exclusive
+	int		calls;
+} profnode_t;
+
+typedef struct
+{
+	int		node;
+	double	start, children;
+} profframe_t;
+
+qbool				pr_profiling;
+
+static proffunc_t	prof_funcs[PROF_FUNCS];
+static int			prof_numfuncs;
+static int			prof_funckeys[PROF_FUNCHASH], prof_funcvals[PROF_FUNCHASH];
+
+static profnode_t	prof_nodes[PROF_NODES];
+static int			prof_numnodes;
+static int			prof_nodehash[PROF_NODEHASH];
+
+static profframe_t	prof_stack[PROF_DEPTH];
+static int			prof_depth, prof_lost;	// calls deeper than PROF_DEPTH or past PROF_NODES
+static double		prof_starttime, prof_endtime, prof_stoptime;
+static qbool		prof_stopping;
+
+static double PR_ProfTime (void)
+{
+#ifdef _WIN32
+	static double scale;
+	LARGE_INTEGER t;
+
+	if (!scale)
+	{
+		QueryPerformanceFrequency (&t);
+		scale = 1.0 / (double) t.QuadPart;
+	}
+	QueryPerformanceCounter (&t);
+	return t.QuadPart * scale;
+#else
+	struct timespec t;
+
+	clock_gettime (CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+#endif
+}
+
+static const char *PR_ProfFuncName (int id)
+{
+#ifdef USE_PR2
+	symbols_t *sym;
+
+	if (sv_vm)
+	{
+		if (id < 0)
+			return va ("syscall_%i", -id - 1);
+		sym = QVM_FindName ((qvm_t *) sv_vm->hInst, id);
+		return sym ? sym->name : va ("sub_%x", id);
+	}
+#endif
+	if (id <= 0 || id >= progs->numfunctions)
+		return va ("function_%i", id);
+	return PR_GetString (pr_functions[id].s_name);
+}
+
+static unsigned int PR_ProfHash (int a, int b)
+{
+	return ((unsigned int) a * 2654435761u) ^ ((unsigned int) b * 40503u);
+}
+
+// functions of the same name share an entry, so the numbers survive a map change
+static int PR_ProfFunc (int id)
+{
+	unsigned int h = PR_ProfHash (id, 0) & (PROF_FUNCHASH - 1);
+	const char *name;
+	int i;
+
+	for ( ; prof_funcvals[h] >= 0; h = (h + 1) & (PROF_FUNCHASH - 1))
+	{
+		if (prof_funckeys[h] == id)
+			return prof_funcvals[h];
+	}
+
+	name = PR_ProfFuncName (id);
+	for (i = 0; i < prof_numfuncs; i++)
+	{
+		if (!strncmp (prof_funcs[i].name, name, PROF_NAMELEN - 1))
+			break;
+	}
+
+	if (i == prof_numfuncs)
+	{
+		if (prof_numfuncs == PROF_FUNCS)
+			return -1;
+		strlcpy (prof_funcs[i].name, name, PROF_NAMELEN);
+		prof_numfuncs++;
+	}
+
+	prof_funckeys[h] = id;
+	prof_funcvals[h] = i;
+	return i;
+}
+
+static int PR_ProfNode (int parent, int func)
+{
+	unsigned int h = PR_ProfHash (parent, func) & (PROF_NODEHASH - 1);
+	profnode_t *n;
+
+	for ( ; prof_nodehash[h] >= 0; h = (h + 1) & (PROF_NODEHASH - 1))
+	{
+		n = &prof_nodes[prof_nodehash[h]];
+		if (n->parent == parent && n->func == func)
+			return prof_nodehash[h];
+	}
+
+	if (prof_numnodes == PROF_NODES)
+		return -1;
+
+	n = &prof_nodes[prof_numnodes];
+	n->parent = parent;
+	n->func = func;
+	return prof_nodehash[h] = prof_numnodes++;
+}
+
+/*
+===============
+PR_ProfEnter
+
+id is a QC function number, a QVM code address or a negative QVM syscall
+===============
+*/
+void PR_ProfEnter (int id)
+{
+	profframe_t *frame;
+	int func, node;
+
+	if (!prof_depth && prof_endtime && PR_ProfTime () >= prof_endtime)
+	{
+		PR_ProfStop ();
+		return;
+	}
+
+	if (prof_lost || prof_depth == PROF_DEPTH
+		|| (func = PR_ProfFunc (id)) < 0
+		|| (node = PR_ProfNode (prof_depth ? prof_stack[prof_depth - 1].node : -1, func)) < 0)
+	{	// the time ends up in the caller
+		prof_lost++;
+		return;
+	}
+
+	prof_funcs[func].active++;
+
+	frame = &prof_stack[prof_depth++];
+	frame->node = node;
+	frame->children = 0;
+	frame->start = PR_ProfTime ();
+}
+
+void PR_ProfLeave (void)
+{
+	profframe_t *frame;
+	proffunc_t *func;
+	profnode_t *node;
+	double t;
+
+	if (prof_lost)
+	{
+		prof_lost--;
+		return;
+	}
+
+	if (!prof_depth)
+		return;		// profiler was started inside a call
+
+	frame = &prof_stack[--prof_depth];
+	t = PR_ProfTime () - frame->start;
+	node = &prof_nodes[frame->node];
+	func = &prof_funcs[node->func];
+
+	node->time += t - frame->children;
+	node->calls++;
+	func->exclusive += t - frame->children;
+	func->calls++;
+	if (!--func->active)
+		func->inclusive += t;
+
+	if (prof_depth)
+		prof_stack[prof_depth - 1].children += t;
+	else if (prof_stopping)
+		PR_ProfStop ();
+}
+
+/*
+===============
+PR_ProfReload
+
+Called when new game code is loaded, function numbers mean something else now
+===============
+*/
+void PR_ProfReload (void)
+{
+	int i;
+
+	memset (prof_funcvals, -1, sizeof(prof_funcvals));
+	for (i = 0; i < prof_numfuncs; i++)
+		prof_funcs[i].active = 0;
+	prof_depth = prof_lost = 0;
+}
+
+static void PR_ProfReset (void)
+{
+	memset (prof_funcs, 0, sizeof(prof_funcs));
+	memset (prof_nodes, 0, sizeof(prof_nodes));
+	memset (prof_nodehash, -1, sizeof(prof_nodehash));
+	prof_numfuncs = prof_numnodes = 0;
+	PR_ProfReload ();
+}
+
+static void PR_ProfPrintPath (FILE *f, int node)
+{
+	if (prof_nodes[node].parent >= 0)
+	{
+		PR_ProfPrintPath (f, prof_nodes[node].parent);
+		fputc (';', f);
+	}
+	fputs (prof_funcs[prof_nodes[node].func].name, f);
+}
+
+static void PR_ProfWrite (void)
+{
+	char name[MAX_OSPATH * 2];
+	FILE *f;
+	int i;
+
+	snprintf (name, sizeof(name), "%s/progprof.txt", fs_gamedir);
+	if (!(f = fopen (name, "wb")))
+	{
+		Con_Printf ("Couldn't open %s\n", name);
+		return;
+	}
+
+	for (i = 0; i < prof_numnodes; i++)
+	{
+		if (prof_nodes[i].time < 0.0000005)
+			continue;
+		PR_ProfPrintPath (f, i);
+		fprintf (f, " %.0f\n", prof_nodes[i].time * 1000000);
+	}
+
+	fclose (f);
+	Con_Printf ("Wrote %i call stacks to %s\n", prof_numnodes, name);
+}
+
+static int PR_ProfCompare (const void *a, const void *b)
+{
+	double d = prof_funcs[*(int *)b].exclusive - prof_funcs[*(int *)a].exclusive;
+
+	return d > 0 ? 1 : d < 0 ? -1 : 0;
+}
+
+static void PR_ProfReport (int count)
+{
+	static int order[PROF_FUNCS];
+	double total = 0, elapsed;
+	proffunc_t *f;
+	int i;
+
+	elapsed = (pr_profiling ? PR_ProfTime () : prof_stoptime) - prof_starttime;
+
+	for (i = 0; i < prof_numfuncs; i++)
+	{
+		order[i] = i;
+		total += prof_funcs[i].exclusive;
+	}
+	qsort (order, prof_numfuncs, sizeof(order[0]), PR_ProfCompare);
+
+	Con_Printf ("%.1f s profiled, %.1f ms (%.1f%%) in game code\n",
+		elapsed, total * 1000, elapsed > 0 ? 100 * total / elapsed : 0);
+	Con_Printf ("  excl ms  incl ms    calls  function\n");
+	for (i = 0; i < min (count, prof_numfuncs); i++)
+	{
+		f = &prof_funcs[order[i]];
+		Con_Printf ("%9.2f %8.2f %8i  %s\n", f->exclusive * 1000, f->inclusive * 1000, f->calls, f->name);
+	}
+}
+
+void PR_ProfStop (void)
+{
+	if (!pr_profiling)
+		return;
+
+	if (prof_depth)
+	{	// let the running call finish first
+		prof_stopping = true;
+		return;
+	}
+
+	pr_profiling = prof_stopping = false;
+	prof_stoptime = PR_ProfTime ();
+	PR_ProfReport (15);
+	PR_ProfWrite ();
+}
+
+void PR_Prof_f (void)
+{
+	char *cmd = Cmd_Argv (1);
+
+	if (!strcmp (cmd, "start"))
+	{
+		PR_ProfReset ();
+		prof_starttime = PR_ProfTime ();
+		prof_endtime = Cmd_Argc () > 2 ? prof_starttime + Q_atof (Cmd_Argv (2)) : 0;
+		prof_stopping = false;
+		pr_profiling = true;
+		Con_Printf ("Profiling game code%s\n", prof_endtime ? va (" for %s seconds", Cmd_Argv (2)) : "");
+	}
+	else if (!strcmp (cmd, "stop"))
+	{
+		if (!pr_profiling)
+			Con_Printf ("Profiler is not running\n");
+		PR_ProfStop ();
+	}
+	else if (!strcmp (cmd, "report") && prof_starttime)
+		PR_ProfReport (Cmd_Argc () > 2 ? Q_atoi (Cmd_Argv (2)) : 15);
+	else if (!strcmp (cmd, "write") && prof_starttime)
+		PR_ProfWrite ();
+	else
+		Con_Printf ("usage: %s <start [seconds] | stop | report [count] | write>\n", Cmd_Argv (0));
+}
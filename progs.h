@@ -56,6 +56,13 @@ typedef struct sv_edict_s
 	int			num_leafs;
 	short		leafnums[MAX_ENT_LEAFS];
 
+	int			num_leafwords;	// leafnums grouped by 32 bit pvs word, see SV_EdictInPVS
+	short		leafwords[MAX_ENT_LEAFS];
+	unsigned int	leafmasks[MAX_ENT_LEAFS];
+
+	vec3_t		leafmins, leafmaxs;	// absmin / absmax the leafs were found for
+	float		leafmargin;		// they stay right until the box moves this far, 0 if not kept
+
 	entity_state_t	baseline;
 
 	float		freetime;		// sv.time when the object was freed
@@ -87,6 +94,7 @@ extern	int		pr_edict_size;	// in bytes
 extern	int		pr_teamfield;
 extern	cvar_t		sv_progsname; 
 extern	cvar_t		sv_forcenqprogs; 
+extern	cvar_t		sv_threadedprogs;
 
 //============================================================================
 
@@ -117,11 +125,20 @@ void NQP_Reset (void);
 void PR_Init (void);
 
 void PR_ExecuteProgram (func_t fnum);
+void PR_TranslateProgs (void);
 void PR_LoadProgs (void);
 void PR_InitPatchTables (void);	// NQ progs support
 
 void PR_Profile_f (void);
 
+// pr_prof.c
+extern	qbool	pr_profiling;
+void PR_ProfEnter (int id);
+void PR_ProfLeave (void);
+void PR_ProfReload (void);
+void PR_ProfStop (void);
+void PR_Prof_f (void);
+
 edict_t *ED_Alloc (void);
 void ED_Free (edict_t *ed);
 
@@ -208,6 +225,11 @@ extern int num_prstr;
 char *PR_GetString(int num);
 int PR_SetString(char *s);
 int PR_SetTmpString(char *s);
+qbool PR_IsTmpString (int num);
+char *PR_KeepString (int num);
+void PR_CollectStrings (void);
+void PR_ClearStrings (void);
+void PR_Strings_f (void);
 
 // pr_cmds.c
 void PR_InitBuiltins (void);
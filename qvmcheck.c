@@ -0,0 +1,234 @@
+/*
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the included (GNU.txt) GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+// qvmcheck.c - checks that QVM mods get compiled to native code
+
+/*
+qvmcheck <qwprogs.qvm> ...
+
+A standalone program (make qvmcheck) built from pr2_vm.c and pr2_vm_jit.c
+with the little else they need stubbed out below.  Every .qvm is loaded
+by VM_LoadBytecode, the way the server loads the mod, and QVM_JitCompile
+has to take it: a mod it rejects runs in the interpreter, which only
+shows as one line in the server console.
+
+Prints what was compiled, or why not, and exits with 1 if any module
+was left to the interpreter.  Like the compiler it is Linux x86_64 only.
+*/
+
+#include "qwsvdef.h"
+
+static byte		*qc_file;
+static int		qc_filelen;
+
+/*
+===============================================================================
+
+ENGINE STUBS
+
+===============================================================================
+*/
+
+server_static_t	svs;
+ctxinfo_t		_localinfo_;
+qbool			sv_error;
+qbool			pr_profiling;
+vm_t			*sv_vm;
+
+void Sys_Error (char *error, ...)
+{
+	va_list argptr;
+
+	va_start (argptr, error);
+	vfprintf (stderr, error, argptr);
+	va_end (argptr);
+	fprintf (stderr, "\n");
+	exit (1);
+}
+
+void SV_Error (char *error, ...)
+{
+	va_list argptr;
+
+	va_start (argptr, error);
+	vfprintf (stderr, error, argptr);
+	va_end (argptr);
+	fprintf (stderr, "\n");
+	exit (1);
+}
+
+void Sys_Printf (char *fmt, ...)
+{
+	va_list argptr;
+
+	va_start (argptr, fmt);
+	vprintf (fmt, argptr);
+	va_end (argptr);
+}
+
+void Com_Printf (char *fmt, ...)
+{
+	va_list argptr;
+
+	va_start (argptr, fmt);
+	vprintf (fmt, argptr);
+	va_end (argptr);
+}
+
+void Com_DPrintf (char *fmt, ...)
+{
+	va_list argptr;
+
+	va_start (argptr, fmt);
+	vprintf (fmt, argptr);
+	va_end (argptr);
+}
+
+char *va (char *format, ...)
+{
+	static char string[1024];
+	va_list argptr;
+
+	va_start (argptr, format);
+	vsnprintf (string, sizeof(string), format, argptr);
+	va_end (argptr);
+	return string;
+}
+
+double Sys_DoubleTime (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 0.000000001;
+}
+
+void *Hunk_Alloc (int size)
+{
+	return Q_calloc (1, size);
+}
+
+void *Hunk_AllocName (int size, char *name)
+{
+	return Q_calloc (1, size);
+}
+
+// the module being checked for the .qvm, there is no .map
+byte *FS_LoadTempFile (char *path, int *len)
+{
+	if (!strstr (path, ".qvm"))
+		return NULL;
+	if (len)
+		*len = qc_filelen;
+	return qc_file;
+}
+
+unsigned short CRC_Block (byte *start, unsigned int count) { return 0; }
+qbool Info_SetStar (ctxinfo_t *ctx, const char *name, const char *value) { return true; }
+void Info_SetValueForStarKey (char *s, char *key, char *value, int maxsize) {}
+char *FS_NextPath (char *prevpath) { return NULL; }
+DL_t Sys_DLOpen (const char *path) { return NULL; }
+qbool Sys_DLClose (DL_t dl) { return true; }
+void *Sys_DLProc (DL_t dl, const char *name) { return NULL; }
+void PR_ProfEnter (int id) {}
+void PR_ProfLeave (void) {}
+void PR_ProfReload (void) {}
+void PR_Profile_f (void) {}
+
+/*
+===============================================================================
+
+CHECKING
+
+===============================================================================
+*/
+
+static byte *QC_LoadFile (char *path, int *len)
+{
+	FILE *f;
+	byte *buf;
+
+	if (!(f = fopen (path, "rb")))
+		return NULL;
+	fseek (f, 0, SEEK_END);
+	*len = ftell (f);
+	fseek (f, 0, SEEK_SET);
+	buf = (byte *) Q_malloc (*len + 1);
+	if (fread (buf, 1, *len, f) != *len)
+	{
+		fclose (f);
+		Q_free (buf);
+		return NULL;
+	}
+	fclose (f);
+	return buf;
+}
+
+static qbool QC_Check (char *path)
+{
+	vm_t vm;
+	qvm_t *qvm;
+
+	if (!(qc_file = QC_LoadFile (path, &qc_filelen)))
+	{
+		printf ("%s: couldn't be read\n", path);
+		return false;
+	}
+
+	memset (&vm, 0, sizeof(vm));
+	strlcpy (vm.name, "qwprogs", sizeof(vm.name));
+	printf ("%s:\n", path);
+	if (!VM_LoadBytecode (&vm, NULL))
+	{
+		printf ("%s: not a QVM\n", path);
+		Q_free (qc_file);
+		return false;
+	}
+
+	qvm = (qvm_t *) vm.hInst;
+	Q_free (qc_file);
+#ifdef QVM_JIT
+	printf ("%s: %i instructions, %s\n", path, qvm->len_cs - 1, qvm->jit ? "compiled" : "left to the interpreter");
+	return qvm->jit != NULL;
+#else
+	return false;
+#endif
+}
+
+int main (int argc, char **argv)
+{
+	int i, failed = 0;
+
+#ifndef QVM_JIT
+	fprintf (stderr, "%s: there is no QVM compiler for this platform\n", argv[0]);
+	return 1;
+#endif
+
+	if (argc < 2)
+	{
+		fprintf (stderr, "usage: %s <qwprogs.qvm> ...\n", argv[0]);
+		return 1;
+	}
+
+	for (i = 1; i < argc; i++)
+	{
+		if (!QC_Check (argv[i]))
+			failed++;
+	}
+
+	return failed ? 1 : 0;
+}
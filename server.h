@@ -67,13 +67,19 @@ typedef enum {
 
 typedef struct packet_s
 {
-	double		time;
+	double		time;		// realtime when the packet arrived
+	double		due;		// realtime when it should be executed
+	double		target;		// client delay at arrival, for sv_delaystats
+	int			client;		// index into svs.clients
+	int			userid;		// drops packets of a client that has left meanwhile
 	sizebuf_t	msg;
 	byte		buf[MSG_BUF_SIZE]; // ?MAX_MSGLEN?
 	struct packet_s *next;
 } packet_t;
 
-#define MAX_DELAYED_PACKETS 1024 // maxclients 32 * 77fps * max minping 0.3 = 739.2
+#define DELAYED_PACKETS_BLOCK	256		// delayed packet pool grows by this many packets
+#define MAX_DELAYED_PACKETS		16384	// maxclients 32 * 500fps * max delay 1.0 = 16000
+#define DELAY_WHEEL_SLOTS		1024	// 1 ms each, must cover the maximum client delay of 1 second
 #define MAP_NAME_LEN 64
 typedef struct
 {
@@ -105,6 +111,7 @@ typedef struct
 	char		*vw_model_name[MAX_VWEP_MODELS];	// NULL terminated
 	char		*sound_precache[MAX_SOUNDS];	// NULL terminated
 	char		*lightstyles[MAX_LIGHTSTYLES];
+	char		tmplightstyles[MAX_LIGHTSTYLES][MAX_STYLESTRING];	// QC temp strings
 	cmodel_t	*models[MAX_MODELS];
 
 	int		num_edicts;			// increases towards MAX_EDICTS
@@ -316,7 +323,11 @@ typedef struct client_s
 	int				rip_vip;
 	double			delay;
 	double			disable_updates_stop;		//Vladis
-	packet_t		*packets, *last_packet;
+	int				delay_queued;			// packets waiting in the delay wheel
+	int				delay_maxqueued;
+	double			delay_lastdue;			// keeps delayed packets of this client in order
+	double			delay_target, delay_actual;	// sums for sv_delaystats
+	int				delay_samples;
 } client_t;
 
 // a client can leave the server in one of four ways:
@@ -409,6 +420,15 @@ typedef struct mvddest_s
 
 	unsigned int totalsize;
 
+	struct mvdwriter_s *writer; // DEST_BUFFEREDFILE written by a thread, see sv_demo_writer.c
+
+// { where in the demo ring we read, see sv_demo_ring.c
+	qbool			inring;
+	unsigned int	ringpos;
+	qbool			resync; // stream reads up to resyncpos, then gets a new gamestate
+	unsigned int	resyncpos;
+// }
+
 // { used by QTV
 	double			io_time; // when last IO occur on socket, so we can timeout this dest
 	int				id; // dest id, used by QTV only
@@ -542,6 +562,7 @@ typedef struct
 	challenge_t		challenges[MAX_CHALLENGES];	// to prevent invalid IPs from connecting
 
 	packet_t		*free_packets;
+	int				num_packets;		// delayed packets allocated so far
 } server_static_t;
 
 //=============================================================================
@@ -716,6 +737,25 @@ void SV_FinalMessage (const char *message);
 void SV_DropClient (client_t *drop);
 
 int SV_CalcPing (client_t *cl);
+void SV_StatusCacheStats (unsigned int *queries, unsigned int *hits);
+
+// SV_Frame phases timed by the frame profiler, see sv_framestats
+typedef enum {
+	SVP_QTV,
+	SVP_READPACKETS,
+	SVP_PHYSICS,
+	SVP_STARTFRAME,		// part of SVP_PHYSICS
+	SVP_SEND,
+	SVP_DEMO,
+	SVP_FRAME,
+	SVP_MAX
+} svprofile_t;
+
+void SV_ProfileAdd (svprofile_t phase, double seconds);
+void SV_FrameProfileStats (float *avg, float *p99);
+float SV_ProfileLastFrame (svprofile_t phase);
+const char *SV_ProfileName (svprofile_t phase);
+
 void SV_FullClientUpdate (client_t *client, sizebuf_t *buf);
 void SV_FullClientUpdateToClient (client_t *client, client_t *cl);
 
@@ -773,6 +813,23 @@ char *Q_normalizetext (char *name); //bliP: red to white text
 unsigned char *Q_redtext (unsigned char *str); //bliP: white to red text
 unsigned char *Q_yelltext (unsigned char *str); //VVD: white to red text and yellow numbers
 
+//
+// sv_loadtest.c
+//
+void SV_LoadTest_f (void);
+void SV_LoadTestFrame (void);
+void SV_LoadTestPacket (int length, void *data, netadr_t to);
+
+//
+// sv_tracelog.c
+//
+extern qbool sv_tracelogging;
+void SV_TraceLog_f (void);
+void SV_TraceLogStop (void);
+void SV_TraceLogEdicts (edict_t **list, int count);
+void SV_TraceLogTrace (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, edict_t *passedict, trace_t *trace);
+void SV_TraceLogPlayerMove (void);
+
 //
 // sv_init.c
 //
@@ -785,6 +842,13 @@ void SV_SpawnServer (char *server, qbool devmap);
 // sv_phys.c
 //
 void SV_ProgStartFrame (void);
+extern	cvar_t	sv_thinkqueue;
+#define	SV_THINKFIELDS	(sizeof(entvars_t) / 4)
+extern	byte	sv_thinkfields[SV_THINKFIELDS];
+// true if a QC store to field ofs can wake a sleeping entity
+#define	SV_THINKFIELD(ofs)	((unsigned int)(ofs) < SV_THINKFIELDS && sv_thinkfields[ofs])
+void SV_ThinkWake (edict_t *ent);
+void SV_ThinkReset (void);
 void SV_Physics (void);
 void SV_CheckVelocity (edict_t *ent);
 void SV_AddGravity (edict_t *ent, float scale);
@@ -843,7 +907,12 @@ void SV_SendServerInfoChange (char *key, char *value);
 //
 // sv_ents.c
 //
+#define MAX_SEND_THREADS	8	// packet building threads, see sv_sendthreads
 void SV_WriteEntitiesToClient (client_t *client, sizebuf_t *msg, qbool recorder);
+void SV_WriteEntitiesToClientWorker (client_t *client, sizebuf_t *msg, int worker);
+void SV_DeltaCacheStats (unsigned int *lookups, unsigned int *hits);
+int SV_ClientViewLeafnum (client_t *client, vec3_t vieworg);
+byte *SV_ClientFatPVS (client_t *client, vec3_t vieworg);
 
 //
 // sv_nchan.c
@@ -897,6 +966,8 @@ extern demo_t	demo; // server demo struct
 
 extern cvar_t	sv_demoUseCache;
 extern cvar_t	sv_demoCacheSize;
+extern cvar_t	sv_demoWriteThread;
+extern cvar_t	sv_demoCompress;
 extern cvar_t	sv_demoMaxDirSize;
 extern cvar_t	sv_demoClearOld;
 extern cvar_t	sv_demoDir;
@@ -922,6 +993,7 @@ char *SV_MVDNum(int num);
 //
 
 char	*SV_PrintTeams (void);
+void	SV_MVDTxtName (char *path);
 void	Run_sv_demotxt_and_sv_onrecordfinish (const char *dest_name, const char *dest_path, qbool destroyfiles);
 qbool	SV_DirSizeCheck (void);
 char	*SV_CleanName (unsigned char *name);
@@ -951,6 +1023,8 @@ extern cvar_t	qtv_maxstreams;
 extern cvar_t	qtv_password;
 extern cvar_t	qtv_pendingtimeout;
 extern cvar_t	qtv_streamtimeout;
+extern cvar_t	qtv_maxlag;
+extern cvar_t	qtv_lagresync;
 
 
 void SV_MVDStream_Poll(void);
@@ -960,6 +1034,27 @@ void SV_QTV_Init(void);
 void DemoWriteQTV (sizebuf_t *msg);
 void QTVsv_FreeUserList(mvddest_t *d);
 
+//
+// sv_demo_ring.c
+//
+
+void MVDRing_Join (mvddest_t *d);
+void MVDRing_Leave (mvddest_t *d);
+void MVDRing_Write (const void *data, int len, qbool streamsonly);
+int  MVDRing_Read (mvddest_t *d, char **data);
+void MVDRing_Advance (mvddest_t *d, int len);
+void MVDRing_CheckLag (mvddest_t *d);
+void SV_MVDRing_f (void);
+
+//
+// sv_demo_writer.c
+//
+
+qbool MVDWriter_Open (mvddest_t *d, int cachesize, qbool batch, int level);
+qbool MVDWriter_Flush (mvddest_t *d, int reserve, qbool complete);
+void MVDWriter_Close (mvddest_t *d);
+void SV_MVDWriter_f (void);
+
 //
 // sv_login.c
 //
@@ -1155,6 +1155,10 @@ void SV_Status_f (void)
 	int i;
 	client_t *cl;
 	float cpu, avg, pak, demo1 = 0.0;
+	unsigned int delta_lookups, delta_hits;
+	unsigned int status_queries, status_hits;
+	float frame_avg, frame_p99;
+	double udp_in, udp_out;
 	char *s;
 
 	cpu = (svs.stats.latched_active + svs.stats.latched_idle);
@@ -1168,16 +1172,31 @@ void SV_Status_f (void)
 	avg = 1000 * svs.stats.latched_active  / STATFRAMES;
 	pak = (float)svs.stats.latched_packets / STATFRAMES;
 
+	SV_DeltaCacheStats (&delta_lookups, &delta_hits);
+	NET_UDPStats (&udp_in, &udp_out);
+	SV_StatusCacheStats (&status_queries, &status_hits);
+	SV_FrameProfileStats (&frame_avg, &frame_p99);
+
 	Con_Printf ("net address                 : %s\n"
 				"cpu utilization (overall)   : %3i%%\n"
 				"cpu utilization (recording) : %3i%%\n"
 				"avg response time           : %i ms\n"
-				"packets/frame               : %5.2f (%d)\n",
+				"packets/frame               : %5.2f (%d)\n"
+				"entity delta cache hits     : %3i%% (%u/%u)\n"
+				"udp packets/syscall         : %5.2f in, %5.2f out\n"
+				"status reply cache hits     : %3i%% (%u/%u)\n"
+				"frame time avg/p99          : %.2f/%.2f ms\n",
 				NET_AdrToString (net_local_sv_ipadr),
 				(int)cpu,
 				(int)demo1,
 				(int)avg,
-				pak, num_prstr);
+				pak, num_prstr,
+				delta_lookups ? (int)(100.0 * delta_hits / delta_lookups) : 0,
+				delta_hits, delta_lookups,
+				udp_in, udp_out,
+				status_queries ? (int)(100.0 * status_hits / status_queries) : 0,
+				status_hits, status_queries,
+				frame_avg, frame_p99);
 
 	switch (sv_redirected)
 	{
@@ -0,0 +1,211 @@
+/*
+Copyright (C) 1996-1997 Id Software, Inc.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+// sv_clip.c - clipping moves against edicts, shared by the server and tracereplay
+
+#include "qwsvdef.h"
+
+/*
+================
+SV_HullForEntity
+
+Returns a hull that can be used for testing or clipping an object of mins/maxs
+size.
+Offset is filled in to contain the adjustment that must be added to the
+testing object's origin to get a point to use with the returned hull.
+================
+*/
+hull_t *SV_HullForEntity (edict_t *ent, vec3_t mins, vec3_t maxs, vec3_t offset)
+{
+	vec3_t size, hullmins, hullmaxs;
+	cmodel_t *model;
+	hull_t *hull;
+
+
+	// decide which clipping hull to use, based on the size
+	if (ent->v.solid == SOLID_BSP)
+	{	// explicit hulls in the BSP model
+		if (ent->v.movetype != MOVETYPE_PUSH)
+			SV_Error ("SOLID_BSP without MOVETYPE_PUSH");
+
+		if ((unsigned)ent->v.modelindex >= MAX_MODELS)
+			SV_Error ("SV_HullForEntity: ent.modelindex >= MAX_MODELS");
+
+		model = sv.models[(int)ent->v.modelindex];
+		if (!model)
+			SV_Error ("SOLID_BSP with a non-bsp model");
+
+		VectorSubtract (maxs, mins, size);
+		if (size[0] < 3)
+			hull = &model->hulls[0];
+		else if (size[0] <= 32)
+			hull = &model->hulls[1];
+		else
+			hull = &model->hulls[2];
+
+		// calculate an offset value to center the origin
+		VectorSubtract (hull->clip_mins, mins, offset);
+		VectorAdd (offset, ent->v.origin, offset);
+	}
+	else
+	{	// create a temp hull from bounding box sizes
+
+		VectorSubtract (ent->v.mins, maxs, hullmins);
+		VectorSubtract (ent->v.maxs, mins, hullmaxs);
+		hull = CM_HullForBox (hullmins, hullmaxs);
+		
+		VectorCopy (ent->v.origin, offset);
+	}
+
+
+	return hull;
+}
+
+/*
+==================
+SV_ClipMoveToEntity
+
+Handles selection or creation of a clipping hull, and offseting (and
+eventually rotation) of the end points
+==================
+*/
+trace_t SV_ClipMoveToEntity (edict_t *ent, vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end)
+{
+	trace_t		trace;
+	vec3_t		offset;
+	vec3_t		start_l, end_l;
+	hull_t		*hull;
+
+// get the clipping hull
+	hull = SV_HullForEntity (ent, mins, maxs, offset);
+
+	VectorSubtract (start, offset, start_l);
+	VectorSubtract (end, offset, end_l);
+
+// trace a line through the apropriate clipping hull
+	trace = CM_HullTrace (hull, start_l, end_l);
+
+// fix trace up by the offset
+	VectorAdd (trace.endpos, offset, trace.endpos);
+
+// did we clip the move?
+	if (trace.fraction < 1 || trace.startsolid )
+		trace.e.ent = ent;
+
+	return trace;
+}
+
+/*
+==================
+SV_InitMoveClip
+
+Sets up clip for a move and clips it to the world
+==================
+*/
+void SV_InitMoveClip (moveclip_t *clip, vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, edict_t *passedict)
+{
+	int i;
+
+	memset (clip, 0, sizeof(*clip));
+
+	// clip to world
+	clip->trace = SV_ClipMoveToEntity (sv.edicts, start, mins, maxs, end);
+
+	clip->start = start;
+	clip->end = end;
+	clip->mins = mins;
+	clip->maxs = maxs;
+	clip->type = type;
+	clip->passedict = passedict;
+
+	if (type == MOVE_MISSILE)
+	{
+		for (i = 0; i < 3; i++)
+		{
+			clip->mins2[i] = -15;
+			clip->maxs2[i] = 15;
+		}
+	}
+	else
+	{
+		VectorCopy (mins, clip->mins2);
+		VectorCopy (maxs, clip->maxs2);
+	}
+}
+
+/*
+==================
+SV_ClipToEdicts
+
+Clips the move to the edicts in list, SV_ClipToLinks passes what
+SV_AreaEdicts found and tracereplay what was recorded
+==================
+*/
+void SV_ClipToEdicts (moveclip_t *clip, edict_t **list, int count)
+{
+	int			i;
+	edict_t		*touch;
+	trace_t		trace;
+
+// touch linked edicts
+	for (i = 0; i < count; i++)
+	{
+		touch = list[i];
+		if (touch == clip->passedict)
+			continue;
+		if (touch->v.solid == SOLID_TRIGGER)
+			SV_Error ("Trigger in clipping list");
+
+		if (clip->type == MOVE_NOMONSTERS && touch->v.solid != SOLID_BSP)
+			continue;
+
+		if (clip->passedict && clip->passedict->v.size[0] && !touch->v.size[0])
+			continue;	// points never interact
+
+	// might intersect, so do an exact clip
+		if (clip->trace.allsolid)
+			return;
+		if (clip->passedict)
+		{
+			if (PROG_TO_EDICT(touch->v.owner) == clip->passedict)
+				continue;	// don't clip against own missiles
+			if (PROG_TO_EDICT(clip->passedict->v.owner) == touch)
+				continue;	// don't clip against owner
+		}
+
+		if ((int)touch->v.flags & FL_MONSTER)
+			trace = SV_ClipMoveToEntity (touch, clip->start, clip->mins2, clip->maxs2, clip->end);
+		else
+			trace = SV_ClipMoveToEntity (touch, clip->start, clip->mins, clip->maxs, clip->end);
+		if (trace.allsolid || trace.startsolid ||
+				  trace.fraction < clip->trace.fraction)
+		{
+			trace.e.ent = touch;
+			if (clip->trace.startsolid)
+			{
+				clip->trace = trace;
+				clip->trace.startsolid = true;
+			}
+			else
+				clip->trace = trace;
+		}
+		else if (trace.startsolid)
+			clip->trace.startsolid = true;
+	}
+}
@@ -33,6 +33,8 @@ void	sv_demoDir_OnChange(cvar_t *cvar, char *value, qbool *cancel);
 
 cvar_t	sv_demoUseCache		= {"sv_demoUseCache",	"0"};
 cvar_t	sv_demoCacheSize	= {"sv_demoCacheSize",	"0", CVAR_ROM};
+cvar_t	sv_demoWriteThread	= {"sv_demoWriteThread",	"1"};
+cvar_t	sv_demoCompress		= {"sv_demoCompress",	"0"}; // zlib level, writes .mvd.gz
 cvar_t	sv_demoMaxDirSize	= {"sv_demoMaxDirSize",	"102400"};
 cvar_t	sv_demoClearOld		= {"sv_demoClearOld",	"0"};
 cvar_t	sv_demoDir			= {"sv_demoDir",		"demos", 0, sv_demoDir_OnChange};
@@ -119,6 +121,9 @@ void DestClose (mvddest_t *d, qbool destroyfiles)
 {
 	char path[MAX_OSPATH];
 
+	MVDRing_Leave(d);
+	MVDWriter_Close(d);
+
 	if (d->cache)
 		Q_free(d->cache);
 	if (d->file)
@@ -132,7 +137,7 @@ void DestClose (mvddest_t *d, qbool destroyfiles)
 	{
 		snprintf(path, MAX_OSPATH, "%s/%s/%s", fs_gamedir, d->path, d->name);
 		Sys_remove(path);
-		strlcpy(path + strlen(path) - 3, "txt", MAX_OSPATH - strlen(path) + 3);
+		SV_MVDTxtName(path);
 		Sys_remove(path);
 	}
 
@@ -145,6 +150,7 @@ void DestClose (mvddest_t *d, qbool destroyfiles)
 void DestFlush (qbool compleate)
 {
 	int len;
+	char *data;
 	mvddest_t *d, *t;
 
 	if (!demo.dest)
@@ -166,6 +172,17 @@ void DestFlush (qbool compleate)
 
 	for (d = demo.dest; d; d = d->nextdest)
 	{
+		// files take everything new in the ring
+		if (d->desttype != DEST_STREAM)
+		{
+			while (!d->error && (len = MVDRing_Read(d, &data)) > 0)
+			{
+				if (DemoWriteDest(data, len, d) != len)
+					break;
+				MVDRing_Advance(d, len);
+			}
+		}
+
 		switch(d->desttype)
 		{
 		case DEST_FILE:
@@ -173,7 +190,15 @@ void DestFlush (qbool compleate)
 			break;
 
 		case DEST_BUFFEREDFILE:
-			if (d->cacheused + DEMO_FLUSH_CACHE_IF_LESS_THAN_THIS > d->maxcachesize || compleate)
+			if (d->writer)
+			{
+				if (!MVDWriter_Flush(d, DEMO_FLUSH_CACHE_IF_LESS_THAN_THIS, compleate))
+				{
+					Sys_Printf("DestFlush: fwrite() error\n");
+					d->error = true;
+				}
+			}
+			else if (d->cacheused + DEMO_FLUSH_CACHE_IF_LESS_THAN_THIS > d->maxcachesize || compleate)
 			{
 				len = fwrite(d->cache, 1, d->cacheused, d->file);
 				if (len != d->cacheused)
@@ -222,6 +247,28 @@ void DestFlush (qbool compleate)
 					}
 				}
 			}
+
+			// then the ring, straight from it
+			while (!d->cacheused && !d->error && (len = MVDRing_Read(d, &data)) > 0)
+			{
+				int sent = send(d->socket, data, len, 0);
+
+				if (sent > 0)
+				{
+					MVDRing_Advance(d, sent);
+					d->io_time = Sys_DoubleTime(); // update IO activity
+				}
+				else if (sent < 0 && qerrno != EWOULDBLOCK && qerrno != EAGAIN)
+				{
+					Sys_Printf("DestFlush: error on stream\n");
+					d->error = true;
+				}
+
+				if (sent < len)
+					break;
+			}
+
+			MVDRing_CheckLag(d);
 			break;
 
 		case DEST_NONE:
@@ -310,6 +357,10 @@ int DemoWriteDest (void *data, int len, mvddest_t *d)
 			break;
 		case DEST_BUFFEREDFILE:	//these write to a cache, which is flushed later
 		case DEST_STREAM:
+			// a writer block can be handed over early, it's only a part of the cache
+			if (d->writer && d->cacheused + len > d->maxcachesize)
+				MVDWriter_Flush(d, len, true);
+
 			if (d->cacheused + len > d->maxcachesize)
 			{
 				Sys_Printf("DemoWriteDest: cache overflow %d > %d\n", d->cacheused + len, d->maxcachesize);
@@ -329,14 +380,11 @@ int DemoWriteDest (void *data, int len, mvddest_t *d)
 
 static void DemoWrite (void *data, int len) //broadcast to all proxies/mvds
 {
-	mvddest_t *d;
-	for (d = demo.dest; d; d = d->nextdest)
-	{
-		if (singledest && singledest != d)
-			continue;
-
-		DemoWriteDest(data, len, d);
-	}
+	// the ring has it for every dest, see sv_demo_ring.c
+	if (singledest)
+		DemoWriteDest(data, len, singledest);
+	else
+		MVDRing_Write(data, len, false);
 }
 
 /*
@@ -771,23 +819,47 @@ SV_InitRecord
 */
 static mvddest_t *SV_InitRecordFile (char *name)
 {
-	char *s;
+	char *s, *filename = name;
 	mvddest_t *dst;
 	FILE *file;
+	int compress = 0;
 
 	char path[MAX_OSPATH];
+	char gzname[MAX_OSPATH];
+
+	// only the writer thread compresses, deflate is too slow for the server frame
+#ifdef WITH_ZLIB
+	if ((int)sv_demoWriteThread.value && (int)sv_demoCompress.value > 0)
+	{
+		compress = (int)sv_demoCompress.value;
+		snprintf(gzname, sizeof(gzname), "%s.gz", name);
+		filename = gzname;
+	}
+#endif
 
-	Con_DPrintf("SV_InitRecordFile: Demo name: \"%s\"\n", name);
-	file = fopen (name, "wb");
+	Con_DPrintf("SV_InitRecordFile: Demo name: \"%s\"\n", filename);
+	file = fopen (filename, "wb");
 	if (!file)
 	{
-		Con_Printf ("ERROR: couldn't open \"%s\"\n", name);
+		Con_Printf ("ERROR: couldn't open \"%s\"\n", filename);
 		return NULL;
 	}
 
 	dst = (mvddest_t*) Q_malloc (sizeof(mvddest_t));
 
-	if (!(int)sv_demoUseCache.value)
+	if ((int)sv_demoWriteThread.value)
+	{
+		dst->desttype = DEST_BUFFEREDFILE;
+		dst->file = file;
+		if (!MVDWriter_Open(dst, 1024 * (int) sv_demoCacheSize.value, (int)sv_demoUseCache.value, compress))
+		{
+			fclose(file);
+			Sys_remove(filename);
+			Q_free(dst);
+			return NULL;
+		}
+	}
+	else if (!(int)sv_demoUseCache.value)
 	{
 		dst->desttype = DEST_FILE;
 		dst->file = file;
@@ -801,13 +873,13 @@ static mvddest_t *SV_InitRecordFile (char *name)
 		dst->cache = (char *) Q_malloc (dst->maxcachesize);
 	}
 
-	s = name + strlen(name);
+	s = filename + strlen(filename);
 	while (*s != '/') s--;
 	strlcpy(dst->name, s+1, sizeof(dst->name));
 	strlcpy(dst->path, sv_demoDir.string, sizeof(dst->path));
 
 	SV_BroadcastPrintf (PRINT_CHAT, "Server starts recording (%s):\n%s\n",
-						(dst->desttype == DEST_BUFFEREDFILE) ? "memory" : "disk", s+1);
+						(int)sv_demoUseCache.value ? "memory" : "disk", s+1);
 	Cvar_SetROM(&serverdemo, dst->name);
 
 	strlcpy(path, name, MAX_OSPATH);
@@ -1124,6 +1196,7 @@ qbool SV_MVD_Record (mvddest_t *dest, qbool mapchange)
 		dest->nextdest = demo.dest;
 		demo.dest = dest;
 
+		MVDRing_Join(dest);
 		SV_MVD_SendInitialGamestate(dest);
 	}
 
@@ -1689,6 +1762,8 @@ static void MVD_Init (void)
 	Cvar_Register (&sv_demoNoVis);
 	Cvar_Register (&sv_demoUseCache);
 	Cvar_Register (&sv_demoCacheSize);
+	Cvar_Register (&sv_demoWriteThread);
+	Cvar_Register (&sv_demoCompress);
 	Cvar_Register (&sv_demoMaxSize);
 	Cvar_Register (&sv_demoMaxDirSize);
 	Cvar_Register (&sv_demoClearOld); //bliP: 24/9 clear old demos
@@ -1738,6 +1813,8 @@ void SV_MVDInit (void)
 	Cmd_AddCommand ("demoInfoAdd",		SV_MVDInfoAdd_f);
 	Cmd_AddCommand ("demoInfoRemove",	SV_MVDInfoRemove_f);
 	Cmd_AddCommand ("demoInfo",			SV_MVDInfo_f);
+	Cmd_AddCommand ("sv_demowriter",	SV_MVDWriter_f);
+	Cmd_AddCommand ("sv_demoring",		SV_MVDRing_f);
 
 	SV_QTV_Init();
 }
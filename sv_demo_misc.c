@@ -194,12 +194,24 @@ qbool SV_DirSizeCheck (void)
 	return true;
 }
 
+// demo.mvd or demo.mvd.gz to demo.txt, in place
+void SV_MVDTxtName (char *path)
+{
+	int len = strlen(path);
+
+	if (len > 3 && !strcasecmp(path + len - 3, ".gz"))
+		path[len -= 3] = 0;
+
+	if (len > 3)
+		strlcpy(path + len - 3, "txt", 4);
+}
+
 void Run_sv_demotxt_and_sv_onrecordfinish (const char *dest_name, const char *dest_path, qbool destroyfiles)
 {
 	char path[MAX_OSPATH];
 
 	snprintf(path, MAX_OSPATH, "%s/%s/%s", fs_gamedir, dest_path, dest_name);
-	strlcpy(path + strlen(path) - 3, "txt", MAX_OSPATH - strlen(path) + 3);
+	SV_MVDTxtName(path);
 
 	if ((int)sv_demotxt.value && !destroyfiles) // dont keep txt's for deleted demos
 	{
@@ -230,7 +242,7 @@ void Run_sv_demotxt_and_sv_onrecordfinish (const char *dest_name, const char *de
 			*p = 0; // strip parameters
 	
 		strlcpy(path, dest_name, MAX_OSPATH);
-		strlcpy(path + strlen(dest_name) - 3, "txt", MAX_OSPATH - strlen(dest_name) + 3);
+		SV_MVDTxtName(path);
 	
 		sv_redirected = RD_NONE; // onrecord script is called always from the console
 		Cmd_TokenizeString(va("script %s \"%s\" \"%s\" \"%s\" %s", sv_onrecordfinish.string, dest_path, dest_name, path, p != NULL ? p+1 : ""));
@@ -451,13 +463,19 @@ char *SV_MVDNum (int num)
 	if (num & 0xFF000000)
 	{
 		char *name = demo.lastdemosname[(demo.lastdemospos - (num >> 24) + 1) & 0xF];
-		char *name2;
-		int c;
+		char *name2, base[MAX_OSPATH];
+
+		if (!name)
+			return NULL;
+
+		// crop extension '.mvd' or '.mvd.gz', sv_demoRegexp matches either
+		strlcpy(base, name, sizeof(base));
+		SV_MVDTxtName(base);
+		if (strlen(base) > 4)
+			base[strlen(base) - 4] = '\0';
 
-		if (!(name2 = quote(name)))
+		if (!(name2 = quote(base)))
 			return NULL;
-		if ((c = strlen(name2)) > 5)
-			name2[c - 5] = '\0'; // crop quoted extension '\.mvd'
 
 		dir = Sys_listdir(va("%s/%s", fs_gamedir, sv_demoDir.string),
 						  va("^%s%s", name2, sv_demoRegexp.string), SORT_NO);
@@ -26,6 +26,8 @@ cvar_t	qtv_maxstreams		= {"qtv_maxstreams",		"1"};
 cvar_t	qtv_password		= {"qtv_password",			""};
 cvar_t	qtv_pendingtimeout	= {"qtv_pendingtimeout",	"5"};  // 5  seconds must be enough
 cvar_t	qtv_streamtimeout	= {"qtv_streamtimeout",		"45"}; // 45 seconds
+cvar_t	qtv_maxlag			= {"qtv_maxlag",			"2048"}; // KB a stream may be behind
+cvar_t	qtv_lagresync		= {"qtv_lagresync",			"1"};  // resync streams behind qtv_maxlag instead of dropping them
 
 static mvddest_t *SV_InitStream (int socket1, netadr_t na, char *userinfo)
 {
@@ -1314,13 +1316,14 @@ void DemoWriteQTV (sizebuf_t *msg)
 	MSG_WriteLong (&mvdheader, msg->cursize);
 
 	for (d = demo.dest; d; d = d->nextdest)
-	{
 		if (d->desttype == DEST_STREAM)
-		{
-			DemoWriteDest(mvdheader.data, mvdheader.cursize, d);
-			DemoWriteDest(msg->data, msg->cursize, d);
-		}
-	}
+			break;
+
+	if (!d)
+		return; // no streams
+
+	MVDRing_Write(mvdheader.data, mvdheader.cursize, true);
+	MVDRing_Write(msg->data, msg->cursize, true);
 }
 
 void Qtv_List_f(void)
@@ -1418,6 +1421,8 @@ void SV_QTV_Init(void)
 	Cvar_Register (&qtv_password);
 	Cvar_Register (&qtv_pendingtimeout);
 	Cvar_Register (&qtv_streamtimeout);
+	Cvar_Register (&qtv_maxlag);
+	Cvar_Register (&qtv_lagresync);
 
 	Cmd_AddCommand ("qtv_list", Qtv_List_f);
 	Cmd_AddCommand ("qtv_close", Qtv_Close_f);
@@ -0,0 +1,324 @@
+/*
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the included (GNU.txt) GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+// sv_demo_ring.c - one buffer of mvd data for all dests
+
+/*
+DemoWrite puts mvd data into the ring once, however many files and QTV
+streams there are.  Each dest reads from its own position in it: files
+take everything new at every DestFlush, streams send() straight out of
+the ring as far as their socket lets them.  Data only written for one
+dest, the initial gamestate of a new dest, still goes through
+DemoWriteDest into the dest's own cache, and is sent before the ring.
+
+Positions count bytes since the server started and wrap at 4 GB, the
+ring size divides that so a position maps to the same byte either way.
+The ring is cut into blocks and every block counts the dests reading
+in it.  Only when the block the next write goes into still has readers
+do we have to look for dests that are a whole ring behind, those have
+lost data and are dropped.
+
+A stream more than qtv_maxlag KB behind is dropped, or with
+qtv_lagresync 1 it gets what there is up to the end of the current
+frame and then starts over with a fresh gamestate at the head of the
+ring, the way a stream that just connected would.
+
+What DemoWriteQTV writes is for streams only, files skip those ranges.
+*/
+
+#include "qwsvdef.h"
+
+#define MVDRING_BLOCKSIZE	0x10000
+#define MVDRING_BLOCKS		64
+#define MVDRING_SIZE		(MVDRING_BLOCKSIZE * MVDRING_BLOCKS)
+#define MVDRING_SKIPS		64
+
+#define MVDRING_BLOCK(pos)	(((pos) / MVDRING_BLOCKSIZE) % MVDRING_BLOCKS)
+
+typedef struct
+{
+	unsigned int	start, end;
+} mvdringskip_t;
+
+typedef struct
+{
+	byte			data[MVDRING_SIZE];
+	unsigned int	head;						// position of the next write
+	int				refs[MVDRING_BLOCKS];		// dests reading in each block
+
+	mvdringskip_t	skips[MVDRING_SKIPS];		// streams only, oldest first
+	int				numskips;
+
+	double			written;					// bytes that went in
+	double			delivered;					// bytes read out, by all dests
+	int				overruns, resyncs, lagdrops;
+	int				maxlag;
+} mvdring_t;
+
+static mvdring_t mvdring;
+
+// bytes d has still to read from the ring
+static unsigned int MVDRing_Lag (mvddest_t *d)
+{
+	return mvdring.head - d->ringpos;
+}
+
+void MVDRing_Join (mvddest_t *d)
+{
+	d->ringpos = mvdring.head;
+	d->inring = true;
+	d->resync = false;
+	mvdring.refs[MVDRING_BLOCK(d->ringpos)]++;
+}
+
+void MVDRing_Leave (mvddest_t *d)
+{
+	if (!d->inring)
+		return;
+
+	mvdring.refs[MVDRING_BLOCK(d->ringpos)]--;
+	d->inring = false;
+}
+
+// drops the dests still reading in the block the head moves into
+static void MVDRing_Overrun (void)
+{
+	mvddest_t *d;
+
+	for (d = demo.dest; d; d = d->nextdest)
+	{
+		if (!d->inring || d->error)
+			continue;
+
+		if (MVDRing_Lag(d) > MVDRING_SIZE - MVDRING_BLOCKSIZE)
+		{
+			Sys_Printf("MVDRing_Write: %s is a whole ring behind, dropped\n",
+					d->desttype == DEST_STREAM ? NET_AdrToString(d->na) : d->name);
+			MVDRing_Leave(d);
+			d->error = true;
+			mvdring.overruns++;
+		}
+	}
+}
+
+static void MVDRing_Move (mvddest_t *d, unsigned int len)
+{
+	int oldblock = MVDRING_BLOCK(d->ringpos);
+
+	d->ringpos += len;
+
+	if (MVDRING_BLOCK(d->ringpos) != oldblock)
+	{
+		mvdring.refs[oldblock]--;
+		mvdring.refs[MVDRING_BLOCK(d->ringpos)]++;
+	}
+}
+
+static void MVDRing_AddSkip (unsigned int start, unsigned int end)
+{
+	mvddest_t *d;
+
+	// forget the ranges every file has gone past
+	while (mvdring.numskips)
+	{
+		for (d = demo.dest; d; d = d->nextdest)
+			if (d->inring && d->desttype != DEST_STREAM && (int)(d->ringpos - mvdring.skips[0].end) < 0)
+				break;
+
+		if (d)
+			break;
+
+		memmove(mvdring.skips, mvdring.skips + 1, --mvdring.numskips * sizeof(mvdring.skips[0]));
+	}
+
+	if (mvdring.numskips && mvdring.skips[mvdring.numskips - 1].end == start)
+		mvdring.skips[mvdring.numskips - 1].end = end;
+	else if (mvdring.numskips < MVDRING_SKIPS)
+	{
+		mvdring.skips[mvdring.numskips].start = start;
+		mvdring.skips[mvdring.numskips].end = end;
+		mvdring.numskips++;
+	}
+	// else files get it too, they're far behind anyway
+}
+
+/*
+====================
+MVDRing_Write
+
+Appends data for every dest in the ring, or only for streams
+====================
+*/
+void MVDRing_Write (const void *data, int len, qbool streamsonly)
+{
+	unsigned int start = mvdring.head;
+	int offset, part;
+
+	if (len <= 0)
+		return;
+
+	while (len > 0)
+	{
+		offset = mvdring.head % MVDRING_SIZE;
+		part = min(len, MVDRING_BLOCKSIZE - offset % MVDRING_BLOCKSIZE);
+
+		// a dest caught up at the head is counted here as well, so look closer
+		if (!(offset % MVDRING_BLOCKSIZE) && mvdring.refs[MVDRING_BLOCK(mvdring.head)])
+			MVDRing_Overrun();
+
+		memcpy(mvdring.data + offset, data, part);
+		data = (const byte *) data + part;
+		mvdring.head += part;
+		mvdring.written += part;
+		len -= part;
+	}
+
+	if (streamsonly)
+		MVDRing_AddSkip(start, mvdring.head);
+}
+
+/*
+====================
+MVDRing_Read
+
+How much d can read in one piece and where, 0 when it has everything.
+Files jump over what was written for streams only.
+====================
+*/
+int MVDRing_Read (mvddest_t *d, char **data)
+{
+	unsigned int end = mvdring.head;
+	int i;
+
+	if (!d->inring)
+		return 0;
+
+	if (d->resync && (int)(d->resyncpos - end) < 0)
+		end = d->resyncpos;
+
+	if (d->desttype != DEST_STREAM)
+	{
+		for (i = 0; i < mvdring.numskips; i++)
+		{
+			if ((int)(mvdring.skips[i].end - d->ringpos) <= 0)
+				continue;	// behind us
+
+			if ((int)(mvdring.skips[i].start - d->ringpos) <= 0)
+			{
+				MVDRing_Move(d, mvdring.skips[i].end - d->ringpos);
+				continue;
+			}
+
+			if ((int)(mvdring.skips[i].start - end) < 0)
+				end = mvdring.skips[i].start;
+			break;
+		}
+	}
+
+	*data = (char *) mvdring.data + d->ringpos % MVDRING_SIZE;
+	return min(end - d->ringpos, MVDRING_SIZE - d->ringpos % MVDRING_SIZE);
+}
+
+void MVDRing_Advance (mvddest_t *d, int len)
+{
+	MVDRing_Move(d, len);
+	if (d->desttype == DEST_STREAM)
+		d->totalsize += len;	// DemoWriteDest counts what files wrote
+	mvdring.delivered += len;
+}
+
+/*
+====================
+MVDRing_CheckLag
+
+Called for streams by DestFlush after sending.  Drops or resyncs the ones
+too far behind, and starts the resync once they got to the frame end.
+====================
+*/
+void MVDRing_CheckLag (mvddest_t *d)
+{
+	unsigned int lag;
+
+	if (!d->inring || d->error)
+		return;
+
+	if (d->resync)
+	{
+		if (d->ringpos != d->resyncpos || d->cacheused)
+			return;
+
+		// same as a new stream
+		MVDRing_Leave(d);
+		MVDRing_Join(d);
+		SV_MVD_SendInitialGamestate(d);
+		mvdring.resyncs++;
+		Con_DPrintf("MVDRing_CheckLag: QTV %s resynced\n", NET_AdrToString(d->na));
+		return;
+	}
+
+	lag = MVDRing_Lag(d) + d->cacheused;
+	mvdring.maxlag = max(mvdring.maxlag, (int)lag);
+
+	if ((int)qtv_maxlag.value <= 0 || lag <= (unsigned int)qtv_maxlag.value * 1024)
+		return;
+
+	if ((int)qtv_lagresync.value)
+	{
+		// it gets what was written up to now, which ends with a whole frame
+		d->resync = true;
+		d->resyncpos = mvdring.head;
+		return;
+	}
+
+	Sys_Printf("QTV %s is %dk behind, dropped\n", NET_AdrToString(d->na), lag / 1024);
+	MVDRing_Leave(d);
+	d->error = true;
+	mvdring.lagdrops++;
+}
+
+void SV_MVDRing_f (void)
+{
+	mvddest_t *d;
+	unsigned int lag, maxlag = 0;
+	int i, used = 0;
+
+	for (d = demo.dest; d; d = d->nextdest)
+		if (d->inring)
+			maxlag = max(maxlag, MVDRing_Lag(d));
+
+	for (i = 0; i < MVDRING_BLOCKS; i++)
+		if (mvdring.refs[i])
+			used++;
+
+	Con_Printf("ring: %ik in %i blocks, %ik buffered, %i blocks with readers\n",
+		MVDRING_SIZE / 1024, MVDRING_BLOCKS, maxlag / 1024, used);
+	Con_Printf("written %.1fMB, delivered %.1fMB, peak stream lag %ik\n",
+		mvdring.written / (1024 * 1024), mvdring.delivered / (1024 * 1024), mvdring.maxlag / 1024);
+	Con_Printf("dropped %i overrun %i lagging, %i resynced\n",
+		mvdring.overruns, mvdring.lagdrops, mvdring.resyncs);
+
+	for (d = demo.dest; d; d = d->nextdest)
+	{
+		if (!d->inring)
+			continue;
+
+		lag = MVDRing_Lag(d);
+		Con_Printf("%-24s lag %6ik own %6ik%s\n",
+			d->desttype == DEST_STREAM ? NET_AdrToString(d->na) : d->name,
+			lag / 1024, d->cacheused / 1024, d->resync ? " resyncing" : "");
+	}
+}
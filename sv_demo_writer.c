@@ -0,0 +1,340 @@
+/*
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the included (GNU.txt) GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+// sv_demo_writer.c - writing mvd files from a thread of their own
+
+/*
+With sv_demoWriteThread 1 every demo file gets a writer thread and its
+cache is split into MVDWRITER_BLOCKS blocks.  DemoWriteDest fills one
+block as before, DestFlush queues it for the thread and carries on with
+the next free one, so fwrite and fflush never run inside a server frame.
+
+The game and the thread share a ring of blocks and two counting
+semaphores, one for queued blocks and one for free ones.  Each side only
+moves its own index through the ring and no lock is ever taken.
+
+A block is queued when it is nearly full.  With sv_demoUseCache 0 it is
+also queued whenever the thread has nothing left to write, so the file is
+as current as it was with fwrite, and a slow disk only makes blocks
+bigger.  Memory stays within sv_demoCacheSize: once every block is queued
+the game has to wait for the thread, which is counted as a stall.
+sv_demowriter prints what the writers have done.
+
+MVDWriter_Close queues what is left, waits until the thread has written
+all of it and quit, and only then does DestClose close the file and run
+sv_onrecordfinish.
+
+With sv_demoCompress the thread also deflates what it writes, the demo
+becomes a .mvd.gz that gunzip, the client and demo tools read as it is.
+*/
+
+#include "qwsvdef.h"
+#ifdef WITH_ZLIB
+#include <zlib.h>
+#endif
+
+#define MVDWRITER_BLOCKS	64
+
+typedef struct
+{
+	int				blocks;			// queued
+	double			bytes;
+	int				stalls;			// frames that waited for a free block
+	double			stalltime;
+	int				maxdepth;		// most blocks queued at once
+	int				errors;
+	double			filebytes;		// what went to the file, less when compressed
+} mvdwriterstats_t;
+
+typedef struct mvdwriter_s
+{
+	FILE			*file;
+	qbool			batch;			// sv_demoUseCache, queue only full blocks
+
+	byte			*data;
+	int				blocksize;
+	int				sizes[MVDWRITER_BLOCKS];	// -1 tells the thread to quit
+
+	int				head;			// block the game fills, only the game touches it
+	int				tail;			// block the thread writes, only the thread touches it
+	sem_t			queued, free, finished;
+
+#ifdef WITH_ZLIB
+	qbool			compress;
+	z_stream		zs;
+	byte			zbuf[0x10000];
+#endif
+
+	// written by the thread
+	volatile int	written;		// blocks
+	volatile unsigned int	filebytes;
+	volatile qbool	error;
+
+	mvdwriterstats_t	stats;
+} mvdwriter_t;
+
+static mvdwriterstats_t	mvdwriter_closed;	// of the writers gone
+static int				mvdwriter_numclosed;
+
+static void MVDWriter_Write (mvdwriter_t *w, byte *data, int size)
+{
+	if (w->error)
+		return;
+
+	if (fwrite (data, 1, size, w->file) != size)
+		w->error = true;
+	w->filebytes += size;
+}
+
+#ifdef WITH_ZLIB
+static void MVDWriter_Deflate (mvdwriter_t *w, byte *data, int size, int flush)
+{
+	w->zs.next_in = data;
+	w->zs.avail_in = size;
+
+	do
+	{
+		w->zs.next_out = w->zbuf;
+		w->zs.avail_out = sizeof(w->zbuf);
+		if (deflate (&w->zs, flush) == Z_STREAM_ERROR)
+		{
+			w->error = true;
+			return;
+		}
+		MVDWriter_Write (w, w->zbuf, sizeof(w->zbuf) - w->zs.avail_out);
+	} while (!w->zs.avail_out);
+}
+#endif
+
+static DWORD WINAPI MVDWriter_Thread (void *param)
+{
+	mvdwriter_t *w = (mvdwriter_t *) param;
+	byte *data;
+	int size;
+
+	while (1)
+	{
+		Sys_SemWait (&w->queued);
+
+		size = w->sizes[w->tail];
+		data = w->data + w->tail * w->blocksize;
+
+#ifdef WITH_ZLIB
+		if (w->compress)
+		{
+			MVDWriter_Deflate (w, data, max (size, 0), size < 0 ? Z_FINISH : Z_NO_FLUSH);
+			if (size < 0)
+				deflateEnd (&w->zs);
+		}
+		else
+#endif
+		if (size > 0)
+			MVDWriter_Write (w, data, size);
+
+		if (size < 0)
+			break;
+
+		if (!w->error && fflush (w->file))
+			w->error = true;
+
+		w->tail = (w->tail + 1) % MVDWRITER_BLOCKS;
+		w->written++;
+		Sys_SemPost (&w->free);
+	}
+
+	Sys_SemPost (&w->finished);
+	return 0;
+}
+
+/*
+====================
+MVDWriter_Open
+
+Gives a file dest a writer thread, d->cache becomes its first block.
+A compression level of 1 to 9 makes it write gzip.
+====================
+*/
+qbool MVDWriter_Open (mvddest_t *d, int cachesize, qbool batch, int level)
+{
+	mvdwriter_t *w;
+
+	w = (mvdwriter_t *) Q_malloc (sizeof(mvdwriter_t));
+	w->file = d->file;
+	w->batch = batch;
+	w->blocksize = cachesize / MVDWRITER_BLOCKS;
+	w->data = (byte *) Q_malloc (w->blocksize * MVDWRITER_BLOCKS);
+
+#ifdef WITH_ZLIB
+	// windowBits + 16 writes a gzip header and trailer around the deflate stream
+	if (level > 0 && deflateInit2 (&w->zs, bound (1, level, 9), Z_DEFLATED, MAX_WBITS + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+	{
+		Con_Printf ("MVDWriter_Open: deflateInit2 failed\n");
+		Q_free (w->data);
+		Q_free (w);
+		return false;
+	}
+	w->compress = (level > 0);
+#endif
+
+	if (Sys_SemInit (&w->queued, 0, MVDWRITER_BLOCKS) ||
+		Sys_SemInit (&w->free, MVDWRITER_BLOCKS - 1, MVDWRITER_BLOCKS) ||
+		Sys_SemInit (&w->finished, 0, 1) ||
+		!Sys_CreateThread (MVDWriter_Thread, w))
+	{
+		Con_Printf ("MVDWriter_Open: couldn't start the writer thread\n");
+#ifdef WITH_ZLIB
+		if (w->compress)
+			deflateEnd (&w->zs);
+#endif
+		Q_free (w->data);
+		Q_free (w);
+		return false;
+	}
+
+	d->writer = w;
+	d->cache = (char *) w->data;
+	d->maxcachesize = w->blocksize;
+	d->cacheused = 0;
+	return true;
+}
+
+static void MVDWriter_Queue (mvdwriter_t *w, int size)
+{
+	double start;
+	int depth;
+
+	w->sizes[w->head] = size;
+	w->head = (w->head + 1) % MVDWRITER_BLOCKS;
+	Sys_SemPost (&w->queued);
+
+	if (size < 0)
+		return;
+
+	w->stats.blocks++;
+	w->stats.bytes += size;
+	depth = w->stats.blocks - w->written;
+	w->stats.maxdepth = max (w->stats.maxdepth, depth);
+
+	// the block after it has to be written before we can have it
+	if (Sys_SemTryWait (&w->free))
+	{
+		w->stats.stalls++;
+		start = Sys_DoubleTime ();
+		Sys_SemWait (&w->free);
+		w->stats.stalltime += Sys_DoubleTime () - start;
+	}
+}
+
+/*
+====================
+MVDWriter_Flush
+
+DestFlush of a file with a writer.  Returns false after a write error.
+====================
+*/
+qbool MVDWriter_Flush (mvddest_t *d, int reserve, qbool complete)
+{
+	mvdwriter_t *w = d->writer;
+
+	if (w->error)
+		return false;
+
+	if (!d->cacheused)
+		return true;
+
+	if (complete || d->cacheused + reserve > d->maxcachesize
+		|| (!w->batch && w->written == w->stats.blocks))
+	{
+		MVDWriter_Queue (w, d->cacheused);
+		d->cache = (char *) w->data + w->head * w->blocksize;
+		d->cacheused = 0;
+	}
+
+	return true;
+}
+
+static void MVDWriter_AddStats (mvdwriterstats_t *to, mvdwriterstats_t *from)
+{
+	to->blocks += from->blocks;
+	to->bytes += from->bytes;
+	to->stalls += from->stalls;
+	to->stalltime += from->stalltime;
+	to->maxdepth = max (to->maxdepth, from->maxdepth);
+	to->errors += from->errors;
+	to->filebytes += from->filebytes;
+}
+
+/*
+====================
+MVDWriter_Close
+
+Waits for the thread to write everything queued and quit.  What is still
+in d->cache has to be flushed first, DestClose throws it away otherwise.
+====================
+*/
+void MVDWriter_Close (mvddest_t *d)
+{
+	mvdwriter_t *w = d->writer;
+
+	if (!w)
+		return;
+
+	MVDWriter_Queue (w, -1);
+	Sys_SemWait (&w->finished);
+
+	Sys_SemDestroy (&w->queued);
+	Sys_SemDestroy (&w->free);
+	Sys_SemDestroy (&w->finished);
+
+	if (w->error)
+		w->stats.errors++;
+	w->stats.filebytes = w->filebytes;
+	MVDWriter_AddStats (&mvdwriter_closed, &w->stats);
+	mvdwriter_numclosed++;
+
+	Q_free (w->data);
+	Q_free (w);
+	d->writer = NULL;
+	d->cache = NULL;
+	d->cacheused = 0;
+}
+
+static void MVDWriter_PrintStats (char *name, mvdwriterstats_t *s)
+{
+	Con_Printf ("%-24s %7i %8.1f %8.1f %4i %6i %9.1f %3i\n", name, s->blocks, s->bytes / (1024 * 1024),
+		s->filebytes / (1024 * 1024), s->maxdepth, s->stalls, s->stalltime * 1000, s->errors);
+}
+
+void SV_MVDWriter_f (void)
+{
+	mvddest_t *d;
+
+	Con_Printf ("%i blocks of %ik per writer\n", MVDWRITER_BLOCKS, (int) sv_demoCacheSize.value / MVDWRITER_BLOCKS);
+	Con_Printf ("demo                      blocks       MB  file MB peak stalls stall ms err\n");
+
+	for (d = demo.dest; d; d = d->nextdest)
+	{
+		if (d->writer)
+		{
+			d->writer->stats.filebytes = d->writer->filebytes;
+			MVDWriter_PrintStats (d->name, &d->writer->stats);
+		}
+	}
+
+	if (mvdwriter_numclosed)
+		MVDWriter_PrintStats (va ("%i finished", mvdwriter_numclosed), &mvdwriter_closed);
+}
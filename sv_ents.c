@@ -27,16 +27,108 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 // because there can be a lot of nails, there is a special
 // network protocol for them
 #define MAX_NAILS 32
-static edict_t *nails[MAX_NAILS];
-static int numnails;
 static int nailcount = 0;
 
+#define FATPVS_WORDS ((MAX_MAP_LEAFS + 31) / 32 + 1)
+
+// encoded SV_WriteDelta output, shared by all clients that need the same
+// from/to pair; one table per packet building thread so no locking is needed
+#define DELTA_CACHE_SIZE	1024	// must be power of two
+#define MAX_DELTA_BYTES		48		// worst case delta is 2+6+3*4+3*2 bytes
+
+typedef struct
+{
+	entity_state_t	from, to;
+	qbool			force;
+	int				coordsize, anglesize;
+	int				len;			// 0 for a valid entry that encodes to nothing
+	qbool			valid;
+	byte			data[MAX_DELTA_BYTES];
+} deltaentry_t;
+
+typedef struct
+{
+	deltaentry_t	entries[DELTA_CACHE_SIZE];
+	unsigned int	lookups, hits;
+} deltacache_t;
+
+static deltacache_t sv_deltacache[MAX_SEND_THREADS];
+
+// state of the packet being built for one client, kept out of globals so that
+// several clients can be encoded at once by the sv_sendthreads workers
+typedef struct
+{
+	deltacache_t	*deltacache;
+	edict_t	*nails[MAX_NAILS];
+	int		numnails;
+	qbool	disable_updates;		// disables sending entities to the client
+	unsigned int	fatpvs[FATPVS_WORDS];	// word aligned for SV_EdictInPVS
+} entbuild_t;
+
+// what each client's eye sees, reused by SV_Multicast, SV_StartSound and entity
+// emission for as long as the eye position doesn't change
+typedef struct
+{
+	int				leaf_spawncount;	// svs.spawncount the cached data belongs to
+	vec3_t			leaf_org;
+	int				leafnum;
+
+	int				pvs_spawncount;
+	vec3_t			pvs_org;
+	unsigned int	fatpvs[FATPVS_WORDS];
+} clientvis_t;
+
+static clientvis_t sv_clientvis[MAX_CLIENTS];
+
+/*
+=============
+SV_ClientViewLeafnum
+
+CM_Leafnum of the leaf containing vieworg, cached per client.
+=============
+*/
+int SV_ClientViewLeafnum (client_t *client, vec3_t vieworg)
+{
+	clientvis_t *vis = &sv_clientvis[client - svs.clients];
+
+	if (vis->leaf_spawncount != svs.spawncount || !VectorCompare (vis->leaf_org, vieworg))
+	{
+		vis->leafnum = CM_Leafnum (CM_PointInLeaf (vieworg));
+		VectorCopy (vieworg, vis->leaf_org);
+		vis->leaf_spawncount = svs.spawncount;
+	}
+
+	return vis->leafnum;
+}
+
+/*
+=============
+SV_ClientFatPVS
+
+CM_FatPVS of vieworg, cached per client. Only the thread building the client's
+packet may call this.
+=============
+*/
+byte *SV_ClientFatPVS (client_t *client, vec3_t vieworg)
+{
+	clientvis_t *vis = &sv_clientvis[client - svs.clients];
+
+	if (vis->pvs_spawncount != svs.spawncount || !VectorCompare (vis->pvs_org, vieworg))
+	{
+		CM_FatPVSToBuffer (vieworg, (byte *) vis->fatpvs);
+		VectorCopy (vieworg, vis->pvs_org);
+		vis->pvs_spawncount = svs.spawncount;
+	}
+
+	return (byte *) vis->fatpvs;
+}
+
 extern	int sv_nailmodel, sv_supernailmodel, sv_playermodel;
 
 cvar_t	sv_nailhack	= {"sv_nailhack", "1"};
 
 
-static qbool SV_AddNailUpdate (edict_t *ent)
+static qbool SV_AddNailUpdate (entbuild_t *eb, edict_t *ent)
 {
 	if ((int)sv_nailhack.value)
 		return false;
@@ -47,22 +139,22 @@ static qbool SV_AddNailUpdate (edict_t *ent)
 	if (msg_coordsize != 2)
 		return false; // Do not allow nailhack in case of sv_bigcoords.
 
-	if (numnails == MAX_NAILS)
+	if (eb->numnails == MAX_NAILS)
 		return true;
 
-	nails[numnails] = ent;
-	numnails++;
+	eb->nails[eb->numnails] = ent;
+	eb->numnails++;
 	return true;
 }
 
-static void SV_EmitNailUpdate (sizebuf_t *msg, qbool recorder)
+static void SV_EmitNailUpdate (entbuild_t *eb, sizebuf_t *msg, qbool recorder)
 {
 	int x, y, z, p, yaw, n, i;
 	byte bits[6]; // [48 bits] xyzpy 12 12 12 4 8
 	edict_t *ent;
 
 
-	if (!numnails)
+	if (!eb->numnails)
 		return;
 
 	if (recorder)
@@ -70,11 +162,11 @@ static void SV_EmitNailUpdate (sizebuf_t *msg, qbool recorder)
 	else
 		MSG_WriteByte (msg, svc_nails);
 
-	MSG_WriteByte (msg, numnails);
+	MSG_WriteByte (msg, eb->numnails);
 
-	for (n=0 ; n<numnails ; n++)
+	for (n=0 ; n<eb->numnails ; n++)
 	{
-		ent = nails[n];
+		ent = eb->nails[n];
 		if (recorder)
 		{
 			if (!ent->v.colormap)
@@ -202,6 +294,106 @@ static void SV_WriteDelta (entity_state_t *from, entity_state_t *to, sizebuf_t *
 		MSG_WriteAngle(msg, to->angles[2]);
 }
 
+/*
+==================
+SV_SameDeltaState
+
+Compares the fields SV_WriteDelta looks at.
+==================
+*/
+static qbool SV_SameDeltaState (const entity_state_t *a, const entity_state_t *b)
+{
+	return a->number == b->number
+		&& (a->flags & U_SOLID) == (b->flags & U_SOLID)
+		&& VectorCompare (a->origin, b->origin)
+		&& VectorCompare (a->angles, b->angles)
+		&& a->modelindex == b->modelindex
+		&& a->frame == b->frame
+		&& a->colormap == b->colormap
+		&& a->skinnum == b->skinnum
+		&& a->effects == b->effects;
+}
+
+static unsigned int SV_HashDeltaState (unsigned int hash, const entity_state_t *s)
+{
+	const int *v = (const int *) s->origin; // hash the float bits, same as comparing them
+	int i;
+
+	hash = (hash ^ s->number) * 16777619;
+	for (i = 0; i < 3; i++)
+		hash = (hash ^ v[i]) * 16777619;
+	hash = (hash ^ (s->frame | (s->modelindex << 8) | (s->effects << 16))) * 16777619;
+
+	return hash;
+}
+
+/*
+==================
+SV_WriteDeltaCached
+
+SV_WriteDelta through the shared cache of encoded deltas.
+==================
+*/
+static void SV_WriteDeltaCached (deltacache_t *cache, entity_state_t *from, entity_state_t *to, sizebuf_t *msg, qbool force)
+{
+	deltaentry_t *entry;
+	sizebuf_t buf;
+	unsigned int hash;
+
+	if (!to->number || to->number >= MAX_EDICTS)
+	{
+		SV_WriteDelta (from, to, msg, force); // let it complain
+		return;
+	}
+
+	hash = SV_HashDeltaState (SV_HashDeltaState (2166136261u + force, from), to);
+	entry = &cache->entries[hash & (DELTA_CACHE_SIZE - 1)];
+	cache->lookups++;
+
+	if (entry->valid && entry->force == force
+		&& entry->coordsize == msg_coordsize && entry->anglesize == msg_anglesize
+		&& SV_SameDeltaState (&entry->to, to) && SV_SameDeltaState (&entry->from, from))
+	{
+		cache->hits++;
+		if (entry->len)
+			SZ_Write (msg, entry->data, entry->len);
+		return;
+	}
+
+	SZ_Init (&buf, entry->data, sizeof(entry->data));
+	SV_WriteDelta (from, to, &buf, force);
+
+	entry->from = *from;
+	entry->to = *to;
+	entry->force = force;
+	entry->coordsize = msg_coordsize;
+	entry->anglesize = msg_anglesize;
+	entry->len = buf.cursize;
+	entry->valid = true;
+
+	if (entry->len)
+		SZ_Write (msg, entry->data, entry->len);
+}
+
+/*
+==================
+SV_DeltaCacheStats
+
+Totals over all packet building threads since the server started.
+==================
+*/
+void SV_DeltaCacheStats (unsigned int *lookups, unsigned int *hits)
+{
+	int i;
+
+	*lookups = *hits = 0;
+	for (i = 0; i < MAX_SEND_THREADS; i++)
+	{
+		*lookups += sv_deltacache[i].lookups;
+		*hits += sv_deltacache[i].hits;
+	}
+}
+
 /*
 =============
 SV_EmitPacketEntities
@@ -210,7 +402,7 @@ Writes a delta update of a packet_entities_t to the message.
 
 =============
 */
-static void SV_EmitPacketEntities (client_t *client, packet_entities_t *to, sizebuf_t *msg)
+static void SV_EmitPacketEntities (entbuild_t *eb, client_t *client, packet_entities_t *to, sizebuf_t *msg)
 {
 	int oldindex, newindex, oldnum, newnum, oldmax;
 	client_frame_t	*fromframe;
@@ -248,7 +440,7 @@ static void SV_EmitPacketEntities (client_t *client, packet_entities_t *to, size
 		if (newnum == oldnum)
 		{	// delta update from old position
 			//Con_Printf ("delta %i\n", newnum);
-			SV_WriteDelta (&from1->entities[oldindex], &to->entities[newindex], msg, false);
+			SV_WriteDeltaCached (eb->deltacache, &from1->entities[oldindex], &to->entities[newindex], msg, false);
 			oldindex++;
 			newindex++;
 			continue;
@@ -267,7 +459,7 @@ static void SV_EmitPacketEntities (client_t *client, packet_entities_t *to, size
 			}
 			ent = EDICT_NUM(newnum);
 			//Con_Printf ("baseline %i\n", newnum);
-			SV_WriteDelta (&ent->e->baseline, &to->entities[newindex], msg, true);
+			SV_WriteDeltaCached (eb->deltacache, &ent->e->baseline, &to->entities[newindex], msg, true);
 			newindex++;
 			continue;
 		}
@@ -308,11 +500,8 @@ SV_WritePlayersToClient
 
 #define ISUNDERWATER(x) ((x) == CONTENTS_WATER || (x) == CONTENTS_SLIME || (x) == CONTENTS_LAVA)
 
-static qbool disable_updates; // disables sending entities to the client
-
-
 int SV_PMTypeForClient (client_t *cl);
-static void SV_WritePlayersToClient (client_t *client, edict_t *clent, byte *pvs, sizebuf_t *msg)
+static void SV_WritePlayersToClient (entbuild_t *eb, client_t *client, edict_t *clent, byte *pvs, sizebuf_t *msg)
 {
 	int msec, pflags, pm_type = 0, pm_code = 0, i, j;
 	demo_frame_t *demo_frame;
@@ -391,14 +580,11 @@ static void SV_WritePlayersToClient (client_t *client, edict_t *clent, byte *pvs
 				continue;
 
 			// ignore if not touching a PV leaf
-			for (i=0 ; i < ent->e->num_leafs ; i++)
-				if (pvs[ent->e->leafnums[i] >> 3] & (1 << (ent->e->leafnums[i]&7) ))
-					break;
-			if (i == ent->e->num_leafs)
+			if (!SV_EdictInPVS (ent, pvs))
 				continue; // not visable
 		}
 
-		if (disable_updates && client != cl)
+		if (eb->disable_updates && client != cl)
 		{ // Vladis
 			continue;
 		}
@@ -547,7 +733,6 @@ static void SV_WritePlayersToClient (client_t *client, edict_t *clent, byte *pvs
 #define offsetrandom(MIN,MAX) ((rand() & 32767) * (((MAX)-(MIN)) * (1.0f / 32767.0f)) + (MIN))
 
 extern cvar_t sv_cullentities;
-extern trace_t SV_ClipMoveToEntity (edict_t *ent, vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end);
 
 qbool SV_InvisibleToClient(edict_t *viewer, edict_t *seen)
 {
@@ -606,7 +791,7 @@ qbool SV_InvisibleToClient(edict_t *viewer, edict_t *seen)
 
 /*
 =============
-SV_WriteEntitiesToClient
+SV_EncodeEntitiesToClient
 
 Encodes the current state of the world as
 a svc_packetentities messages and possibly
@@ -615,7 +800,7 @@ svc_playerinfo messages
 =============
 */
 
-void SV_WriteEntitiesToClient (client_t *client, sizebuf_t *msg, qbool recorder)
+static void SV_EncodeEntitiesToClient (client_t *client, sizebuf_t *msg, qbool recorder, deltacache_t *deltacache)
 {
 	int e, i, max_packet_entities;
 	packet_entities_t *pack;
@@ -627,6 +812,9 @@ void SV_WriteEntitiesToClient (client_t *client, sizebuf_t *msg, qbool recorder)
 	vec3_t org;
 	byte *pvs;
 	int hideent;
+	entbuild_t eb;
+
+	eb.deltacache = deltacache;
 
 	// this is the frame we are creating
 	frame = &client->frames[client->netchan.incoming_sequence & UPDATE_MASK];
@@ -637,7 +825,7 @@ void SV_WriteEntitiesToClient (client_t *client, sizebuf_t *msg, qbool recorder)
 	if (!recorder)
 	{
 		VectorAdd (clent->v.origin, clent->v.view_ofs, org);
-		pvs = CM_FatPVS (org);
+		pvs = SV_ClientFatPVS (client, org);
 		if (client->fteprotocolextensions & FTE_PEXT_256PACKETENTITIES)
 			max_packet_entities = 256;
 		else
@@ -659,7 +847,7 @@ void SV_WriteEntitiesToClient (client_t *client, sizebuf_t *msg, qbool recorder)
 
 			// disconnect --> "is it correct?"
 			//if (pvs == NULL)
-				pvs = CM_FatPVS (org);
+				pvs = CM_FatPVSToBuffer (org, (byte *) eb.fatpvs);
 			//else
 				//	SV_AddToFatPVS (org, sv.worldmodel->nodes, false);
 			// <-- disconnect
@@ -668,28 +856,28 @@ void SV_WriteEntitiesToClient (client_t *client, sizebuf_t *msg, qbool recorder)
 	if (clent && client->disable_updates_stop > realtime)
 	{ // Vladis
 		int where = TruePointContents(clent->v.origin); // server flash should not work underwater
-		disable_updates = !ISUNDERWATER(where);
+		eb.disable_updates = !ISUNDERWATER(where);
 	}
 	else
 	{
-		disable_updates = false;
+		eb.disable_updates = false;
 	}
 
 	// send over the players in the PVS
-	SV_WritePlayersToClient (client, clent, pvs, msg);
+	SV_WritePlayersToClient (&eb, client, clent, pvs, msg);
 
 	// put other visible entities into either a packet_entities or a nails message
 	pack = &frame->entities;
 	pack->num_entities = 0;
 
-	numnails = 0;
+	eb.numnails = 0;
 
 	if (fofs_hideentity)
 		hideent = ((eval_t *)((byte *)&(clent)->v + fofs_hideentity))->_int / pr_edict_size;
 	else
 		hideent = 0;
 
-	if (!disable_updates)
+	if (!eb.disable_updates)
 	{// Vladis, server flash
 
 		// QW protocol can only handle 512 entities. Any entity with number >= 512 will be invisible
@@ -722,18 +910,14 @@ void SV_WriteEntitiesToClient (client_t *client, sizebuf_t *msg, qbool recorder)
 			if (!(int)sv_demoNoVis.value || !recorder)
 			{
 				// ignore if not touching a PV leaf
-				for (i=0 ; i < ent->e->num_leafs ; i++)
-					if (pvs[ent->e->leafnums[i] >> 3] & (1 << (ent->e->leafnums[i]&7) ))
-						break;
-
-				if (i == ent->e->num_leafs)
+				if (!SV_EdictInPVS (ent, pvs))
 					continue;		// not visible
 
 				if (sv_cullentities.value && SV_InvisibleToClient(clent, ent))
 					continue;
 			}
 
-			if (SV_AddNailUpdate (ent))
+			if (SV_AddNailUpdate (&eb, ent))
 				continue; // added to the special update list
 
 			// add to the packetentities
@@ -757,10 +941,10 @@ void SV_WriteEntitiesToClient (client_t *client, sizebuf_t *msg, qbool recorder)
 	// encode the packet entities as a delta from the
 	// last packetentities acknowledged by the client
 
-	SV_EmitPacketEntities (client, pack, msg);
+	SV_EmitPacketEntities (&eb, client, pack, msg);
 
 	// now add the specialized nail update
-	SV_EmitNailUpdate (msg, recorder);
+	SV_EmitNailUpdate (&eb, msg, recorder);
 
 	// Translate NQ progs' EF_MUZZLEFLASH to svc_muzzleflash
 	if (pr_nqprogs)
@@ -782,3 +966,25 @@ void SV_WriteEntitiesToClient (client_t *client, sizebuf_t *msg, qbool recorder)
 		}
 	}			
 }
+
+/*
+=============
+SV_WriteEntitiesToClient
+=============
+*/
+void SV_WriteEntitiesToClient (client_t *client, sizebuf_t *msg, qbool recorder)
+{
+	SV_EncodeEntitiesToClient (client, msg, recorder, &sv_deltacache[0]);
+}
+
+/*
+=============
+SV_WriteEntitiesToClientWorker
+
+Same as SV_WriteEntitiesToClient, for packet building thread number worker.
+=============
+*/
+void SV_WriteEntitiesToClientWorker (client_t *client, sizebuf_t *msg, int worker)
+{
+	SV_EncodeEntitiesToClient (client, msg, false, &sv_deltacache[worker]);
+}
@@ -287,6 +287,9 @@ void SV_SpawnServer (char *mapname, qbool devmap)
 		PR2_GameShutDown();
 #endif
 
+	// recorded traces only replay against the map they came from
+	SV_TraceLogStop ();
+
 	svs.spawncount++; // any partially connected client will be restarted
 
 	sv.state = ss_dead;
@@ -391,6 +394,7 @@ void SV_SpawnServer (char *mapname, qbool devmap)
 #endif
 
 	// leave slots at start for clients only
+	SV_ThinkReset ();
 	sv.num_edicts = MAX_CLIENTS+1;
 	for (i=0 ; i<MAX_CLIENTS ; i++)
 	{
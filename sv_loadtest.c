@@ -0,0 +1,558 @@
+/*
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the included (GNU.txt) GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+// sv_loadtest.c - synthetic clients for measuring server capacity
+
+/*
+sv_loadtest <clients> [seconds] connects synthetic clients to the running
+server over the loopback buffers.  Each one is a real netchan with its own
+qport, the loopback port tells them apart: port 0 stays the local player,
+server packets to any other loopback port end up in SV_LoadTestPacket and
+their packets to the server share a queue of their own in net.c.  Unlike
+the local player they are held to their rate by Netchan_CanPacket, so the
+choke of a real connection is there too.
+
+There is no dedicated server build in this tree, so this measures the
+server of the client binary, the client's own frame included.
+
+Clients go through the usual connect and signon commands and then send
+scripted usercmds (running in circles, strafing, jumping and firing) at
+LOADTEST_PPS.  When the test ends the frame time distribution of SV_Frame
+and the traffic per client are printed.
+
+The optional trigger count adds that many invisible triggers without a
+touch function around the entities of the map, to see what many triggers
+cost the SV_TouchLinks calls of all the moving players and missiles.
+They are removed when the test stops.  QVM mods own edict allocation, so
+there it only works with QC.
+*/
+
+#include "qwsvdef.h"
+
+#define LOADTEST_PPS		77		// packets per second sent by each client
+#define LOADTEST_PORT		1000	// loopback port of the first client
+#define LOADTEST_RATE		25000	// rate in the userinfo, choked like a real client
+#define LOADTEST_INBOX		8		// server packets kept per client until the next frame
+#define LOADTEST_BUCKETS	1000	// frame time histogram, LOADTEST_BUCKET ms each
+#define LOADTEST_BUCKET		0.05
+#define LOADTEST_TRIGGERS	(MAX_EDICTS / 2)
+
+typedef enum {
+	lt_connecting,
+	lt_signon,
+	lt_active,
+	lt_failed
+} loadstate_t;
+
+typedef struct
+{
+	loadstate_t	state;
+	netadr_t	adr;
+	netchan_t	netchan;
+	int			qport;
+	client_t	*client;			// server side slot
+	int			signon;				// next signon command
+	double		lastsend;
+	usercmd_t	cmds[UPDATE_BACKUP];
+
+	byte		inbox[LOADTEST_INBOX][8];	// netchan headers of received packets
+	int			numinbox;
+
+	unsigned int	packets_in, bytes_in;
+	unsigned int	packets_out, bytes_out;
+} loadclient_t;
+
+typedef struct
+{
+	qbool		active;
+	int			numclients;
+	loadclient_t	clients[MAX_CLIENTS];
+	int			spawncount;
+	double		starttime, endtime;
+	double		activetime;		// when the last client spawned
+
+	int			triggers[LOADTEST_TRIGGERS];	// edict numbers
+	int			numtriggers;
+
+	int			frames;
+	unsigned int	histogram[LOADTEST_BUCKETS + 1];
+	double		frametotal, framemax;
+	double		phasetotal[SVP_MAX];
+} loadtest_t;
+
+static loadtest_t	lt;
+
+extern cvar_t password;
+
+/*
+==================
+SV_LoadTestPacket
+
+Server packet to a synthetic client, called from NET_SendPacket
+==================
+*/
+void SV_LoadTestPacket (int length, void *data, netadr_t to)
+{
+	int i = ntohs (to.port) - LOADTEST_PORT;
+	loadclient_t *lc;
+
+	if (!lt.active || i < 0 || i >= lt.numclients)
+		return;
+
+	lc = &lt.clients[i];
+	lc->packets_in++;
+	lc->bytes_in += length;
+
+	if (length >= 5 && *(int *) data == -1)
+	{
+		if (((byte *) data)[4] == S2C_CONNECTION && lc->state == lt_connecting)
+		{
+			Netchan_Setup (NS_CLIENT, &lc->netchan, lc->adr, lc->qport);
+			lc->state = lt_signon;
+		}
+		else if (((byte *) data)[4] == A2C_PRINT && lc->state == lt_connecting)
+		{
+			Con_Printf ("loadtest client %i: %s", i, (char *) data + 5);
+			lc->state = lt_failed;
+		}
+		return;
+	}
+
+	// the payload isn't parsed, the netchan only needs the sequence numbers
+	if (length >= 8 && lc->numinbox < LOADTEST_INBOX)
+		memcpy (lc->inbox[lc->numinbox++], data, 8);
+}
+
+static void SV_LoadTestReceive (loadclient_t *lc)
+{
+	sizebuf_t saved_message = net_message;
+	netadr_t saved_from = net_from;
+	int i;
+
+	for (i = 0; i < lc->numinbox; i++)
+	{
+		SZ_Init (&net_message, lc->inbox[i], 8);
+		net_message.cursize = 8;
+		net_from = lc->adr;
+		Netchan_Process (&lc->netchan);
+	}
+	lc->numinbox = 0;
+
+	net_message = saved_message;
+	net_from = saved_from;
+}
+
+static void SV_LoadTestConnect (loadclient_t *lc, int num)
+{
+	Netchan_OutOfBandPrint (NS_CLIENT, lc->adr,
+		"connect %i %i %i \"\\name\\loadtest%02i\\team\\lt%i\\topcolor\\%i\\bottomcolor\\%i"
+		"\\rate\\%i\\msg\\1\\spectator\\0\\password\\%s\"\n",
+		PROTOCOL_VERSION, lc->qport, 0, num, num & 1, num % 14, (num + 7) % 14, LOADTEST_RATE, password.string);
+	lc->packets_out++;
+}
+
+// returns the next signon command, NULL once all were sent
+static char *SV_LoadTestSignon (loadclient_t *lc)
+{
+	int step = lc->signon++;
+
+	if (step == 0)
+		return "new";
+	if (step == 1)
+		return va ("soundlist %i 0", svs.spawncount);
+	if (step == 2)
+		return va ("modellist %i 0", svs.spawncount);
+	step -= 3;
+	if (step < sv.num_signon_buffers)
+		return va ("prespawn %i %i %i", svs.spawncount, step, sv.map_checksum2);
+	step -= sv.num_signon_buffers;
+	// the other players' userinfos are of no use to us
+	if (step == 0)
+		return va ("spawn %i %i", svs.spawncount, MAX_CLIENTS - 1);
+	if (step == 1)
+		return va ("begin %i", svs.spawncount);
+
+	return NULL;
+}
+
+static client_t *SV_LoadTestFindClient (loadclient_t *lc)
+{
+	client_t *cl;
+	int i;
+
+	for (i = 0, cl = svs.clients; i < MAX_CLIENTS; i++, cl++)
+		if (cl->state != cs_free && cl->netchan.remote_address.type == NA_LOOPBACK
+			&& cl->netchan.remote_address.port == lc->adr.port)
+			return cl;
+
+	return NULL;
+}
+
+// scripted input: circle around, strafe, jump now and then and fire half the time
+static void SV_LoadTestMove (loadclient_t *lc, int num, usercmd_t *cmd, double frametime)
+{
+	double t = realtime - lt.starttime + num * 0.37;
+
+	memset (cmd, 0, sizeof(*cmd));
+	cmd->msec = bound (1, (int)(frametime * 1000), 250);
+	cmd->angles[YAW] = anglemod (num * 40 + t * 60);
+	cmd->angles[PITCH] = 10 * sin (t);
+	cmd->forwardmove = 400;
+	cmd->sidemove = ((int) t & 1) ? 350 : -350;
+
+	if (fmod (t, 1.5) < 0.1)
+		cmd->buttons |= BUTTON_JUMP;
+	if (fmod (t, 4) < 2)
+		cmd->buttons |= BUTTON_ATTACK;
+	if (fmod (t, 10) < frametime)
+		cmd->impulse = 1 + (int)(t / 10) % 8;
+}
+
+static void SV_LoadTestSend (loadclient_t *lc, int num)
+{
+	static usercmd_t nullcmd;
+	byte data[128];
+	sizebuf_t buf;
+	usercmd_t *cmd;
+	char *s;
+	int i, checksumIndex;
+
+	if (lc->state == lt_signon)
+	{
+		// one command at a time, like a client following stufftexts
+		if (lc->client && lc->client->state == cs_spawned)
+			lc->state = lt_active;
+		else if (!lc->netchan.reliable_length && !lc->netchan.message.cursize && (s = SV_LoadTestSignon (lc)))
+		{
+			MSG_WriteByte (&lc->netchan.message, clc_stringcmd);
+			MSG_WriteString (&lc->netchan.message, s);
+		}
+	}
+
+	SZ_Init (&buf, data, sizeof(data));
+
+	i = lc->netchan.outgoing_sequence & UPDATE_MASK;
+	SV_LoadTestMove (lc, num, &lc->cmds[i], realtime - lc->lastsend);
+
+	MSG_WriteByte (&buf, clc_move);
+	checksumIndex = buf.cursize;
+	MSG_WriteByte (&buf, 0);
+	MSG_WriteByte (&buf, 0);	// lossage
+
+	cmd = &lc->cmds[(lc->netchan.outgoing_sequence - 2) & UPDATE_MASK];
+	MSG_WriteDeltaUsercmd (&buf, &nullcmd, cmd);
+	MSG_WriteDeltaUsercmd (&buf, cmd, &lc->cmds[(lc->netchan.outgoing_sequence - 1) & UPDATE_MASK]);
+	cmd = &lc->cmds[(lc->netchan.outgoing_sequence - 1) & UPDATE_MASK];
+	MSG_WriteDeltaUsercmd (&buf, cmd, &lc->cmds[i]);
+
+	buf.data[checksumIndex] = COM_BlockSequenceCRCByte (buf.data + checksumIndex + 1,
+		buf.cursize - checksumIndex - 1, lc->netchan.outgoing_sequence);
+
+	// ask for delta compression against the last packet we got
+	if (lc->state == lt_active && lc->netchan.incoming_sequence)
+	{
+		MSG_WriteByte (&buf, clc_delta);
+		MSG_WriteByte (&buf, lc->netchan.incoming_sequence & 255);
+	}
+
+	Netchan_Transmit (&lc->netchan, buf.cursize, buf.data);
+	lc->packets_out++;
+	lc->bytes_out += lc->netchan.outgoing_size[lc->netchan.outgoing_sequence & (MAX_LATENT-1)];
+}
+
+static void SV_LoadTestRecordFrame (void)
+{
+	double ms = SV_ProfileLastFrame (SVP_FRAME);
+	int i;
+
+	lt.frames++;
+	lt.frametotal += ms;
+	lt.framemax = max (lt.framemax, ms);
+	lt.histogram[min ((int)(ms / LOADTEST_BUCKET), LOADTEST_BUCKETS)]++;
+
+	for (i = 0; i < SVP_MAX; i++)
+		lt.phasetotal[i] += SV_ProfileLastFrame (i);
+}
+
+static double SV_LoadTestPercentile (int percent)
+{
+	unsigned int n = 0, want = (unsigned int)((double) lt.frames * percent / 100);
+	int i;
+
+	for (i = 0; i < LOADTEST_BUCKETS; i++)
+		if ((n += lt.histogram[i]) > want)
+			return (i + 1) * LOADTEST_BUCKET;
+
+	return lt.framemax;
+}
+
+static void SV_LoadTestReport (void)
+{
+	unsigned int packets_in = 0, bytes_in = 0, packets_out = 0, bytes_out = 0;
+	double seconds = realtime - lt.starttime;
+	int i, spawned = 0;
+
+	for (i = 0; i < lt.numclients; i++)
+	{
+		if (lt.clients[i].state != lt_active)
+			continue;
+		spawned++;
+		packets_in += lt.clients[i].packets_in;
+		bytes_in += lt.clients[i].bytes_in;
+		packets_out += lt.clients[i].packets_out;
+		bytes_out += lt.clients[i].bytes_out;
+	}
+
+	Con_Printf ("loadtest: %i/%i clients spawned, %i frames in %.1f s\n", spawned, lt.numclients, lt.frames, seconds);
+	Con_Printf ("loadtest: listen server of the client, rate %i in the userinfo\n", LOADTEST_RATE);
+	if (lt.numtriggers)
+		Con_Printf ("loadtest: %i extra triggers\n", lt.numtriggers);
+	if (!lt.frames)
+		return;
+
+	Con_Printf ("frame ms: avg %.3f  p50 %.3f  p90 %.3f  p99 %.3f  max %.3f\n", lt.frametotal / lt.frames,
+		SV_LoadTestPercentile (50), SV_LoadTestPercentile (90), SV_LoadTestPercentile (99), lt.framemax);
+	for (i = 0; i < SVP_MAX; i++)
+		Con_Printf ("  %-17s avg %.3f ms\n", SV_ProfileName (i), lt.phasetotal[i] / lt.frames);
+
+	if (spawned && seconds > 0)
+	{
+		Con_Printf ("per client: server->client %.0f bytes/s, %.1f packets/s, %.1f bytes/packet\n",
+			bytes_in / seconds / spawned, packets_in / seconds / spawned, packets_in ? (double) bytes_in / packets_in : 0);
+		Con_Printf ("            client->server %.0f bytes/s, %.1f packets/s, %.1f bytes/packet\n",
+			bytes_out / seconds / spawned, packets_out / seconds / spawned, packets_out ? (double) bytes_out / packets_out : 0);
+	}
+}
+
+/*
+==================
+SV_LoadTestSpawnTriggers
+
+Scatters triggers of 32 to 256 units around the entities already in the
+map, so they end up where the game is played rather than in the void
+==================
+*/
+static void SV_LoadTestSpawnTriggers (int count)
+{
+	static int nearby[MAX_EDICTS];
+	edict_t *ent, *near;
+	int i, j, size, numnearby = 0;
+
+	for (i = MAX_CLIENTS + 1; i < sv.num_edicts; i++)
+	{
+		if (!EDICT_NUM(i)->e->free)
+			nearby[numnearby++] = i;
+	}
+
+	if (!numnearby)
+	{
+		Con_Printf ("loadtest: no entities in the map to put triggers near\n");
+		return;
+	}
+
+	for (i = 0; i < count; i++)
+	{
+		near = EDICT_NUM(nearby[rand () % numnearby]);
+
+		ent = ED_Alloc ();
+#ifdef USE_PR2
+		ent->v.classname = PR2_SetString ("loadtest_trigger");
+#else
+		ent->v.classname = PR_SetString ("loadtest_trigger");
+#endif
+		ent->v.solid = SOLID_TRIGGER;
+		ent->v.movetype = MOVETYPE_NONE;
+		for (j = 0; j < 3; j++)
+		{
+			size = 16 + rand () % 113;
+			ent->v.origin[j] = near->v.origin[j] + (rand () % 513) - 256;
+			ent->v.mins[j] = -size;
+			ent->v.maxs[j] = size;
+		}
+		VectorSubtract (ent->v.maxs, ent->v.mins, ent->v.size);
+		SV_LinkEdict (ent, false);
+
+		lt.triggers[lt.numtriggers++] = NUM_FOR_EDICT(ent);
+	}
+}
+
+static void SV_LoadTestStop (void)
+{
+	int i;
+
+	if (!lt.active)
+		return;
+
+	SV_LoadTestReport ();
+
+	if (sv.state == ss_active && svs.spawncount == lt.spawncount)
+		for (i = 0; i < lt.numtriggers; i++)
+			ED_Free (EDICT_NUM(lt.triggers[i]));
+
+	for (i = 0; i < lt.numclients; i++)
+		if (lt.clients[i].client && lt.clients[i].client->state != cs_free
+			&& lt.clients[i].client->netchan.remote_address.port == lt.clients[i].adr.port)
+			SV_DropClient (lt.clients[i].client);
+
+	lt.active = false;
+}
+
+/*
+==================
+SV_LoadTestFrame
+
+Called by SV_Frame before reading packets
+==================
+*/
+void SV_LoadTestFrame (void)
+{
+	loadclient_t *lc;
+	int i, spawned = 0;
+
+	if (!lt.active)
+		return;
+
+	if (sv.state != ss_active || svs.spawncount != lt.spawncount)
+	{
+		Con_Printf ("loadtest: map changed, stopping\n");
+		SV_LoadTestStop ();
+		return;
+	}
+
+	if (lt.endtime && realtime >= lt.endtime)
+	{
+		SV_LoadTestStop ();
+		return;
+	}
+
+	for (i = 0, lc = lt.clients; i < lt.numclients; i++, lc++)
+	{
+		SV_LoadTestReceive (lc);
+
+		if (lc->state == lt_active)
+			spawned++;
+
+		if (realtime - lc->lastsend < 1.0 / LOADTEST_PPS)
+			continue;
+
+		if (lc->state == lt_connecting)
+		{
+			if (realtime - lc->lastsend > 1)
+			{
+				SV_LoadTestConnect (lc, i);
+				lc->lastsend = realtime;
+			}
+			continue;
+		}
+
+		if (lc->state == lt_failed)
+			continue;
+
+		if (!lc->client && (lc->client = SV_LoadTestFindClient (lc)))
+			if (!lc->client->realip.ip[0])
+				lc->client->realip.ip[0] = 127;	// loopback, no need to ask for the real ip
+
+		SV_LoadTestSend (lc, i);
+		lc->lastsend = realtime;
+	}
+
+	// measure only once everybody is in the game
+	if (spawned && spawned == lt.numclients)
+	{
+		if (!lt.activetime)
+		{
+			Con_Printf ("loadtest: all %i clients spawned\n", spawned);
+			lt.activetime = realtime;
+			if (lt.endtime)
+				lt.endtime += realtime - lt.starttime;	// the time limit starts now
+			lt.starttime = realtime;
+			for (i = 0; i < lt.numclients; i++)
+			{
+				lt.clients[i].packets_in = lt.clients[i].bytes_in = 0;
+				lt.clients[i].packets_out = lt.clients[i].bytes_out = 0;
+			}
+			return;
+		}
+		SV_LoadTestRecordFrame ();
+	}
+}
+
+/*
+==================
+SV_LoadTest_f
+==================
+*/
+void SV_LoadTest_f (void)
+{
+	loadclient_t *lc;
+	double seconds;
+	int i;
+
+	if (Cmd_Argc () < 2)
+	{
+		Con_Printf ("usage: sv_loadtest <clients> [seconds] [triggers]\n"
+					"       sv_loadtest stop\n");
+		if (lt.active)
+			Con_Printf ("loadtest running with %i clients\n", lt.numclients);
+		return;
+	}
+
+	if (!strcmp (Cmd_Argv (1), "stop"))
+	{
+		SV_LoadTestStop ();
+		return;
+	}
+
+	if (sv.state != ss_active)
+	{
+		Con_Printf ("sv_loadtest: no map running\n");
+		return;
+	}
+
+	SV_LoadTestStop ();
+
+	memset (&lt, 0, sizeof(lt));
+	lt.numclients = bound (1, Q_atoi (Cmd_Argv (1)), MAX_CLIENTS);
+	seconds = Cmd_Argc () > 2 ? Q_atof (Cmd_Argv (2)) : 0;
+	lt.spawncount = svs.spawncount;
+	lt.starttime = realtime;
+	lt.endtime = seconds > 0 ? realtime + seconds : 0;
+
+	for (i = 0, lc = lt.clients; i < lt.numclients; i++, lc++)
+	{
+		lc->adr.type = NA_LOOPBACK;
+		lc->adr.port = htons (LOADTEST_PORT + i);
+		lc->qport = LOADTEST_PORT + i;
+		lc->lastsend = -1;
+	}
+
+	if (Cmd_Argc () > 3 && Q_atoi (Cmd_Argv (3)) > 0)
+	{
+#ifdef USE_PR2
+		if (sv_vm)
+			Con_Printf ("loadtest: extra triggers need a QC mod\n");
+		else
+#endif
+		if (sv.num_edicts <= MAX_CLIENTS + 1)
+			Con_Printf ("loadtest: no entities to put triggers near\n");
+		else
+			SV_LoadTestSpawnTriggers (min (Q_atoi (Cmd_Argv (3)), min (LOADTEST_TRIGGERS, MAX_EDICTS - 64 - sv.num_edicts)));
+	}
+
+	lt.active = true;
+	Con_Printf ("loadtest: connecting %i clients\n", lt.numclients);
+}
@@ -292,21 +292,232 @@ void SV_Error (char *error, ...)
 	Sys_Error ("SV_Error: %s", string);
 }
 
-static void SV_FreeHeadDelayedPacket(client_t *cl) {
-	if (cl->packets) {
-		packet_t *next = cl->packets->next;
-		cl->packets->next = svs.free_packets;
-		svs.free_packets = cl->packets;
-		cl->packets = next;
+/*
+=============================================================================
+
+DELAYED PACKETS
+
+Packets of clients with a delay (sv_minping) wait in a timing wheel of
+DELAY_WHEEL_SLOTS one millisecond slots, so queueing and expiring a packet
+costs O(1) no matter how many clients are delayed.  Packets are taken from
+a pool that grows in DELAYED_PACKETS_BLOCK chunks up to MAX_DELAYED_PACKETS.
+
+=============================================================================
+*/
+
+static packet_t		*sv_delaywheel[DELAY_WHEEL_SLOTS];
+static packet_t		*sv_delaywheel_tail[DELAY_WHEEL_SLOTS];
+static unsigned int	sv_delaytick;		// first slot not yet expired
+static qbool		sv_delaytick_valid;
+
+static unsigned int SV_DelayTick (double time)
+{
+	return (unsigned int) (time * 1000);
+}
+
+static packet_t *SV_AllocDelayedPacket (void)
+{
+	packet_t *p;
+	int i;
+
+	if (!svs.free_packets)
+	{
+		if (svs.num_packets >= MAX_DELAYED_PACKETS)
+			return NULL;
+
+		// never freed, the pool is reused for the lifetime of the server
+		p = (packet_t *) Q_malloc (DELAYED_PACKETS_BLOCK * sizeof(packet_t));
+		for (i = 0; i < DELAYED_PACKETS_BLOCK; i++)
+		{
+			SZ_Init (&p[i].msg, p[i].buf, sizeof(p[i].buf));
+			p[i].next = (i == DELAYED_PACKETS_BLOCK - 1) ? NULL : &p[i + 1];
+		}
+		svs.free_packets = p;
+		svs.num_packets += DELAYED_PACKETS_BLOCK;
+	}
+
+	p = svs.free_packets;
+	svs.free_packets = p->next;
+	p->next = NULL;
+	return p;
+}
+
+static void SV_FreeDelayedPacket (packet_t *p)
+{
+	p->next = svs.free_packets;
+	svs.free_packets = p;
+}
+
+static void SV_LinkDelayedPacket (packet_t *p)
+{
+	int slot = SV_DelayTick (p->due) & (DELAY_WHEEL_SLOTS - 1);
+
+	p->next = NULL;
+	if (sv_delaywheel[slot])
+		sv_delaywheel_tail[slot]->next = p;
+	else
+		sv_delaywheel[slot] = p;
+	sv_delaywheel_tail[slot] = p;
+}
+
+/*
+==================
+SV_DelayPacket
+
+Queues net_message for execution after cl->delay seconds
+==================
+*/
+static void SV_DelayPacket (client_t *cl)
+{
+	packet_t *p;
+
+	if (!(p = SV_AllocDelayedPacket ()))
+		return; // packet has to be dropped..
+
+	if (!sv_delaytick_valid)
+	{
+		sv_delaytick = SV_DelayTick (realtime);
+		sv_delaytick_valid = true;
+	}
+
+	p->time = realtime;
+	p->target = cl->delay;
+	// never overtake a packet queued while the delay was higher
+	p->due = max (realtime + cl->delay, cl->delay_lastdue);
+	p->client = cl - svs.clients;
+	p->userid = cl->userid;
+	SZ_Clear (&p->msg);
+	SZ_Write (&p->msg, net_message.data, net_message.cursize);
+
+	cl->delay_lastdue = p->due;
+	cl->delay_queued++;
+	cl->delay_maxqueued = max (cl->delay_maxqueued, cl->delay_queued);
+
+	SV_LinkDelayedPacket (p);
+}
+
+static void SV_ExecuteDelayedPacket (packet_t *p)
+{
+	client_t *cl = &svs.clients[p->client];
+
+	// the client may have dropped and the slot been reused
+	if (cl->state != cs_free && cl->userid == p->userid)
+	{
+		cl->delay_queued--;
+		cl->delay_target += p->target;
+		cl->delay_actual += realtime - p->time;
+		cl->delay_samples++;
+
+		net_from = cl->netchan.remote_address;
+		SZ_Clear (&net_message);
+		SZ_Write (&net_message, p->msg.data, p->msg.cursize);
+		SV_ExecuteClientMessage (cl);
+	}
+
+	SV_FreeDelayedPacket (p);
+}
+
+/*
+==================
+SV_RunDelayedPackets
+
+Executes every delayed packet that is due, all of them if the server is paused
+==================
+*/
+static void SV_RunDelayedPackets (void)
+{
+	unsigned int now, slots, i;
+	packet_t *p, *next;
+	int slot;
+
+	if (!sv_delaytick_valid)
+		return;
+
+	now = SV_DelayTick (realtime);
+	slots = now - sv_delaytick + 1;
+	if (sv.paused || slots > DELAY_WHEEL_SLOTS)
+		slots = DELAY_WHEEL_SLOTS;
+
+	for (i = 0; i < slots; i++)
+	{
+		slot = (sv_delaytick + i) & (DELAY_WHEEL_SLOTS - 1);
+		p = sv_delaywheel[slot];
+		sv_delaywheel[slot] = sv_delaywheel_tail[slot] = NULL;
+
+		for ( ; p; p = next)
+		{
+			next = p->next;
+			if (p->due > realtime && !sv.paused)
+				SV_LinkDelayedPacket (p);	// due later in this millisecond
+			else
+				SV_ExecuteDelayedPacket (p);
+		}
+	}
+
+	sv_delaytick = now;
+}
+
+void SV_FreeDelayedPackets (client_t *cl)
+{
+	packet_t *p, *next;
+	int slot, userid = cl->userid;
+
+	for (slot = 0; slot < DELAY_WHEEL_SLOTS; slot++)
+	{
+		p = sv_delaywheel[slot];
+		sv_delaywheel[slot] = sv_delaywheel_tail[slot] = NULL;
+
+		for ( ; p; p = next)
+		{
+			next = p->next;
+			if (&svs.clients[p->client] == cl && p->userid == userid)
+				SV_FreeDelayedPacket (p);
+			else
+				SV_LinkDelayedPacket (p);
+		}
 	}
+
+	cl->delay_queued = 0;
 }
 
+/*
+==================
+SV_DelayStats_f
+
+Prints delayed packet queue depth and average target / actual delays
+==================
+*/
+static void SV_DelayStats_f (void)
+{
+	client_t *cl;
+	int i, nfree;
+	packet_t *p;
+
+	Con_Printf ("name             queued   max  target  actual\n");
+	for (i = 0, cl = svs.clients; i < MAX_CLIENTS; i++, cl++)
+	{
+		if (cl->state == cs_free)
+			continue;
+
+		Con_Printf ("%-15.15s  %6i  %4i  %4.0fms  %4.0fms\n", cl->name, cl->delay_queued, cl->delay_maxqueued,
+			cl->delay_samples ? 1000 * cl->delay_target / cl->delay_samples : 0,
+			cl->delay_samples ? 1000 * cl->delay_actual / cl->delay_samples : 0);
+
+		if (Cmd_Argc () > 1 && !strcmp (Cmd_Argv (1), "reset"))
+		{
+			cl->delay_maxqueued = cl->delay_queued;
+			cl->delay_target = cl->delay_actual = 0;
+			cl->delay_samples = 0;
+		}
+	}
 
-void SV_FreeDelayedPackets (client_t *cl) {
-	while (cl->packets)
-		SV_FreeHeadDelayedPacket(cl);
+	for (nfree = 0, p = svs.free_packets; p; p = p->next)
+		nfree++;
+	Con_Printf ("delayed packet pool: %i allocated, %i in use, %i max\n",
+		svs.num_packets, svs.num_packets - nfree, MAX_DELAYED_PACKETS);
 }
 
+
 /*
 ==================
 SV_FinalMessage
@@ -581,6 +792,10 @@ SVC_Status
 
 Responds with all the info that qplug or qspy can see
 This message can be up to around 5k with worst case string lengths.
+
+Replies are cached per status flag combination and rebuilt only when
+serverinfo or a listed client's userinfo, frags, connection minutes or
+ping bucket change, which is checked at most once per frame.
 ================
 */
 #define STATUS_OLDSTYLE					0
@@ -589,20 +804,150 @@ This message can be up to around 5k with worst case string lengths.
 #define	STATUS_SPECTATORS				4
 #define	STATUS_SPECTATORS_AS_PLAYERS	8 //for ASE - change only frags: show as "S"
 #define STATUS_SHOWTEAMS				16
+#define STATUS_FLAGS					32	// number of flag combinations
 
-static void SVC_Status (void)
+#define STATUS_PING_BUCKET				10	// ms, smaller ping changes reuse the cached reply
+#define STATUS_MAX_PACKETS				16
+#define LASTSCORES_CACHE_TIME			10	// seconds, the demo list changes only when a match ends
+
+typedef struct
 {
-	int top, bottom, ping, i, opt = 0;
-	char *name, *frags;
+	qbool		valid;
+	double		time;		// realtime when built
+	int			len;
+	int			numpackets;
+	int			end[STATUS_MAX_PACKETS];	// packet boundaries in text
+	char		text[OUTPUTBUF_SIZE];
+} statusreply_t;
+
+typedef struct
+{
+	int			userid;		// 0 if not listed
+	int			spectator;
+	int			infochanges;
+	int			frags;
+	int			minutes;
+	int			pingbucket;
+} statusclient_t;
+
+static statusreply_t	sv_statusreplies[STATUS_FLAGS];
+static statusclient_t	sv_statusclients[MAX_CLIENTS];
+static char				sv_statusinfo[MAX_SERVERINFO_STRING];
+static double			sv_statuschecked = -1;
+static unsigned int		sv_statusqueries, sv_statushits;
+
+static statusreply_t	sv_lastscoresreply;
+static int				sv_lastscoresarg;
+static qbool			sv_lastscoresstarted;
+
+static void SV_ReplyBegin (statusreply_t *r)
+{
+	r->valid = false;
+	r->time = realtime;
+	r->len = 0;
+	r->numpackets = 0;
+}
+
+// appends one print, starting a new packet where SV_FlushRedirect would
+static void SV_ReplyPrint (statusreply_t *r, const char *msg)
+{
+	int start = r->numpackets ? r->end[r->numpackets - 1] : 0;
+	int len = strlen (msg);
+
+	if (r->len > start && r->len - start + len > MAX_MSGLEN - 10 && r->numpackets < STATUS_MAX_PACKETS - 1)
+		r->end[r->numpackets++] = r->len;
+
+	len = min (len, (int) sizeof(r->text) - r->len);
+	memcpy (r->text + r->len, msg, len);
+	r->len += len;
+}
+
+static void SV_ReplyPrintf (statusreply_t *r, const char *fmt, ...)
+{
+	va_list argptr;
+	char msg[MAX_MSGLEN];
+
+	va_start (argptr, fmt);
+	vsnprintf (msg, sizeof(msg), fmt, argptr);
+	va_end (argptr);
+
+	SV_ReplyPrint (r, msg);
+}
+
+static void SV_ReplyFinish (statusreply_t *r)
+{
+	r->end[r->numpackets++] = r->len;
+	r->valid = true;
+}
+
+static void SV_ReplySend (statusreply_t *r)
+{
+	byte data[MAX_MSGLEN + 6];
+	int i, start, len;
+
+	data[0] = data[1] = data[2] = data[3] = 0xff;
+	data[4] = A2C_PRINT;
+
+	for (i = 0, start = 0; i < r->numpackets; start = r->end[i++])
+	{
+		len = min (r->end[i] - start, MAX_MSGLEN);
+		memcpy (data + 5, r->text + start, len);
+		data[5 + len] = 0;
+		NET_SendPacket (NS_SERVER, len + 6, data, net_from);
+	}
+}
+
+// drops cached replies if anything they show has changed since the last frame
+static void SV_CheckStatusReplies (void)
+{
+	statusclient_t s;
+	qbool changed;
 	client_t *cl;
+	int i;
 
+	if (sv_statuschecked == realtime)
+		return;
+	sv_statuschecked = realtime;
 
-	if (Cmd_Argc() > 1)
-		opt = Q_atoi(Cmd_Argv(1));
+	changed = strcmp (sv_statusinfo, svs.info);
 
-	SV_BeginRedirect (RD_PACKET);
+	for (i = 0, cl = svs.clients; i < MAX_CLIENTS; i++, cl++)
+	{
+		memset (&s, 0, sizeof(s));
+		if (cl->state >= cs_preconnected)
+		{
+			s.userid = cl->userid;
+			s.spectator = cl->spectator;
+			s.infochanges = cl->_userinfo_ctx_.changes;
+			s.frags = cl->old_frags;
+			s.minutes = (int)(realtime - cl->connection_started)/60;
+			s.pingbucket = SV_CalcPing (cl) / STATUS_PING_BUCKET;
+		}
+
+		if (memcmp (&s, &sv_statusclients[i], sizeof(s)))
+		{
+			sv_statusclients[i] = s;
+			changed = true;
+		}
+	}
+
+	if (changed)
+	{
+		strlcpy (sv_statusinfo, svs.info, sizeof(sv_statusinfo));
+		for (i = 0; i < STATUS_FLAGS; i++)
+			sv_statusreplies[i].valid = false;
+	}
+}
+
+static void SV_BuildStatusReply (statusreply_t *r, int opt)
+{
+	int top, bottom, ping, i;
+	char *name, *frags;
+	client_t *cl;
+
+	SV_ReplyBegin (r);
 	if (opt == STATUS_OLDSTYLE || (opt & STATUS_SERVERINFO))
-		Con_Printf ("%s\n", svs.info);
+		SV_ReplyPrintf (r, "%s\n", svs.info);
 	if (opt == STATUS_OLDSTYLE || (opt & (STATUS_PLAYERS | STATUS_SPECTATORS)))
 		for (i = 0; i < MAX_CLIENTS; i++)
 		{
@@ -631,34 +976,91 @@ static void SVC_Status (void)
 				else
 					frags = va("%i", cl->old_frags);
 
-				Con_Printf ("%i %s %i %i \"%s\" \"%s\" %i %i", cl->userid, frags,
+				SV_ReplyPrintf (r, "%i %s %i %i \"%s\" \"%s\" %i %i", cl->userid, frags,
 				            (int)(realtime - cl->connection_started)/60, ping, name,
 				            Info_Get (&cl->_userinfo_ctx_, "skin"), top, bottom);
 
 				if (opt & STATUS_SHOWTEAMS)
-					Con_Printf (" \"%s\"\n", cl->team);
+					SV_ReplyPrintf (r, " \"%s\"\n", cl->team);
 				else
-					Con_Printf ("\n");
+					SV_ReplyPrint (r, "\n");
 			}
 		}
-	SV_EndRedirect ();
+	SV_ReplyFinish (r);
+}
+
+static void SVC_Status (void)
+{
+	statusreply_t *r, uncached;
+	int opt = 0;
+
+	if (Cmd_Argc() > 1)
+		opt = Q_atoi(Cmd_Argv(1));
+
+	SV_CheckStatusReplies ();
+
+	// flags we don't know about don't change the reply, but don't waste slots on them
+	r = (opt >= 0 && opt < STATUS_FLAGS) ? &sv_statusreplies[opt] : &uncached;
+
+	sv_statusqueries++;
+	if (r != &uncached && r->valid)
+		sv_statushits++;
+	else
+		SV_BuildStatusReply (r, opt);
+
+	SV_ReplySend (r);
+}
+
+void SV_StatusCacheStats (unsigned int *queries, unsigned int *hits)
+{
+	*queries = sv_statusqueries;
+	*hits = sv_statushits;
 }
 
 /*
 ===================
 SVC_LastScores
 
+The reply reads a demo listing and one text file per demo, so it is
+reused for LASTSCORES_CACHE_TIME seconds for the same arguments.
 ===================
 */
 void SV_LastScores_f (void);
+static void SV_LastScoresPrint (char *msg)
+{
+	SV_ReplyPrint (&sv_lastscoresreply, msg);
+}
+
 static void SVC_LastScores (void)
 {
+	extern redirect_t sv_redirected;
+	statusreply_t *r = &sv_lastscoresreply;
+	int arg = Cmd_Argc() > 1 ? Q_atoi(Cmd_Argv(1)) : -1;
+
 	if(!(int)sv_allowlastscores.value)
 		return;
 
-	SV_BeginRedirect (RD_PACKET);
+	sv_statusqueries++;
+	if (r->valid && realtime - r->time < LASTSCORES_CACHE_TIME
+		&& sv_lastscoresarg == arg && sv_lastscoresstarted == GameStarted())
+	{
+		sv_statushits++;
+		SV_ReplySend (r);
+		return;
+	}
+
+	// capture the prints, SV_LastScores_f still sees an RD_PACKET redirect
+	SV_ReplyBegin (r);
+	sv_redirected = RD_PACKET;
+	Com_BeginRedirect (SV_LastScoresPrint);
 	SV_LastScores_f ();
-	SV_EndRedirect ();
+	Com_EndRedirect ();
+	sv_redirected = RD_NONE;
+	SV_ReplyFinish (r);
+
+	sv_lastscoresarg = arg;
+	sv_lastscoresstarted = GameStarted();
+	SV_ReplySend (r);
 }
 
 /*
@@ -1877,7 +2279,7 @@ If 0, then only addresses matching the list will be allowed.  This lets you easi
 } ipfilter_t;
 */
 
-#define	MAX_IPFILTERS	1024
+#define	MAX_IPFILTERS	16384
 
 ipfilter_t	ipfilters[MAX_IPFILTERS];
 int		numipfilters;
@@ -1892,6 +2294,127 @@ int		numpenfilters;
 
 cvar_t	filterban = {"filterban", "1"};
 
+/*
+Every filter list is mirrored by a bitwise trie keyed on the filter mask
+and address, so SV_FilterPacket and SV_VIPbyIP cost at most 32 steps per
+possible wildcard path instead of a walk over the whole list.  A mask bit
+of 0 follows the wildcard child, so "addip 10.0.0.5" still matches 10.*.*.5.
+Leaf nodes keep the list index of their filter plus one.
+*/
+typedef struct ipnode_s
+{
+	struct ipnode_s	*child[3];	// 0, 1, any
+	int				index;
+} ipnode_t;
+
+static ipnode_t	*ipfilters_trie;
+static ipnode_t	*ipvip_trie;
+
+static void SV_FreeIPTrie (ipnode_t **node)
+{
+	int i;
+
+	if (!*node)
+		return;
+
+	for (i = 0; i < 3; i++)
+		SV_FreeIPTrie (&(*node)->child[i]);
+	Q_free (*node);
+}
+
+static ipnode_t **SV_IPTrieNode (ipnode_t **node, unsigned mask, unsigned compare, qbool create)
+{
+	byte *m = (byte *) &mask, *c = (byte *) &compare;
+	int i, k;
+
+	for (i = 0; i < 32; i++)
+	{
+		if (!*node)
+		{
+			if (!create)
+				return NULL;
+			*node = (ipnode_t *) Q_malloc (sizeof(ipnode_t));
+		}
+
+		k = 7 - (i & 7);
+		if (m[i >> 3] & (1 << k))
+			node = &(*node)->child[(c[i >> 3] >> k) & 1];
+		else
+			node = &(*node)->child[2];
+	}
+
+	if (!*node && create)
+		*node = (ipnode_t *) Q_malloc (sizeof(ipnode_t));
+
+	return *node ? node : NULL;
+}
+
+// returns the list index of the first filter of given type (-1 for any) matching ip
+static int SV_IPTrieMatch (ipnode_t *node, const byte *ip, int bit, const ipfilter_t *filters, int type)
+{
+	int best = -1, i;
+
+	for ( ; node; bit++)
+	{
+		if (bit == 32)
+		{
+			i = node->index - 1;
+			if (i >= 0 && (type < 0 || filters[i].type == type) && (best < 0 || i < best))
+				best = i;
+			break;
+		}
+
+		if (node->child[2])
+		{
+			i = SV_IPTrieMatch (node->child[2], ip, bit + 1, filters, type);
+			if (i >= 0 && (best < 0 || i < best))
+				best = i;
+		}
+
+		node = node->child[(ip[bit >> 3] >> (7 - (bit & 7))) & 1];
+	}
+
+	return best;
+}
+
+static int SV_IPTrieFind (ipnode_t **trie, unsigned mask, unsigned compare)
+{
+	ipnode_t **node = SV_IPTrieNode (trie, mask, compare, false);
+
+	return node ? (*node)->index - 1 : -1;
+}
+
+static void SV_RebuildIPTrie (ipnode_t **trie, const ipfilter_t *filters, int num)
+{
+	int i;
+
+	SV_FreeIPTrie (trie);
+
+	for (i = 0; i < num; i++)
+		(*SV_IPTrieNode (trie, filters[i].mask, filters[i].compare, true))->index = i + 1;
+}
+
+// returns the list slot to use for f, the same one if f is already there
+static int SV_IPFilterSlot (ipnode_t **trie, const ipfilter_t *filters, int num, const ipfilter_t *f)
+{
+	int i = SV_IPTrieFind (trie, f->mask, f->compare);
+
+	if (i < 0)
+		i = SV_IPTrieFind (trie, 0xffffffff, 0xffffffff);	// free spot
+	return i < 0 ? num : i;
+}
+
+static void SV_SetIPFilter (ipnode_t **trie, ipfilter_t *filters, int i, const ipfilter_t *f)
+{
+	ipnode_t **node;
+
+	if ((node = SV_IPTrieNode (trie, filters[i].mask, filters[i].compare, false)) && (*node)->index == i + 1)
+		(*node)->index = 0;
+
+	filters[i] = *f;
+	(*SV_IPTrieNode (trie, f->mask, f->compare, true))->index = i + 1;
+}
+
 /*
 =================
 StringToFilter
@@ -1959,10 +2482,7 @@ static void SV_AddIPVIP_f (void)
 
 	if (l < 1) l = 1;
 
-	for (i=0 ; i<numipvips ; i++)
-		if (ipvip[i].compare == 0xffffffff || (ipvip[i].mask == f.mask
-		                                       && ipvip[i].compare == f.compare))
-			break;		// free spot
+	i = SV_IPFilterSlot (&ipvip_trie, ipvip, numipvips, &f);
 	if (i == numipvips)
 	{
 		if (numipvips == MAX_IPFILTERS)
@@ -1973,8 +2493,8 @@ static void SV_AddIPVIP_f (void)
 		numipvips++;
 	}
 
-	ipvip[i] = f;
-	ipvip[i].level = l;
+	f.level = l;
+	SV_SetIPFilter (&ipvip_trie, ipvip, i, &f);
 }
 
 /*
@@ -1992,16 +2512,15 @@ static void SV_RemoveIPVIP_f (void)
 		Con_Printf ("Bad filter address: %s\n", Cmd_Argv(1));
 		return;
 	}
-	for (i=0 ; i<numipvips ; i++)
-		if (ipvip[i].mask == f.mask
-		        && ipvip[i].compare == f.compare)
-		{
-			for (j=i+1 ; j<numipvips ; j++)
-				ipvip[j-1] = ipvip[j];
-			numipvips--;
-			Con_Printf ("Removed.\n");
-			return;
-		}
+	if ((i = SV_IPTrieFind (&ipvip_trie, f.mask, f.compare)) >= 0)
+	{
+		for (j=i+1 ; j<numipvips ; j++)
+			ipvip[j-1] = ipvip[j];
+		numipvips--;
+		SV_RebuildIPTrie (&ipvip_trie, ipvip, numipvips);
+		Con_Printf ("Removed.\n");
+		return;
+	}
 	Con_Printf ("Didn't find %s.\n", Cmd_Argv(1));
 }
 
@@ -2099,10 +2618,7 @@ static void SV_AddIP_f (void)
 	f.time = t;
 	f.type = ipft;
 
-	for (i=0 ; i<numipfilters ; i++)
-		if (ipfilters[i].compare == 0xffffffff || (ipfilters[i].mask == f.mask
-		        && ipfilters[i].compare == f.compare))
-			break;		// free spot
+	i = SV_IPFilterSlot (&ipfilters_trie, ipfilters, numipfilters, &f);
 	if (i == numipfilters)
 	{
 		if (numipfilters == MAX_IPFILTERS)
@@ -2113,7 +2629,7 @@ static void SV_AddIP_f (void)
 		numipfilters++;
 	}
 
-	ipfilters[i] = f;
+	SV_SetIPFilter (&ipfilters_trie, ipfilters, i, &f);
 }
 
 /*
@@ -2132,16 +2648,15 @@ static void SV_RemoveIP_f (void)
 		return;
 	}
 
-	for (i=0 ; i<numipfilters ; i++)
-		if (ipfilters[i].mask == f.mask
-		        && ipfilters[i].compare == f.compare)
-		{
-			for (j=i+1 ; j<numipfilters ; j++)
-				ipfilters[j-1] = ipfilters[j];
-			numipfilters--;
-			Con_Printf ("Removed.\n");
-			return;
-		}
+	if ((i = SV_IPTrieFind (&ipfilters_trie, f.mask, f.compare)) >= 0)
+	{
+		for (j=i+1 ; j<numipfilters ; j++)
+			ipfilters[j-1] = ipfilters[j];
+		numipfilters--;
+		SV_RebuildIPTrie (&ipfilters_trie, ipfilters, numipfilters);
+		Con_Printf ("Removed.\n");
+		return;
+	}
 	Con_Printf ("Didn't find %s.\n", Cmd_Argv(1));
 }
 
@@ -2246,14 +2761,8 @@ SV_FilterPacket
 */
 qbool SV_FilterPacket (void)
 {
-	int		i;
-	unsigned	in;
-
-	in = *(unsigned *)net_from.ip;
-
-	for (i=0 ; i<numipfilters ; i++)
-		if ( ipfilters[i].type == ipft_ban && (in & ipfilters[i].mask) == ipfilters[i].compare )
-			return (int)filterban.value;
+	if (SV_IPTrieMatch (ipfilters_trie, net_from.ip, 0, ipfilters, ipft_ban) >= 0)
+		return (int)filterban.value;
 
 	return !(int)filterban.value;
 }
@@ -2331,9 +2840,9 @@ qbool SV_CanAddBan (ipfilter_t *f)
 	if (f->compare == 0)
 		return false;
 
-	for (i=0 ; i<numipfilters ; i++)
-		if (ipfilters[i].mask == f->mask && ipfilters[i].compare == f->compare && ipfilters[i].type == ipft_safe)
-			return false; // can't add filter f because present "safe" filter
+	i = SV_IPTrieFind (&ipfilters_trie, f->mask, f->compare);
+	if (i >= 0 && ipfilters[i].type == ipft_safe)
+		return false; // can't add filter f because present "safe" filter
 
 	return true;
 }
@@ -2344,24 +2853,29 @@ void SV_RemoveBansIPFilter (int i)
 		ipfilters[i] = ipfilters[i + 1];
 
 	numipfilters--;
+	SV_RebuildIPTrie (&ipfilters_trie, ipfilters, numipfilters);
 }
 
 void SV_CleanBansIPList (void)
 {
 	time_t	long_time = time(NULL);
-	int     i;
+	int     i, j;
 
 	if (sv.state != ss_active)
 		return;
 
-	for (i = 0; i < numipfilters;)
+	// compact in place and rebuild the trie once, this runs every frame
+	for (i = j = 0; i < numipfilters; i++)
 	{
 		if (ipfilters[i].time && ipfilters[i].time <= long_time)
-		{
-			SV_RemoveBansIPFilter (i);
-		}
-		else
-			i++;
+			continue;
+		ipfilters[j++] = ipfilters[i];
+	}
+
+	if (j != numipfilters)
+	{
+		numipfilters = j;
+		SV_RebuildIPTrie (&ipfilters_trie, ipfilters, numipfilters);
 	}
 }
 
@@ -2602,13 +3116,9 @@ SV_VIPbyIP
 int SV_VIPbyIP (netadr_t adr)
 {
 	int		i;
-	unsigned	in;
 
-	in = *(unsigned *)adr.ip;
-
-	for (i=0 ; i<numipvips ; i++)
-		if ( (in & ipvip[i].mask) == ipvip[i].compare)
-			return ipvip[i].level;
+	if ((i = SV_IPTrieMatch (ipvip_trie, adr.ip, 0, ipvip, -1)) >= 0)
+		return ipvip[i].level;
 
 	return 0;
 }
@@ -2851,21 +3361,7 @@ static void SV_ReadPackets (void)
 		return;
 
 	// first deal with delayed packets from connected clients
-	for (i = 0, cl=svs.clients; i < MAX_CLIENTS; i++, cl++)
-	{
-		if (cl->state == cs_free)
-			continue;
-
-		net_from = cl->netchan.remote_address;
-
-		while (cl->packets && (realtime - cl->packets->time >= cl->delay || sv.paused))
-		{
-			SZ_Clear(&net_message);
-			SZ_Write(&net_message, cl->packets->msg.data, cl->packets->msg.cursize);
-			SV_ExecuteClientMessage(cl);
-			SV_FreeHeadDelayedPacket(cl);
-		}
-	}
+	SV_RunDelayedPackets ();
 
 	// now deal with new packets
 	while (NET_GetPacket(NS_SERVER))
@@ -2914,23 +3410,7 @@ static void SV_ReadPackets (void)
 		// ok, we know who sent this packet, but do we need to delay executing it?
 		if (cl->delay > 0)
 		{
-			if (!svs.free_packets) // packet has to be dropped..
-				break;
-
-			// insert at end of list
-			if (!cl->packets) {
-				cl->last_packet = cl->packets = svs.free_packets;
-			} else {
-				// this works because '=' associates from right to left
-				cl->last_packet = cl->last_packet->next = svs.free_packets;
-			}
-
-			svs.free_packets = svs.free_packets->next;
-			cl->last_packet->next = NULL;
-
-			cl->last_packet->time = realtime;
-			SZ_Clear(&cl->last_packet->msg);
-			SZ_Write(&cl->last_packet->msg, net_message.data, net_message.cursize);
+			SV_DelayPacket (cl);
 		}
 		else
 		{
@@ -3129,6 +3609,172 @@ static void KtproAirstepFix(void)
 	}
 }
 
+/*
+=============================================================================
+
+FRAME PROFILER
+
+SV_Frame phases are timed every frame into a ring of PROFILE_FRAMES
+samples, sv_framestats prints min / avg / p99 / max over that window,
+and sv_framelog names a csv file in the gamedir getting one row per frame.
+
+=============================================================================
+*/
+
+#define PROFILE_FRAMES		1024
+
+static const char *sv_profilenames[SVP_MAX] =
+{
+	"qtv poll",
+	"read packets",
+	"physics",
+	"  qc startframe",
+	"send clients",
+	"mvd write",
+	"frame total"
+};
+
+static float	sv_profiletimes[SVP_MAX][PROFILE_FRAMES];	// ms
+static double	sv_profilecur[SVP_MAX];
+static int		sv_profileframe, sv_profileframes;
+static FILE		*sv_framelogfile;
+
+static void OnChange_framelog_var (cvar_t *var, char *value, qbool *cancel);
+cvar_t	sv_framelog = {"sv_framelog", "", 0, OnChange_framelog_var};
+
+static void OnChange_framelog_var (cvar_t *var, char *value, qbool *cancel)
+{
+	char name[MAX_OSPATH * 2];
+	int i;
+
+	if (strstr (value, ".."))
+	{
+		*cancel = true;
+		return;
+	}
+
+	if (sv_framelogfile)
+	{
+		fclose (sv_framelogfile);
+		sv_framelogfile = NULL;
+	}
+
+	if (!value[0])
+		return;
+
+	snprintf (name, sizeof(name), "%s/%s", fs_gamedir, value);
+	if (!(sv_framelogfile = fopen (name, "wb")))
+	{
+		Con_Printf ("Couldn't open %s\n", name);
+		return;
+	}
+
+	fprintf (sv_framelogfile, "realtime");
+	for (i = 0; i < SVP_MAX; i++)
+		fprintf (sv_framelogfile, ",%s", sv_profilenames[i] + strspn (sv_profilenames[i], " "));
+	fprintf (sv_framelogfile, "\n");
+}
+
+void SV_ProfileAdd (svprofile_t phase, double seconds)
+{
+	sv_profilecur[phase] += seconds;
+}
+
+static void SV_ProfileEndFrame (void)
+{
+	int i;
+
+	for (i = 0; i < SVP_MAX; i++)
+		sv_profiletimes[i][sv_profileframe] = 1000 * sv_profilecur[i];
+
+	if (sv_framelogfile)
+	{
+		fprintf (sv_framelogfile, "%.3f", realtime);
+		for (i = 0; i < SVP_MAX; i++)
+			fprintf (sv_framelogfile, ",%.3f", 1000 * sv_profilecur[i]);
+		fprintf (sv_framelogfile, "\n");
+	}
+
+	memset (sv_profilecur, 0, sizeof(sv_profilecur));
+	sv_profileframe = (sv_profileframe + 1) % PROFILE_FRAMES;
+	sv_profileframes = min (sv_profileframes + 1, PROFILE_FRAMES);
+}
+
+static int SV_CompareFloats (const void *a, const void *b)
+{
+	float x = *(const float *) a, y = *(const float *) b;
+
+	return x < y ? -1 : x > y;
+}
+
+// returns min, avg, p99 and max of a phase over the profile window, in ms
+static void SV_ProfilePhase (svprofile_t phase, float *stats)
+{
+	float sorted[PROFILE_FRAMES];
+	double sum = 0;
+	int i, n = sv_profileframes;
+
+	if (!n)
+	{
+		stats[0] = stats[1] = stats[2] = stats[3] = 0;
+		return;
+	}
+
+	memcpy (sorted, sv_profiletimes[phase], n * sizeof(float));
+	qsort (sorted, n, sizeof(float), SV_CompareFloats);
+	for (i = 0; i < n; i++)
+		sum += sorted[i];
+
+	stats[0] = sorted[0];
+	stats[1] = sum / n;
+	stats[2] = sorted[(n * 99) / 100];
+	stats[3] = sorted[n - 1];
+}
+
+// time of the last finished frame in ms, for sv_loadtest
+float SV_ProfileLastFrame (svprofile_t phase)
+{
+	return sv_profiletimes[phase][(sv_profileframe + PROFILE_FRAMES - 1) % PROFILE_FRAMES];
+}
+
+const char *SV_ProfileName (svprofile_t phase)
+{
+	return sv_profilenames[phase];
+}
+
+void SV_FrameProfileStats (float *avg, float *p99)
+{
+	float stats[4];
+
+	SV_ProfilePhase (SVP_FRAME, stats);
+	*avg = stats[1];
+	*p99 = stats[2];
+}
+
+/*
+==================
+SV_FrameStats_f
+==================
+*/
+static void SV_FrameStats_f (void)
+{
+	float stats[4];
+	int i;
+
+	if (Cmd_Argc () > 1 && !strcmp (Cmd_Argv (1), "reset"))
+	{
+		sv_profileframe = sv_profileframes = 0;
+		return;
+	}
+
+	Con_Printf ("last %i frames, ms      min      avg      p99      max\n", sv_profileframes);
+	for (i = 0; i < SVP_MAX; i++)
+	{
+		SV_ProfilePhase (i, stats);
+		Con_Printf ("%-17s %8.3f %8.3f %8.3f %8.3f\n", sv_profilenames[i], stats[0], stats[1], stats[2], stats[3]);
+	}
+}
+
 /*
 ==================
 SV_Frame
@@ -3139,7 +3785,7 @@ void SV_Map (qbool now);
 void SV_Frame (double time1)
 {
 	static double start, end;
-	double demo_start, demo_end;
+	double demo_start, demo_end, t;
 
 
 	start = Sys_DoubleTime ();
@@ -3172,24 +3818,40 @@ void SV_Frame (double time1)
 	// toggle the log buffer if full
 	SV_CheckLog ();
 
+	t = Sys_DoubleTime ();
 	SV_MVDStream_Poll();
+	SV_ProfileAdd (SVP_QTV, Sys_DoubleTime () - t);
 
 	// check for map change;
 	SV_Map(true);
 
 	SV_CheckVars ();
 
+	// free QC temp strings nothing refers to any more
+	PR_CollectStrings ();
+
+	// synthetic clients of sv_loadtest, not counted as server time
+	t = Sys_DoubleTime ();
+	SV_LoadTestFrame ();
+	start += Sys_DoubleTime () - t;
+
 	// get packets
+	t = Sys_DoubleTime ();
 	SV_ReadPackets ();
+	SV_ProfileAdd (SVP_READPACKETS, Sys_DoubleTime () - t);
 
 	// move autonomous things around if enough time has passed
+	t = Sys_DoubleTime ();
 	if (!sv.paused)
 		SV_Physics ();
 	else
 		PausedTic ();
+	SV_ProfileAdd (SVP_PHYSICS, Sys_DoubleTime () - t);
 
 	// send messages back to the clients that had packets read this frame
+	t = Sys_DoubleTime ();
 	SV_SendClientMessages ();
+	SV_ProfileAdd (SVP_SEND, Sys_DoubleTime () - t);
 
 	demo_start = Sys_DoubleTime ();
 	
@@ -3197,6 +3859,7 @@ void SV_Frame (double time1)
 	
 	demo_end = Sys_DoubleTime ();
 	svs.stats.demo += demo_end - demo_start;
+	SV_ProfileAdd (SVP_DEMO, demo_end - demo_start);
 
 	// send a heartbeat to the master if needed
 	Master_Heartbeat ();
@@ -3204,6 +3867,8 @@ void SV_Frame (double time1)
 	// collect timing statistics
 	end = Sys_DoubleTime ();
 	svs.stats.active += end-start;
+	SV_ProfileAdd (SVP_FRAME, end - start);
+	SV_ProfileEndFrame ();
 	if (++svs.stats.count == STATFRAMES)
 	{
 		svs.stats.latched_active = svs.stats.active;
@@ -3237,13 +3902,14 @@ void SV_InitLocal (void)
 	extern	cvar_t	sv_friction;
 	extern	cvar_t	sv_waterfriction;
 	extern	cvar_t	sv_nailhack;
+	extern	cvar_t	sv_sendthreads;
+	extern	cvar_t	sv_udpbatch;
 
 	extern	cvar_t	pm_airstep;
 	extern	cvar_t	pm_pground;
 	//extern	cvar_t	pm_slidefix;
 	extern	cvar_t	pm_ktjump;
 	//extern	cvar_t	pm_bunnyspeedcap;
-	packet_t *packet_freeblock; // initialise delayed packet free block
 
 
 //	Cvar_Init ();
@@ -3297,6 +3963,7 @@ void SV_InitLocal (void)
 	Cvar_Register (&sv_nailhack);
 
 	Cvar_Register (&sv_mintic);
+	Cvar_Register (&sv_thinkqueue);
 	Cvar_Register (&sv_maxtic);
 	Cvar_Register (&sys_select_timeout);
 	Cvar_Register (&sys_restart_on_error);
@@ -3385,6 +4052,12 @@ void SV_InitLocal (void)
 #endif
 
 	Cvar_Register (&sv_cullentities);
+	Cvar_Register (&sv_areadepth);
+	Cvar_Register (&sv_physentgrid);
+	Cvar_Register (&sv_triggergrid);
+	Cvar_Register (&sv_sendthreads);
+	Cvar_Register (&sv_udpbatch);
+	Cvar_Register (&sv_framelog);
 
 // QW262 -->
 	Cmd_AddCommand ("svadmin", SV_Admin_f);
@@ -3399,6 +4072,13 @@ void SV_InitLocal (void)
 	Cmd_AddCommand ("vip_listip", SV_ListIPVIP_f);
 	Cmd_AddCommand ("vip_writeip", SV_WriteIPVIP_f);
 
+	Cmd_AddCommand ("sv_areastats", SV_AreaStats_f);
+	Cmd_AddCommand ("sv_tracebench", SV_TraceBench_f);
+	Cmd_AddCommand ("sv_delaystats", SV_DelayStats_f);
+	Cmd_AddCommand ("sv_framestats", SV_FrameStats_f);
+	Cmd_AddCommand ("sv_loadtest", SV_LoadTest_f);
+	Cmd_AddCommand ("sv_tracelog", SV_TraceLog_f);
+
 
 	for (i=0 ; i<MAX_MODELS ; i++)
 		snprintf (localmodels[i], MODEL_NAME_LEN, "*%i", i);
@@ -3437,15 +4117,6 @@ void SV_InitLocal (void)
 	svs.log[1].maxsize = sizeof(svs.log_buf[1]);
 	svs.log[1].cursize = 0;
 	svs.log[1].allowoverflow = true;
-
-	packet_freeblock = (packet_t *) Hunk_AllocName (MAX_DELAYED_PACKETS * sizeof(packet_t), "delayed_packets");
-
-	for (i = 0; i < MAX_DELAYED_PACKETS; i++) {
-		SZ_Init (&packet_freeblock[i].msg, packet_freeblock[i].buf, sizeof(packet_freeblock[i].buf));
-		packet_freeblock[i].next = &packet_freeblock[i + 1];
-	}
-	packet_freeblock[MAX_DELAYED_PACKETS - 1].next = NULL;
-	svs.free_packets = &packet_freeblock[0];
 }
 
 
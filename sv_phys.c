@@ -507,7 +507,10 @@ qbool SV_Push (edict_t *pusher, vec3_t move)
 
 		// remove the onground flag for non-players
 		if (check->v.movetype != MOVETYPE_WALK)
+		{
 			check->v.flags = (int)check->v.flags & ~FL_ONGROUND;
+			SV_ThinkWake (check);
+		}
 
 		VectorCopy (check->v.origin, moved_from[num_moved]);
 		moved_edict[num_moved] = check;
@@ -870,6 +873,8 @@ void SV_Physics_Step (edict_t *ent)
 
 void SV_ProgStartFrame (void)
 {
+	double start = Sys_DoubleTime ();
+
 	// let the progs know that a new frame has started
 	pr_global_struct->self = EDICT_TO_PROG(sv.edicts);
 	pr_global_struct->other = EDICT_TO_PROG(sv.edicts);
@@ -880,6 +885,8 @@ void SV_ProgStartFrame (void)
 	else
 #endif
 		PR_ExecuteProgram (PR_GLOBAL(StartFrame));
+
+	SV_ProfileAdd (SVP_STARTFRAME, Sys_DoubleTime () - start);
 }
 
 /*
@@ -980,6 +987,266 @@ void SV_RunNewmis (void)
 	sv_frametime = save_frametime;
 }
 
+/*
+==============================================================================
+
+THINK SCHEDULER
+
+Most entities sit still and think rarely, running SV_RunEntity on them
+every frame does nothing.  Entities that can only think (MOVETYPE_NONE and
+LOCK, tossed things resting on the ground) sleep in a heap ordered by
+nextthink, SV_Physics wakes the ones due this frame and runs them together
+with everything that moves, in edict order as before.
+
+An entity is looked at again when anything it sleeps on could have changed:
+QC stores to the fields in sv_thinkfields (see SV_THINKFIELD), OP_STATE,
+ED_ClearEdict, and SV_Push lifting it off the ground.  QVM mods write edicts
+directly, so with those every entity runs every frame like before.
+
+sv_thinkqueue 2 checks every skipped entity would really have done nothing,
+reporting and running those that would.
+==============================================================================
+*/
+
+cvar_t	sv_thinkqueue = {"sv_thinkqueue", "1"};	// 2 also checks nothing is missed
+
+typedef struct
+{
+	float	time;		// nextthink when it was queued
+	int		num;
+	int		seq;		// stale unless sv_thinkseq[num] still matches
+} thinkentry_t;
+
+#define MAX_THINKHEAP	(MAX_EDICTS * 4)
+
+byte			sv_thinkfields[SV_THINKFIELDS];
+static unsigned int	sv_thinkvisit[(MAX_EDICTS + 31) / 32];	// run this or next frame
+static int		sv_thinkseq[MAX_EDICTS];
+static thinkentry_t	sv_thinkheap[MAX_THINKHEAP];
+static int		sv_thinkheapsize;
+static qbool	sv_thinkvalid;
+
+#define ENTVAR_OFS(f)	((int *)&((entvars_t *)0)->f - (int *)0)
+#define THINK_SET(n)	(sv_thinkvisit[(n) >> 5] |= 1u << ((n) & 31))
+
+static qbool SV_ThinkLess (thinkentry_t *a, thinkentry_t *b)
+{
+	return a->time < b->time;
+}
+
+static void SV_ThinkHeapDown (int i)
+{
+	thinkentry_t tmp;
+	int child;
+
+	for ( ; (child = 2 * i + 1) < sv_thinkheapsize; i = child)
+	{
+		if (child + 1 < sv_thinkheapsize && SV_ThinkLess (&sv_thinkheap[child + 1], &sv_thinkheap[child]))
+			child++;
+		if (!SV_ThinkLess (&sv_thinkheap[child], &sv_thinkheap[i]))
+			break;
+		tmp = sv_thinkheap[i];
+		sv_thinkheap[i] = sv_thinkheap[child];
+		sv_thinkheap[child] = tmp;
+	}
+}
+
+static void SV_ThinkHeapPush (float time, int num)
+{
+	thinkentry_t tmp;
+	int i, j;
+
+	if (sv_thinkheapsize == MAX_THINKHEAP)
+	{	// drop the stale entries
+		for (i = j = 0; i < sv_thinkheapsize; i++)
+		{
+			if (sv_thinkheap[i].seq == sv_thinkseq[sv_thinkheap[i].num])
+				sv_thinkheap[j++] = sv_thinkheap[i];
+		}
+		sv_thinkheapsize = j;
+		for (i = sv_thinkheapsize / 2 - 1; i >= 0; i--)
+			SV_ThinkHeapDown (i);
+	}
+
+	i = sv_thinkheapsize++;
+	sv_thinkheap[i].time = time;
+	sv_thinkheap[i].num = num;
+	sv_thinkheap[i].seq = sv_thinkseq[num];
+
+	for ( ; i && SV_ThinkLess (&sv_thinkheap[i], &sv_thinkheap[(i - 1) / 2]); i = (i - 1) / 2)
+	{
+		tmp = sv_thinkheap[i];
+		sv_thinkheap[i] = sv_thinkheap[(i - 1) / 2];
+		sv_thinkheap[(i - 1) / 2] = tmp;
+	}
+}
+
+// true if SV_RunEntity would do nothing but SV_RunThink
+static qbool SV_ThinkOnly (edict_t *ent)
+{
+	switch ((int)ent->v.movetype)
+	{
+	case MOVETYPE_NONE:
+	case MOVETYPE_LOCK:
+		return true;
+	case MOVETYPE_TOSS:
+	case MOVETYPE_BOUNCE:
+	case MOVETYPE_FLY:
+	case MOVETYPE_FLYMISSILE:
+		return ((int)ent->v.flags & FL_ONGROUND) && ent->v.velocity[2] <= 0;
+	}
+	return false;
+}
+
+static qbool SV_ThinkDue (edict_t *ent)
+{
+	return ent->v.nextthink > 0 && ent->v.nextthink <= sv.time + sv_frametime;
+}
+
+// decides when entity num runs next
+static void SV_ThinkSchedule (edict_t *ent, int num)
+{
+	sv_thinkseq[num]++;
+
+	if (ent->e->free || (num > 0 && num <= MAX_CLIENTS))
+		return;
+
+	if (!SV_ThinkOnly (ent))
+		THINK_SET(num);
+	else if (ent->v.nextthink > 0)
+		SV_ThinkHeapPush (ent->v.nextthink, num);
+}
+
+/*
+================
+SV_ThinkWake
+
+Something an entity sleeps on was changed, run it at the next chance
+================
+*/
+void SV_ThinkWake (edict_t *ent)
+{
+	int num = ((byte *)ent - (byte *)sv.edicts) / pr_edict_size;
+
+	if ((unsigned int)num < MAX_EDICTS)
+		THINK_SET(num);
+}
+
+/*
+================
+SV_ThinkReset
+
+Called when a map is spawned, everything runs on the first frame
+================
+*/
+void SV_ThinkReset (void)
+{
+	memset (sv_thinkfields, 0, sizeof(sv_thinkfields));
+	sv_thinkfields[ENTVAR_OFS(movetype)] = true;
+	sv_thinkfields[ENTVAR_OFS(flags)] = true;
+	sv_thinkfields[ENTVAR_OFS(nextthink)] = true;
+	sv_thinkfields[ENTVAR_OFS(velocity)] = true;		// whole vector
+	sv_thinkfields[ENTVAR_OFS(velocity) + 2] = true;	// velocity_z
+
+	sv_thinkvalid = false;
+}
+
+static void SV_RunPhysicsEntity (edict_t *ent, int num)
+{
+	if (PR_GLOBAL(force_retouch))
+		SV_LinkEdict (ent, true);	// force retouch even for stationary
+
+	if (num > 0 && num <= MAX_CLIENTS)
+		return;		// clients are run directly from packets
+
+	SV_RunEntity (ent);
+	SV_RunNewmis ();
+}
+
+// the old way, optionally building the schedule as it goes
+static void SV_RunAllEntities (qbool schedule)
+{
+	edict_t *ent;
+	int i;
+
+	memset (sv_thinkvisit, 0, sizeof(sv_thinkvisit));
+	sv_thinkheapsize = 0;
+
+	ent = sv.edicts;
+	for (i=0 ; i<sv.num_edicts ; i++, ent = NEXT_EDICT(ent))
+	{
+		if (ent->e->free)
+			continue;
+
+		SV_RunPhysicsEntity (ent, i);
+		if (schedule)
+			SV_ThinkSchedule (ent, i);
+	}
+
+	sv_thinkvalid = schedule;
+}
+
+static void SV_RunScheduledEntities (void)
+{
+	thinkentry_t *top;
+	edict_t *ent;
+	int i, missed;
+
+	// wake the sleepers whose think is due
+	while (sv_thinkheapsize && sv_thinkheap[0].time <= sv.time + sv_frametime)
+	{
+		top = &sv_thinkheap[0];
+		if (top->seq == sv_thinkseq[top->num])
+		{
+			THINK_SET(top->num);
+			sv_thinkseq[top->num]++;
+		}
+		sv_thinkheap[0] = sv_thinkheap[--sv_thinkheapsize];
+		SV_ThinkHeapDown (0);
+	}
+
+	// entities woken while this runs are picked up if they come later,
+	// otherwise next frame, the old loop would have done the same
+	for (i = 0; i < sv.num_edicts; i++)
+	{
+		if (!sv_thinkvisit[i >> 5])
+		{
+			i |= 31;
+			continue;
+		}
+		if (!(sv_thinkvisit[i >> 5] & (1u << (i & 31))))
+			continue;
+		sv_thinkvisit[i >> 5] &= ~(1u << (i & 31));
+
+		ent = EDICT_NUM(i);
+		if (ent->e->free)
+			continue;
+
+		SV_RunPhysicsEntity (ent, i);
+		SV_ThinkSchedule (ent, i);
+	}
+
+	if ((int)sv_thinkqueue.value != 2)
+		return;
+
+	missed = 0;
+	ent = NEXT_EDICT(sv.edicts);
+	for (i = 1; i < sv.num_edicts; i++, ent = NEXT_EDICT(ent))
+	{
+		if (ent->e->free || i <= MAX_CLIENTS || ent->e->lastruntime == sv.time)
+			continue;
+		if (SV_ThinkOnly (ent) && !SV_ThinkDue (ent))
+			continue;
+
+		Con_Printf ("sv_thinkqueue: entity %i (%s) was skipped\n", i, PR_GetString (ent->v.classname));
+		SV_RunPhysicsEntity (ent, i);
+		SV_ThinkSchedule (ent, i);
+		missed++;
+	}
+	if (missed)
+		Con_Printf ("sv_thinkqueue: %i entities skipped at %.2f\n", missed, sv.time);
+}
+
 /*
 ================
 SV_Physics
@@ -992,9 +1259,9 @@ void SV_PostRunCmd(void);
 #endif
 void SV_Physics (void)
 {
+#ifdef USE_PR2
 	int i;
 	edict_t *ent;
-#ifdef USE_PR2
 	client_t *cl,*savehc;
 	edict_t *savesvpl;
 #endif
@@ -1016,6 +1283,7 @@ void SV_Physics (void)
 		sv_frametime = 0.1; // initialization frame
 
 	sv.physicstime = sv.time;
+	SV_AreaStatsFrame ();
 
 	if (pr_nqprogs)
 		NQP_Reset ();
@@ -1028,21 +1296,16 @@ void SV_Physics (void)
 	// treat each object in turn
 	// even the world gets a chance to think
 	//
-	ent = sv.edicts;
-	for (i=0 ; i<sv.num_edicts ; i++, ent = NEXT_EDICT(ent))
-	{
-		if (ent->e->free)
-			continue;
-
-		if (PR_GLOBAL(force_retouch))
-			SV_LinkEdict (ent, true);	// force retouch even for stationary
-
-		if (i > 0 && i <= MAX_CLIENTS)
-			continue;		// clients are run directly from packets
-
-		SV_RunEntity (ent);
-		SV_RunNewmis ();
-	}
+	if (!sv_thinkqueue.value
+#ifdef USE_PR2
+		|| sv_vm
+#endif
+		)
+		SV_RunAllEntities (false);
+	else if (!sv_thinkvalid || PR_GLOBAL(force_retouch))
+		SV_RunAllEntities (true);
+	else
+		SV_RunScheduledEntities ();
 
 	if (PR_GLOBAL(force_retouch))
 		PR_GLOBAL(force_retouch)--;
@@ -436,7 +436,7 @@ void SV_Multicast (vec3_t origin, int to)
 				goto inrange;
 		}
 
-		leafnum = CM_Leafnum(CM_PointInLeaf(vieworg));
+		leafnum = SV_ClientViewLeafnum (client, vieworg);
 		if (leafnum)
 		{
 			// -1 is because pvs rows are 1 based, not 0 based like leafs
@@ -815,20 +815,18 @@ void SV_UpdateClientStats (client_t *client)
 
 /*
 =======================
-SV_SendClientDatagram
+SV_BeginClientDatagram
+
+Starts the unreliable packet for a spawned client with its own view data.
 =======================
 */
-void SV_SendClientDatagram (client_t *client, int client_num)
+static void SV_BeginClientDatagram (client_t *client, sizebuf_t *msg, byte *buf, int size)
 {
-	byte		buf[MAX_DATAGRAM];
-	sizebuf_t	msg;
-	//	packet_t	*pack;
-
-	msg.data = buf;
-	msg.maxsize = sizeof(buf);
-	msg.cursize = 0;
-	msg.allowoverflow = true;
-	msg.overflowed = false;
+	msg->data = buf;
+	msg->maxsize = size;
+	msg->cursize = 0;
+	msg->allowoverflow = true;
+	msg->overflowed = false;
 
 	// for faster downloading skip half the frames
 	/*if (client->download && client->netchan.outgoing_sequence & 1)
@@ -843,15 +841,20 @@ void SV_SendClientDatagram (client_t *client, int client_num)
 	*/
 
 	// add the client specific data to the datagram
-	SV_WriteClientdataToMessage (client, &msg);
+	SV_WriteClientdataToMessage (client, msg);
+}
 
-	// send over all the objects that are in the PVS
-	// this will include clients, a packetentities, and
-	// possibly a nails update
-	SV_WriteEntitiesToClient (client, &msg, false);
+/*
+=======================
+SV_FinishClientDatagram
 
+Appends the per client multicast data and sends the packet.
+=======================
+*/
+static void SV_FinishClientDatagram (client_t *client, sizebuf_t *msg)
+{
 #ifdef FTE_PEXT2_VOICECHAT
-	SV_VoiceSendPacket(client, &msg);
+	SV_VoiceSendPacket(client, msg);
 #endif
 
 	// copy the accumulated multicast datagram
@@ -859,21 +862,181 @@ void SV_SendClientDatagram (client_t *client, int client_num)
 	if (client->datagram.overflowed)
 		Con_Printf ("WARNING: datagram overflowed for %s\n", client->name);
 	else
-		SZ_Write (&msg, client->datagram.data, client->datagram.cursize);
+		SZ_Write (msg, client->datagram.data, client->datagram.cursize);
 	SZ_Clear (&client->datagram);
 
 	// send deltas over reliable stream
 	if (Netchan_CanReliable (&client->netchan))
 		SV_UpdateClientStats (client);
 
-	if (msg.overflowed)
+	if (msg->overflowed)
 	{
 		Con_Printf ("WARNING: msg overflowed for %s\n", client->name);
-		SZ_Clear (&msg);
+		SZ_Clear (msg);
 	}
 
 	// send the datagram
-	Netchan_Transmit (&client->netchan, msg.cursize, buf);
+	Netchan_Transmit (&client->netchan, msg->cursize, msg->data);
+}
+
+/*
+=======================
+SV_SendClientDatagram
+=======================
+*/
+void SV_SendClientDatagram (client_t *client, int client_num)
+{
+	byte		buf[MAX_DATAGRAM];
+	sizebuf_t	msg;
+
+	SV_BeginClientDatagram (client, &msg, buf, sizeof(buf));
+
+	// send over all the objects that are in the PVS
+	// this will include clients, a packetentities, and
+	// possibly a nails update
+	SV_WriteEntitiesToClient (client, &msg, false);
+
+	SV_FinishClientDatagram (client, &msg);
+}
+
+/*
+===============================================================================
+
+PARALLEL PACKET BUILDING
+
+With sv_sendthreads > 1 the entity part of every client datagram, which only
+reads the world, is encoded by a pool of worker threads into per client
+buffers. Client data, multicasts and Netchan_Transmit stay on the main thread.
+
+===============================================================================
+*/
+
+cvar_t	sv_sendthreads = {"sv_sendthreads", "0"};
+
+typedef struct
+{
+	sem_t		start;
+	int			index;
+} sendworker_t;
+
+static sendworker_t	sv_sendworkers[MAX_SEND_THREADS];
+static int			sv_numsendworkers;	// worker threads started so far, never shrinks
+static sem_t		sv_senddone;
+
+static byte			sv_sendbufs[MAX_CLIENTS][MAX_DATAGRAM];
+static sizebuf_t	sv_sendmsgs[MAX_CLIENTS];
+static client_t		*sv_sendjobs[MAX_CLIENTS];
+static int			sv_numsendjobs;
+static int			sv_sendstride;		// number of threads sharing the current jobs
+
+// clients that aren't spawned only get their reliable message, they are
+// queued too so that packets still go out in client order
+static void SV_RunSendJobs (int first)
+{
+	int i;
+
+	for (i = first; i < sv_numsendjobs; i += sv_sendstride)
+		if (sv_sendjobs[i]->state == cs_spawned)
+			SV_WriteEntitiesToClientWorker (sv_sendjobs[i], &sv_sendmsgs[i], first);
+}
+
+static DWORD WINAPI SV_SendWorkerProc (void *param)
+{
+	sendworker_t *worker = (sendworker_t *) param;
+
+	SV_AreaStatsThread (worker->index);
+
+	while (1)
+	{
+		Sys_SemWait (&worker->start);
+		SV_RunSendJobs (worker->index);
+		Sys_SemPost (&sv_senddone);
+	}
+
+	return 0;
+}
+
+/*
+=======================
+SV_SendThreads
+
+How many threads should build this frame's packets, starting workers as needed.
+=======================
+*/
+static int SV_SendThreads (void)
+{
+	int threads = bound (1, (int) sv_sendthreads.value, MAX_SEND_THREADS);
+
+#ifdef WITH_NQPROGS
+	if (pr_nqprogs)
+		return 1; // EF_MUZZLEFLASH translation writes to edicts while encoding
+#endif
+
+	if (threads > 1 && !sv_numsendworkers)
+	{
+		if (Sys_SemInit (&sv_senddone, 0, MAX_SEND_THREADS))
+			return 1;
+		sv_numsendworkers = 1; // the main thread is worker 0
+	}
+
+	while (sv_numsendworkers < threads)
+	{
+		sendworker_t *worker = &sv_sendworkers[sv_numsendworkers];
+
+		worker->index = sv_numsendworkers;
+		if (Sys_SemInit (&worker->start, 0, 1) || !Sys_CreateThread (SV_SendWorkerProc, worker))
+		{
+			Con_Printf ("WARNING: failed to start packet building thread %i\n", sv_numsendworkers);
+			break;
+		}
+		sv_numsendworkers++;
+	}
+
+	return min (threads, max (sv_numsendworkers, 1));
+}
+
+/*
+=======================
+SV_FlushSendJobs
+
+Builds the entity part of the queued datagrams in parallel and sends them.
+=======================
+*/
+static void SV_FlushSendJobs (void)
+{
+	client_t *c;
+	int i;
+
+	if (!sv_numsendjobs)
+		return;
+
+	// the workers reach CM_HullPointContents through the entity culling
+	if (sv_sendstride > 1)
+		CM_SetThreaded (true);
+
+	for (i = 1; i < sv_sendstride; i++)
+		Sys_SemPost (&sv_sendworkers[i].start);
+
+	SV_RunSendJobs (0);
+
+	for (i = 1; i < sv_sendstride; i++)
+		Sys_SemWait (&sv_senddone);
+
+	CM_SetThreaded (false);
+
+	for (i = 0; i < sv_numsendjobs; i++)
+	{
+		c = sv_sendjobs[i];
+		if (c->state == cs_spawned)
+			SV_FinishClientDatagram (c, &sv_sendmsgs[i]);
+		else
+		{
+			Netchan_Transmit (&c->netchan, c->datagram.cursize, c->datagram.data);	// just update reliable
+			c->datagram.cursize = 0;
+		}
+	}
+
+	sv_numsendjobs = 0;
 }
 
 /*
@@ -1013,6 +1176,11 @@ void SV_SendClientMessages (void)
 	// update frags, names, etc
 	SV_UpdateToReliableMessages ();
 
+	sv_sendstride = SV_SendThreads ();
+	sv_numsendjobs = 0;
+
+	NET_BeginSendBatch ();
+
 	// build individual updates
 	for (i=0, c = svs.clients ; i<MAX_CLIENTS ; i++, c++)
 	{
@@ -1093,13 +1261,24 @@ void SV_SendClientMessages (void)
 			continue;		// bandwidth choke
 		}
 
-		if (c->state == cs_spawned)
+		if (sv_sendstride > 1)
+		{
+			// entities are encoded later by SV_FlushSendJobs, which also sends in this order
+			if (c->state == cs_spawned)
+				SV_BeginClientDatagram (c, &sv_sendmsgs[sv_numsendjobs], sv_sendbufs[sv_numsendjobs], MAX_DATAGRAM);
+			sv_sendjobs[sv_numsendjobs++] = c;
+		}
+		else if (c->state == cs_spawned)
 			SV_SendClientDatagram (c, i);
 		else {
 			Netchan_Transmit (&c->netchan, c->datagram.cursize, c->datagram.data);	// just update reliable
 			c->datagram.cursize = 0;
 		}
 	}
+
+	SV_FlushSendJobs ();
+
+	NET_FlushSendBatch ();
 }
 
 void SV_MVDPings (void)
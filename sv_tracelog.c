@@ -0,0 +1,263 @@
+/*
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the included (GNU.txt) GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+// sv_tracelog.c - recording traces and player moves for tracereplay
+
+/*
+sv_tracelog start [name] writes every CM_HullTrace, SV_Trace and
+PM_PlayerMove with what went in and what came out to <gamedir>/name.trl
+("tracelog" by default), until sv_tracelog stop or the next map.
+
+SV_Trace records carry the edicts SV_AreaEdicts handed to SV_ClipToLinks
+and player moves their physents, so the calls can be run again without
+the game.  tracereplay (make tracereplay) does that against the current
+code with the same map loaded, times them and reports every result that
+came out different.  The format is in tracelog.h.
+
+With sv_sendthreads > 1 the hull traces of the entity culling run on
+several threads at once and are left out of the log.
+*/
+
+#include "qwsvdef.h"
+#include "tracelog.h"
+
+#define TRACELOG_BUFFER		(1024 * 1024)
+
+qbool				sv_tracelogging;
+
+static FILE			*tl_file;
+static char			tl_filename[MAX_OSPATH * 2];
+static int			tl_counts[TL_PLAYERMOVE + 1];
+static double		tl_starttime;
+
+static tl_edict_t	tl_edicts[MAX_EDICTS + 1];	// the world and then SV_AreaEdicts
+static int			tl_numedicts;
+
+static void SV_TraceLogWrite (int type, void *data, int size)
+{
+	fwrite (&type, sizeof(type), 1, tl_file);
+	fwrite (data, size, 1, tl_file);
+	tl_counts[type]++;
+}
+
+static void SV_TraceLogResult (trace_t *trace, tl_trace_t *out, int ent)
+{
+	out->allsolid = trace->allsolid;
+	out->startsolid = trace->startsolid;
+	out->inopen = trace->inopen;
+	out->inwater = trace->inwater;
+	out->fraction = trace->fraction;
+	VectorCopy (trace->endpos, out->endpos);
+	VectorCopy (trace->plane.normal, out->normal);
+	out->dist = trace->plane.dist;
+	out->ent = ent;
+}
+
+static int SV_TraceLogModel (cmodel_t *model)
+{
+	vec3_t mins, maxs;
+	int hullnum;
+
+	return model ? CM_HullNumber (&model->hulls[0], &hullnum, mins, maxs) : -1;
+}
+
+static void SV_TraceLogHull (hull_t *hull, vec3_t start, vec3_t end, trace_t *trace)
+{
+	tl_hulltrace_t rec;
+
+	memset (&rec, 0, sizeof(rec));
+	if ((rec.model = CM_HullNumber (hull, &rec.hull, rec.mins, rec.maxs)) < -1)
+		return;		// not a hull of the map
+
+	VectorCopy (start, rec.start);
+	VectorCopy (end, rec.end);
+	SV_TraceLogResult (trace, &rec.trace, -1);
+	SV_TraceLogWrite (TL_HULLTRACE, &rec, sizeof(rec));
+}
+
+static void SV_TraceLogEdict (edict_t *ent, tl_edict_t *out)
+{
+	int modelindex = ent->v.modelindex;
+
+	memset (out, 0, sizeof(*out));
+	out->num = NUM_FOR_EDICT(ent);
+	out->solid = ent->v.solid;
+	out->flags = ent->v.flags;
+	out->owner = NUM_FOR_EDICT(PROG_TO_EDICT(ent->v.owner));
+	out->model = ent->v.solid == SOLID_BSP && modelindex > 0 && modelindex < MAX_MODELS ?
+		SV_TraceLogModel (sv.models[modelindex]) : -1;
+	VectorCopy (ent->v.origin, out->origin);
+	VectorCopy (ent->v.mins, out->mins);
+	VectorCopy (ent->v.maxs, out->maxs);
+	out->size = ent->v.size[0];
+}
+
+/*
+===============
+SV_TraceLogEdicts
+
+Called by SV_ClipToLinks with what SV_AreaEdicts found
+===============
+*/
+void SV_TraceLogEdicts (edict_t **list, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++)
+		SV_TraceLogEdict (list[i], &tl_edicts[i + 1]);
+	tl_numedicts = count + 1;
+}
+
+void SV_TraceLogTrace (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, edict_t *passedict, trace_t *trace)
+{
+	tl_svtrace_t rec;
+
+	memset (&rec, 0, sizeof(rec));
+	VectorCopy (start, rec.start);
+	VectorCopy (mins, rec.mins);
+	VectorCopy (maxs, rec.maxs);
+	VectorCopy (end, rec.end);
+	rec.type = type;
+	if (passedict)
+		SV_TraceLogEdict (passedict, &rec.pass);
+	else
+		rec.pass.num = -1;
+	rec.numedicts = max (tl_numedicts, 1);
+	SV_TraceLogResult (trace, &rec.trace, trace->e.ent ? NUM_FOR_EDICT(trace->e.ent) : -1);
+
+	SV_TraceLogEdict (sv.edicts, &tl_edicts[0]);
+	SV_TraceLogWrite (TL_TRACE, &rec, sizeof(rec));
+	fwrite (tl_edicts, sizeof(tl_edicts[0]), rec.numedicts, tl_file);
+	tl_numedicts = 0;
+}
+
+static void SV_TraceLogMoveState (tl_movestate_t *s)
+{
+	memset (s, 0, sizeof(*s));
+	VectorCopy (pmove.origin, s->origin);
+	VectorCopy (pmove.angles, s->angles);
+	VectorCopy (pmove.velocity, s->velocity);
+	s->jump_held = pmove.jump_held;
+	s->jump_msec = pmove.jump_msec;
+	s->waterjumptime = pmove.waterjumptime;
+	s->onground = pmove.onground;
+	s->groundent = pmove.groundent;
+	s->waterlevel = pmove.waterlevel;
+	s->watertype = pmove.watertype;
+	s->numtouch = pmove.numtouch;
+	memcpy (s->touchindex, pmove.touchindex, pmove.numtouch * sizeof(int));
+}
+
+/*
+===============
+SV_TraceLogPlayerMove
+
+Runs PM_PlayerMove for SV_RunCmd and records it
+===============
+*/
+void SV_TraceLogPlayerMove (void)
+{
+	static tl_physent_t physents[MAX_PHYSENTS];
+	tl_playermove_t rec;
+	physent_t *pe;
+	int i;
+
+	memset (&rec, 0, sizeof(rec));
+	SV_TraceLogMoveState (&rec.in);
+	rec.pm_type = pmove.pm_type;
+	rec.cmd = pmove.cmd;
+	rec.movevars = movevars;
+	rec.numphysent = pmove.numphysent;
+
+	for (i = 0, pe = pmove.physents; i < pmove.numphysent; i++, pe++)
+	{
+		physents[i].model = SV_TraceLogModel (pe->model);
+		VectorCopy (pe->origin, physents[i].origin);
+		VectorCopy (pe->mins, physents[i].mins);
+		VectorCopy (pe->maxs, physents[i].maxs);
+		physents[i].info = pe->info;
+	}
+
+	PM_PlayerMove ();
+
+	SV_TraceLogMoveState (&rec.out);
+	SV_TraceLogWrite (TL_PLAYERMOVE, &rec, sizeof(rec));
+	fwrite (physents, sizeof(physents[0]), rec.numphysent, tl_file);
+}
+
+void SV_TraceLogStop (void)
+{
+	if (!sv_tracelogging)
+		return;
+
+	sv_tracelogging = false;
+	cm_tracelog = NULL;
+	fclose (tl_file);
+	tl_file = NULL;
+
+	Con_Printf ("Wrote %i hull traces, %i traces and %i player moves in %.1f s to %s\n",
+		tl_counts[TL_HULLTRACE], tl_counts[TL_TRACE], tl_counts[TL_PLAYERMOVE],
+		Sys_DoubleTime () - tl_starttime, tl_filename);
+}
+
+void SV_TraceLog_f (void)
+{
+	tracelog_header_t header;
+	char *cmd = Cmd_Argv (1);
+	static char buffer[TRACELOG_BUFFER];
+
+	if (!strcmp (cmd, "start"))
+	{
+		if (sv.state != ss_active)
+		{
+			Con_Printf ("sv_tracelog: no map running\n");
+			return;
+		}
+
+		SV_TraceLogStop ();
+
+		snprintf (tl_filename, sizeof(tl_filename), "%s/%s.trl", fs_gamedir, Cmd_Argc () > 2 ? Cmd_Argv (2) : "tracelog");
+		if (!(tl_file = fopen (tl_filename, "wb")))
+		{
+			Con_Printf ("Couldn't open %s\n", tl_filename);
+			return;
+		}
+		setvbuf (tl_file, buffer, _IOFBF, sizeof(buffer));
+
+		memset (&header, 0, sizeof(header));
+		header.id = TRACELOG_ID;
+		header.version = TRACELOG_VERSION;
+		strlcpy (header.mapname, sv.modelname, sizeof(header.mapname));
+		header.checksum = sv.map_checksum;
+		fwrite (&header, sizeof(header), 1, tl_file);
+
+		memset (tl_counts, 0, sizeof(tl_counts));
+		tl_numedicts = 0;
+		tl_starttime = Sys_DoubleTime ();
+		cm_tracelog = SV_TraceLogHull;
+		sv_tracelogging = true;
+		Con_Printf ("Recording traces to %s\n", tl_filename);
+	}
+	else if (!strcmp (cmd, "stop"))
+	{
+		if (!sv_tracelogging)
+			Con_Printf ("Not recording traces\n");
+		SV_TraceLogStop ();
+	}
+	else
+		Con_Printf ("usage: %s <start [name] | stop>\n", Cmd_Argv (0));
+}
@@ -3221,81 +3221,109 @@ USER CMD EXECUTION
 ===========================================================================
 */
 
+static vec3_t	pmove_mins, pmove_maxs;	// box around the player the physents come from
+static int		pmove_considered;
+
 /*
 ====================
-AddLinksToPmove
+AddPhysentToPmove
 
+Returns false once the physent list is full
 ====================
 */
-static void AddLinksToPmove ( areanode_t *node )
+static qbool AddPhysentToPmove (edict_t *check)
 {
-	link_t		*l, *next;
-	edict_t		*check;
-	int 		pl;
-	int 		i;
 	physent_t	*pe;
-	vec3_t		pmove_mins, pmove_maxs;
+	int 		i;
 
-	for (i=0 ; i<3 ; i++)
+	pmove_considered++;
+
+	if (check->v.owner == EDICT_TO_PROG(sv_player))
+		return true;		// player's own missile
+	if (check->v.solid == SOLID_BSP
+			|| check->v.solid == SOLID_BBOX
+			|| check->v.solid == SOLID_SLIDEBOX)
 	{
-		pmove_mins[i] = pmove.origin[i] - 256;
-		pmove_maxs[i] = pmove.origin[i] + 256;
+		if (check == sv_player)
+			return true;
+
+		for (i=0 ; i<3 ; i++)
+			if (check->v.absmin[i] > pmove_maxs[i]
+			|| check->v.absmax[i] < pmove_mins[i])
+				break;
+		if (i != 3)
+			return true;
+		if (pmove.numphysent == MAX_PHYSENTS)
+			return false;
+		pe = &pmove.physents[pmove.numphysent];
+		pmove.numphysent++;
+
+		VectorCopy (check->v.origin, pe->origin);
+		pe->info = NUM_FOR_EDICT(check);
+		if (check->v.solid == SOLID_BSP) {
+			if ((unsigned)check->v.modelindex >= MAX_MODELS)
+				SV_Error ("AddPhysentToPmove: check->v.modelindex >= MAX_MODELS");
+			pe->model = sv.models[(int)(check->v.modelindex)];
+			if (!pe->model)
+				SV_Error ("SOLID_BSP with a non-bsp model");
+		}
+		else
+		{
+			pe->model = NULL;
+			VectorCopy (check->v.mins, pe->mins);
+			VectorCopy (check->v.maxs, pe->maxs);
+		}
 	}
 
-	pl = EDICT_TO_PROG(sv_player);
+	return true;
+}
+
+/*
+====================
+AddLinksToPmove
+
+====================
+*/
+static qbool AddLinksToPmove ( areanode_t *node )
+{
+	link_t		*l, *next;
 
 	// touch linked edicts
 	for (l = node->solid_edicts.next ; l != &node->solid_edicts ; l = next)
 	{
 		next = l->next;
-		check = EDICT_FROM_AREA(l);
-
-		if (check->v.owner == pl)
-			continue;		// player's own missile
-		if (check->v.solid == SOLID_BSP
-				|| check->v.solid == SOLID_BBOX
-				|| check->v.solid == SOLID_SLIDEBOX)
-		{
-			if (check == sv_player)
-				continue;
-
-			for (i=0 ; i<3 ; i++)
-				if (check->v.absmin[i] > pmove_maxs[i]
-				|| check->v.absmax[i] < pmove_mins[i])
-					break;
-			if (i != 3)
-				continue;
-			if (pmove.numphysent == MAX_PHYSENTS)
-				return;
-			pe = &pmove.physents[pmove.numphysent];
-			pmove.numphysent++;
-
-			VectorCopy (check->v.origin, pe->origin);
-			pe->info = NUM_FOR_EDICT(check);
-			if (check->v.solid == SOLID_BSP) {
-				if ((unsigned)check->v.modelindex >= MAX_MODELS)
-					SV_Error ("AddLinksToPmove: check->v.modelindex >= MAX_MODELS");
-				pe->model = sv.models[(int)(check->v.modelindex)];
-				if (!pe->model)
-					SV_Error ("SOLID_BSP with a non-bsp model");
-			}
-			else
-			{
-				pe->model = NULL;
-				VectorCopy (check->v.mins, pe->mins);
-				VectorCopy (check->v.maxs, pe->maxs);
-			}
-		}
+		if (!AddPhysentToPmove (EDICT_FROM_AREA(l)))
+			return false;
 	}
 
 	// recurse down both sides
 	if (node->axis == -1)
-		return;
+		return true;
 
 	if ( pmove_maxs[node->axis] > node->dist )
-		AddLinksToPmove ( node->children[0] );
+		if (!AddLinksToPmove ( node->children[0] ))
+			return false;
 	if ( pmove_mins[node->axis] < node->dist )
-		AddLinksToPmove ( node->children[1] );
+		return AddLinksToPmove ( node->children[1] );
+	return true;
+}
+
+/*
+====================
+AddGridToPmove
+
+Same as AddLinksToPmove, with the edicts from the per frame physent grid
+====================
+*/
+static void AddGridToPmove (void)
+{
+	edict_t	*list[MAX_EDICTS];
+	int		i, count;
+
+	count = SV_PhysentEdicts (pmove_mins, pmove_maxs, list, MAX_EDICTS);
+	for (i = 0; i < count; i++)
+		if (!AddPhysentToPmove (list[i]))
+			break;
 }
 
 int SV_PMTypeForClient (client_t *cl)
@@ -3502,7 +3530,17 @@ FIXME
 	// build physent list
 	pmove.numphysent = 1;
 	pmove.physents[0].model = sv.worldmodel;
-	AddLinksToPmove ( sv_areanodes );
+	for (i=0 ; i<3 ; i++)
+	{
+		pmove_mins[i] = pmove.origin[i] - 256;
+		pmove_maxs[i] = pmove.origin[i] + 256;
+	}
+	pmove_considered = 0;
+	if (sv_physentgrid.value)
+		AddGridToPmove ();
+	else
+		AddLinksToPmove ( sv_areanodes );
+	SV_PhysentStats (pmove_considered, pmove.numphysent - 1);
 
 	// fill in movevars
 	movevars.entgravity = sv_client->entgravity;
@@ -3514,7 +3552,10 @@ FIXME
 	movevars.pground = ((int)pm_pground.value != 0);
 	
 	// do the move
-	PM_PlayerMove ();
+	if (sv_tracelogging)
+		SV_TraceLogPlayerMove ();
+	else
+		PM_PlayerMove ();
 
 	// get player state back out of pmove
 	sv_client->jump_held = pmove.jump_held;
@@ -31,74 +31,6 @@ line of sight checks trace->crosscontent, but bullets don't
 */
 
 
-typedef struct
-{
-	vec3_t		boxmins, boxmaxs;// enclose the test object along entire move
-	float		*mins, *maxs;	// size of the moving object
-	vec3_t		mins2, maxs2;	// size when clipping against mosnters
-	float		*start, *end;
-	trace_t		trace;
-	int			type;
-	edict_t		*passedict;
-} moveclip_t;
-
-
-/*
-================
-SV_HullForEntity
-
-Returns a hull that can be used for testing or clipping an object of mins/maxs
-size.
-Offset is filled in to contain the adjustment that must be added to the
-testing object's origin to get a point to use with the returned hull.
-================
-*/
-hull_t *SV_HullForEntity (edict_t *ent, vec3_t mins, vec3_t maxs, vec3_t offset)
-{
-	vec3_t size, hullmins, hullmaxs;
-	cmodel_t *model;
-	hull_t *hull;
-
-
-	// decide which clipping hull to use, based on the size
-	if (ent->v.solid == SOLID_BSP)
-	{	// explicit hulls in the BSP model
-		if (ent->v.movetype != MOVETYPE_PUSH)
-			SV_Error ("SOLID_BSP without MOVETYPE_PUSH");
-
-		if ((unsigned)ent->v.modelindex >= MAX_MODELS)
-			SV_Error ("SV_HullForEntity: ent.modelindex >= MAX_MODELS");
-
-		model = sv.models[(int)ent->v.modelindex];
-		if (!model)
-			SV_Error ("SOLID_BSP with a non-bsp model");
-
-		VectorSubtract (maxs, mins, size);
-		if (size[0] < 3)
-			hull = &model->hulls[0];
-		else if (size[0] <= 32)
-			hull = &model->hulls[1];
-		else
-			hull = &model->hulls[2];
-
-		// calculate an offset value to center the origin
-		VectorSubtract (hull->clip_mins, mins, offset);
-		VectorAdd (offset, ent->v.origin, offset);
-	}
-	else
-	{	// create a temp hull from bounding box sizes
-
-		VectorSubtract (ent->v.mins, maxs, hullmins);
-		VectorSubtract (ent->v.maxs, mins, hullmaxs);
-		hull = CM_HullForBox (hullmins, hullmaxs);
-		
-		VectorCopy (ent->v.origin, offset);
-	}
-
-
-	return hull;
-}
-
 /*
 ===============================================================================
 
@@ -140,6 +72,304 @@ void InsertLinkAfter (link_t *l, link_t *after)
 areanode_t sv_areanodes[AREA_NODES];
 int sv_numareanodes;
 
+// 0 - adaptive: split until nodes are about AREA_MIN_SIZE wide, 1..AREA_MAX_DEPTH - fixed depth
+cvar_t sv_areadepth = {"sv_areadepth", "0"};
+
+static int sv_areadepth_current;	// depth limit the tree was built with
+
+// broadphase counters, printed and reset by sv_areastats
+typedef struct
+{
+	unsigned int	queries;		// SV_AreaEdicts calls
+	unsigned int	traces;			// SV_Trace calls
+	double			nodes;			// areanodes visited
+	double			tested;			// edicts whose boxes were tested
+	double			candidates;		// edicts returned to the caller
+	double			trace_candidates;	// edicts handed to SV_ClipToLinks
+	unsigned int	moves;			// player moves in SV_RunCmd
+	double			considered;		// edicts looked at for their physents
+	double			physents;		// physents handed to pmove
+	unsigned int	frames;			// SV_Physics runs
+	unsigned int	leafs_found;	// SV_LinkToLeafs searching the bsp
+	unsigned int	leafs_kept;		// SV_LinkToLeafs keeping the last leafs
+	unsigned int	touches;		// trigger queries
+	double			touch_tested;	// triggers whose boxes were tested
+	double			touch_found;	// triggers returned to the caller
+} areastats_t;
+
+// one set per thread that may query the world, summed by sv_areastats
+#ifdef _MSC_VER
+#define AREASTATS_THREAD	__declspec(thread)
+#else
+#define AREASTATS_THREAD	__thread
+#endif
+
+static areastats_t sv_areastats[MAX_SEND_THREADS];
+static AREASTATS_THREAD int sv_areastats_thread;
+
+#define AREASTATS	sv_areastats[sv_areastats_thread]
+
+/*
+===============================================================================
+
+AREA GRIDS
+
+Walking the areanode tree is slow for the two most frequent queries:
+SV_RunCmd wants the solid edicts around every player move, SV_TouchLinks
+the triggers around everything linked with touch_triggers.  Each list can
+also be sorted into a flat grid, a query then only reads the cells around
+its box.  The solid grid is rebuilt once per frame, the trigger grid only
+after enough triggers have been linked or unlinked, as most never move.
+Edicts that changed since a build are flagged and always handed out, so a
+grid never has to be right about them.
+
+===============================================================================
+*/
+
+cvar_t sv_physentgrid = {"sv_physentgrid", "1"};
+cvar_t sv_triggergrid = {"sv_triggergrid", "1"};
+
+#define	AREAGRID_SIDE		64		// cells per side at most
+#define	AREAGRID_CELLSIZE	256		// smallest cell
+#define	AREAGRID_MAXCELLS	16		// edicts covering more are always checked
+#define	AREAGRID_MAXMOVED	64		// rebuild when this many have moved
+#define	AREAGRID_WORDS		((MAX_EDICTS + 31) / 32)
+
+typedef struct
+{
+	int				area;			// AREA_SOLID or AREA_TRIGGERS
+	qbool			valid;
+	double			time;			// sv.time it was built at
+	vec3_t			mins;
+	float			cellsize;
+	int				width, height;
+	int				cellstart[AREAGRID_SIDE * AREAGRID_SIDE + 1];
+	short			cells[MAX_EDICTS * AREAGRID_MAXCELLS];
+	unsigned int	members[AREAGRID_WORDS];	// in the list at build time
+	unsigned int	large[AREAGRID_WORDS];		// members too big for the cells
+	unsigned int	moved[AREAGRID_WORDS];		// linked or unlinked since the build
+	unsigned int	linked[AREAGRID_WORDS];		// moved and now in the list
+	int				nummoved;
+} areagrid_t;
+
+static areagrid_t	sv_areagrids[2];	// by AREA_SOLID / AREA_TRIGGERS
+
+// cells covered by the box, as x0 y0 x1 y1
+static void SV_AreaGridRect (areagrid_t *grid, vec3_t mins, vec3_t maxs, int *rect)
+{
+	int i;
+
+	for (i = 0; i < 2; i++)
+	{
+		rect[i] = (int) ((mins[i] - grid->mins[i]) / grid->cellsize);
+		rect[i + 2] = (int) ((maxs[i] - grid->mins[i]) / grid->cellsize);
+	}
+	rect[0] = bound (0, rect[0], grid->width - 1);
+	rect[2] = bound (0, rect[2], grid->width - 1);
+	rect[1] = bound (0, rect[1], grid->height - 1);
+	rect[3] = bound (0, rect[3], grid->height - 1);
+}
+
+static void SV_BuildAreaGrid (areagrid_t *grid)
+{
+	static short nums[MAX_EDICTS];
+	static int rects[MAX_EDICTS][4];
+	int i, x, y, count, numents, *rect;
+	link_t *l, *start;
+	vec3_t size;
+	edict_t *ent;
+
+	VectorCopy (sv.worldmodel->mins, grid->mins);
+	VectorSubtract (sv.worldmodel->maxs, sv.worldmodel->mins, size);
+	grid->cellsize = max (AREAGRID_CELLSIZE, max (size[0], size[1]) / AREAGRID_SIDE);
+	grid->width = bound (1, (int) ceil (size[0] / grid->cellsize), AREAGRID_SIDE);
+	grid->height = bound (1, (int) ceil (size[1] / grid->cellsize), AREAGRID_SIDE);
+
+	memset (grid->cellstart, 0, sizeof(grid->cellstart));
+	memset (grid->members, 0, sizeof(grid->members));
+	memset (grid->large, 0, sizeof(grid->large));
+	memset (grid->moved, 0, sizeof(grid->moved));
+	memset (grid->linked, 0, sizeof(grid->linked));
+	grid->nummoved = 0;
+
+	// count the edicts in each cell
+	numents = 0;
+	for (i = 0; i < sv_numareanodes; i++)
+	{
+		start = grid->area == AREA_SOLID ? &sv_areanodes[i].solid_edicts : &sv_areanodes[i].trigger_edicts;
+		for (l = start->next; l != start; l = l->next)
+		{
+			ent = EDICT_FROM_AREA(l);
+			nums[numents] = NUM_FOR_EDICT(ent);
+			grid->members[nums[numents] >> 5] |= 1u << (nums[numents] & 31);
+			rect = rects[numents];
+			SV_AreaGridRect (grid, ent->v.absmin, ent->v.absmax, rect);
+
+			if ((rect[2] - rect[0] + 1) * (rect[3] - rect[1] + 1) > AREAGRID_MAXCELLS)
+			{
+				grid->large[nums[numents] >> 5] |= 1u << (nums[numents] & 31);
+				continue;
+			}
+
+			for (y = rect[1]; y <= rect[3]; y++)
+				for (x = rect[0]; x <= rect[2]; x++)
+					grid->cellstart[y * grid->width + x + 1]++;
+			numents++;
+		}
+	}
+
+	for (i = 0, count = grid->width * grid->height; i < count; i++)
+		grid->cellstart[i + 1] += grid->cellstart[i];
+
+	// fill them, cellstart[cell] ends up where the next cell starts
+	for (i = 0; i < numents; i++)
+	{
+		rect = rects[i];
+		for (y = rect[1]; y <= rect[3]; y++)
+			for (x = rect[0]; x <= rect[2]; x++)
+				grid->cells[grid->cellstart[y * grid->width + x]++] = nums[i];
+	}
+	for (i = count; i > 0; i--)
+		grid->cellstart[i] = grid->cellstart[i - 1];
+	grid->cellstart[0] = 0;
+
+	grid->time = sv.time;
+	grid->valid = true;
+}
+
+// keeps the grids honest about edicts linked into area (-1 for none) after they were built
+static void SV_AreaGridMoved (edict_t *ent, int area)
+{
+	int i, num = ((byte *)ent - (byte *)sv.edicts) / pr_edict_size;
+	unsigned int bit = 1u << (num & 31);
+	areagrid_t *grid;
+
+	for (i = 0, grid = sv_areagrids; i < 2; i++, grid++)
+	{
+		if (!grid->valid)
+			continue;
+
+		if (!(grid->moved[num >> 5] & bit))
+		{
+			if (!(grid->members[num >> 5] & bit) && area != grid->area)
+				continue;	// never was in this list and still isn't
+			grid->moved[num >> 5] |= bit;
+			grid->nummoved++;
+		}
+
+		if (area == grid->area)
+			grid->linked[num >> 5] |= bit;
+		else
+			grid->linked[num >> 5] &= ~bit;
+	}
+}
+
+// returns, in edict order, the edicts in the grid's list that may touch the
+// box, the caller still has to check their boxes
+static int SV_AreaGridEdicts (areagrid_t *grid, vec3_t mins, vec3_t maxs, edict_t **edicts, int max_edicts)
+{
+	unsigned int found[AREAGRID_WORDS], word;
+	int i, j, x, y, cell, rect[4], count;
+
+	SV_AreaGridRect (grid, mins, maxs, rect);
+
+	memcpy (found, grid->large, sizeof(found));
+	for (y = rect[1]; y <= rect[3]; y++)
+	{
+		for (x = rect[0]; x <= rect[2]; x++)
+		{
+			cell = y * grid->width + x;
+			for (i = grid->cellstart[cell]; i < grid->cellstart[cell + 1]; i++)
+				found[grid->cells[i] >> 5] |= 1u << (grid->cells[i] & 31);
+		}
+	}
+
+	count = 0;
+	for (i = 0; i < AREAGRID_WORDS; i++)
+	{
+		// moved edicts are wherever they are now
+		word = (found[i] & ~grid->moved[i]) | grid->linked[i];
+		for (j = 0; word; j++, word >>= 1)
+		{
+			if (!(word & 1))
+				continue;
+			if (count == max_edicts)
+			{
+				Con_DPrintf ("SV_AreaGridEdicts: more than %i edicts in the box\n", max_edicts);
+				return count;
+			}
+			edicts[count++] = EDICT_NUM(i * 32 + j);
+		}
+	}
+
+	return count;
+}
+
+/*
+====================
+SV_PhysentEdicts
+====================
+*/
+int SV_PhysentEdicts (vec3_t mins, vec3_t maxs, edict_t **edicts, int max_edicts)
+{
+	areagrid_t *grid = &sv_areagrids[AREA_SOLID];
+
+	if (!grid->valid || grid->time != sv.time || grid->nummoved > AREAGRID_MAXMOVED)
+		SV_BuildAreaGrid (grid);
+
+	return SV_AreaGridEdicts (grid, mins, maxs, edicts, max_edicts);
+}
+
+// SV_AreaEdicts for triggers
+static int SV_TriggerEdicts (vec3_t mins, vec3_t maxs, edict_t **edicts, int max_edicts)
+{
+	areagrid_t *grid = &sv_areagrids[AREA_TRIGGERS];
+	int i, count, found;
+	edict_t *touch;
+
+	if (!grid->valid || grid->nummoved > AREAGRID_MAXMOVED)
+		SV_BuildAreaGrid (grid);
+
+	count = SV_AreaGridEdicts (grid, mins, maxs, edicts, max_edicts);
+	for (i = found = 0; i < count; i++)
+	{
+		touch = edicts[i];
+		if (touch->v.solid == SOLID_NOT)
+			continue;
+		if (mins[0] > touch->v.absmax[0]
+					 || mins[1] > touch->v.absmax[1]
+					 || mins[2] > touch->v.absmax[2]
+					 || maxs[0] < touch->v.absmin[0]
+					 || maxs[1] < touch->v.absmin[1]
+					 || maxs[2] < touch->v.absmin[2])
+			continue;
+		edicts[found++] = touch;
+	}
+
+	AREASTATS.touches++;
+	AREASTATS.touch_tested += count;
+	AREASTATS.touch_found += found;
+
+	return found;
+}
+
+void SV_AreaStatsThread (int thread)
+{
+	sv_areastats_thread = bound (0, thread, MAX_SEND_THREADS - 1);
+}
+
+void SV_AreaStatsFrame (void)
+{
+	AREASTATS.frames++;
+}
+
+void SV_PhysentStats (int considered, int added)
+{
+	AREASTATS.moves++;
+	AREASTATS.considered += considered;
+	AREASTATS.physents += added;
+}
+
 /*
 ===============
 SV_CreateAreaNode
@@ -157,14 +387,16 @@ areanode_t *SV_CreateAreaNode (int depth, vec3_t mins, vec3_t maxs)
 	ClearLink (&anode->trigger_edicts);
 	ClearLink (&anode->solid_edicts);
 
-	if (depth == AREA_DEPTH)
+	VectorSubtract (maxs, mins, size);
+
+	if (depth == sv_areadepth_current
+		|| (!sv_areadepth.value && max(size[0], size[1]) < 2 * AREA_MIN_SIZE))
 	{
 		anode->axis = -1;
 		anode->children[0] = anode->children[1] = NULL;
 		return anode;
 	}
 
-	VectorSubtract (maxs, mins, size);
 	if (size[0] > size[1])
 		anode->axis = 0;
 	else
@@ -191,11 +423,75 @@ SV_ClearWorld
 */
 void SV_ClearWorld (void)
 {
+	if (sv_areadepth.value)
+		sv_areadepth_current = bound (1, (int)sv_areadepth.value, AREA_MAX_DEPTH);
+	else
+		sv_areadepth_current = AREA_MAX_DEPTH;
+
 	memset (sv_areanodes, 0, sizeof(sv_areanodes));
+	memset (&sv_areastats, 0, sizeof(sv_areastats));
 	sv_numareanodes = 0;
+	sv_areagrids[AREA_SOLID].valid = sv_areagrids[AREA_TRIGGERS].valid = false;
+	sv_areagrids[AREA_SOLID].area = AREA_SOLID;
+	sv_areagrids[AREA_TRIGGERS].area = AREA_TRIGGERS;
 	SV_CreateAreaNode (0, sv.worldmodel->mins, sv.worldmodel->maxs);
 }
 
+/*
+===============
+SV_AreaStats_f
+===============
+*/
+void SV_AreaStats_f (void)
+{
+	areastats_t st;
+	unsigned int queries, traces, moves, frames, touches;
+	int i;
+
+	memset (&st, 0, sizeof(st));
+	for (i = 0; i < MAX_SEND_THREADS; i++)
+	{
+		st.queries += sv_areastats[i].queries;
+		st.traces += sv_areastats[i].traces;
+		st.nodes += sv_areastats[i].nodes;
+		st.tested += sv_areastats[i].tested;
+		st.candidates += sv_areastats[i].candidates;
+		st.trace_candidates += sv_areastats[i].trace_candidates;
+		st.moves += sv_areastats[i].moves;
+		st.considered += sv_areastats[i].considered;
+		st.physents += sv_areastats[i].physents;
+		st.frames += sv_areastats[i].frames;
+		st.leafs_found += sv_areastats[i].leafs_found;
+		st.leafs_kept += sv_areastats[i].leafs_kept;
+		st.touches += sv_areastats[i].touches;
+		st.touch_tested += sv_areastats[i].touch_tested;
+		st.touch_found += sv_areastats[i].touch_found;
+	}
+
+	queries = max(st.queries, 1);
+	traces = max(st.traces, 1);
+	moves = max(st.moves, 1);
+	frames = max(st.frames, 1);
+	touches = max(st.touches, 1);
+
+	Con_Printf ("areanodes: %i, depth limit %i (%s)\n", sv_numareanodes, sv_areadepth_current,
+				sv_areadepth.value ? "fixed" : "adaptive");
+	Con_Printf ("queries  : %u, avg nodes %.1f, avg tested %.1f, avg found %.1f\n", st.queries,
+				st.nodes / queries, st.tested / queries, st.candidates / queries);
+	Con_Printf ("traces   : %u, avg candidates per trace %.1f\n", st.traces,
+				st.trace_candidates / traces);
+	Con_Printf ("relinks  : %.1f leaf searches, %.1f kept per frame (%u frames)\n",
+				st.leafs_found / (double) frames, st.leafs_kept / (double) frames, st.frames);
+	Con_Printf ("touches  : %u, avg tested %.1f, avg found %.1f (%s)\n", st.touches,
+				st.touch_tested / touches, st.touch_found / touches,
+				sv_triggergrid.value ? "grid" : "areanodes");
+	Con_Printf ("moves    : %u, avg considered %.1f, avg physents %.1f (%s)\n", st.moves,
+				st.considered / moves, st.physents / moves,
+				sv_physentgrid.value ? "grid" : "areanodes");
+
+	memset (&sv_areastats, 0, sizeof(sv_areastats));
+}
+
 
 /*
 ===============
@@ -207,6 +503,7 @@ void SV_UnlinkEdict (edict_t *ent)
 	if (!ent->e->area.prev)
 		return;		// not linked in anywhere
 	RemoveLink (&ent->e->area);
+	SV_AreaGridMoved (ent, -1);
 	ent->e->area.prev = ent->e->area.next = NULL;
 }
 
@@ -221,6 +518,10 @@ int SV_AreaEdicts (vec3_t mins, vec3_t maxs, edict_t **edicts, int max_edicts, i
 	edict_t		*touch;
 	int			stackdepth = 0, count = 0;
 	areanode_t	*localstack[AREA_NODES], *node = sv_areanodes;
+	int			nodes = 0, tested = 0;
+
+	if (area == AREA_TRIGGERS && sv_triggergrid.value)
+		return SV_TriggerEdicts (mins, maxs, edicts, max_edicts);
 
 // touch linked edicts
 	while (1)
@@ -230,8 +531,11 @@ int SV_AreaEdicts (vec3_t mins, vec3_t maxs, edict_t **edicts, int max_edicts, i
 		else
 			start = &node->trigger_edicts;
 
+		nodes++;
+
 		for (l = start->next ; l != start ; l = l->next)
 		{
+			tested++;
 			touch = EDICT_FROM_AREA(l);
 			if (touch->v.solid == SOLID_NOT)
 				continue;
@@ -244,7 +548,10 @@ int SV_AreaEdicts (vec3_t mins, vec3_t maxs, edict_t **edicts, int max_edicts, i
 				continue;
 
 			if (count == max_edicts)
-				return count;
+			{
+				Con_DPrintf ("SV_AreaEdicts: more than %i edicts in the box\n", max_edicts);
+				goto done;
+			}
 			edicts[count++] = touch;
 		}
 
@@ -271,10 +578,22 @@ int SV_AreaEdicts (vec3_t mins, vec3_t maxs, edict_t **edicts, int max_edicts, i
 
 checkstack:
 		if (!stackdepth)
-		return count;
+			break;
 		node = localstack[--stackdepth];
 	}
 
+done:
+	AREASTATS.queries++;
+	AREASTATS.nodes += nodes;
+	AREASTATS.tested += tested;
+	AREASTATS.candidates += count;
+	if (area == AREA_TRIGGERS)
+	{
+		AREASTATS.touches++;
+		AREASTATS.touch_tested += tested;
+		AREASTATS.touch_found += count;
+	}
+
 	return count;
 }
 
@@ -326,13 +645,93 @@ SV_LinkToLeafs
 void SV_LinkToLeafs (edict_t *ent)
 {
 	int	i, leafnums[MAX_ENT_LEAFS];
+	float d, dist;
 
-	ent->e->num_leafs = CM_FindTouchedLeafs (ent->v.absmin, ent->v.absmax, leafnums,
-					      MAX_ENT_LEAFS, 0, NULL);
+	// the leafs are the same if no corner of the box crossed a plane
+	// the last search decided on
+	if (ent->e->leafmargin > 0)
+	{
+		dist = 0;
+		for (i = 0; i < 3; i++)
+		{
+			d = max (fabs (ent->v.absmin[i] - ent->e->leafmins[i]), fabs (ent->v.absmax[i] - ent->e->leafmaxs[i]));
+			dist += d * d;
+		}
+		if (dist < ent->e->leafmargin * ent->e->leafmargin)
+		{
+			AREASTATS.leafs_kept++;
+			return;
+		}
+	}
+
+	ent->e->num_leafs = CM_FindTouchedLeafsMargin (ent->v.absmin, ent->v.absmax, leafnums,
+					      MAX_ENT_LEAFS, 0, &ent->e->leafmargin);
 	for (i = 0; i < ent->e->num_leafs; i++) {
 		// ent->e->leafnums are real leafnum minus one (for pvs checks)
 		ent->e->leafnums[i] = leafnums[i] - 1;
 	}
+	VectorCopy (ent->v.absmin, ent->e->leafmins);
+	VectorCopy (ent->v.absmax, ent->e->leafmaxs);
+	AREASTATS.leafs_found++;
+
+	SV_PackLeafWords (ent);
+}
+
+/*
+====================
+SV_PackLeafWords
+
+Groups the edict's leafnums by the 32 bit word of a pvs row they fall in, so
+visibility can be tested a word at a time. The masks are built byte by byte
+to match the byte order of the pvs data.
+====================
+*/
+void SV_PackLeafWords (edict_t *ent)
+{
+	int i, j, leaf, word;
+	unsigned int mask;
+
+	ent->e->num_leafwords = 0;
+
+	for (i = 0; i < ent->e->num_leafs; i++)
+	{
+		leaf = ent->e->leafnums[i];
+		word = leaf >> 5;
+		mask = 0;
+		((byte *)&mask)[(leaf >> 3) & 3] = 1 << (leaf & 7);
+
+		for (j = 0; j < ent->e->num_leafwords; j++)
+			if (ent->e->leafwords[j] == word)
+				break;
+
+		if (j == ent->e->num_leafwords)
+		{
+			ent->e->leafwords[j] = word;
+			ent->e->leafmasks[j] = 0;
+			ent->e->num_leafwords++;
+		}
+		ent->e->leafmasks[j] |= mask;
+	}
+}
+
+/*
+====================
+SV_EdictInPVS
+
+pvs must be 4 byte aligned, which holds for CM_LeafPVS/CM_LeafPHS rows
+and the SV_ClientFatPVS buffers.
+====================
+*/
+qbool SV_EdictInPVS (edict_t *ent, const byte *pvs)
+{
+	const unsigned int *words = (const unsigned int *) pvs;
+	int i;
+
+	for (i = 0; i < ent->e->num_leafwords; i++)
+		if (words[ent->e->leafwords[i]] & ent->e->leafmasks[i])
+			return true;
+
+	return false;
 }
 
 
@@ -385,7 +784,10 @@ void SV_LinkEdict (edict_t *ent, qbool touch_triggers)
 	if (ent->v.modelindex)
 		SV_LinkToLeafs (ent);
 	else
-		ent->e->num_leafs = 0;
+	{
+		ent->e->num_leafs = ent->e->num_leafwords = 0;
+		ent->e->leafmargin = 0;
+	}
 
 	if (ent->v.solid == SOLID_NOT)
 		return;
@@ -407,9 +809,15 @@ void SV_LinkEdict (edict_t *ent, qbool touch_triggers)
 // link it in	
 
 	if (ent->v.solid == SOLID_TRIGGER)
+	{
 		InsertLinkBefore (&ent->e->area, &node->trigger_edicts);
+		SV_AreaGridMoved (ent, AREA_TRIGGERS);
+	}
 	else
+	{
 		InsertLinkBefore (&ent->e->area, &node->solid_edicts);
+		SV_AreaGridMoved (ent, AREA_SOLID);
+	}
 	
 // if touch_triggers, touch all entities at this node and decend for more
 	if (touch_triggers)
@@ -463,40 +871,6 @@ edict_t	*SV_TestEntityPosition (edict_t *ent)
 	return NULL;
 }
 
-/*
-==================
-SV_ClipMoveToEntity
-
-Handles selection or creation of a clipping hull, and offseting (and
-eventually rotation) of the end points
-==================
-*/
-trace_t SV_ClipMoveToEntity (edict_t *ent, vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end)
-{
-	trace_t		trace;
-	vec3_t		offset;
-	vec3_t		start_l, end_l;
-	hull_t		*hull;
-
-// get the clipping hull
-	hull = SV_HullForEntity (ent, mins, maxs, offset);
-
-	VectorSubtract (start, offset, start_l);
-	VectorSubtract (end, offset, end_l);
-
-// trace a line through the apropriate clipping hull
-	trace = CM_HullTrace (hull, start_l, end_l);
-
-// fix trace up by the offset
-	VectorAdd (trace.endpos, offset, trace.endpos);
-
-// did we clip the move?
-	if (trace.fraction < 1 || trace.startsolid )
-		trace.e.ent = ent;
-
-	return trace;
-}
-
 //===========================================================================
 
 /*
@@ -508,57 +882,18 @@ Mins and maxs enclose the entire area swept by the move
 */
 void SV_ClipToLinks ( areanode_t *node, moveclip_t *clip )
 {
-	int			i, numtouch;
-	edict_t		*touchlist[MAX_EDICTS], *touch;
-	trace_t		trace;
+	int			numtouch;
+	edict_t		*touchlist[MAX_EDICTS];
 
 	numtouch = SV_AreaEdicts (clip->boxmins, clip->boxmaxs, touchlist, MAX_EDICTS, AREA_SOLID);
 
-// touch linked edicts
-	for (i = 0; i < numtouch; i++)
-	{
-		touch = touchlist[i];
-		if (touch == clip->passedict)
-			continue;
-		if (touch->v.solid == SOLID_TRIGGER)
-			SV_Error ("Trigger in clipping list");
+	AREASTATS.traces++;
+	AREASTATS.trace_candidates += numtouch;
 
-		if (clip->type == MOVE_NOMONSTERS && touch->v.solid != SOLID_BSP)
-			continue;
-
-		if (clip->passedict && clip->passedict->v.size[0] && !touch->v.size[0])
-			continue;	// points never interact
-
-	// might intersect, so do an exact clip
-		if (clip->trace.allsolid)
-			return;
-		if (clip->passedict)
-		{
-			if (PROG_TO_EDICT(touch->v.owner) == clip->passedict)
-				continue;	// don't clip against own missiles
-			if (PROG_TO_EDICT(clip->passedict->v.owner) == touch)
-				continue;	// don't clip against owner
-		}
+	if (sv_tracelogging)
+		SV_TraceLogEdicts (touchlist, numtouch);
 
-		if ((int)touch->v.flags & FL_MONSTER)
-			trace = SV_ClipMoveToEntity (touch, clip->start, clip->mins2, clip->maxs2, clip->end);
-		else
-			trace = SV_ClipMoveToEntity (touch, clip->start, clip->mins, clip->maxs, clip->end);
-		if (trace.allsolid || trace.startsolid ||
-				  trace.fraction < clip->trace.fraction)
-		{
-			trace.e.ent = touch;
-			if (clip->trace.startsolid)
-			{
-				clip->trace = trace;
-				clip->trace.startsolid = true;
-			}
-			else
-				clip->trace = trace;
-		}
-		else if (trace.startsolid)
-			clip->trace.startsolid = true;
-	}
+	SV_ClipToEdicts (clip, touchlist, numtouch);
 }
 
 
@@ -600,40 +935,99 @@ SV_Trace
 trace_t SV_Trace (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, edict_t *passedict)
 {
 	moveclip_t	clip;
-	int			i;
 
-	memset ( &clip, 0, sizeof ( moveclip_t ) );
+	SV_InitMoveClip (&clip, start, mins, maxs, end, type, passedict);
+
+	// create the bounding box of the entire move
+	SV_MoveBounds ( start, clip.mins2, clip.maxs2, end, clip.boxmins, clip.boxmaxs );
+
+	// clip to entities
+	SV_ClipToLinks ( sv_areanodes, &clip );
+
+	if (sv_tracelogging)
+		SV_TraceLogTrace (start, mins, maxs, end, type, passedict, &clip.trace);
 
-	// clip to world
-	clip.trace = SV_ClipMoveToEntity ( sv.edicts, start, mins, maxs, end );
+	return clip.trace;
+}
 
-	clip.start = start;
-	clip.end = end;
-	clip.mins = mins;
-	clip.maxs = maxs;
-	clip.type = type;
-	clip.passedict = passedict;
 
-	if (type == MOVE_MISSILE)
+/*
+====================
+SV_TraceBench_f
+
+Traces random short moves around the entities of the map through the
+world hulls, with the packed hulls and with the original code, and
+reports the time taken and any trace that came out different
+====================
+*/
+void SV_TraceBench_f (void)
+{
+	vec3_t *starts, *ends;
+	edict_t *near;
+	trace_t a, b;
+	double t, time[2];
+	int i, j, count, diffs, hits, contents;
+	hull_t *hull;
+
+	if (sv.state != ss_active || sv.num_edicts <= MAX_CLIENTS + 1)
 	{
-		for (i=0 ; i<3 ; i++)
+		Con_Printf ("sv_tracebench: no map running\n");
+		return;
+	}
+
+	count = Cmd_Argc () > 1 ? bound (1, Q_atoi (Cmd_Argv (1)), 1000000) : 100000;
+	starts = Q_malloc (count * sizeof(vec3_t));
+	ends = Q_malloc (count * sizeof(vec3_t));
+
+	for (i = 0; i < count; i++)
+	{
+		do
+			near = EDICT_NUM(MAX_CLIENTS + 1 + rand () % (sv.num_edicts - MAX_CLIENTS - 1));
+		while (near->e->free);
+
+		for (j = 0; j < 3; j++)
 		{
-			clip.mins2[i] = -15;
-			clip.maxs2[i] = 15;
+			starts[i][j] = near->v.origin[j] + (rand () % 257) - 128;
+			ends[i][j] = starts[i][j] + (rand () % 513) - 256;
 		}
 	}
-	else
+
+	// same results
+	diffs = hits = 0;
+	for (i = 0; i < count; i++)
 	{
-		VectorCopy (mins, clip.mins2);
-		VectorCopy (maxs, clip.maxs2);
+		hull = &sv.worldmodel->hulls[i % 3];
+
+		CM_UsePackedHulls (false);
+		a = CM_HullTrace (hull, starts[i], ends[i]);
+		contents = CM_HullPointContents (hull, hull->firstclipnode, ends[i]);
+		CM_UsePackedHulls (true);
+		b = CM_HullTrace (hull, starts[i], ends[i]);
+
+		if (memcmp (&a, &b, sizeof(a)) || contents != CM_HullPointContents (hull, hull->firstclipnode, ends[i]))
+		{
+			if (diffs++ < 5)
+				Con_Printf ("trace %i differs: %f %f %f -> %f %f %f hull %i\n", i,
+					starts[i][0], starts[i][1], starts[i][2], ends[i][0], ends[i][1], ends[i][2], i % 3);
+		}
+		if (a.fraction < 1)
+			hits++;
 	}
 
-	// create the bounding box of the entire move
-	SV_MoveBounds ( start, clip.mins2, clip.maxs2, end, clip.boxmins, clip.boxmaxs );
+	// and the time they take
+	for (j = 0; j < 2; j++)
+	{
+		CM_UsePackedHulls (j);
+		t = Sys_DoubleTime ();
+		for (i = 0; i < count; i++)
+			CM_HullTrace (&sv.worldmodel->hulls[i % 3], starts[i], ends[i]);
+		time[j] = Sys_DoubleTime () - t;
+	}
+	CM_UsePackedHulls (true);
 
-	// clip to entities
-	SV_ClipToLinks ( sv_areanodes, &clip );
+	Con_Printf ("%i traces, %i hit something, %i differ\n", count, hits, diffs);
+	Con_Printf ("original %.1f ns, packed %.1f ns per trace\n", time[0] * 1e9 / count, time[1] * 1e9 / count);
 
-	return clip.trace;
+	Q_free (starts);
+	Q_free (ends);
 }
-
@@ -35,13 +35,36 @@ typedef struct areanode_s
 	link_t	solid_edicts;
 } areanode_t;
 
+typedef struct
+{
+	vec3_t		boxmins, boxmaxs;// enclose the test object along entire move
+	float		*mins, *maxs;	// size of the moving object
+	vec3_t		mins2, maxs2;	// size when clipping against mosnters
+	float		*start, *end;
+	trace_t		trace;
+	int			type;
+	edict_t		*passedict;
+} moveclip_t;
+
 #define AREA_SOLID	0
 #define AREA_TRIGGERS	1
 
-#define	AREA_DEPTH	4
-#define	AREA_NODES	32
+#define	AREA_MAX_DEPTH	8	// deepest tree sv_areadepth may ask for
+#define	AREA_NODES		(1 << (AREA_MAX_DEPTH + 1))
+#define	AREA_MIN_SIZE	512	// adaptive tree stops splitting nodes smaller than this
 
 extern	areanode_t	sv_areanodes[AREA_NODES];
+extern	int			sv_numareanodes;
+extern	cvar_t		sv_areadepth;
+
+extern	cvar_t		sv_physentgrid;
+extern	cvar_t		sv_triggergrid;
+
+void SV_AreaStats_f (void);
+// prints how many nodes and edicts the broadphase has tested per query
+
+void SV_TraceBench_f (void);
+// compares and times world traces with and without the packed hulls
 
 
 void SV_ClearWorld (void);
@@ -58,6 +81,12 @@ void SV_LinkEdict (edict_t *ent, qbool touch_triggers);
 // sets ent->v.absmin and ent->v.absmax
 // if touchtriggers, calls prog functions for the intersected triggers
 
+void SV_PackLeafWords (edict_t *ent);
+// rebuilds the word grouped copy of ent->e->leafnums
+
+qbool SV_EdictInPVS (edict_t *ent, const byte *pvs);
+// true if any leaf the entity touches is set in the word aligned pvs
+
 int SV_PointContents (vec3_t p);
 // returns the CONTENTS_* value from the world at the given point.
 // does not check any entities at all
@@ -77,6 +106,34 @@ trace_t SV_Trace (vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type,
 
 // passedict is explicitly excluded from clipping checks (normally NULL)
 
+// sv_clip.c, also linked into tracereplay
+
+hull_t *SV_HullForEntity (edict_t *ent, vec3_t mins, vec3_t maxs, vec3_t offset);
+// the hull to clip an object of mins/maxs size against ent with,
+// offset is what to subtract from the object's origin to use it
+
+trace_t SV_ClipMoveToEntity (edict_t *ent, vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end);
+// the move clipped to a single edict, trace.e.ent is set if it hit
+
+void SV_InitMoveClip (moveclip_t *clip, vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end, int type, edict_t *passedict);
+// fills in clip for SV_Trace and clips the move to the world
+
+void SV_ClipToEdicts (moveclip_t *clip, edict_t **list, int count);
+// clips the move to the edicts in list, the way SV_Trace does with those
+// SV_AreaEdicts finds
+
 int SV_AreaEdicts (vec3_t mins, vec3_t maxs, edict_t **edicts, int max_edicts, int area);
 
+int SV_PhysentEdicts (vec3_t mins, vec3_t maxs, edict_t **edicts, int max_edicts);
+// edicts in a solid list that may touch the box, in edict order, from a grid built once a frame
+
+void SV_PhysentStats (int considered, int added);
+// counts the physents of a player move for sv_areastats
+
+void SV_AreaStatsFrame (void);
+// counts a server frame for the per frame numbers of sv_areastats
+
+void SV_AreaStatsThread (int thread);
+// counters of the calling thread go to slot thread, 0 (the default) is the main thread
+
 #endif /* !__WORLD_H__ */
@@ -115,6 +115,7 @@ typedef HANDLE sem_t;
 #endif
 int Sys_SemInit(sem_t *sem, int value, int max_value);
 int Sys_SemWait(sem_t *sem);
+int Sys_SemTryWait(sem_t *sem);	// -1 instead of waiting
 int Sys_SemPost(sem_t *sem);
 int Sys_SemDestroy(sem_t *sem);
 
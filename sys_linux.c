@@ -744,6 +744,11 @@ int Sys_SemWait(sem_t *sem)
 	return sem_wait(sem);
 }
 
+int Sys_SemTryWait(sem_t *sem)
+{
+	return sem_trywait(sem);
+}
+
 int Sys_SemPost(sem_t *sem)
 {
 	return sem_post(sem);
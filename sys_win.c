@@ -1361,6 +1361,13 @@ int Sys_SemWait(sem_t *sem)
 	return 0;
 }
 
+int Sys_SemTryWait(sem_t *sem)
+{
+	if (WaitForSingleObject(*sem, 0) != WAIT_OBJECT_0)
+		return -1;
+	return 0;
+}
+
 int Sys_SemPost(sem_t *sem)
 {
 	if (ReleaseSemaphore(*sem, 1, NULL))
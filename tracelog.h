@@ -0,0 +1,113 @@
+/*
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the included (GNU.txt) GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+// tracelog.h - file format of sv_tracelog, read by tracereplay
+
+/*
+A tracelog_header_t and then records, each an int record type and its
+struct, in the byte order and layout of the machine that wrote them.
+SV_Trace and PM_PlayerMove records are followed by their edicts and
+physents.  The CM_HullTrace calls made inside an SV_Trace or a
+PM_PlayerMove come before it in the file.
+*/
+
+#ifndef __TRACELOG_H__
+#define __TRACELOG_H__
+
+#define TRACELOG_ID			(('L'<<24)+('R'<<16)+('T'<<8)+'Q')	// "QTRL"
+#define TRACELOG_VERSION	1
+
+typedef struct
+{
+	int			id, version;
+	char		mapname[MAX_QPATH];
+	unsigned	checksum;			// of the map as CM_LoadMap returns it
+} tracelog_header_t;
+
+enum {
+	TL_HULLTRACE = 1,
+	TL_TRACE,
+	TL_PLAYERMOVE
+};
+
+typedef struct
+{
+	int			allsolid, startsolid, inopen, inwater;
+	float		fraction;
+	vec3_t		endpos;
+	vec3_t		normal;
+	float		dist;
+	int			ent;				// edict number for SV_Trace, -1 for none
+} tl_trace_t;
+
+typedef struct
+{
+	int			model, hull;		// see CM_HullNumber, model -1 is the box hull
+	vec3_t		mins, maxs;			// of the box hull
+	vec3_t		start, end;
+	tl_trace_t	trace;
+} tl_hulltrace_t;
+
+// what SV_HullForEntity and SV_ClipToEdicts look at
+typedef struct
+{
+	int			num;
+	int			solid, flags;
+	int			owner;				// edict number
+	int			model;				// map model number for SOLID_BSP
+	vec3_t		origin, mins, maxs;
+	float		size;				// size[0]
+} tl_edict_t;
+
+typedef struct
+{
+	vec3_t		start, mins, maxs, end;
+	int			type;
+	tl_edict_t	pass;				// num is -1 without a passedict
+	int			numedicts;			// the world and then what SV_AreaEdicts found
+	tl_trace_t	trace;
+} tl_svtrace_t;
+
+typedef struct
+{
+	int			model;				// -1 for a box
+	vec3_t		origin, mins, maxs;
+	int			info;
+} tl_physent_t;
+
+// the parts of playermove_t that PM_PlayerMove reads or writes
+typedef struct
+{
+	vec3_t		origin, angles, velocity;
+	int			jump_held, jump_msec;
+	float		waterjumptime;
+	int			onground, groundent;
+	int			waterlevel, watertype;
+	int			numtouch, touchindex[MAX_PHYSENTS];
+} tl_movestate_t;
+
+typedef struct
+{
+	tl_movestate_t	in;
+	int			pm_type;
+	usercmd_t	cmd;
+	movevars_t	movevars;
+	int			numphysent;
+	tl_movestate_t	out;
+} tl_playermove_t;
+
+#endif /* !__TRACELOG_H__ */
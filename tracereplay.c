@@ -0,0 +1,636 @@
+/*
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the included (GNU.txt) GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+*/
+
+// tracereplay.c - runs the traces recorded by sv_tracelog again
+
+/*
+tracereplay <file.trl> <map.bsp> [passes]
+
+A standalone program (make tracereplay) built from the collision code of
+the engine, cmodel.c, sv_clip.c, pmove.c and pmovetst.c, with the little
+else they need stubbed out below.  It loads the map the log was recorded on, runs
+every recorded CM_HullTrace, SV_Trace and PM_PlayerMove once and compares
+the results with the recorded ones bit for bit, then runs each kind
+passes times (5 by default) and prints how many calls a second they take.
+
+SV_Trace is run by filling in the recorded edicts and handing them to
+SV_InitMoveClip and SV_ClipToEdicts of sv_clip.c, which SV_Trace calls
+on the server with what SV_AreaEdicts found.
+
+Exits with 1 if any result came out different.
+*/
+
+#include "qwsvdef.h"
+#include "tracelog.h"
+
+#define TR_MAXREPORTS	10		// differences printed of each kind
+
+typedef struct
+{
+	tl_hulltrace_t	*rec;
+} tr_hulltrace_t;
+
+typedef struct
+{
+	tl_svtrace_t	*rec;
+	tl_edict_t		*edicts;
+} tr_trace_t;
+
+typedef struct
+{
+	tl_playermove_t	*rec;
+	tl_physent_t	*physents;
+} tr_playermove_t;
+
+static cmodel_t			*tr_models[MAX_MAP_MODELS];
+static int				tr_nummodels;
+
+static edict_t			tr_edicts[MAX_EDICTS];	// sv.edicts, filled in by TR_Edict
+
+static tr_hulltrace_t	*tr_hulltraces;
+static tr_trace_t		*tr_traces;
+static tr_playermove_t	*tr_moves;
+static int				tr_numhulltraces, tr_numtraces, tr_nummoves;
+
+/*
+===============================================================================
+
+ENGINE STUBS
+
+===============================================================================
+*/
+
+cvar_t	sv_halflifebsp = {"halflifebsp", "0"};
+
+server_t	sv;
+
+void Sys_Error (char *error, ...)
+{
+	va_list argptr;
+
+	va_start (argptr, error);
+	vfprintf (stderr, error, argptr);
+	va_end (argptr);
+	fputc ('\n', stderr);
+	exit (2);
+}
+
+void SV_Error (char *error, ...)
+{
+	char text[1024];
+	va_list argptr;
+
+	va_start (argptr, error);
+	vsnprintf (text, sizeof(text), error, argptr);
+	va_end (argptr);
+	Sys_Error ("%s", text);
+}
+
+void Host_Error (char *error, ...)
+{
+	char text[1024];
+	va_list argptr;
+
+	va_start (argptr, error);
+	vsnprintf (text, sizeof(text), error, argptr);
+	va_end (argptr);
+	Sys_Error ("%s", text);
+}
+
+void Sys_Printf (char *fmt, ...)
+{
+	va_list argptr;
+
+	va_start (argptr, fmt);
+	vprintf (fmt, argptr);
+	va_end (argptr);
+}
+
+void Cvar_ForceSet (cvar_t *var, char *value)
+{
+}
+
+void COM_FileBase (const char *in, char *out)
+{
+	const char *s = strrchr (in, '/') ? strrchr (in, '/') + 1 : in;
+	int i;
+
+	for (i = 0; s[i] && s[i] != '.' && i < 31; i++)
+		out[i] = s[i];
+	out[i] = 0;
+}
+
+void *Hunk_Alloc (int size)
+{
+	void *p = calloc (1, size);
+
+	if (!p)
+		Sys_Error ("Hunk_Alloc: failed on %i bytes", size);
+	return p;
+}
+
+void *Hunk_AllocName (int size, char *name)
+{
+	return Hunk_Alloc (size);
+}
+
+static byte *TR_LoadFile (char *path, int *len)
+{
+	FILE *f;
+	byte *buf;
+	long size;
+
+	if (!(f = fopen (path, "rb")))
+		return NULL;
+
+	fseek (f, 0, SEEK_END);
+	size = ftell (f);
+	fseek (f, 0, SEEK_SET);
+
+	buf = Hunk_Alloc (size + 1);
+	if (fread (buf, 1, size, f) != size)
+		Sys_Error ("Couldn't read %s", path);
+	fclose (f);
+
+	if (len)
+		*len = size;
+	return buf;
+}
+
+byte *FS_LoadTempFile (char *path, int *len)
+{
+	return TR_LoadFile (path, len);
+}
+
+static double TR_Time (void)
+{
+	struct timespec t;
+
+	clock_gettime (CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/*
+===============================================================================
+
+REPLAY
+
+===============================================================================
+*/
+
+static void TR_Result (trace_t *trace, tl_trace_t *out, int ent)
+{
+	memset (out, 0, sizeof(*out));
+	out->allsolid = trace->allsolid;
+	out->startsolid = trace->startsolid;
+	out->inopen = trace->inopen;
+	out->inwater = trace->inwater;
+	out->fraction = trace->fraction;
+	VectorCopy (trace->endpos, out->endpos);
+	VectorCopy (trace->plane.normal, out->normal);
+	out->dist = trace->plane.dist;
+	out->ent = ent;
+}
+
+static trace_t TR_HullTrace (tl_hulltrace_t *rec)
+{
+	hull_t *hull;
+
+	if (rec->model < 0)
+		hull = CM_HullForBox (rec->mins, rec->maxs);
+	else
+		hull = &tr_models[rec->model]->hulls[rec->hull];
+
+	return CM_HullTrace (hull, rec->start, rec->end);
+}
+
+// the edict with the recorded fields SV_HullForEntity and SV_ClipToEdicts look at
+static edict_t *TR_Edict (tl_edict_t *rec)
+{
+	edict_t *ent = &tr_edicts[rec->num];
+
+	ent->v.solid = rec->solid;
+	ent->v.flags = rec->flags;
+	ent->v.owner = EDICT_TO_PROG(&tr_edicts[rec->owner]);
+	ent->v.modelindex = max (rec->model, 0);
+	ent->v.movetype = rec->solid == SOLID_BSP ? MOVETYPE_PUSH : MOVETYPE_NONE;
+	VectorCopy (rec->origin, ent->v.origin);
+	VectorCopy (rec->mins, ent->v.mins);
+	VectorCopy (rec->maxs, ent->v.maxs);
+	ent->v.size[0] = rec->size;
+	return ent;
+}
+
+// SV_Trace with the edicts SV_AreaEdicts found back then
+static trace_t TR_Trace (tl_svtrace_t *rec, tl_edict_t *edicts)
+{
+	static edict_t *list[MAX_EDICTS];
+	edict_t *pass;
+	moveclip_t clip;
+	int i;
+
+	TR_Edict (&edicts[0]);
+	pass = rec->pass.num >= 0 ? TR_Edict (&rec->pass) : NULL;
+	for (i = 1; i < rec->numedicts; i++)
+		list[i - 1] = TR_Edict (&edicts[i]);
+
+	SV_InitMoveClip (&clip, rec->start, rec->mins, rec->maxs, rec->end, rec->type, pass);
+	SV_ClipToEdicts (&clip, list, rec->numedicts - 1);
+
+	return clip.trace;
+}
+
+static void TR_MoveState (tl_movestate_t *s)
+{
+	memset (s, 0, sizeof(*s));
+	VectorCopy (pmove.origin, s->origin);
+	VectorCopy (pmove.angles, s->angles);
+	VectorCopy (pmove.velocity, s->velocity);
+	s->jump_held = pmove.jump_held;
+	s->jump_msec = pmove.jump_msec;
+	s->waterjumptime = pmove.waterjumptime;
+	s->onground = pmove.onground;
+	s->groundent = pmove.groundent;
+	s->waterlevel = pmove.waterlevel;
+	s->watertype = pmove.watertype;
+	s->numtouch = pmove.numtouch;
+	memcpy (s->touchindex, pmove.touchindex, pmove.numtouch * sizeof(int));
+}
+
+static void TR_PlayerMove (tl_playermove_t *rec, tl_physent_t *physents)
+{
+	tl_movestate_t *in = &rec->in;
+	physent_t *pe;
+	int i;
+
+	VectorCopy (in->origin, pmove.origin);
+	VectorCopy (in->angles, pmove.angles);
+	VectorCopy (in->velocity, pmove.velocity);
+	pmove.jump_held = in->jump_held;
+	pmove.jump_msec = in->jump_msec;
+	pmove.waterjumptime = in->waterjumptime;
+	pmove.onground = in->onground;
+	pmove.groundent = in->groundent;
+	pmove.waterlevel = in->waterlevel;
+	pmove.watertype = in->watertype;
+	pmove.pm_type = rec->pm_type;
+	pmove.cmd = rec->cmd;
+	movevars = rec->movevars;
+
+	pmove.numphysent = rec->numphysent;
+	for (i = 0, pe = pmove.physents; i < rec->numphysent; i++, pe++)
+	{
+		pe->model = physents[i].model >= 0 ? tr_models[physents[i].model] : NULL;
+		VectorCopy (physents[i].origin, pe->origin);
+		VectorCopy (physents[i].mins, pe->mins);
+		VectorCopy (physents[i].maxs, pe->maxs);
+		pe->info = physents[i].info;
+	}
+
+	PM_PlayerMove ();
+}
+
+/*
+===============================================================================
+
+LOG
+
+===============================================================================
+*/
+
+static void TR_CheckModel (int model, char *what)
+{
+	if (model < -1 || model >= tr_nummodels)
+		Sys_Error ("%s with bad model %i, was the log recorded on this map?", what, model);
+}
+
+static void TR_CheckEdict (tl_edict_t *ent)
+{
+	if ((unsigned) ent->num >= MAX_EDICTS || (unsigned) ent->owner >= MAX_EDICTS)
+		Sys_Error ("Trace with bad edict %i owned by %i", ent->num, ent->owner);
+	if (ent->solid == SOLID_BSP && ent->model < 0)
+		Sys_Error ("Trace with a SOLID_BSP edict without a model");
+	TR_CheckModel (ent->model, "Trace");
+}
+
+/*
+===============
+TR_ReadRecord
+
+Returns the type of the record at *p, with the record and the edicts or
+physents after it, or 0 if the log ends in the middle of it
+===============
+*/
+static int TR_ReadRecord (byte **p, byte *end, void **rec, void **extra)
+{
+	byte *data = *p;
+	int type, size, count;
+
+	if (end - data < sizeof(int))
+		return 0;
+	type = *(int *) data;
+	data += sizeof(int);
+
+	switch (type)
+	{
+	case TL_HULLTRACE:
+		size = sizeof(tl_hulltrace_t);
+		break;
+	case TL_TRACE:
+		size = sizeof(tl_svtrace_t);
+		break;
+	case TL_PLAYERMOVE:
+		size = sizeof(tl_playermove_t);
+		break;
+	default:
+		Sys_Error ("Bad record type %i", type);
+		return 0;
+	}
+	if (end - data < size)
+		return 0;
+
+	*rec = data;
+	*extra = data + size;
+
+	if (type == TL_TRACE)
+	{
+		count = ((tl_svtrace_t *) data)->numedicts;
+		if (count < 1 || count > MAX_EDICTS + 1)
+			Sys_Error ("Trace with %i edicts", count);
+		size += count * sizeof(tl_edict_t);
+	}
+	else if (type == TL_PLAYERMOVE)
+	{
+		count = ((tl_playermove_t *) data)->numphysent;
+		if (count < 0 || count > MAX_PHYSENTS)
+			Sys_Error ("Player move with %i physents", count);
+		size += count * sizeof(tl_physent_t);
+	}
+	if (end - data < size)
+		return 0;
+
+	*p = data + size;
+	return type;
+}
+
+static void TR_LoadLog (char *name, unsigned checksum)
+{
+	tracelog_header_t *header;
+	byte *buf, *p, *end;
+	int len, type, i, count[TL_PLAYERMOVE + 1];
+	void *rec, *extra;
+	tl_hulltrace_t *hulltrace;
+
+	if (!(buf = TR_LoadFile (name, &len)))
+		Sys_Error ("Couldn't open %s", name);
+	end = buf + len;
+
+	header = (tracelog_header_t *) buf;
+	if (len < sizeof(*header) || header->id != TRACELOG_ID || header->version != TRACELOG_VERSION)
+		Sys_Error ("%s is not a version %i trace log", name, TRACELOG_VERSION);
+	if (header->checksum != checksum)
+		Sys_Error ("%s was recorded on another version of %s", name, header->mapname);
+
+	// count the records, then keep pointers into the buffer
+	for (i = 0; i < 2; i++)
+	{
+		memset (count, 0, sizeof(count));
+		for (p = buf + sizeof(*header); p < end; count[type]++)
+		{
+			if (!(type = TR_ReadRecord (&p, end, &rec, &extra)))
+			{	// the server didn't get to finish the file
+				if (!i)
+					printf ("%s: ignoring the cut off record at the end\n", name);
+				break;
+			}
+			if (!i)
+				continue;
+
+			switch (type)
+			{
+			case TL_HULLTRACE:
+				tr_hulltraces[count[type]].rec = rec;
+				break;
+			case TL_TRACE:
+				tr_traces[count[type]].rec = rec;
+				tr_traces[count[type]].edicts = extra;
+				break;
+			case TL_PLAYERMOVE:
+				tr_moves[count[type]].rec = rec;
+				tr_moves[count[type]].physents = extra;
+				break;
+			}
+		}
+
+		if (!i)
+		{
+			tr_hulltraces = Hunk_Alloc ((count[TL_HULLTRACE] + 1) * sizeof(*tr_hulltraces));
+			tr_traces = Hunk_Alloc ((count[TL_TRACE] + 1) * sizeof(*tr_traces));
+			tr_moves = Hunk_Alloc ((count[TL_PLAYERMOVE] + 1) * sizeof(*tr_moves));
+		}
+	}
+
+	tr_numhulltraces = count[TL_HULLTRACE];
+	tr_numtraces = count[TL_TRACE];
+	tr_nummoves = count[TL_PLAYERMOVE];
+
+	// the models and hulls records refer to
+	for (i = 0; i < tr_numhulltraces; i++)
+	{
+		hulltrace = tr_hulltraces[i].rec;
+		TR_CheckModel (hulltrace->model, "Hull trace");
+		if ((unsigned) hulltrace->hull >= MAX_MAP_HULLS)
+			Sys_Error ("Hull trace with bad hull %i", hulltrace->hull);
+	}
+	for (i = 0; i < tr_numtraces; i++)
+	{
+		for (len = 0; len < tr_traces[i].rec->numedicts; len++)
+			TR_CheckEdict (&tr_traces[i].edicts[len]);
+		if (tr_traces[i].rec->pass.num >= 0)
+			TR_CheckEdict (&tr_traces[i].rec->pass);
+	}
+	for (i = 0; i < tr_nummoves; i++)
+	{
+		for (len = 0; len < tr_moves[i].rec->numphysent; len++)
+			TR_CheckModel (tr_moves[i].physents[len].model, "Player move");
+	}
+
+	printf ("%s: %s, %i hull traces, %i traces, %i player moves\n", name, header->mapname,
+		tr_numhulltraces, tr_numtraces, tr_nummoves);
+}
+
+/*
+===============================================================================
+
+CHECKS AND TIMING
+
+===============================================================================
+*/
+
+static void TR_PrintTrace (char *what, tl_trace_t *t)
+{
+	printf ("    %s: fraction %.9g endpos %.9g %.9g %.9g normal %g %g %g dist %.9g%s%s ent %i\n",
+		what, t->fraction, t->endpos[0], t->endpos[1], t->endpos[2],
+		t->normal[0], t->normal[1], t->normal[2], t->dist,
+		t->allsolid ? " allsolid" : "", t->startsolid ? " startsolid" : "", t->ent);
+}
+
+static void TR_PrintMove (char *what, tl_movestate_t *s)
+{
+	printf ("    %s: origin %.9g %.9g %.9g velocity %.9g %.9g %.9g onground %i groundent %i waterlevel %i touches %i\n",
+		what, s->origin[0], s->origin[1], s->origin[2], s->velocity[0], s->velocity[1], s->velocity[2],
+		s->onground, s->onground ? s->groundent : -1, s->waterlevel, s->numtouch);
+}
+
+static int TR_Check (void)
+{
+	tl_movestate_t state;
+	tl_trace_t result;
+	trace_t trace;
+	int i, diffs[TL_PLAYERMOVE + 1];
+	tl_hulltrace_t *h;
+	tl_svtrace_t *t;
+
+	memset (diffs, 0, sizeof(diffs));
+
+	for (i = 0; i < tr_numhulltraces; i++)
+	{
+		h = tr_hulltraces[i].rec;
+		trace = TR_HullTrace (h);
+		TR_Result (&trace, &result, -1);
+		if (!memcmp (&result, &h->trace, sizeof(result)))
+			continue;
+
+		if (diffs[TL_HULLTRACE]++ < TR_MAXREPORTS)
+		{
+			printf ("hull trace %i, model %i hull %i, %.9g %.9g %.9g to %.9g %.9g %.9g\n", i, h->model, h->hull,
+				h->start[0], h->start[1], h->start[2], h->end[0], h->end[1], h->end[2]);
+			TR_PrintTrace ("recorded", &h->trace);
+			TR_PrintTrace ("now", &result);
+		}
+	}
+
+	for (i = 0; i < tr_numtraces; i++)
+	{
+		t = tr_traces[i].rec;
+		trace = TR_Trace (t, tr_traces[i].edicts);
+		TR_Result (&trace, &result, trace.e.ent ? trace.e.ent - tr_edicts : -1);
+		if (!memcmp (&result, &t->trace, sizeof(result)))
+			continue;
+
+		if (diffs[TL_TRACE]++ < TR_MAXREPORTS)
+		{
+			printf ("trace %i, type %i, %i edicts, %.9g %.9g %.9g to %.9g %.9g %.9g\n", i, t->type, t->numedicts,
+				t->start[0], t->start[1], t->start[2], t->end[0], t->end[1], t->end[2]);
+			TR_PrintTrace ("recorded", &t->trace);
+			TR_PrintTrace ("now", &result);
+		}
+	}
+
+	for (i = 0; i < tr_nummoves; i++)
+	{
+		TR_PlayerMove (tr_moves[i].rec, tr_moves[i].physents);
+		TR_MoveState (&state);
+		if (!memcmp (&state, &tr_moves[i].rec->out, sizeof(state)))
+			continue;
+
+		if (diffs[TL_PLAYERMOVE]++ < TR_MAXREPORTS)
+		{
+			printf ("player move %i, pm_type %i, msec %i, %i physents\n", i, tr_moves[i].rec->pm_type,
+				tr_moves[i].rec->cmd.msec, tr_moves[i].rec->numphysent);
+			TR_PrintMove ("recorded", &tr_moves[i].rec->out);
+			TR_PrintMove ("now", &state);
+		}
+	}
+
+	printf ("differences: %i hull traces, %i traces, %i player moves\n",
+		diffs[TL_HULLTRACE], diffs[TL_TRACE], diffs[TL_PLAYERMOVE]);
+
+	return diffs[TL_HULLTRACE] + diffs[TL_TRACE] + diffs[TL_PLAYERMOVE];
+}
+
+static void TR_PrintTime (char *what, int count, int passes, double time)
+{
+	if (!count)
+		return;
+	printf ("%-14s %10.0f calls/s %8.1f ns/call\n", what,
+		time > 0 ? count * passes / time : 0, time * 1e9 / (count * passes));
+}
+
+static void TR_Benchmark (int passes)
+{
+	double t, time[TL_PLAYERMOVE + 1];
+	int i, pass;
+
+	memset (time, 0, sizeof(time));
+
+	for (pass = 0; pass < passes; pass++)
+	{
+		t = TR_Time ();
+		for (i = 0; i < tr_numhulltraces; i++)
+			TR_HullTrace (tr_hulltraces[i].rec);
+		time[TL_HULLTRACE] += TR_Time () - t;
+
+		t = TR_Time ();
+		for (i = 0; i < tr_numtraces; i++)
+			TR_Trace (tr_traces[i].rec, tr_traces[i].edicts);
+		time[TL_TRACE] += TR_Time () - t;
+
+		t = TR_Time ();
+		for (i = 0; i < tr_nummoves; i++)
+			TR_PlayerMove (tr_moves[i].rec, tr_moves[i].physents);
+		time[TL_PLAYERMOVE] += TR_Time () - t;
+	}
+
+	TR_PrintTime ("CM_HullTrace", tr_numhulltraces, passes, time[TL_HULLTRACE]);
+	TR_PrintTime ("SV_Trace", tr_numtraces, passes, time[TL_TRACE]);
+	TR_PrintTime ("PM_PlayerMove", tr_nummoves, passes, time[TL_PLAYERMOVE]);
+}
+
+int main (int argc, char **argv)
+{
+	unsigned checksum, checksum2;
+	char name[MAX_QPATH];
+	int i, passes;
+
+	if (argc < 3)
+	{
+		printf ("usage: %s <file.trl> <map.bsp> [passes]\n", argv[0]);
+		return 2;
+	}
+	passes = argc > 3 ? max (atoi (argv[3]), 1) : 5;
+
+	CM_Init ();
+	tr_models[0] = CM_LoadMap (argv[2], false, &checksum, &checksum2);
+	tr_nummodels = CM_NumInlineModels ();
+	for (i = 1; i < tr_nummodels; i++)
+	{
+		snprintf (name, sizeof(name), "*%i", i);
+		tr_models[i] = CM_InlineModel (name);
+	}
+
+	// the recorded model numbers are used as modelindex
+	memcpy (sv.models, tr_models, tr_nummodels * sizeof(tr_models[0]));
+	sv.edicts = tr_edicts;
+
+	TR_LoadLog (argv[1], checksum);
+
+	i = TR_Check ();
+	TR_Benchmark (passes);
+
+	return i ? 1 : 0;
+}